@@ -6,7 +6,7 @@ _rsc_completions()
     
     if [ "${#COMP_WORDS[@]}" == "2" ]
     then
-	COMPREPLY=($(compgen -W "-i -k" -- "${COMP_WORDS[1]}"))
+	COMPREPLY=($(compgen -W "-i -k -t" -- "${COMP_WORDS[1]}"))
     elif [ "${#COMP_WORDS[@]}" == "4" ]
     then
 	case "${COMP_WORDS[1]}" in
@@ -22,7 +22,7 @@ _rsccli_completions()
 		OPT="-c -a -r"
 		;;
 	    "if")
-		OPT="-s -g -l"
+		OPT="-s -g -l -t"
 		;;
 	    "shortcut")
 		OPT="-s -l -r"
@@ -1,3 +1,5 @@
+#include <fstream>
+
 #include <util.hpp>
 #include <pc_list.hpp>
 #include <config.hpp>
@@ -253,6 +255,37 @@ int ControllerOperation::getif()
   return 1;
 }
 
+int ControllerOperation::gettuning()
+{
+  rsclocalcom::Message msg(rsclocalcom::Message::TUNING);
+
+  int err = _send_cmd(msg);
+
+  if(err) return err;
+
+  std::ifstream ifs(SOCKET_TUNING);
+
+  if(!ifs.is_open()) {
+    _ui->display_error("Can not read the socket tuning");
+    return 1;
+  }
+
+  std::string                                     profile;
+  std::vector<std::pair<int, struct scnp_tuning>> sockets;
+  int                                             if_index;
+  struct scnp_tuning                              tuning;
+
+  ifs >> profile;
+  while(ifs >> if_index >> tuning.busy_poll_us >> tuning.priority
+	>> tuning.rcvbuf >> tuning.sndbuf >> tuning.qdisc_bypass) {
+    sockets.emplace_back(if_index, tuning);
+  }
+
+  _ui->display_tuning(profile, sockets);
+
+  return 0;
+}
+
 int ControllerOperation::list_shortcut()
 {
   ComboShortcut::ComboShortcutList list;
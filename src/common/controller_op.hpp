@@ -113,6 +113,13 @@ namespace rscui {
 
     int getif();
 
+    /**
+     *\brief Get the socket options in effect on each network interface
+     *\return 1 if there was an error. 0 otherwise
+     */
+
+    int gettuning();
+
     /**
      *\brief List all the network interface of the PC
      *\return 1 if there was an error. 0 otherwise
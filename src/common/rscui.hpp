@@ -2,7 +2,10 @@
 #define RSCUI_H
 
 #include <string>
+#include <vector>
+#include <utility>
 #include <interface.h>
+#include <scnp.h>
 
 #include <combo.hpp>
 
@@ -22,6 +25,8 @@ namespace rscui {
     virtual void display_all_pc(rscutil::PCList& list, bool all) = 0;
     virtual void display_if(const IF * interface) = 0;
     virtual void display_if(int if_index, const std::string& if_name) = 0;
+    virtual void display_tuning(const std::string& profile,
+				const std::vector<std::pair<int, struct scnp_tuning>>& sockets) = 0;
     virtual void display_error(const std::string& error) = 0;
     virtual void display_version(const std::string& version) = 0;
     virtual void display_help() = 0;
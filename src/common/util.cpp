@@ -2,6 +2,7 @@
 
 #include <config.hpp>
 #include <util.hpp>
+#include <scnp.h>
 
 #ifdef __gnu_linux__
 
@@ -110,6 +111,23 @@ void rscutil::register_pid()
 
 #endif
 
+int rscutil::tuning_profile(const std::string& name)
+{
+  if(name == "none")        return SCNP_TUNING_NONE;
+  if(name == "low-latency") return SCNP_TUNING_LOW_LATENCY;
+
+  return -1;
+}
+
+std::string rscutil::tuning_name(int profile)
+{
+  switch(profile) {
+  case SCNP_TUNING_NONE:        return "none";
+  case SCNP_TUNING_LOW_LATENCY: return "low-latency";
+  default:                      return "unknown";
+  }
+}
+
 void rscutil::serialize_string(std::ofstream& ofs, const std::string& str)
 {
   size_t size = str.size();
@@ -11,6 +11,19 @@ namespace rscutil {
   void deserialize_string(std::ifstream& ifs, std::string& str);
   void create_base_dir();
 
+  /**
+   *\brief Get a socket tuning profile by its name
+   *\return The SCNP_TUNING_* profile, -1 if the name is unknown
+   */
+
+  int tuning_profile(const std::string& name);
+
+  /**
+   *\brief Get the name of a socket tuning profile
+   */
+
+  std::string tuning_name(int profile);
+
 }  // rscutil
 
 #endif /* RSC_UTIL_H */
@@ -26,11 +26,13 @@
 
 #define CURRENT_PC_LIST "/var/lib/rsc/current_pc"
 #define ALL_PC_LIST "/var/lib/rsc/all_pc"
+#define SOCKET_TUNING "/var/lib/rsc/socket_tuning"
 
 #else
 
 #define CURRENT_PC_LIST "current_pc"
 #define ALL_PC_LIST "all_pc"
+#define SOCKET_TUNING "socket_tuning"
 
 #endif
 
@@ -2,6 +2,7 @@
 #define EVENT_INTERFACE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -26,6 +27,12 @@ extern "C" {
 #define KEY_RELEASED 0x00
 #define KEY_PRESSED 0x01
 #define KEY_REPEATED 0x02
+
+  /*
+   * Number of events written at once by write_controller_events()
+   */
+
+#define CONTROLLER_FRAME_MAX 64
   
   typedef struct ControllerEvent
   {
@@ -43,6 +50,15 @@ extern "C" {
 
   void write_controller(const ControllerEvent * ce);
 
+  /**
+   *\brief Simulate several events as a single frame. They are written at once, followed by one SYN_REPORT.
+   * Above CONTROLLER_FRAME_MAX events, they are written CONTROLLER_FRAME_MAX at a time, in the same frame.
+   *\param ces The events, in order. Must not be NULL.
+   *\param count The number of events.
+   */
+
+  void write_controller_events(const ControllerEvent * ces, size_t count);
+
   /**
    *\brief Simulate a key (keyboard or click) with key pressed and then key event
    *\param c The key code
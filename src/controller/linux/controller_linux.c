@@ -84,20 +84,30 @@ static void remove_event_file(const char * name)
   }
 }
 
+static void fill_event(struct input_event * ie, int type, unsigned short code, int val)
+{
+   ie->type = type;
+   ie->code = code;
+   ie->value = val;
+   /* timestamp values below are ignored */
+   ie->time.tv_sec = 0;
+   ie->time.tv_usec = 0;
+}
+
 static void emit(int fd, int type, unsigned short code, int val)
 {
    struct input_event ie;
 
-   ie.type = type;
-   ie.code = code;
-   ie.value = val;
-   /* timestamp values below are ignored */
-   ie.time.tv_sec = 0;
-   ie.time.tv_usec = 0;
-   
+   fill_event(&ie, type, code, val);
    write(fd, &ie, sizeof(ie));
 }
 
+/* uinput takes several events in a single write */
+static void emit_events(int fd, const struct input_event * ies, size_t count)
+{
+  write(fd, ies, count * sizeof(struct input_event));
+}
+
 void write_key(unsigned char c)
 {
   emit(uinput_file_descriptor, EV_KEY, c, KEY_PRESSED);
@@ -320,8 +330,25 @@ void grab_controller(bool t)
 
 void write_controller(const ControllerEvent * ce)
 {
-  emit(uinput_file_descriptor, ce->ev_type, ce->code, ce->value);
-  emit(uinput_file_descriptor, EV_SYN, SYN_REPORT, 0);
+  write_controller_events(ce, 1);
+}
+
+void write_controller_events(const ControllerEvent * ces, size_t count)
+{
+  struct input_event ies[CONTROLLER_FRAME_MAX + 1];
+  size_t             n = 0;
+
+  for(size_t i = 0; i < count; ++i) {
+    fill_event(&ies[n++], ces[i].ev_type, ces[i].code, ces[i].value);
+    
+    if(n == CONTROLLER_FRAME_MAX && i + 1 < count) {
+      emit_events(uinput_file_descriptor, ies, n);
+      n = 0;
+    }
+  }
+
+  fill_event(&ies[n++], EV_SYN, SYN_REPORT, 0);
+  emit_events(uinput_file_descriptor, ies, n);
 }
 
 /* Read all available inotify events */
@@ -268,12 +268,8 @@ void fill_input(KEYBDINPUT& input_type, INPUT& input, DWORD flags)
     input.ki = input_type;
 }
 
-void write_controller(const ControllerEvent* ce)
+static void fill_event(const ControllerEvent* ce, INPUT& input)
 {
-    constexpr int nb_input = 1;
-
-    INPUT input = {};
-
     if (ce->controller_type == KEY) {
         if (ce->code == BTN_LEFT) {
             MOUSEINPUT mouse_input = {};
@@ -325,8 +321,29 @@ void write_controller(const ControllerEvent* ce)
 
         fill_input(mouse_input, input, flag);
     }
+}
+
+void write_controller(const ControllerEvent* ce)
+{
+    write_controller_events(ce, 1);
+}
+
+void write_controller_events(const ControllerEvent* ces, size_t count)
+{
+    INPUT inputs[CONTROLLER_FRAME_MAX];
+
+    while (count > 0) {
+        UINT nb_input = (count < CONTROLLER_FRAME_MAX) ? (UINT)count : CONTROLLER_FRAME_MAX;
 
-    SendInput(nb_input, &input, sizeof(input));
+        for (UINT i = 0; i < nb_input; ++i) {
+            inputs[i] = {};
+            fill_event(&ces[i], inputs[i]);
+        }
+
+        SendInput(nb_input, inputs, sizeof(INPUT));
+        ces += nb_input;
+        count -= nb_input;
+    }
 }
 
 void write_key(unsigned char c)
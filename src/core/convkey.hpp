@@ -1,101 +1,127 @@
 #ifndef CONVKEY_H
 #define CONVKEY_H
 
-template<typename Impl, typename Dest, typename Pkt>
+#include <cstring>
+
+/*
+ * Conversions between ControllerEvent and the SCNP packets, by value.
+ * They use no shared state, the threads can convert at the same time.
+ */
+
+template<typename Impl, typename Pkt>
 struct ConvKeyBase
 {
-  using type_key_t = std::conditional_t<std::is_same<Dest,ControllerEvent>::value,
-					ControllerEvent,
-					Pkt>;
-  
-  static           type_key_t key;
-  static constexpr size_t     SIZE = sizeof(Pkt);
+  using packet_t = Pkt;
+
+  static constexpr size_t SIZE = sizeof(Pkt);
+
+  /*
+    *\brief Convert a SCNP packet into ControllerEvent
+  */
+
+  static constexpr ControllerEvent to_event(const Pkt& pkt)
+  {
+    ControllerEvent ev{};
+
+    ev.controller_type = Impl::CTRL_TYPE;
+    ev.code = pkt.code;
+
+    Impl::set(ev, pkt);
+
+    return ev;
+  }
+
+  /*
+    *\brief Convert a scnp_packet of type Impl::SCNP_TYPE into ControllerEvent
+  */
+
+  static ControllerEvent to_event(const struct scnp_packet& packet)
+  {
+    return to_event(from_packet(packet));
+  }
 
   /*
-    *\brief Convert scnp_packet into ControllerEvent
+    *\brief Convert ControllerEvent into a SCNP packet
   */
-  static Dest * get(const struct scnp_packet& ev)
+
+  static constexpr Pkt to_packet(const ControllerEvent& ev)
   {
-    auto pkt = reinterpret_cast<const Pkt *>(&ev);
+    Pkt pkt{};
+
+    pkt.type = Impl::SCNP_TYPE;
+    pkt.code = ev.code;
 
-    key.controller_type = Impl::CTRL_TYPE;
-    key.code = pkt->code;
-    
-    Impl::set(pkt);
+    Impl::set(pkt, ev);
 
-    return &key;
+    return pkt;
   }
 
   /*
-    *\brief Convert ControllerEvent into scnp_packet
+    *\brief Convert ControllerEvent into a scnp_packet, ready to be sent
   */
 
-  static Dest * get(const ControllerEvent& ev)
+  static void to_packet(const ControllerEvent& ev, struct scnp_packet& packet)
   {
-    key.type = Impl::SCNP_TYPE;
-    key.code = ev.code;
+    const Pkt pkt = to_packet(ev);
+    std::memcpy(&packet, &pkt, SIZE);
+  }
 
-    Impl::set(ev);
-      
-    return reinterpret_cast<scnp_packet *>(&key);
+  /*
+    *\brief Read the SCNP packet in a scnp_packet, the copy is optimized out
+  */
+
+  static Pkt from_packet(const struct scnp_packet& packet)
+  {
+    Pkt pkt;
+    std::memcpy(&pkt, &packet, SIZE);
+    return pkt;
   }
 
 };
 
-template<typename T, int N>
+template<int N>
 struct ConvKey;
 
-template<typename T>
-struct ConvKey<T, MOUSE> : public ConvKeyBase<ConvKey<T,MOUSE>,T,struct scnp_movement>
+template<>
+struct ConvKey<MOUSE> : public ConvKeyBase<ConvKey<MOUSE>,struct scnp_movement>
 {
-  using ConvKeyBase<ConvKey<T,MOUSE>,T,struct scnp_movement>::key;
-  
   static constexpr int CTRL_TYPE=MOUSE;
   static constexpr int SCNP_TYPE=SCNP_MOV;
-  
-  template<typename U>
-  static void set(const U* packet) {
-    key.ev_type = (packet->move_type == MOV_ABS) ? EV_ABS : EV_REL;
-    key.value = packet->value;
+
+  static constexpr void set(ControllerEvent& ev, const struct scnp_movement& packet) {
+    ev.ev_type = (packet.move_type == MOV_ABS) ? EV_ABS : EV_REL;
+    ev.value = packet.value;
   }
 
-  template<typename U>
-  static void set(const U& ev) {
-    key.move_type = (ev.ev_type == EV_ABS) ? MOV_ABS : MOV_REL;
-    key.value = ev.value;
+  static constexpr void set(struct scnp_movement& packet, const ControllerEvent& ev) {
+    packet.move_type = (ev.ev_type == EV_ABS) ? MOV_ABS : MOV_REL;
+    packet.value = ev.value;
   }
 };
 
-template<typename T>
-struct ConvKey<T, KEY> : public ConvKeyBase<ConvKey<T,KEY>,T,struct scnp_key>
+template<>
+struct ConvKey<KEY> : public ConvKeyBase<ConvKey<KEY>,struct scnp_key>
 {
-  using ConvKeyBase<ConvKey<T,KEY>,T,struct scnp_key>::key;
-  
   static constexpr int CTRL_TYPE=KEY;
   static constexpr int CTRL_EV_TYPE=EV_KEY;
   static constexpr int SCNP_TYPE=SCNP_KEY;
-  
-  template<typename U>
-  static void set(const U& ev) {
+
+  static constexpr void set(struct scnp_key& packet, const ControllerEvent& ev) {
     if(ev.value == KEY_REPEATED) {
-      key.pressed = true;
-      key.repeated = true;
+      packet.pressed = true;
+      packet.repeated = true;
     }
     else {
-      key.pressed = ev.value == KEY_PRESSED;
-      key.repeated = false;
+      packet.pressed = ev.value == KEY_PRESSED;
+      packet.repeated = false;
     }
   }
 
-  template<typename U>
-  static void set(const U * packet) {
-    key.ev_type = CTRL_EV_TYPE;
-    if(packet->repeated) key.value = KEY_REPEATED;
-    else                 key.value = packet->pressed;
+  static constexpr void set(ControllerEvent& ev, const struct scnp_key& packet) {
+    ev.ev_type = CTRL_EV_TYPE;
+    if(packet.repeated) ev.value = KEY_REPEATED;
+    else                ev.value = packet.pressed;
   }
 };
 
-template<typename T,typename U, typename V>
-typename ConvKeyBase<T,U,V>::type_key_t ConvKeyBase<T,U,V>::key;
-
 #endif /* CONVKEY_H */
@@ -0,0 +1,69 @@
+#ifndef EVENT_FRAME_H
+#define EVENT_FRAME_H
+
+#include <controller.h>
+
+/*
+ * Events of a receiving thread written together to the controller, with a
+ * single synchronization. A frame never changes a key or an axis twice.
+ */
+
+class EventFrame
+{
+  ControllerEvent _events[CONTROLLER_FRAME_MAX];
+  size_t          _size;
+
+public:
+
+  EventFrame() : _size(0) {}
+
+  /**
+   *\brief Whether an event can join the frame. Otherwise the frame must be
+   * written first, it is full or already has an event of the same code.
+   */
+
+  bool fits(const ControllerEvent& ev) const
+  {
+    if(_size == CONTROLLER_FRAME_MAX) return false;
+
+    for(size_t i = 0; i < _size; i++) {
+      if(_events[i].ev_type == ev.ev_type && _events[i].code == ev.code) return false;
+    }
+
+    return true;
+  }
+
+  /**
+   *\brief Add an event that fits in the frame.
+   */
+
+  void push(const ControllerEvent& ev)
+  {
+    _events[_size++] = ev;
+  }
+
+  /**
+   *\brief Write the events to the controller, nothing if there is none.
+   *\return true if a mouse event was written.
+   */
+
+  bool flush()
+  {
+    bool moved = false;
+
+    if(_size == 0) return false;
+
+    for(size_t i = 0; i < _size && !moved; i++) {
+      moved = _events[i].controller_type == MOUSE;
+    }
+
+    write_controller_events(_events, _size);
+    _size = 0;
+
+    return moved;
+  }
+
+  size_t size() const { return _size; }
+};
+
+#endif /* EVENT_FRAME_H */
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cstring>
+#include <vector>
 #include <rsc.hpp>
 #include <scnp.h>
 #include <util.hpp>
@@ -7,8 +8,9 @@
 void print_help()
 {
   std::cout << "Remote-Shared-Controller help" << std::endl << std::endl;
-  std::cout << "-i if_index" << "\t" << "Specify the network interface" << std::endl;
+  std::cout << "-i if_index" << "\t" << "Specify a network interface, may be repeated to use several" << std::endl;
   std::cout << "-k key" << "\t" << "Specify the key to encrypt data" << std::endl;
+  std::cout << "-t profile" << "\t" << "Specify the socket tuning profile : none (default) or low-latency" << std::endl;
   std::cout << std::endl;
 }
 
@@ -18,8 +20,9 @@ int main(int argc, char *argv[])
   rscutil::register_pid();
 
   RSC rsc;
-  int if_index = -1;
+  std::vector<int> if_indexes;
   std::string key;
+  int tuning = SCNP_TUNING_NONE;
 
   for(int i = 1; i < argc; ++i) {
     if(argv[i] == std::string("-k")) {
@@ -35,7 +38,17 @@ int main(int argc, char *argv[])
     else if(argv[i] == std::string("-i")) {
       if(++i >= argc)
 	throw std::runtime_error("-i need one argument : the index of the network interface");
-      else if_index = atoi(argv[i]);
+      else if_indexes.push_back(atoi(argv[i]));
+    }
+    else if(argv[i] == std::string("-t")) {
+      if(++i >= argc)
+	throw std::runtime_error("-t need one argument : the socket tuning profile");
+      else {
+	tuning = rscutil::tuning_profile(argv[i]);
+	if(tuning < 0) {
+	  throw std::runtime_error(std::string("Unknown socket tuning profile : ") + argv[i]);
+	}
+      }
     }
     else if(argv[i] == std::string("-h")) {
       print_help();
@@ -48,7 +61,7 @@ int main(int argc, char *argv[])
     }
   }
 
-  rsc.init(if_index, key);
+  rsc.init(if_indexes, key, tuning);
   do {
     rsc.run();
     if(rsc.is_paused()) rsc.wait_for_wakeup();
@@ -2,6 +2,7 @@
 #include <string>
 #include <cstring>
 #include <algorithm>
+#include <fstream>
 
 #include <controller.h> // Must be before convkey.hpp
 #include <rsc.hpp> // Also before convkey.hpp
@@ -9,6 +10,7 @@
 #include <convkey.hpp>
 #include <config.hpp>
 #include <interface.h>
+#include <util.hpp>
 
 #include <iostream>
 
@@ -32,11 +34,31 @@ void RSC::_th_safe_op(Mutex &m, Lambda &&l)
   l();
 }
 
-RSC::RSC(): _if(DEFAULT_IF), _next_pc_id{0},
+struct RSC::HandlerTable
+{
+  PacketHandler handlers[UINT8_MAX + 1];
+
+  constexpr HandlerTable() : handlers{}
+  {
+    for(auto& handler : handlers) handler = &RSC::_ignore;
+
+    handlers[SCNP_KEY] = &RSC::_on_key;
+    handlers[SCNP_MOV] = &RSC::_on_movement;
+    handlers[SCNP_MOT] = &RSC::_on_motion;
+    handlers[SCNP_OUT] = &RSC::_on_out;
+    handlers[SCNP_MNG] = &RSC::_on_management;
+  }
+};
+
+constexpr RSC::HandlerTable RSC::_default_handlers{};
+
+RSC::RSC(): _ifs{DEFAULT_IF}, _tuning{SCNP_TUNING_NONE}, _next_pc_id{0},
 	    _com(rsclocalcom::RSCLocalCom::Contact::CORE),
 	    _state(State::HERE)
 {
   using namespace rscutil;
+
+  std::copy(std::begin(_default_handlers.handlers), std::end(_default_handlers.handlers), _handlers);
   
   load_shortcut(false);
   PC local_pc { _next_pc_id++, true, true, "localhost", {0}, {0,0}, {0,0}};
@@ -70,18 +92,19 @@ RSC::~RSC()
 #endif
 }
 
-int RSC::init(int if_index, const std::string& key)
+int RSC::init(const std::vector<int>& if_indexes, const std::string& key, int tuning)
 {  
   _key = key;
+  _ifs = if_indexes;
+  _tuning = tuning;
 
-  if(if_index <= 0) {
+  if(_ifs.empty()) {
     IF * interfaces = get_interfaces();
-    if_index = interfaces->if_index;
+    _ifs.push_back(interfaces->if_index);
     free_interfaces(interfaces);
   }
 
-  _if = if_index;
-  int err = scnp_start(_if, ((key.empty()) ? nullptr : key.c_str()));
+  int err = _open_sessions();
 
   if(err) error("Cannot start SCNP session");
   
@@ -95,7 +118,151 @@ int RSC::init(int if_index, const std::string& key)
 void RSC::exit()
 {
   exit_controller();
-  scnp_stop();
+  _close_sessions();
+}
+
+int RSC::_open_sessions()
+{
+  const char *        key = (_key.empty()) ? nullptr : _key.c_str();
+  struct scnp_options options{};
+
+  if(scnp_tuning_profile(_tuning, &options.tuning)) return -1;
+
+  for(int index : _ifs) {
+    scnp_session_t * session = scnp_session_open(index, key, &options);
+
+    if(!session) {
+      int err = errno;
+      _close_sessions();
+      errno = err;
+      return -1;
+    }
+    
+    _sessions.push_back(session);
+  }
+
+  return 0;
+}
+
+void RSC::_close_sessions()
+{
+  for(auto * session : _sessions) scnp_session_close(session);
+  _sessions.clear();
+
+  _th_safe_op(_paths_mutex, [this]() { _paths.clear(); });
+}
+
+void RSC::_save_tuning()
+{
+  std::ofstream ofs(SOCKET_TUNING);
+
+  ofs << rscutil::tuning_name(_tuning) << "\n";
+
+  for(size_t i = 0; i < _sessions.size(); ++i) {
+    struct scnp_tuning tuning;
+
+    if(scnp_session_get_tuning(_sessions[i], &tuning)) continue;
+
+    ofs << _ifs[i] << " " << tuning.busy_poll_us << " " << tuning.priority << " "
+	<< tuning.rcvbuf << " " << tuning.sndbuf << " " << tuning.qdisc_bypass << "\n";
+  }
+}
+
+void RSC::_start_receivers()
+{
+  for(auto * session : _sessions)
+    _receivers.push_back(std::thread(&RSC::_receive, this, session));
+}
+
+void RSC::_stop_receivers()
+{
+  for(auto&& th : _receivers) pthread_cancel(th.native_handle());
+  for(auto&& th : _receivers) th.join();
+  _receivers.clear();
+}
+
+bool RSC::_add_path(scnp_session_t * session, const uint8_t addr[], const std::string& hostname)
+{
+  using rscutil::PC;
+  std::unique_lock<std::mutex> lock(_paths_mutex);
+  auto& paths = _paths[hostname];
+  auto  now = clock_t::now();
+
+  // Forget the paths that are not used by the peer anymore
+  paths.erase(std::remove_if(paths.begin(), paths.end(), [&now](const Path& p) {
+	std::chrono::duration<double> elapsed = now - p.seen;
+	return elapsed.count() > ALIVE_TIMEOUT;
+      }), paths.end());
+
+  bool other_session = std::any_of(paths.begin(), paths.end(), [session](const Path& p) {
+      return p.session != session;
+    });
+
+  auto it = std::find_if(paths.begin(), paths.end(), [session, &addr](const Path& p) {
+      return p.session == session && !memcmp(p.address, addr, PC::LEN_ADDR);
+    });
+  
+  if(it == paths.end()) {
+    paths.push_back(Path{ session, {0}, now });
+    memcpy(paths.back().address, addr, PC::LEN_ADDR);
+  }
+  else it->seen = now;
+
+  return other_session;
+}
+
+bool RSC::_same_peer(const uint8_t a[], const uint8_t b[])
+{
+  using rscutil::PC;
+  if(!memcmp(a, b, PC::LEN_ADDR)) return true;
+
+  std::unique_lock<std::mutex> lock(_paths_mutex);
+  auto has = [](const std::vector<Path>& paths, const uint8_t * addr) {
+    return std::any_of(paths.begin(), paths.end(), [addr](const Path& p) {
+	return !memcmp(p.address, addr, PC::LEN_ADDR);
+      });
+  };
+
+  return std::any_of(_paths.begin(), _paths.end(), [&](const auto& peer) {
+      return has(peer.second, a) && has(peer.second, b);
+    });
+}
+
+int RSC::_send_packet(struct scnp_packet * packet, const uint8_t address[])
+{
+  using rscutil::PC;
+  scnp_session_t * sessions[SCNP_MAX_SESSIONS];
+  uint8_t          addrs[SCNP_MAX_SESSIONS][PC::LEN_ADDR];
+  size_t           count = 0;
+
+  if(_sessions.empty()) {
+    errno = ESRCH;
+    return -1;
+  }
+
+  _th_safe_op(_paths_mutex, [&]() {
+      for(auto&& peer : _paths) {
+	auto& paths = peer.second;
+	bool found = std::any_of(paths.begin(), paths.end(), [address](const Path& p) {
+	    return !memcmp(p.address, address, PC::LEN_ADDR);
+	  });
+	if(!found) continue;
+
+	for(auto&& p : paths) {
+	  if(count == SCNP_MAX_SESSIONS) break;
+	  sessions[count] = p.session;
+	  memcpy(addrs[count], p.address, PC::LEN_ADDR);
+	  ++count;
+	}
+	break;
+      }
+    });
+
+  // A peer never seen is reached through the first interface
+  if(count == 0) return scnp_session_send(_sessions.front(), packet, address);
+
+  int best = scnp_best_path(sessions, addrs, count);
+  return scnp_session_send(sessions[best], packet, addrs[best]);
 }
 
 void RSC::_transit(rscutil::Combo::Way way)
@@ -171,8 +338,10 @@ void RSC::_transit(rscutil::Combo::Way way, float height)
       pkt.side = (way == Way::LEFT)? OUT_LEFT : OUT_RIGHT;
     }
 
-    scnp_send(reinterpret_cast<scnp_packet*>(&pkt),
-	      _pc_list.get_current().address);
+    if(_send_packet(reinterpret_cast<scnp_packet*>(&pkt),
+		    _pc_list.get_current().address) == -1) {
+      perror("scnp_send");
+    }
 
     _th_safe_op(_egress_mutex, [this]() {
 	_waiting_for_egress.first = true;
@@ -197,12 +366,16 @@ void RSC::_transit(rscutil::Combo::Way way, float height)
 
 #endif
 
-void RSC::add_pc(const uint8_t *addr, const std::string& hostname)
+void RSC::add_pc(scnp_session_t * session, const uint8_t *addr, const std::string& hostname)
 {
   using namespace rscutil;
-  bool exist = _all_pc_list.exist([&addr](const PC& pc) -> bool {
-      return !memcmp(addr, pc.address, PC::LEN_ADDR);
-    });
+  // A pc reached through several interfaces is the same pc
+  bool other_path = _add_path(session, addr, hostname);
+  auto same_pc = [&addr, &hostname, other_path](const PC& pc) -> bool {
+    return !memcmp(addr, pc.address, PC::LEN_ADDR) || (other_path && pc.name == hostname);
+  };
+  
+  bool exist = _all_pc_list.exist(same_pc);
   if(!exist) {
     PC pc{ _next_pc_id++, false, false, hostname, {0}, { 0,0 }, { 0,0 }}; 
 
@@ -212,26 +385,128 @@ void RSC::add_pc(const uint8_t *addr, const std::string& hostname)
     _th_safe_op(_alive_mutex, [this, &pc]() { _alive[pc.id] = clock_t::now(); });
   }
   else {
-    int id = _all_pc_list.get([&addr](const PC& pc) -> bool {
-	return !memcmp(addr, pc.address, PC::LEN_ADDR);
-      }).id;
+    int id = _all_pc_list.get(same_pc).id;
     _th_safe_op(_alive_mutex, [&id,this]() { _alive[id] = clock_t::now(); } );
   }
 }
 
-void RSC::_receive()
+void RSC::register_handler(uint8_t type, PacketHandler handler)
+{
+  _handlers[type] = handler ? handler : &RSC::_ignore;
+}
+
+void RSC::add_event(Receiver& receiver, const ControllerEvent& ev)
+{
+  if(!receiver.frame.fits(ev)) flush_events(receiver);
+  
+  receiver.frame.push(ev);
+}
+
+void RSC::flush_events(Receiver& receiver)
+{
+  if(receiver.frame.size() == 0) return;
+
+  bool moved = receiver.frame.flush();
+  
+  _update_mouse(receiver, moved);
+}
+
+void RSC::_ignore(RSC&, Receiver&, const struct scnp_packet&, const uint8_t[])
+{
+}
+
+void RSC::_on_key(RSC& rsc, Receiver& receiver, const struct scnp_packet& packet, const uint8_t[])
+{
+  rsc.add_event(receiver, ConvKey<KEY>::to_event(packet));
+}
+
+void RSC::_on_movement(RSC& rsc, Receiver& receiver, const struct scnp_packet& packet, const uint8_t[])
+{
+  rsc.add_event(receiver, ConvKey<MOUSE>::to_event(packet));
+}
+
+void RSC::_on_motion(RSC& rsc, Receiver& receiver, const struct scnp_packet& packet, const uint8_t[])
+{
+  auto * pkt = reinterpret_cast<const struct scnp_motion*>(&packet);
+
+  if(pkt->dx)    rsc.add_event(receiver, { 0, MOUSE, EV_REL, pkt->dx, REL_X });
+  if(pkt->dy)    rsc.add_event(receiver, { 0, MOUSE, EV_REL, pkt->dy, REL_Y });
+  if(pkt->wheel) rsc.add_event(receiver, { 0, MOUSE, EV_REL, pkt->wheel, REL_WHEEL });
+}
+
+void RSC::_on_out(RSC& rsc, Receiver& receiver, const struct scnp_packet& packet, const uint8_t src[])
+{
+#ifndef NO_CURSOR
+  using rscutil::Combo;
+  
+  auto * pkt = reinterpret_cast<const struct scnp_out*>(&packet);
+
+  rsc.flush_events(receiver);
+  
+  if(pkt->direction == OUT_EGRESS) {
+    bool expected = false;
+
+    rsc._th_safe_op(rsc._egress_mutex, [&rsc, &expected, src]() {
+	expected = rsc._waiting_for_egress.first &&
+	  rsc._same_peer(rsc._waiting_for_egress.second,src);
+	if(expected) rsc._waiting_for_egress.first = false;
+      });
+
+    if(!expected) return;
+		     
+    if(!pkt->side) rsc._transit(Combo::Way::LEFT, pkt->height);
+    else           rsc._transit(Combo::Way::RIGHT, pkt->height);		     
+  }
+  else {
+    std::unique_lock<std::mutex> lock(rsc._cursor_mutex);
+    rsc._cursor->pos_x = (pkt->side == OUT_RIGHT)?10:rsc._cursor->screen_size.width-10;
+    rsc._cursor->pos_y = pkt->height * rsc._cursor->screen_size.height;
+    set_cursor_position(rsc._cursor);
+  }
+#else
+  (void)rsc;
+  (void)receiver;
+  (void)packet;
+  (void)src;
+#endif
+}
+
+void RSC::_on_management(RSC& rsc, Receiver& receiver, const struct scnp_packet& packet, const uint8_t src[])
+{
+  auto * pkt = reinterpret_cast<const struct scnp_management*>(&packet);
+  
+  rsc.add_pc(receiver.session, src, pkt->hostname);
+}
+
+void RSC::_update_mouse(Receiver& receiver, bool moved)
+{
+#ifndef NO_CURSOR
+  int x = 0, y = 0;
+  _th_safe_op(_cursor_mutex, [this, &x, &y](){
+      if(!_cursor->visible) show_cursor(_cursor);
+      get_cursor_position(_cursor);
+      x = _cursor->pos_x;
+      y = _cursor->pos_y;
+    });
+  if(moved) receiver.mouse.update(0, 0, x, y);
+#else
+  (void)receiver;
+  (void)moved;
+#endif
+}
+
+void RSC::_receive(scnp_session_t * session)
 {
   using rscutil::Combo;
   
   struct scnp_packet   packet;
-  ControllerEvent    * ev = nullptr;
   uint8_t              addr_src[rscutil::PC::LEN_ADDR];
     
 #ifndef NO_CURSOR
   const rscutil::PC&   local_pc = _pc_list.get_local();
-  rscutil::ComboMouse  mouse(local_pc.resolution.w, local_pc.resolution.h);
+  Receiver             receiver(session, local_pc.resolution.w, local_pc.resolution.h);
   
-  mouse.set_action([&](Combo* combo) {
+  receiver.mouse.set_action([this, &receiver](Combo* combo) {
       auto way = combo->get_way();
 		     
       struct scnp_out pkt;
@@ -244,76 +519,37 @@ void RSC::_receive()
       hide_cursor(_cursor);
       _cursor_mutex.unlock();
 		     
-      scnp_send(reinterpret_cast<struct scnp_packet *>(&pkt), addr_src);
+      if(scnp_session_send(receiver.session, reinterpret_cast<struct scnp_packet *>(&pkt), receiver.src) == -1) {
+	perror("scnp_send");
+      }
     });
+#else
+  Receiver             receiver(session);
 #endif
 
-  std::map<uint8_t, std::function<ControllerEvent *(void)>> on_packet =
-    {
-      { SCNP_KEY, [&packet]() { return ConvKey<ControllerEvent,KEY>::get(packet); }},
-      { SCNP_MOV, [&packet]() { return ConvKey<ControllerEvent,MOUSE>::get(packet); }},
-      { SCNP_OUT, [&packet, &addr_src,this]() {
-#ifndef NO_CURSOR
-	  auto * pkt = reinterpret_cast<struct scnp_out*>(&packet);
-		   
-	  if(pkt->direction == OUT_EGRESS) {
-	    const int l = rscutil::PC::LEN_ADDR;
-		     
-	    if(_waiting_for_egress.first &&
-	       !memcmp(_waiting_for_egress.second,addr_src,l)) {
-	      _waiting_for_egress.first = false;
-	    }
-	    else return nullptr;
-		     
-	    if(!pkt->side) _transit(Combo::Way::LEFT, pkt->height);
-	    else           _transit(Combo::Way::RIGHT, pkt->height);		     
-	  }
-	  else {
-	    std::unique_lock<std::mutex> lock(_cursor_mutex);
-	    _cursor->pos_x = (pkt->side == OUT_RIGHT)?10:_cursor->screen_size.width-10;
-	    _cursor->pos_y = pkt->height * _cursor->screen_size.height;
-	    set_cursor_position(_cursor);
-	  }
-#endif
-	  return nullptr;
-	}},
-      { SCNP_MNG, [this, &addr_src, &packet]() {
-	  auto * pkt = reinterpret_cast<struct scnp_management*>(&packet);
-	  add_pc(addr_src, pkt->hostname);
-	  return nullptr; }},
-    };
+  receiver.src = addr_src;
 
   while(_run) {
-    int err = scnp_recv(&packet, addr_src);
+    int err = scnp_session_recv(session, &packet, addr_src);
 
-    if(err == -1) perror("scnp_recv");
-    
-    auto it = on_packet.find(packet.type);
-    
-    if(it != on_packet.end()) ev = it->second();
-    else                      ev = nullptr;
-    
-    if(ev) {
-      write_controller(ev);
-
-#ifndef NO_CURSOR
-      int x = 0, y = 0;
-      _th_safe_op(_cursor_mutex, [this, &x, &y](){
-	  if(!_cursor->visible) show_cursor(_cursor);
-	  get_cursor_position(_cursor);
-	  x = _cursor->pos_x;
-	  y = _cursor->pos_y;
-	});
-      if(ev->controller_type == MOUSE) mouse.update(ev->code, ev->value, x, y);
-#endif
+    if(err == -1) {
+      perror("scnp_recv");
+      continue;
     }
+
+    /* every packet already received goes in the same frame */
+    do {
+      _handlers[packet.type](*this, receiver, packet, addr_src);
+    } while(scnp_session_try_recv(session, &packet, addr_src) == 0);
+
+    flush_events(receiver);
   }
 }
 
-
 void RSC::_send(const ControllerEvent &ev)
 {
-  uint8_t * address;
+  uint8_t *          address;
+  struct scnp_packet packet;
 
   _th_safe_op(_pc_list_mutex, [this, &address]() {
       address = _pc_list.get_current().address;
@@ -321,14 +557,17 @@ void RSC::_send(const ControllerEvent &ev)
   
   switch(ev.controller_type) {
   case MOUSE:
-    scnp_send(ConvKey<struct scnp_packet, MOUSE>::get(ev), address);
+    ConvKey<MOUSE>::to_packet(ev, packet);
     break;
   case KEY:
-    scnp_send(ConvKey<struct scnp_packet, KEY>::get(ev), address);
+    ConvKey<KEY>::to_packet(ev, packet);
     break;
   default:
-    break;
+    return;
   }
+
+  // The event is lost, the library already retried what it could
+  if(_send_packet(&packet, address) == -1) perror("scnp_send");
 }
 
 void RSC::_local_cmd()
@@ -344,7 +583,7 @@ void RSC::_local_cmd()
 	  if(ret) ack.add_arg(Message::ERROR, Message::IF_EXIST);
 	  else    ack.add_arg(Message::OK, Message::DEFAULT);  }},
       { Message::GETIF, [this,&ack](const Message&) {
-	  ack.add_arg(Message::OK, _if);  }},
+	  ack.add_arg(Message::OK, _ifs.front());  }},
       { Message::GETLIST, [this, &ack](const Message& ) {
 	  _pc_list.save(CURRENT_PC_LIST);
 	  _all_pc_list.save(ALL_PC_LIST);
@@ -384,6 +623,10 @@ void RSC::_local_cmd()
 	  scnp_set_key((arg == Message::NO_PASSWD)? NULL : arg.c_str());
 	  ack.add_arg(Message::OK, Message::DEFAULT);
 	}},
+      { Message::TUNING, [this, &ack](const Message&) {
+	  _save_tuning();
+	  ack.add_arg(Message::OK, Message::DEFAULT);
+	}},
     };
 
   while(_run) {
@@ -489,26 +732,30 @@ void RSC::run()
   _pause = false;
   _run = true;
   
-  _threads.push_back(std::thread(std::bind(&RSC::_receive, this)));
+  _start_receivers();
   _threads.push_back(std::thread([this]() { _send(); }));
   _threads.push_back(std::thread(std::bind(&RSC::_keep_alive, this)));
   _threads.push_back(std::thread(&RSC::_local_cmd, this));
 
   for(auto&& th : _threads) th.join();
+  for(auto&& th : _receivers) th.join();
 
   _threads.clear();
+  _receivers.clear();
 }
 
 void RSC::pause_requested()
 {
   _pause = true;
   for(auto&& th : _threads) pthread_cancel(th.native_handle()); 
+  for(auto&& th : _receivers) pthread_cancel(th.native_handle());
 }
 
 void RSC::stop_requested()
 {
   _run = false;
   for(auto&& th : _threads) pthread_cancel(th.native_handle());
+  for(auto&& th : _receivers) pthread_cancel(th.native_handle());
 }
 
 int RSC::set_interface(int index)
@@ -527,9 +774,12 @@ int RSC::set_interface(int index)
   
   if(not_found) return 1;
   
-  scnp_stop();
-  _if = index;
-  int err = scnp_start(_if, ((_key.empty())? nullptr : _key.c_str()));
+  // The receiving threads must not use the sessions once they are closed
+  _stop_receivers();
+  _close_sessions();
+  _ifs.assign(1, index);
+  int err = _open_sessions();
+  _start_receivers();
   
   if (err) return -1;
 
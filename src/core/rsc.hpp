@@ -6,7 +6,10 @@
 #include <map>
 #include <mutex>
 #include <thread>
+#include <vector>
 
+#include <controller.h>
+#include <event_frame.hpp>
 #include <rsclocal_com.hpp>
 #include <combo.hpp>
 #include <pc_list.hpp>
@@ -16,17 +19,44 @@
 #include <cursor.h>
 #endif
 
-struct ControllerEvent;
-
 class RSC
 {
+public:
+
+  struct Receiver;
+
+  /**
+   *\brief Handler of a SCNP packet type, called by the receiving thread of a session.
+   *\param receiver The state of the receiving thread.
+   *\param packet The packet received.
+   *\param src The source address of the packet.
+   * The events for the controller are given to add_event(), they are written together once
+   * every received packet is handled.
+   */
+
+  using PacketHandler = void (*)(RSC& rsc, Receiver& receiver, const struct scnp_packet& packet, const uint8_t src[]);
+
+private:
+  
   using clock_t = std::chrono::system_clock;
   using timestamp_t = std::chrono::time_point<RSC::clock_t>;
 
   static constexpr int DEFAULT_IF = 5;
   static constexpr int ALIVE_TIMEOUT = 5;
   
+  /**
+   *\brief Way to reach a peer through one of the sessions.
+   */
+  
+  struct Path
+  {
+    scnp_session_t * session;
+    uint8_t          address[rscutil::PC::LEN_ADDR];
+    timestamp_t      seen;
+  };
+  
   std::map<int, timestamp_t> _alive;
+  std::map<std::string, std::vector<Path>> _paths; // Paths to each peer, by hostname
   
   std::list<rscutil::Combo::ptr> _shortcut;
   rscutil::PCList                _pc_list;
@@ -34,18 +64,31 @@ class RSC
   std::atomic_bool               _run, _pause;
   std::pair<bool, uint8_t[6]>    _waiting_for_egress;
   std::string                    _key;
-  int                            _if;
+  std::vector<int>               _ifs;
+  std::vector<scnp_session_t *>  _sessions; // One session per interface
+  int                            _tuning; // Socket tuning profile of the sessions
   int                            _next_pc_id;
   CursorInfo *                   _cursor;
   
   rsclocalcom::RSCLocalCom _com;
   std::vector<std::thread> _threads; // Index 0 is reserved for keep_alive
+  std::vector<std::thread> _receivers; // One receiving thread per session
   std::mutex               _pc_list_mutex;
   std::mutex               _all_pc_list_mutex;
   std::mutex               _alive_mutex;
   std::mutex               _state_mutex;
   std::mutex               _cursor_mutex;
   std::mutex               _egress_mutex;
+  std::mutex               _paths_mutex;
+
+  /**
+   *\brief Dense table of the handlers indexed by SCNP type, built at compile time.
+   */
+
+  struct HandlerTable;
+  
+  static const HandlerTable _default_handlers;
+  PacketHandler             _handlers[UINT8_MAX + 1]; // Handlers in use, see register_handler
 
   /**
    *\brief Lock a mutex to execute safely an operation
@@ -57,10 +100,79 @@ class RSC
   void _th_safe_op(Mutex& m, Lambda && l);
 
   /**
-   *\brief Listening thread to sncp_packet
+   *\brief Open a session on each interface of _ifs.
+   *\return 0 on success. -1 otherwise, no session is open.
+   */
+  
+  int _open_sessions();
+
+  /**
+   *\brief Close all the sessions and forget the paths.
+   */
+  
+  void _close_sessions();
+
+  /**
+   *\brief Write the socket options in effect for each session in SOCKET_TUNING.
+   */
+  
+  void _save_tuning();
+
+  /**
+   *\brief Start a receiving thread for each session.
+   */
+  
+  void _start_receivers();
+
+  /**
+   *\brief Cancel and join the receiving threads.
+   */
+  
+  void _stop_receivers();
+
+  /**
+   *\brief Record the path to a peer through a session.
+   *\return true if the peer was already reached through another session.
    */
   
-  void _receive();
+  bool _add_path(scnp_session_t * session, const uint8_t addr[], const std::string& hostname);
+
+  /**
+   *\brief Check if two addresses are paths to the same peer.
+   */
+  
+  bool _same_peer(const uint8_t a[], const uint8_t b[]);
+
+  /**
+   *\brief Send a packet to a peer through its path with the lowest latency.
+   *\param address The address of the peer in the pc list.
+   */
+  
+  int _send_packet(struct scnp_packet * packet, const uint8_t address[]);
+
+  /**
+   *\brief Listening thread to sncp_packet of a session
+   */
+  
+  void _receive(scnp_session_t * session);
+
+  /**
+   *\brief Show the cursor and update the mouse shortcut after a frame of the receiving thread.
+   *\param moved If the frame has mouse events.
+   */
+  
+  void _update_mouse(Receiver& receiver, bool moved);
+
+  /**
+   *\brief Default handlers of the SCNP packet types, see PacketHandler.
+   */
+  
+  static void _ignore(RSC& rsc, Receiver& receiver, const struct scnp_packet& packet, const uint8_t src[]);
+  static void _on_key(RSC& rsc, Receiver& receiver, const struct scnp_packet& packet, const uint8_t src[]);
+  static void _on_movement(RSC& rsc, Receiver& receiver, const struct scnp_packet& packet, const uint8_t src[]);
+  static void _on_motion(RSC& rsc, Receiver& receiver, const struct scnp_packet& packet, const uint8_t src[]);
+  static void _on_out(RSC& rsc, Receiver& receiver, const struct scnp_packet& packet, const uint8_t src[]);
+  static void _on_management(RSC& rsc, Receiver& receiver, const struct scnp_packet& packet, const uint8_t src[]);
 
   /**
    *\biref Listening thread to local command
@@ -103,6 +215,24 @@ class RSC
 public:
 
   enum class State { HERE, AWAY };
+
+  /**
+   *\brief State of a receiving thread, given to the packet handlers.
+   */
+
+  struct Receiver
+  {
+    scnp_session_t * session;
+    const uint8_t *  src;                         // Source address of the packet being handled
+    EventFrame       frame;                       // Events not written yet
+#ifndef NO_CURSOR
+    rscutil::ComboMouse mouse;
+
+    Receiver(scnp_session_t * s, size_t width, size_t height) : session(s), src(nullptr), mouse(width, height) {}
+#else
+    explicit Receiver(scnp_session_t * s) : session(s), src(nullptr) {}
+#endif
+  };
   
   RSC();
   ~RSC();
@@ -115,10 +245,13 @@ public:
 
   /**
    *\brief Init the object.
+   *\param if_indexes The interfaces used at the same time, the first one
+   * if it is empty.
+   *\param tuning The socket tuning profile, SCNP_TUNING_NONE by default.
    *\return 1 if there was an error. 0 otherwise.
    */
   
-  int  init(int if_index, const std::string& key);
+  int  init(const std::vector<int>& if_indexes, const std::string& key, int tuning = SCNP_TUNING_NONE);
 
   /**
    *\brief Release everything that need to be in the object
@@ -128,13 +261,14 @@ public:
 
   /**
    *\brief Add a PC to the list (all_pc) by its mac address
+   *\param session The session the pc was seen on
    *\param addr The mac address of the pc
    */
   
-  void add_pc(const uint8_t addr[], const std::string& hostname);
+  void add_pc(scnp_session_t * session, const uint8_t addr[], const std::string& hostname);
 
   /**
-   *\brief Change the current network interface.
+   *\brief Change the current network interface, the other sessions are closed.
    *\param index The index of the current interface.
    *\return 0 on success. 1 otherwise.
    */
@@ -162,6 +296,30 @@ public:
   
   void wait_for_wakeup();
 
+  /**
+   *\brief Handle a SCNP packet type with another handler.
+   * Must be called before run(), the receiving threads read the handlers without lock.
+   *\param type The SCNP type.
+   *\param handler The handler, nullptr to ignore the packets of the type.
+   */
+  
+  void register_handler(uint8_t type, PacketHandler handler);
+
+  /**
+   *\brief Add an event to the frame of a receiving thread.
+   * The frame is written first when it is full or already has an event of the same code,
+   * so that a frame never changes a key or an axis twice.
+   */
+  
+  void add_event(Receiver& receiver, const ControllerEvent& ev);
+
+  /**
+   *\brief Write the frame of a receiving thread to the controller.
+   * A handler acting on the controller by another way must call it first.
+   */
+  
+  void flush_events(Receiver& receiver);
+
   void save_shortcut() const;
   void load_shortcut(bool reset);
   
@@ -0,0 +1,55 @@
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Minimal set of atomic operations used by the lock-free parts of the network
+ * library. Every atomic variable is a 64-bit integer so that the same
+ * operations can be mapped on the Interlocked functions of MSVC.
+ */
+
+#ifdef _MSC_VER
+
+#include <windows.h>
+
+static __inline int64_t atomic_load_64(volatile int64_t * ptr)
+{
+  int64_t v = *ptr;
+  _ReadWriteBarrier();
+  return v;
+}
+
+static __inline void atomic_store_64(volatile int64_t * ptr, int64_t value)
+{
+  _ReadWriteBarrier();
+  *ptr = value;
+}
+
+static __inline bool atomic_cas_64(volatile int64_t * ptr, int64_t * expected, int64_t desired)
+{
+  int64_t old = InterlockedCompareExchange64((volatile LONG64 *) ptr, desired, *expected);
+  if (old == *expected) return true;
+  *expected = old;
+  return false;
+}
+
+#define ATOMIC_LOAD(ptr) atomic_load_64((volatile int64_t *) (ptr))
+#define ATOMIC_STORE(ptr, value) atomic_store_64((volatile int64_t *) (ptr), (int64_t) (value))
+#define ATOMIC_FETCH_ADD(ptr, value) InterlockedExchangeAdd64((volatile LONG64 *) (ptr), (value))
+#define ATOMIC_CAS(ptr, expected, desired) atomic_cas_64((volatile int64_t *) (ptr), (int64_t *) (expected), (desired))
+#define ATOMIC_FENCE() MemoryBarrier()
+
+#else
+
+#define ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define ATOMIC_FETCH_ADD(ptr, value) __atomic_fetch_add((ptr), (value), __ATOMIC_SEQ_CST)
+#define ATOMIC_CAS(ptr, expected, desired) \
+  __atomic_compare_exchange_n((ptr), (expected), (desired), true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define ATOMIC_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#endif
+
+#endif /* ATOMIC_H */
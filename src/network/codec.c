@@ -0,0 +1,329 @@
+#include <string.h>
+#include <errno.h>
+
+#include "crypto.h"
+#include "codec.h"
+
+/* the structures of the packets must fit in a struct scnp_packet */
+#define CODEC_ASSERT(cond, name) typedef char codec_assert_##name[(cond) ? 1 : -1]
+
+CODEC_ASSERT(sizeof(struct scnp_key) <= sizeof(struct scnp_packet), key);
+CODEC_ASSERT(sizeof(struct scnp_movement) <= sizeof(struct scnp_packet), movement);
+CODEC_ASSERT(sizeof(struct scnp_motion) <= sizeof(struct scnp_packet), motion);
+CODEC_ASSERT(sizeof(struct scnp_out) <= sizeof(struct scnp_packet), out);
+CODEC_ASSERT(sizeof(struct scnp_management) <= sizeof(struct scnp_packet), management);
+CODEC_ASSERT(sizeof(struct scnp_ack) <= sizeof(struct scnp_packet), ack);
+CODEC_ASSERT(sizeof(struct scnp_sack) <= sizeof(struct scnp_packet), sack);
+CODEC_ASSERT(MNG_LENGTH <= MAX_PACKET_LENGTH, mng_length);
+
+uint8_t cypher_key[CYPHER_KEY_LENGTH] = {0, 0};
+
+/* length on the wire of every type, 0 for the unknown types */
+static const size_t packet_sizes[UINT8_MAX + 1] = {
+    [SCNP_KEY] = KEY_LENGTH,
+    [SCNP_MOV] = MOV_LENGTH,
+    [SCNP_OUT] = OUT_LENGTH,
+    [SCNP_MOT] = MOT_LENGTH,
+    [SCNP_MNG] = MNG_LENGTH,
+    [SCNP_SACK] = SACK_LENGTH,
+    [SCNP_ACK] = ACK_LENGTH
+};
+
+static int build_key_packet(struct scnp_packet * packet, const uint8_t * buf)
+{
+  struct scnp_key key;
+  /* type */
+  key.type = SCNP_KEY;
+  /* id */
+  memcpy(&key.id, buf, sizeof(uint32_t));
+  key.id = ntohl(key.id);
+  /* code */
+  uint8_t payload[2];
+  memcpy(payload, buf + sizeof(uint32_t), sizeof(payload));
+  if (decrypt(payload, 2, cypher_key, 2)) return -1;
+  memcpy(&key.code, payload, sizeof(uint16_t));
+  key.code = ntohs(key.code);
+  /* pressed */
+  key.pressed = *(buf + sizeof(uint32_t) + sizeof(uint16_t)) >> 7u;
+  /* repeated */
+  key.repeated = *(buf + sizeof(uint32_t) + sizeof(uint16_t)) & (1u << 6u);
+
+  memcpy(packet, &key, sizeof(struct scnp_key));
+
+  return 0;
+}
+
+static int build_mov_packet(struct scnp_packet * packet, const uint8_t * buf)
+{
+  struct scnp_movement mov;
+  /* type */
+  mov.type = SCNP_MOV;
+  /* move_type */
+  mov.move_type = *buf >> 7u;
+  /* code */
+  memcpy(&mov.code, buf + sizeof(uint8_t), sizeof(uint16_t));
+  mov.code = ntohs(mov.code);
+  /* value */
+  memcpy(&mov.value, buf + sizeof(uint8_t) + sizeof(uint16_t), sizeof(uint32_t));
+  mov.value = ntohl(mov.value);
+
+  memcpy(packet, &mov, sizeof(struct scnp_movement));
+
+  return 0;
+}
+
+static int build_mot_packet(struct scnp_packet * packet, const uint8_t * buf)
+{
+  struct scnp_motion mot;
+  uint16_t value;
+  /* type */
+  mot.type = SCNP_MOT;
+  /* dx */
+  memcpy(&value, buf, sizeof(uint16_t));
+  mot.dx = (int16_t) ntohs(value);
+  /* dy */
+  memcpy(&value, buf + sizeof(uint16_t), sizeof(uint16_t));
+  mot.dy = (int16_t) ntohs(value);
+  /* wheel */
+  mot.wheel = (int8_t) *(buf + 2 * sizeof(uint16_t));
+
+  memcpy(packet, &mot, sizeof(struct scnp_motion));
+
+  return 0;
+}
+
+static int build_out_packet(struct scnp_packet * packet, const uint8_t * buf)
+{
+  struct scnp_out out;
+  /* type */
+  out.type = SCNP_OUT;
+  /* id */
+  memcpy(&out.id, buf, sizeof(uint32_t));
+  out.id = ntohl(out.id);
+  /* direction */
+  out.direction = *(buf + sizeof(uint32_t)) >> 7u;
+  /* side */
+  out.side = *(buf + sizeof(uint32_t)) & (1u << 6u);
+  /* height */
+  uint16_t height;
+  memcpy(&height, buf + sizeof(uint32_t) + sizeof(uint8_t), sizeof(uint16_t));
+  out.height = (float) ntohs(height) / ((1u << 16u) - 1u);
+
+  memcpy(packet, &out, sizeof(struct scnp_out));
+
+  return 0;
+}
+
+static int build_mng_packet(struct scnp_packet * packet, const uint8_t * buf)
+{
+  struct scnp_management mng;
+  /* type */
+  mng.type = SCNP_MNG;
+  /* hostname */
+  memcpy(&mng.hostname, buf, HOSTNAME_LENGTH);
+  /* features */
+  mng.features = *(buf + HOSTNAME_LENGTH);
+
+  memcpy(packet, &mng, sizeof(struct scnp_management));
+
+  return 0;
+}
+
+static int build_ack_packet(struct scnp_packet * packet, const uint8_t * buf)
+{
+  struct scnp_ack ack;
+  /* type */
+  ack.type = SCNP_ACK;
+  /* id */
+  memcpy(&ack.id, buf, sizeof(uint32_t));
+  ack.id = ntohl(ack.id);
+
+  memcpy(packet, &ack, sizeof(struct scnp_ack));
+
+  return 0;
+}
+
+static int build_sack_packet(struct scnp_packet * packet, const uint8_t * buf)
+{
+  struct scnp_sack sack;
+  /* type */
+  sack.type = SCNP_SACK;
+  /* id */
+  memcpy(&sack.id, buf, sizeof(uint32_t));
+  sack.id = ntohl(sack.id);
+  /* count */
+  memcpy(&sack.count, buf + sizeof(uint32_t), sizeof(uint16_t));
+  sack.count = ntohs(sack.count);
+  /* bitmap */
+  memcpy(&sack.bitmap, buf + sizeof(uint32_t) + sizeof(uint16_t), sizeof(uint32_t));
+  sack.bitmap = ntohl(sack.bitmap);
+
+  memcpy(packet, &sack, sizeof(struct scnp_sack));
+
+  return 0;
+}
+
+static int build_key_buffer(uint8_t * buf, const struct scnp_packet * packet)
+{
+  struct scnp_key * p = (struct scnp_key *) packet;
+
+  /* id */
+  uint32_t id = htonl(p->id);
+  memcpy(buf, &id, sizeof(uint32_t));
+  /* code */
+  uint16_t code = htons(p->code);
+  memcpy(buf + sizeof(uint32_t), &code, sizeof(uint16_t));
+  if (encrypt(buf + sizeof(uint32_t), 2, cypher_key, 2)) return -1;
+  /* flags */
+  uint8_t pressed_flag = (p->pressed) << 7u;
+  uint8_t repeated_flag = (p->repeated) << 6u;
+  *(buf + sizeof(uint32_t) + sizeof(uint16_t)) = pressed_flag + repeated_flag;
+
+  return 0;
+}
+
+static int build_mov_buffer(uint8_t * buf, const struct scnp_packet * packet)
+{
+  struct scnp_movement * p = (struct scnp_movement *) packet;
+
+  /* move_type */
+  uint8_t type_flag = (p->move_type) << 7u;
+  memcpy(buf, &type_flag, sizeof(uint8_t));
+  /* code */
+  uint16_t code = htons(p->code);
+  memcpy(buf + sizeof(uint8_t), &code, sizeof(uint16_t));
+  /* value */
+  uint32_t value = htonl(p->value);
+  memcpy(buf + sizeof(uint8_t) + sizeof(uint16_t), &value, sizeof(uint32_t));
+
+  return 0;
+}
+
+static int build_out_buffer(uint8_t * buf, const struct scnp_packet * packet)
+{
+  struct scnp_out * p = (struct scnp_out *) packet;
+
+  /* id */
+  uint32_t id = htonl(p->id);
+  memcpy(buf, &id, sizeof(uint32_t));
+  /* flags */
+  uint8_t direction_flag = (p->direction) << 7u;
+  uint8_t side_flag = (p->side) << 6u;
+  *(buf + sizeof(uint32_t)) = direction_flag + side_flag;
+  /* height */
+  if (p->height > 1 || p->height < 0) p->height = 0.5f;
+  uint16_t height = p->height * ((1u << 16u) - 1u);
+  height = htons(height);
+  memcpy(buf + sizeof(uint32_t) + sizeof(uint8_t), &height, sizeof(uint16_t));
+
+  return 0;
+}
+
+static int build_mot_buffer(uint8_t * buf, const struct scnp_packet * packet)
+{
+  struct scnp_motion * p = (struct scnp_motion *) packet;
+
+  /* dx */
+  uint16_t dx = htons((uint16_t) p->dx);
+  memcpy(buf, &dx, sizeof(uint16_t));
+  /* dy */
+  uint16_t dy = htons((uint16_t) p->dy);
+  memcpy(buf + sizeof(uint16_t), &dy, sizeof(uint16_t));
+  /* wheel */
+  *(buf + 2 * sizeof(uint16_t)) = (uint8_t) p->wheel;
+
+  return 0;
+}
+
+static int build_mng_buffer(uint8_t * buf, const struct scnp_packet * packet)
+{
+  struct scnp_management * p = (struct scnp_management *) packet;
+
+  /* hostname */
+  memcpy(buf, p->hostname, HOSTNAME_LENGTH);
+  /* features */
+  *(buf + HOSTNAME_LENGTH) = p->features;
+
+  return 0;
+}
+
+static int build_ack_buffer(uint8_t * buf, const struct scnp_packet * packet)
+{
+  struct scnp_ack * p = (struct scnp_ack *) packet;
+
+  /* id */
+  uint32_t id = htonl(p->id);
+  memcpy(buf, &id, sizeof(uint32_t));
+
+  return 0;
+}
+
+static int build_sack_buffer(uint8_t * buf, const struct scnp_packet * packet)
+{
+  struct scnp_sack * p = (struct scnp_sack *) packet;
+
+  /* id */
+  uint32_t id = htonl(p->id);
+  memcpy(buf, &id, sizeof(uint32_t));
+  /* count */
+  uint16_t count = htons(p->count);
+  memcpy(buf + sizeof(uint32_t), &count, sizeof(uint16_t));
+  /* bitmap */
+  uint32_t bitmap = htonl(p->bitmap);
+  memcpy(buf + sizeof(uint32_t) + sizeof(uint16_t), &bitmap, sizeof(uint32_t));
+
+  return 0;
+}
+
+static int (* const builders[UINT8_MAX + 1])(struct scnp_packet *, const uint8_t *) = {
+    [SCNP_KEY] = build_key_packet,
+    [SCNP_MOV] = build_mov_packet,
+    [SCNP_OUT] = build_out_packet,
+    [SCNP_MOT] = build_mot_packet,
+    [SCNP_MNG] = build_mng_packet,
+    [SCNP_SACK] = build_sack_packet,
+    [SCNP_ACK] = build_ack_packet
+};
+
+static int (* const buf_builders[UINT8_MAX + 1])(uint8_t *, const struct scnp_packet *) = {
+    [SCNP_KEY] = build_key_buffer,
+    [SCNP_MOV] = build_mov_buffer,
+    [SCNP_OUT] = build_out_buffer,
+    [SCNP_MOT] = build_mot_buffer,
+    [SCNP_MNG] = build_mng_buffer,
+    [SCNP_SACK] = build_sack_buffer,
+    [SCNP_ACK] = build_ack_buffer
+};
+
+size_t packet_length(uint8_t type)
+{
+  return packet_sizes[type];
+}
+
+bool is_type_valid(uint8_t type)
+{
+  return packet_sizes[type] != 0;
+}
+
+int build_packet(struct scnp_packet * packet, const uint8_t * buf)
+{
+  if (!is_type_valid(*buf)) {
+    errno = EBADMSG;
+    return -1;
+  }
+  return builders[*buf](packet, buf + 1);
+}
+
+size_t build_buffer(uint8_t * buf, const struct scnp_packet * packet)
+{
+  if (!is_type_valid(packet->type)) {
+    errno = EBADMSG;
+    return 0;
+  }
+
+  /* type */
+  *buf = packet->type;
+
+  if (buf_builders[packet->type](buf + 1, packet)) return 0;
+  return packet_sizes[packet->type];
+}
@@ -0,0 +1,73 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scnp.h"
+
+/* Length of the key used to encrypt the code of the SCNP_KEY packets */
+#define CYPHER_KEY_LENGTH 2
+
+/* Key of the current session, see scnp_set_key() */
+extern uint8_t cypher_key[CYPHER_KEY_LENGTH];
+
+/**
+ * @fn size_t packet_length(uint8_t type)
+ * @brief Length on the wire of the packets of a type.
+ *
+ * The lengths are read from a table built at compile time.
+ *
+ * @return Length in bytes, type included. 0 if the type is unknown.
+ */
+
+size_t packet_length(uint8_t type);
+
+/**
+ * @fn bool is_type_valid(uint8_t type)
+ * @brief Check that a type can be decoded by build_packet().
+ */
+
+bool is_type_valid(uint8_t type);
+
+/**
+ * @fn int build_packet(struct scnp_packet * packet, const uint8_t * buf)
+ * @brief Decode the SCNP packet at the beginning of a buffer.
+ *
+ * The buffer must contain at least packet_length() bytes of its type.
+ * This function does not allocate memory.
+ *
+ * @return On success, returns 0.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * EBADMSG Unknown type.
+ */
+
+int build_packet(struct scnp_packet * packet, const uint8_t * buf);
+
+/**
+ * @fn size_t build_buffer(uint8_t * buf, const struct scnp_packet * packet)
+ * @brief Encode a SCNP packet in a buffer.
+ *
+ * The buffer must have room for packet_length() bytes of the type of the
+ * packet, MAX_PACKET_LENGTH is always enough. This function does not
+ * allocate memory.
+ *
+ * @return On success, returns the number of bytes written.
+ * On error, returns 0 and errno is set appropriately.
+ * @section Errors
+ * EBADMSG Unknown type.
+ */
+
+size_t build_buffer(uint8_t * buf, const struct scnp_packet * packet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CODEC_H */
@@ -0,0 +1,542 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "atomic.h"
+#include "queue.h"
+#include "inflight.h"
+#include "sack.h"
+
+#ifndef __gnu_linux__
+#define EXFULL ENOSPC
+#endif
+
+#define NO_ENTRY -1
+#define NO_STATUS -1
+
+/* maximum number of timers handled out of the lock by one inflight_expire() */
+#define EXPIRE_MAX 64
+
+struct inflight_entry
+{
+  struct scnp_packet packet;
+  uint32_t id;
+  int status;
+  int tries;
+  bool armed;
+  int slot;  // slot of the timer wheel where it is armed
+  long long int sent_at;  // time of the last transmission
+  long long int timeout;  // retransmission timeout, doubled at each expiration
+  long long int deadline;
+  int next; // next entry in the same slot of the timer wheel
+  scnp_callback callback;
+  void * data;
+};
+
+struct inflight_peer
+{
+  bool used;
+  uint8_t addr[ETHER_ADDR_LEN];
+  int next_slot;
+  int64_t next_id; // sequence number of the next packet to the destination
+  long long int srtt;
+  long long int rttvar;
+  long long int rto;
+  int64_t samples;
+  struct inflight_entry window[INFLIGHT_WINDOW];
+};
+
+/* a packet to retransmit or a callback to call once the lock is released */
+struct inflight_event
+{
+  struct scnp_packet packet;
+  uint8_t addr[ETHER_ADDR_LEN];
+  int status;
+  scnp_callback callback;
+  void * data;
+};
+
+struct inflight_table
+{
+  pthread_mutex_t mutex;
+  struct inflight_peer peers[INFLIGHT_MAX_PEERS];
+  int wheel[TIMER_WHEEL_SIZE];
+  long long int wheel_tick;
+  int pending;
+  long long int rto_min;
+  long long int rto_max;
+};
+
+#define ENTRY(index) (&inflight->peers[(index) / INFLIGHT_WINDOW].window[(index) % INFLIGHT_WINDOW])
+
+static bool is_free(const struct inflight_entry * e)
+{
+  return e->status != SCNP_PENDING && !e->armed;
+}
+
+static bool is_idle(const struct inflight_peer * peer)
+{
+  for (int i = 0; i < INFLIGHT_WINDOW; ++i) {
+    if (!is_free(&peer->window[i])) return false;
+  }
+  return true;
+}
+
+static void set_id(struct scnp_packet * packet, uint32_t id)
+{
+  if (packet->type == SCNP_KEY) ((struct scnp_key *) packet)->id = id;
+  else if (packet->type == SCNP_OUT) ((struct scnp_out *) packet)->id = id;
+}
+
+static long long int clamp_rto(const struct inflight_table * inflight, long long int rto)
+{
+  if (rto < inflight->rto_min) return inflight->rto_min;
+  if (rto > inflight->rto_max) return inflight->rto_max;
+  return rto;
+}
+
+/* update the round trip estimation of a destination, see RFC 6298 */
+static void update_rtt(const struct inflight_table * inflight, struct inflight_peer * peer, long long int sample)
+{
+  if (peer->samples == 0) {
+    peer->srtt = sample;
+    peer->rttvar = sample / 2;
+  }
+  else {
+    long long int delta = peer->srtt - sample;
+    if (delta < 0) delta = -delta;
+    peer->rttvar = (3 * peer->rttvar + delta) / 4;
+    peer->srtt = (7 * peer->srtt + sample) / 8;
+  }
+  ++peer->samples;
+
+  /* the variation cannot be less than the resolution of the timers */
+  long long int variation = 4 * peer->rttvar;
+  if (variation < TIMER_TICK_NS) variation = TIMER_TICK_NS;
+  peer->rto = clamp_rto(inflight, peer->srtt + variation);
+}
+
+/* send again a packet, its timeout is doubled if it expired */
+static void resend(const struct inflight_table * inflight, struct inflight_entry * e, const uint8_t * addr, long long int now, bool backoff, struct inflight_event * ev)
+{
+  ++e->tries;
+  if (backoff) e->timeout = clamp_rto(inflight, 2 * e->timeout);
+  e->sent_at = now;
+  e->deadline = now + e->timeout;
+  memcpy(&ev->packet, &e->packet, sizeof(struct scnp_packet));
+  memcpy(ev->addr, addr, ETHER_ADDR_LEN);
+  ev->status = SCNP_PENDING;
+  ev->callback = NULL;
+}
+
+static void reset_peer(const struct inflight_table * inflight, struct inflight_peer * peer, const uint8_t * addr)
+{
+  peer->used = true;
+  memcpy(peer->addr, addr, ETHER_ADDR_LEN);
+  peer->next_slot = 0;
+  ATOMIC_STORE(&peer->next_id, (int64_t) (uint32_t) rand());
+  peer->srtt = 0;
+  peer->rttvar = 0;
+  peer->rto = clamp_rto(inflight, RTO_INITIAL_NS);
+  peer->samples = 0;
+  for (int i = 0; i < INFLIGHT_WINDOW; ++i) {
+    peer->window[i].status = NO_STATUS;
+    peer->window[i].armed = false;
+    peer->window[i].next = NO_ENTRY;
+  }
+}
+
+static struct inflight_peer * find_peer(struct inflight_table * inflight, const uint8_t * addr, bool create)
+{
+  for (int i = 0; i < INFLIGHT_MAX_PEERS; ++i) {
+    struct inflight_peer * peer = &inflight->peers[i];
+    if (peer->used && memcmp(peer->addr, addr, ETHER_ADDR_LEN) == 0) return peer;
+  }
+
+  if (!create) return NULL;
+
+  /* take an unused destination or recycle one without packet in flight */
+  for (int i = 0; i < INFLIGHT_MAX_PEERS; ++i) {
+    if (!inflight->peers[i].used) {
+      reset_peer(inflight, &inflight->peers[i], addr);
+      return &inflight->peers[i];
+    }
+  }
+  for (int i = 0; i < INFLIGHT_MAX_PEERS; ++i) {
+    if (is_idle(&inflight->peers[i])) {
+      reset_peer(inflight, &inflight->peers[i], addr);
+      return &inflight->peers[i];
+    }
+  }
+
+  return NULL;
+}
+
+static struct inflight_entry * find_entry(struct inflight_peer * peer, uint32_t id)
+{
+  for (int i = 0; i < INFLIGHT_WINDOW; ++i) {
+    struct inflight_entry * e = &peer->window[i];
+    if (e->status != NO_STATUS && e->id == id) return e;
+  }
+  return NULL;
+}
+
+static void arm(struct inflight_table * inflight, int index)
+{
+  struct inflight_entry * e = ENTRY(index);
+  long long int tick = e->deadline / TIMER_TICK_NS;
+  if (tick < inflight->wheel_tick) tick = inflight->wheel_tick;
+
+  int slot = (int) (tick % TIMER_WHEEL_SIZE);
+  e->next = inflight->wheel[slot];
+  e->armed = true;
+  e->slot = slot;
+  inflight->wheel[slot] = index;
+}
+
+/* remove the timer of an entry from the wheel, so that its place is free at once */
+static void disarm(struct inflight_table * inflight, int index)
+{
+  struct inflight_entry * e = ENTRY(index);
+  if (!e->armed) return;
+
+  for (int * link = &inflight->wheel[e->slot]; *link != NO_ENTRY; link = &ENTRY(*link)->next) {
+    if (*link == index) {
+      *link = e->next;
+      break;
+    }
+  }
+  e->next = NO_ENTRY;
+  e->armed = false;
+}
+
+static void complete(struct inflight_table * inflight, struct inflight_entry * e, int status, const uint8_t * addr, struct inflight_event * ev)
+{
+  e->status = status;
+  --inflight->pending;
+  memcpy(&ev->packet, &e->packet, sizeof(struct scnp_packet));
+  memcpy(ev->addr, addr, ETHER_ADDR_LEN);
+  ev->status = status;
+  ev->callback = e->callback;
+  ev->data = e->data;
+}
+
+struct inflight_table * inflight_new(long long int rto_min_ns, long long int rto_max_ns)
+{
+  struct inflight_table * inflight = malloc(sizeof(struct inflight_table));
+  if (inflight == NULL) return NULL;
+
+  pthread_mutex_init(&inflight->mutex, NULL);
+  inflight->rto_min = rto_min_ns;
+  inflight->rto_max = rto_max_ns;
+  memset(inflight->peers, 0, sizeof(inflight->peers));
+  inflight_init(inflight);
+
+  return inflight;
+}
+
+void inflight_free(struct inflight_table * inflight)
+{
+  if (inflight != NULL) {
+    inflight_init(inflight);
+    pthread_mutex_destroy(&inflight->mutex);
+    free(inflight);
+  }
+}
+
+void inflight_init(struct inflight_table * inflight)
+{
+  struct inflight_event ev;
+
+  pthread_mutex_lock(&inflight->mutex);
+
+  /* complete packets of the previous session */
+  for (int i = 0; i < INFLIGHT_MAX_PEERS; ++i) {
+    struct inflight_peer * peer = &inflight->peers[i];
+    for (int j = 0; peer->used && j < INFLIGHT_WINDOW; ++j) {
+      if (peer->window[j].status == SCNP_PENDING) {
+        complete(inflight, &peer->window[j], SCNP_TIMEDOUT, peer->addr, &ev);
+        if (ev.callback != NULL) {
+          pthread_mutex_unlock(&inflight->mutex);
+          ev.callback(&ev.packet, ev.addr, ev.status, ev.data);
+          pthread_mutex_lock(&inflight->mutex);
+        }
+      }
+    }
+  }
+
+  memset(inflight->peers, 0, sizeof(inflight->peers));
+  for (int i = 0; i < TIMER_WHEEL_SIZE; ++i) inflight->wheel[i] = NO_ENTRY;
+  inflight->wheel_tick = queue_clock() / TIMER_TICK_NS;
+  inflight->pending = 0;
+
+  pthread_mutex_unlock(&inflight->mutex);
+}
+
+int inflight_add(struct inflight_table * inflight, struct scnp_packet * packet, const uint8_t * dest_addr, scnp_callback callback, void * data)
+{
+  if (packet->type != SCNP_KEY && packet->type != SCNP_OUT) {
+    errno = EBADMSG;
+    return -1;
+  }
+
+  pthread_mutex_lock(&inflight->mutex);
+
+  struct inflight_peer * peer = find_peer(inflight, dest_addr, true);
+  if (peer == NULL) {
+    pthread_mutex_unlock(&inflight->mutex);
+    errno = EXFULL;
+    return -1;
+  }
+
+  /* look for a free place, the oldest statuses are overwritten first */
+  int slot = -1;
+  for (int i = 0; i < INFLIGHT_WINDOW && slot == -1; ++i) {
+    int s = (peer->next_slot + i) % INFLIGHT_WINDOW;
+    if (is_free(&peer->window[s])) slot = s;
+  }
+  if (slot == -1) {
+    pthread_mutex_unlock(&inflight->mutex);
+    errno = EXFULL;
+    return -1;
+  }
+  peer->next_slot = (slot + 1) % INFLIGHT_WINDOW;
+
+  /* identify the packet */
+  uint32_t id = (uint32_t) ATOMIC_FETCH_ADD(&peer->next_id, 1);
+  set_id(packet, id);
+
+  struct inflight_entry * e = &peer->window[slot];
+  memcpy(&e->packet, packet, sizeof(struct scnp_packet));
+  e->id = id;
+  e->status = SCNP_PENDING;
+  e->tries = 1;
+  e->sent_at = queue_clock();
+  e->timeout = peer->rto;
+  e->deadline = e->sent_at + e->timeout;
+  e->callback = callback;
+  e->data = data;
+  ++inflight->pending;
+  arm(inflight, (int) (peer - inflight->peers) * INFLIGHT_WINDOW + slot);
+
+  pthread_mutex_unlock(&inflight->mutex);
+
+  return 0;
+}
+
+int inflight_cancel(struct inflight_table * inflight, const uint8_t * dest_addr, uint32_t id)
+{
+  pthread_mutex_lock(&inflight->mutex);
+
+  struct inflight_peer * peer = find_peer(inflight, dest_addr, false);
+  struct inflight_entry * e = (peer != NULL) ? find_entry(peer, id) : NULL;
+  bool pending = e != NULL && e->status == SCNP_PENDING;
+
+  if (pending) {
+    e->status = NO_STATUS;
+    --inflight->pending;
+    disarm(inflight, (int) (peer - inflight->peers) * INFLIGHT_WINDOW + (int) (e - peer->window));
+  }
+
+  pthread_mutex_unlock(&inflight->mutex);
+
+  if (!pending) errno = ENOENT;
+  return pending ? 0 : -1;
+}
+
+int inflight_number(struct inflight_table * inflight, struct scnp_packet * packet, const uint8_t * dest_addr)
+{
+  if (packet->type != SCNP_KEY && packet->type != SCNP_OUT) {
+    errno = EBADMSG;
+    return -1;
+  }
+
+  pthread_mutex_lock(&inflight->mutex);
+
+  struct inflight_peer * peer = find_peer(inflight, dest_addr, true);
+  if (peer != NULL) set_id(packet, (uint32_t) ATOMIC_FETCH_ADD(&peer->next_id, 1));
+
+  pthread_mutex_unlock(&inflight->mutex);
+
+  if (peer == NULL) {
+    errno = EXFULL;
+    return -1;
+  }
+  return 0;
+}
+
+int inflight_ack(struct inflight_table * inflight, const uint8_t * src_addr, uint32_t id, inflight_send send, void * data)
+{
+  struct scnp_sack sack;
+  sack_start(&sack, id);
+  return inflight_sack(inflight, src_addr, &sack, send, data);
+}
+
+int inflight_sack(struct inflight_table * inflight, const uint8_t * src_addr, const struct scnp_sack * sack, inflight_send send, void * data)
+{
+  struct inflight_event acked[INFLIGHT_WINDOW];
+  struct inflight_event resent[INFLIGHT_WINDOW];
+  int                   nacked = 0, nresent = 0;
+
+  pthread_mutex_lock(&inflight->mutex);
+
+  struct inflight_peer * peer = find_peer(inflight, src_addr, false);
+  if (peer == NULL) {
+    pthread_mutex_unlock(&inflight->mutex);
+    return -1;
+  }
+
+  /* the places of the acknowledged packets are free at once */
+  struct inflight_entry * e = NULL;
+  for (int i = 0; i < INFLIGHT_WINDOW; ++i) {
+    struct inflight_entry * p = &peer->window[i];
+    if (p->status != SCNP_PENDING || !sack_covers(sack, p->id)) continue;
+    if (e == NULL || p->sent_at > e->sent_at) e = p;
+    complete(inflight, p, SCNP_ACKED, peer->addr, &acked[nacked++]);
+    disarm(inflight, (int) (peer - inflight->peers) * INFLIGHT_WINDOW + i);
+  }
+  if (e == NULL) {
+    pthread_mutex_unlock(&inflight->mutex);
+    return -1;
+  }
+
+  /* the round trip of a retransmitted packet is ambiguous (Karn's algorithm) */
+  long long int now = queue_clock();
+  if (e->tries == 1) update_rtt(inflight, peer, now - e->sent_at);
+
+  /* the packets sent before the acknowledged one are lost if they wait for longer than a round trip */
+  long long int reordering = peer->srtt + peer->srtt / 4;
+  for (int i = 0; send != NULL && peer->samples > 0 && i < INFLIGHT_WINDOW; ++i) {
+    struct inflight_entry * p = &peer->window[i];
+    if (p->status != SCNP_PENDING || p->tries >= ACK_MAX_TRIES) continue;
+    if (p->sent_at < e->sent_at && now - p->sent_at > reordering) {
+      resend(inflight, p, peer->addr, now, false, &resent[nresent++]);
+    }
+  }
+
+  pthread_mutex_unlock(&inflight->mutex);
+
+  for (int i = 0; i < nacked; ++i) {
+    if (acked[i].callback != NULL) acked[i].callback(&acked[i].packet, acked[i].addr, acked[i].status, acked[i].data);
+  }
+  for (int i = 0; i < nresent; ++i) send(&resent[i].packet, resent[i].addr, data);
+
+  return nresent;
+}
+
+int inflight_status(struct inflight_table * inflight, const uint8_t * dest_addr, uint32_t id)
+{
+  int status = -1;
+
+  pthread_mutex_lock(&inflight->mutex);
+
+  struct inflight_peer * peer = find_peer(inflight, dest_addr, false);
+  struct inflight_entry * e = (peer != NULL) ? find_entry(peer, id) : NULL;
+  if (e != NULL) status = e->status;
+
+  pthread_mutex_unlock(&inflight->mutex);
+
+  if (status == -1) errno = ENOENT;
+  return status;
+}
+
+int inflight_rtt(struct inflight_table * inflight, const uint8_t * dest_addr, struct scnp_rtt * rtt)
+{
+  int ret = -1;
+
+  pthread_mutex_lock(&inflight->mutex);
+
+  struct inflight_peer * peer = find_peer(inflight, dest_addr, false);
+  if (peer != NULL && peer->samples > 0) {
+    rtt->srtt_ns = (uint64_t) peer->srtt;
+    rtt->rttvar_ns = (uint64_t) peer->rttvar;
+    rtt->rto_ns = (uint64_t) peer->rto;
+    rtt->samples = (uint64_t) peer->samples;
+    ret = 0;
+  }
+
+  pthread_mutex_unlock(&inflight->mutex);
+
+  if (ret) errno = ENOENT;
+  return ret;
+}
+
+long long int inflight_next_deadline(struct inflight_table * inflight)
+{
+  long long int deadline = -1;
+
+  pthread_mutex_lock(&inflight->mutex);
+
+  for (long long int t = inflight->wheel_tick; inflight->pending > 0 && t < inflight->wheel_tick + TIMER_WHEEL_SIZE; ++t) {
+    /* timers of the current round are earlier than the ones of next rounds */
+    if (deadline != -1 && deadline <= t * TIMER_TICK_NS) break;
+
+    for (int i = inflight->wheel[t % TIMER_WHEEL_SIZE]; i != NO_ENTRY; i = ENTRY(i)->next) {
+      struct inflight_entry * e = ENTRY(i);
+      if (e->status == SCNP_PENDING && (deadline == -1 || e->deadline < deadline)) deadline = e->deadline;
+    }
+  }
+
+  pthread_mutex_unlock(&inflight->mutex);
+
+  return deadline;
+}
+
+void inflight_expire(struct inflight_table * inflight, long long int now, inflight_send send, void * data)
+{
+  struct inflight_event events[EXPIRE_MAX];
+  int                   rearm[EXPIRE_MAX];
+  int                   nevents = 0, nrearm = 0;
+
+  pthread_mutex_lock(&inflight->mutex);
+
+  long long int now_tick = now / TIMER_TICK_NS;
+  long long int last_tick = now_tick;
+  if (last_tick - inflight->wheel_tick >= TIMER_WHEEL_SIZE) last_tick = inflight->wheel_tick + TIMER_WHEEL_SIZE - 1;
+
+  bool full = false;
+  long long int t;
+  for (t = inflight->wheel_tick; t <= last_tick && !full; ++t) {
+    int * link = &inflight->wheel[t % TIMER_WHEEL_SIZE];
+
+    while (*link != NO_ENTRY && !full) {
+      int index = *link;
+      struct inflight_entry * e = ENTRY(index);
+      struct inflight_peer * peer = &inflight->peers[index / INFLIGHT_WINDOW];
+
+      /* remove the timer from the wheel */
+      *link = e->next;
+      e->next = NO_ENTRY;
+      e->armed = false;
+
+      if (e->status != SCNP_PENDING) continue;
+
+      if (e->deadline > now) {
+        /* timer of a next round or moved by a fast retransmission */
+        rearm[nrearm++] = index;
+      }
+      else if (e->tries < ACK_MAX_TRIES) {
+        /* retransmit the packet */
+        rearm[nrearm++] = index;
+        resend(inflight, e, peer->addr, now, true, &events[nevents++]);
+      }
+      else {
+        complete(inflight, e, SCNP_TIMEDOUT, peer->addr, &events[nevents++]);
+      }
+
+      full = nevents == EXPIRE_MAX || nrearm == EXPIRE_MAX;
+    }
+  }
+
+  /* the last visited slot may still contain timers when stopped early */
+  inflight->wheel_tick = full ? t - 1 : now_tick;
+  for (int i = 0; i < nrearm; ++i) arm(inflight, rearm[i]);
+
+  pthread_mutex_unlock(&inflight->mutex);
+
+  for (int i = 0; i < nevents; ++i) {
+    if (events[i].status == SCNP_PENDING) send(&events[i].packet, events[i].addr, data);
+    else if (events[i].callback != NULL) events[i].callback(&events[i].packet, events[i].addr, events[i].status, events[i].data);
+  }
+}
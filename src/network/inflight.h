@@ -0,0 +1,203 @@
+#ifndef INFLIGHT_H
+#define INFLIGHT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scnp.h"
+
+/* Number of destinations that can have packets in flight at the same time */
+#define INFLIGHT_MAX_PEERS 16
+
+/* Number of packets in flight per destination */
+#define INFLIGHT_WINDOW 64
+
+/* Resolution and number of slots of the retransmission timer wheel */
+#define TIMER_TICK_NS 1000000
+#define TIMER_WHEEL_SIZE 1024
+
+/* Retransmission timeout before the first round trip to a destination is measured */
+#define RTO_INITIAL_NS 1000000000
+
+/* Default floor and ceiling of the retransmission timeout */
+#define RTO_MIN_NS 5000000
+#define RTO_MAX_NS 1000000000
+
+/* Number of transmissions of a packet before it times out */
+#define ACK_MAX_TRIES 3
+
+/**
+ * @struct inflight_table
+ * @brief Packets waiting for an acknowledgement and their timers.
+ *
+ * Each SCNP session has its own table, the functions taking a table are
+ * thread-safe.
+ */
+
+struct inflight_table;
+
+/**
+ * @typedef inflight_send
+ * @brief Function used by inflight_expire() to retransmit a packet.
+ *
+ * data is the pointer given to inflight_expire() or inflight_ack().
+ */
+
+typedef void (*inflight_send)(const struct scnp_packet * packet, const uint8_t * dest_addr, void * data);
+
+/**
+ * @fn struct inflight_table * inflight_new(long long int rto_min_ns, long long int rto_max_ns)
+ * @brief Create an empty in-flight table.
+ *
+ * The bounds are those of the table and cannot be changed. They clamp the
+ * timeout of every destination each time it is computed, the initial one
+ * included.
+ *
+ * @param rto_min_ns Floor of the retransmission timeout.
+ * @param rto_max_ns Ceiling of the retransmission timeout.
+ * @return The table, NULL if out of memory.
+ */
+
+struct inflight_table * inflight_new(long long int rto_min_ns, long long int rto_max_ns);
+
+/**
+ * @fn void inflight_free(struct inflight_table * inflight)
+ * @brief Complete the pending packets with SCNP_TIMEDOUT and free the table.
+ */
+
+void inflight_free(struct inflight_table * inflight);
+
+/**
+ * @fn void inflight_init(struct inflight_table * inflight)
+ * @brief Reset the in-flight table and the timer wheel.
+ *
+ * Packets still pending are completed with SCNP_TIMEDOUT.
+ */
+
+void inflight_init(struct inflight_table * inflight);
+
+/**
+ * @fn int inflight_add(struct inflight_table * inflight, struct scnp_packet * packet, const uint8_t * dest_addr, scnp_callback callback, void * data)
+ * @brief Give an identifier to a packet and keep it until its acknowledgement.
+ *
+ * The packet is added to the window of its destination and its
+ * retransmission timer is armed. The identifier is the next sequence number
+ * of the destination, which starts at a random value, and is written in the
+ * packet.
+ *
+ * @return On success, returns 0.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * EBADMSG The packet does not need acknowledgement.
+ * EXFULL The window of the destination or the table of destinations is full.
+ */
+
+int inflight_add(struct inflight_table * inflight, struct scnp_packet * packet, const uint8_t * dest_addr, scnp_callback callback, void * data);
+
+/**
+ * @fn int inflight_cancel(struct inflight_table * inflight, const uint8_t * dest_addr, uint32_t id)
+ * @brief Forget a pending packet that could not be sent, without calling its
+ * callback. It is neither retransmitted nor known by inflight_status().
+ *
+ * @return On success, returns 0.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * ENOENT The packet is not pending.
+ */
+
+int inflight_cancel(struct inflight_table * inflight, const uint8_t * dest_addr, uint32_t id);
+
+/**
+ * @fn int inflight_number(struct inflight_table * inflight, struct scnp_packet * packet, const uint8_t * dest_addr)
+ * @brief Give an identifier to a packet that is not kept until its
+ * acknowledgement.
+ *
+ * The identifier is the next sequence number of the destination, as given
+ * by inflight_add(), so that the peer checks the replays of both packets
+ * with the same window.
+ *
+ * @return On success, returns 0.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * EBADMSG The packet does not need acknowledgement.
+ * EXFULL The table of destinations is full.
+ */
+
+int inflight_number(struct inflight_table * inflight, struct scnp_packet * packet, const uint8_t * dest_addr);
+
+/**
+ * @fn int inflight_ack(struct inflight_table * inflight, const uint8_t * src_addr, uint32_t id, inflight_send send, void * data)
+ * @brief Complete the packet acknowledged by an SCNP_ACK.
+ *
+ * The callback of the packet is called with SCNP_ACKED and its place in the
+ * window is free at once. If the packet was sent once, its round trip updates the smoothed round trip time (SRTT) and
+ * its variation (RTTVAR) of the destination, from which the retransmission
+ * timeout is computed. The packets sent before it that wait for longer than
+ * a round trip are retransmitted at once with send (fast retransmit).
+ *
+ * @param send Function used for the fast retransmissions. May be NULL.
+ * @param data Pointer given to send.
+ * @return The number of packets retransmitted if a pending packet was
+ * acknowledged, -1 otherwise.
+ */
+
+int inflight_ack(struct inflight_table * inflight, const uint8_t * src_addr, uint32_t id, inflight_send send, void * data);
+
+/**
+ * @fn int inflight_sack(struct inflight_table * inflight, const uint8_t * src_addr, const struct scnp_sack * sack, inflight_send send, void * data)
+ * @brief Complete the packets acknowledged by a SCNP_SACK, see inflight_ack().
+ *
+ * The round trip is measured with the last packet sent among the
+ * acknowledged ones, which waited the least for the acknowledgement. The
+ * packets sent before it and not acknowledged may be fast retransmitted.
+ */
+
+int inflight_sack(struct inflight_table * inflight, const uint8_t * src_addr, const struct scnp_sack * sack, inflight_send send, void * data);
+
+/**
+ * @fn int inflight_status(struct inflight_table * inflight, const uint8_t * dest_addr, uint32_t id)
+ * @brief Delivery status of a packet, see scnp_send_status().
+ */
+
+int inflight_status(struct inflight_table * inflight, const uint8_t * dest_addr, uint32_t id);
+
+/**
+ * @fn long long int inflight_next_deadline(struct inflight_table * inflight)
+ * @brief Time of the next retransmission timer.
+ *
+ * @return Time in nanoseconds on the queue_clock(), -1 if no timer is armed.
+ */
+
+long long int inflight_next_deadline(struct inflight_table * inflight);
+
+/**
+ * @fn int inflight_rtt(struct inflight_table * inflight, const uint8_t * dest_addr, struct scnp_rtt * rtt)
+ * @brief Round trip estimation of a destination, see scnp_get_rtt().
+ */
+
+int inflight_rtt(struct inflight_table * inflight, const uint8_t * dest_addr, struct scnp_rtt * rtt);
+
+/**
+ * @fn void inflight_expire(struct inflight_table * inflight, long long int now, inflight_send send, void * data)
+ * @brief Run the retransmission timers that expired.
+ *
+ * Must only be called by the sending thread. Each expired packet is
+ * retransmitted with send and its timeout is doubled, or it is completed
+ * with SCNP_TIMEDOUT after ACK_MAX_TRIES transmissions.
+ *
+ * @param now Current time on the queue_clock().
+ * @param send Function used to retransmit a packet.
+ * @param data Pointer given to send.
+ */
+
+void inflight_expire(struct inflight_table * inflight, long long int now, inflight_send send, void * data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INFLIGHT_H */
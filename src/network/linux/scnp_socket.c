@@ -1,21 +1,159 @@
+#define _GNU_SOURCE
 #include <string.h>
+#include <errno.h>
 
+#include <time.h>
 #include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
-#include <netpacket/packet.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
 #include <net/ethernet.h>
 
 #include <scnp_socket.h>
 
+#include "atomic.h"
+
+/* Geometry of the rings, the transmit ring has the same size as the receive ring */
+#define RING_BLOCK_SIZE (1 << 16)
+#define RING_BLOCK_NR 8
+#define RING_FRAME_SIZE 2048
+#define RING_FRAME_NR (RING_BLOCK_SIZE / RING_FRAME_SIZE * RING_BLOCK_NR)
+
+/* Time in milliseconds after which the kernel gives a partially filled block */
+#define RING_RETIRE_TOV 1
+
+/* Length of the ethernet header written in the transmit ring */
+#define ETHER_HEADER_LEN (2 * ETHER_ADDR_LEN + 2)
+
+#define RX_BLOCK(sock, i) ((struct tpacket_block_desc *) ((sock)->ring + (size_t) (i) * RING_BLOCK_SIZE))
+#define TX_FRAME(sock, i) \
+    ((struct tpacket3_hdr *) ((sock)->ring + (size_t) RING_BLOCK_SIZE * RING_BLOCK_NR + (size_t) (i) * RING_FRAME_SIZE))
+#define TX_DATA(hdr) ((uint8_t *) (hdr) + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)))
+
+/* First byte of the handles of the peers in UDP mode, a locally administered address */
+#define UDP_HANDLE_PREFIX 0x02
+
+static int get_hwaddr(int fd, int if_index, uint8_t * addr)
+{
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(struct ifreq));
+    if (if_indextoname((unsigned int)if_index, ifr.ifr_name) == NULL) return -1;
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr)) return -1;
+
+    memcpy(addr, ifr.ifr_hwaddr.sa_data, ETHER_ADDR_LEN);
+
+    return 0;
+}
+
+/* set up and map the receive and transmit rings */
+static int open_ring(struct scnp_socket* sock)
+{
+    int version = TPACKET_V3;
+    if (setsockopt(sock->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version))) {
+        if (errno == EINVAL || errno == ENOPROTOOPT) errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(struct tpacket_req3));
+    req.tp_block_size = RING_BLOCK_SIZE;
+    req.tp_block_nr = RING_BLOCK_NR;
+    req.tp_frame_size = RING_FRAME_SIZE;
+    req.tp_frame_nr = RING_FRAME_NR;
+    req.tp_retire_blk_tov = RING_RETIRE_TOV;
+    if (setsockopt(sock->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req))) return -1;
+
+    /* the transmit ring is made of frames only */
+    req.tp_retire_blk_tov = 0;
+    if (setsockopt(sock->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req))) {
+        if (errno == EINVAL) errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    sock->ring_size = 2 * (size_t)RING_BLOCK_SIZE * RING_BLOCK_NR;
+    void * ring = mmap(NULL, sock->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, sock->fd, 0);
+    if (ring == MAP_FAILED) return -1;
+    sock->ring = (uint8_t*)ring;
+
+    return 0;
+}
+
 int scnp_socket_open(struct scnp_socket* sock, int if_index)
 {
-  sock->fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_SCNP));
+    return scnp_socket_open_mode(sock, if_index, SCNP_SOCKET_PLAIN);
+}
+
+static void reset(struct scnp_socket* sock, int mode)
+{
+    sock->mode = mode;
+    sock->ring = NULL;
+    sock->ring_size = 0;
+    sock->rx_block = 0;
+    sock->rx_left = 0;
+    sock->rx_frame = NULL;
+    sock->rx_release = false;
+    sock->tx_frame = 0;
+    sock->rx_calls = 0;
+    sock->tx_calls = 0;
+    sock->tx_errors = 0;
+    sock->family = AF_PACKET;
+    sock->port = 0;
+    sock->npeers = 0;
+    sock->nfilter_peers = 0;
+}
+
+static int close_on_error(struct scnp_socket* sock)
+{
+    int err = errno;
+    scnp_socket_close(sock);
+    errno = err;
+    return -1;
+}
+
+int scnp_socket_open_mode(struct scnp_socket* sock, int if_index, int mode)
+{
+    if (mode == SCNP_SOCKET_UDP) return scnp_socket_open_udp(sock, if_index, SCNP_UDP_PORT);
+
+    if (mode != SCNP_SOCKET_PLAIN && mode != SCNP_SOCKET_RING) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    reset(sock, mode);
+
+    /* the ethernet header is read and written in the rings */
+    int type = (mode == SCNP_SOCKET_RING) ? SOCK_RAW : SOCK_DGRAM;
+
+  sock->fd = socket(AF_PACKET, type, htons(ETH_P_SCNP));
     if (sock->fd < 0) {
         return -1;
     }
 
     sock->if_index = if_index;
 
+    if (get_hwaddr(sock->fd, if_index, sock->src_addr)) {
+        int err = errno;
+        scnp_socket_close(sock);
+        errno = err;
+        return -1;
+    }
+
+    if (mode == SCNP_SOCKET_RING) {
+        if (open_ring(sock)) {
+            int err = errno;
+            scnp_socket_close(sock);
+            errno = err;
+            return -1;
+        }
+    }
+
     /* bind the socket to the interface */
     struct sockaddr_ll addr;
     socklen_t addrlen = sizeof(struct sockaddr_ll);
@@ -24,14 +162,319 @@ int scnp_socket_open(struct scnp_socket* sock, int if_index)
     addr.sll_protocol = htons(ETH_P_SCNP);
     addr.sll_ifindex = (int)if_index;
     if (bind(sock->fd, (struct sockaddr*) & addr, addrlen)) {
+        int err = errno;
+        scnp_socket_close(sock);
+        errno = err;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* write the handle of the peer at index */
+static void udp_handle(int64_t index, uint8_t* handle)
+{
+    memset(handle, 0, ETHER_ADDR_LEN);
+    handle[0] = UDP_HANDLE_PREFIX;
+    handle[4] = (uint8_t)(index >> 8);
+    handle[5] = (uint8_t)index;
+}
+
+/* index of the peer of a handle, -1 if the handle is unknown */
+static int64_t udp_index(struct scnp_socket* socket, const uint8_t* handle)
+{
+    static const uint8_t prefix[4] = { UDP_HANDLE_PREFIX, 0, 0, 0 };
+
+    if (memcmp(handle, prefix, sizeof(prefix)) != 0) return -1;
+
+    int64_t index = ((int64_t)handle[4] << 8) | handle[5];
+
+    return (index < ATOMIC_LOAD(&socket->npeers)) ? index : -1;
+}
+
+/* write a socket address in IPv6, IPv4 addresses are mapped */
+static int udp_map(const struct sockaddr* addr, socklen_t addrlen, struct sockaddr_in6* mapped)
+{
+    memset(mapped, 0, sizeof(struct sockaddr_in6));
+    mapped->sin6_family = AF_INET6;
+
+    if (addr->sa_family == AF_INET6) {
+        if (addrlen < sizeof(struct sockaddr_in6)) {
+            errno = EINVAL;
+            return -1;
+        }
+        const struct sockaddr_in6 * in6 = (const struct sockaddr_in6 *) addr;
+        mapped->sin6_port = in6->sin6_port;
+        mapped->sin6_addr = in6->sin6_addr;
+        mapped->sin6_scope_id = in6->sin6_scope_id;
+    }
+    else if (addr->sa_family == AF_INET) {
+        if (addrlen < sizeof(struct sockaddr_in)) {
+            errno = EINVAL;
+            return -1;
+        }
+        const struct sockaddr_in * in = (const struct sockaddr_in *) addr;
+        mapped->sin6_port = in->sin_port;
+        mapped->sin6_addr.s6_addr[10] = 0xff;
+        mapped->sin6_addr.s6_addr[11] = 0xff;
+        memcpy(&mapped->sin6_addr.s6_addr[12], &in->sin_addr, sizeof(struct in_addr));
+    }
+    else {
+        errno = EAFNOSUPPORT;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* write the address given to the system, in IPv4 if the socket has no IPv6 */
+static socklen_t udp_unmap(const struct scnp_socket* socket, const struct sockaddr_in6* mapped, struct sockaddr_storage* addr)
+{
+    if (socket->family == AF_INET6) {
+        memcpy(addr, mapped, sizeof(struct sockaddr_in6));
+        return sizeof(struct sockaddr_in6);
+    }
+
+    struct sockaddr_in * in = (struct sockaddr_in *) addr;
+    memset(in, 0, sizeof(struct sockaddr_in));
+    in->sin_family = AF_INET;
+    in->sin_port = mapped->sin6_port;
+    memcpy(&in->sin_addr, &mapped->sin6_addr.s6_addr[12], sizeof(struct in_addr));
+
+    return sizeof(struct sockaddr_in);
+}
+
+static int64_t udp_find(struct scnp_socket* socket, const struct sockaddr_in6* addr)
+{
+    int64_t npeers = ATOMIC_LOAD(&socket->npeers);
+
+    for (int64_t i = 0; i < npeers; ++i) {
+        const struct sockaddr_in6 * peer = &socket->peers[i];
+        if (peer->sin6_port == addr->sin6_port && memcmp(&peer->sin6_addr, &addr->sin6_addr, sizeof(struct in6_addr)) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/* time of CLOCK_MONOTONIC in nanoseconds */
+static int64_t udp_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* unconfirmed peer quiet for the longest time, -1 if every peer is confirmed */
+static int64_t udp_oldest(struct scnp_socket* socket)
+{
+    int64_t oldest = -1;
+
+    for (int64_t i = 0; i < SCNP_SOCKET_MAX_PEERS; ++i) {
+        if (socket->peer_confirmed[i]) continue;
+        if (oldest == -1 || socket->peer_seen[i] < socket->peer_seen[oldest]) oldest = i;
+    }
+
+    return oldest;
+}
+
+/*
+ * add a peer, or give it the place of the oldest unconfirmed one if the table is full,
+ * a source received from only takes a place quiet for SCNP_SOCKET_PEER_IDLE_MS,
+ * peers_mutex must be held
+ */
+static int64_t udp_append(struct scnp_socket* socket, const struct sockaddr_in6* addr, bool confirmed, int64_t now)
+{
+    int64_t index = ATOMIC_LOAD(&socket->npeers);
+
+    if (index == SCNP_SOCKET_MAX_PEERS) {
+        index = udp_oldest(socket);
+        if (index == -1 || (!confirmed && now - socket->peer_seen[index] < SCNP_SOCKET_PEER_IDLE_MS * 1000000LL)) {
+            errno = EXFULL;
+            return -1;
+        }
+        socket->peers[index] = *addr;
+    }
+    else {
+        /* the address is written before the peer is visible to the senders */
+        socket->peers[index] = *addr;
+        ATOMIC_STORE(&socket->npeers, index + 1);
+    }
+
+    socket->peer_seen[index] = now;
+    socket->peer_confirmed[index] = confirmed;
+
+    return index;
+}
+
+/* whether the filter accepts a peer, peers_mutex must be held */
+static bool udp_accepted(struct scnp_socket* socket, int64_t index)
+{
+    uint8_t handle[ETHER_ADDR_LEN];
+
+    if (socket->nfilter_peers == 0) return true;
+    if (index == -1) return false;
+
+    udp_handle(index, handle);
+    for (int64_t i = 0; i < socket->nfilter_peers; ++i) {
+        if (memcmp(socket->filter_peers[i], handle, ETHER_ADDR_LEN) == 0) return true;
+    }
+
+    return false;
+}
+
+int scnp_socket_open_udp(struct scnp_socket* sock, int if_index, uint16_t port)
+{
+    reset(sock, SCNP_SOCKET_UDP);
+
+    /* a single socket receives IPv4 and IPv6 unless IPv6 is disabled */
+    sock->family = AF_INET6;
+    sock->fd = socket(AF_INET6, SOCK_DGRAM, 0);
+    if (sock->fd < 0 && errno == EAFNOSUPPORT) {
+        sock->family = AF_INET;
+        sock->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    }
+    if (sock->fd < 0) {
+        return -1;
+    }
+
+    sock->if_index = if_index;
+    memset(sock->src_addr, 0, ETHER_ADDR_LEN);
+    pthread_mutex_init(&sock->peers_mutex, NULL);
+
+    int v6only = 0;
+    if (sock->family == AF_INET6 && setsockopt(sock->fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only))) {
+        return close_on_error(sock);
+    }
+
+    if (if_index > 0) {
+        char name[IF_NAMESIZE];
+        if (if_indextoname((unsigned int)if_index, name) == NULL) return close_on_error(sock);
+        if (setsockopt(sock->fd, SOL_SOCKET, SO_BINDTODEVICE, name, (socklen_t)strlen(name) + 1)) return close_on_error(sock);
+    }
+
+    struct sockaddr_in6     any;
+    struct sockaddr_storage addr;
+    memset(&any, 0, sizeof(struct sockaddr_in6));
+    any.sin6_family = AF_INET6;
+    any.sin6_port = htons(port);
+    any.sin6_addr = in6addr_any;
+
+    socklen_t addrlen = udp_unmap(sock, &any, &addr);
+    if (bind(sock->fd, (struct sockaddr*) &addr, addrlen)) return close_on_error(sock);
+
+    /* the port chosen by the system */
+    addrlen = sizeof(struct sockaddr_storage);
+    if (getsockname(sock->fd, (struct sockaddr*) &addr, &addrlen)) return close_on_error(sock);
+    sock->port = ntohs((sock->family == AF_INET6) ? ((struct sockaddr_in6*) &addr)->sin6_port : ((struct sockaddr_in*) &addr)->sin_port);
+
+    return 0;
+}
+
+int scnp_socket_add_peer(struct scnp_socket* socket, const struct sockaddr* addr, socklen_t addrlen, uint8_t* peer)
+{
+    struct sockaddr_in6 mapped;
+
+    if (socket->mode != SCNP_SOCKET_UDP) {
+        errno = EOPNOTSUPP;
         return -1;
     }
 
+    if (udp_map(addr, addrlen, &mapped)) return -1;
+
+    /* an IPv4 socket cannot reach an IPv6 peer */
+    if (socket->family == AF_INET && !IN6_IS_ADDR_V4MAPPED(&mapped.sin6_addr)) {
+        errno = EAFNOSUPPORT;
+        return -1;
+    }
+
+    pthread_mutex_lock(&socket->peers_mutex);
+    int64_t index = udp_find(socket, &mapped);
+    if (index == -1) index = udp_append(socket, &mapped, true, udp_clock());
+    else socket->peer_confirmed[index] = true;
+    pthread_mutex_unlock(&socket->peers_mutex);
+
+    if (index == -1) return -1;
+
+    udp_handle(index, peer);
+
     return 0;
 }
 
+static int set_int(int fd, int level, int name, int value)
+{
+    return setsockopt(fd, level, name, &value, sizeof(value));
+}
+
+static int get_int(int fd, int level, int name)
+{
+    int       value = 0;
+    socklen_t len = sizeof(value);
+
+    if (getsockopt(fd, level, name, &value, &len)) return 0;
+
+    return value;
+}
+
+int scnp_socket_tune(struct scnp_socket* socket, const struct scnp_tuning* wanted, struct scnp_tuning* effective)
+{
+    int  fd = socket->fd;
+    bool packet = socket->mode != SCNP_SOCKET_UDP;
+    int  ret = 0, err = 0;
+
+    if (wanted->busy_poll_us != 0 && set_int(fd, SOL_SOCKET, SO_BUSY_POLL, wanted->busy_poll_us)) {
+        err = errno;
+        ret = -1;
+    }
+    if (wanted->priority != 0 && set_int(fd, SOL_SOCKET, SO_PRIORITY, wanted->priority)) {
+        err = errno;
+        ret = -1;
+    }
+    /* the limits of the system only apply without CAP_NET_ADMIN */
+    if (wanted->rcvbuf != 0 && set_int(fd, SOL_SOCKET, SO_RCVBUFFORCE, wanted->rcvbuf) &&
+        set_int(fd, SOL_SOCKET, SO_RCVBUF, wanted->rcvbuf)) {
+        err = errno;
+        ret = -1;
+    }
+    if (wanted->sndbuf != 0 && set_int(fd, SOL_SOCKET, SO_SNDBUFFORCE, wanted->sndbuf) &&
+        set_int(fd, SOL_SOCKET, SO_SNDBUF, wanted->sndbuf)) {
+        err = errno;
+        ret = -1;
+    }
+    if (wanted->qdisc_bypass) {
+        if (!packet) {
+            err = EOPNOTSUPP;
+            ret = -1;
+        }
+        else if (set_int(fd, SOL_PACKET, PACKET_QDISC_BYPASS, 1)) {
+            err = errno;
+            ret = -1;
+        }
+    }
+
+    if (effective != NULL) {
+        effective->busy_poll_us = get_int(fd, SOL_SOCKET, SO_BUSY_POLL);
+        effective->priority = get_int(fd, SOL_SOCKET, SO_PRIORITY);
+        effective->rcvbuf = get_int(fd, SOL_SOCKET, SO_RCVBUF);
+        effective->sndbuf = get_int(fd, SOL_SOCKET, SO_SNDBUF);
+        effective->qdisc_bypass = packet && get_int(fd, SOL_PACKET, PACKET_QDISC_BYPASS) != 0;
+    }
+
+    if (ret) errno = err;
+
+    return ret;
+}
+
 int scnp_socket_close(struct scnp_socket* socket)
 {
+    if (socket->ring != NULL) munmap(socket->ring, socket->ring_size);
+    socket->ring = NULL;
+    socket->ring_size = 0;
+
+    if (socket->mode == SCNP_SOCKET_UDP) pthread_mutex_destroy(&socket->peers_mutex);
+    socket->mode = SCNP_SOCKET_PLAIN;
+
     close(socket->fd);
     socket->fd = -1;
     socket->if_index = 0;
@@ -46,6 +489,26 @@ bool scnp_socket_opened(struct scnp_socket* socket)
 
 ssize_t scnp_socket_recvfrom(struct scnp_socket* socket, void* buf, size_t len, int flags, uint8_t* src_addr)
 {
+    if (socket->mode == SCNP_SOCKET_UDP) {
+        struct scnp_frame frame = { .buf = (uint8_t*)buf, .len = len };
+        if (scnp_socket_recvmmsg(socket, &frame, 1, flags) == -1) return -1;
+
+        memcpy(src_addr, frame.addr, ETHER_ADDR_LEN);
+
+        return (ssize_t)frame.len;
+    }
+
+    if (socket->mode == SCNP_SOCKET_RING) {
+        struct scnp_frame frame = { .buf = NULL, .len = 0 };
+        if (scnp_socket_recvmmsg(socket, &frame, 1, flags) == -1) return -1;
+
+        if (frame.len > len) frame.len = len;
+        memcpy(buf, frame.buf, frame.len);
+        memcpy(src_addr, frame.addr, ETHER_ADDR_LEN);
+
+        return (ssize_t)frame.len;
+    }
+
     socklen_t          addrlen = sizeof(struct sockaddr_ll);
     struct sockaddr_ll addr;
 
@@ -54,6 +517,7 @@ ssize_t scnp_socket_recvfrom(struct scnp_socket* socket, void* buf, size_t len,
     addr.sll_protocol = htons(ETH_P_SCNP);
     addr.sll_ifindex = socket->if_index;
 
+    ATOMIC_FETCH_ADD(&socket->rx_calls, 1);
     ssize_t ret = recvfrom(socket->fd, buf, len, flags, (struct sockaddr*) &addr, &addrlen);
 
     if (ret == -1) return -1;
@@ -65,6 +529,13 @@ ssize_t scnp_socket_recvfrom(struct scnp_socket* socket, void* buf, size_t len,
 
 ssize_t scnp_socket_sendto(struct scnp_socket* socket, const void* buf, size_t len, int flags, const uint8_t* dest_addr)
 {
+    if (socket->mode != SCNP_SOCKET_PLAIN) {
+        struct scnp_frame frame = { .buf = (uint8_t*)buf, .len = len };
+        memcpy(frame.addr, dest_addr, ETHER_ADDR_LEN);
+
+        return (scnp_socket_sendmmsg(socket, &frame, 1, flags) == 1) ? (ssize_t)len : -1;
+    }
+
     socklen_t          addrlen = sizeof(struct sockaddr_ll);
     struct sockaddr_ll addr;
 
@@ -75,5 +546,443 @@ ssize_t scnp_socket_sendto(struct scnp_socket* socket, const void* buf, size_t l
     addr.sll_halen = ETHER_ADDR_LEN;
     memcpy(addr.sll_addr, dest_addr, ETHER_ADDR_LEN);
 
+    ATOMIC_FETCH_ADD(&socket->tx_calls, 1);
     return sendto(socket->fd, buf, len, flags, (struct sockaddr*) & addr, addrlen);
 }
+
+/* Maximum length of a filter program */
+#define FILTER_MAX_LEN (10 + 4 * SCNP_FILTER_MAX_PEERS + 3 * SCNP_FILTER_MAX_TYPES)
+
+/* Jump targets resolved once the program is complete */
+#define JUMP_NEXT 0
+#define JUMP_ACCEPT 0x100
+#define JUMP_DROP 0x101
+#define JUMP_PEERS_OK 0x102
+
+struct filter_builder
+{
+    struct sock_filter insns[FILTER_MAX_LEN];
+    uint16_t           jt[FILTER_MAX_LEN];
+    uint16_t           jf[FILTER_MAX_LEN];
+    unsigned short     len;
+};
+
+static void emit(struct filter_builder* b, uint16_t code, uint16_t jt, uint16_t jf, uint32_t k)
+{
+    struct sock_filter insn = BPF_JUMP(code, k, 0, 0);
+    b->insns[b->len] = insn;
+    b->jt[b->len] = jt;
+    b->jf[b->len] = jf;
+    ++b->len;
+}
+
+/* compare the 6 bytes at SKF_LL_OFF + off with addr, jump to match or skip the comparison */
+static void emit_addr_cmp(struct filter_builder* b, uint32_t off, const uint8_t* addr, uint16_t match)
+{
+    uint32_t hi = ((uint32_t)addr[0] << 24) | ((uint32_t)addr[1] << 16) | ((uint32_t)addr[2] << 8) | addr[3];
+    uint32_t lo = ((uint32_t)addr[4] << 8) | addr[5];
+
+    emit(b, BPF_LD | BPF_W | BPF_ABS, JUMP_NEXT, JUMP_NEXT, (uint32_t)SKF_LL_OFF + off);
+    emit(b, BPF_JMP | BPF_JEQ | BPF_K, JUMP_NEXT, 2, hi);
+    emit(b, BPF_LD | BPF_H | BPF_ABS, JUMP_NEXT, JUMP_NEXT, (uint32_t)SKF_LL_OFF + off + 4);
+    emit(b, BPF_JMP | BPF_JEQ | BPF_K, match, JUMP_NEXT, lo);
+}
+
+static uint8_t resolve(uint16_t target, unsigned short pc, unsigned short accept, unsigned short drop, unsigned short peers_ok)
+{
+    switch (target) {
+        case JUMP_ACCEPT:   return (uint8_t)(accept - pc - 1);
+        case JUMP_DROP:     return (uint8_t)(drop - pc - 1);
+        case JUMP_PEERS_OK: return (uint8_t)(peers_ok - pc - 1);
+        default:            return (uint8_t)target;
+    }
+}
+
+int scnp_socket_set_filter(struct scnp_socket* socket, const struct scnp_filter* filter)
+{
+    static const uint8_t  zero_addr[ETHER_ADDR_LEN] = { 0 };
+    struct filter_builder b;
+
+    if (filter->ntypes > SCNP_FILTER_MAX_TYPES || filter->npeers > SCNP_FILTER_MAX_PEERS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* the payload follows the ethernet header in the rings, the UDP header on a UDP socket */
+    uint32_t base = 0;
+    if (socket->mode == SCNP_SOCKET_RING) base = ETHER_HEADER_LEN;
+    if (socket->mode == SCNP_SOCKET_UDP) base = sizeof(struct udphdr);
+    b.len = 0;
+
+    /* the sources of the datagrams are not handles, they are checked by recv_udp() */
+    if (socket->mode == SCNP_SOCKET_UDP) {
+        pthread_mutex_lock(&socket->peers_mutex);
+        memcpy(socket->filter_peers, filter->peers, filter->npeers * ETHER_ADDR_LEN);
+        socket->nfilter_peers = (int64_t)filter->npeers;
+        pthread_mutex_unlock(&socket->peers_mutex);
+    }
+    else {
+        /* frames sent by this host */
+        emit(&b, BPF_LD | BPF_B | BPF_ABS, JUMP_NEXT, JUMP_NEXT, (uint32_t)SKF_AD_OFF + SKF_AD_PKTTYPE);
+        emit(&b, BPF_JMP | BPF_JEQ | BPF_K, JUMP_DROP, JUMP_NEXT, PACKET_OUTGOING);
+        /* frames of this host looped back by the network, the loopback has no address */
+        if (memcmp(socket->src_addr, zero_addr, ETHER_ADDR_LEN) != 0) {
+            emit_addr_cmp(&b, ETHER_ADDR_LEN, socket->src_addr, JUMP_DROP);
+        }
+
+        /* frames of unknown sources */
+        for (size_t i = 0; i < filter->npeers; ++i) {
+            emit_addr_cmp(&b, ETHER_ADDR_LEN, filter->peers[i], JUMP_PEERS_OK);
+        }
+        if (filter->npeers > 0) emit(&b, BPF_JMP | BPF_JA, JUMP_NEXT, JUMP_NEXT, 0);
+    }
+
+    unsigned short peers_ok = b.len;
+
+    /* frames of unknown type or too short for their type */
+    emit(&b, BPF_LD | BPF_B | BPF_ABS, JUMP_NEXT, JUMP_NEXT, base);
+    for (size_t i = 0; i < filter->ntypes; ++i) {
+        emit(&b, BPF_JMP | BPF_JEQ | BPF_K, JUMP_NEXT, 2, filter->types[i]);
+        emit(&b, BPF_LD | BPF_W | BPF_LEN, JUMP_NEXT, JUMP_NEXT, 0);
+        emit(&b, BPF_JMP | BPF_JGE | BPF_K, JUMP_ACCEPT, JUMP_DROP, (uint32_t)(base + filter->lengths[i]));
+    }
+
+    unsigned short drop = b.len;
+    emit(&b, BPF_RET | BPF_K, JUMP_NEXT, JUMP_NEXT, 0);
+    unsigned short accept = b.len;
+    emit(&b, BPF_RET | BPF_K, JUMP_NEXT, JUMP_NEXT, 0xffffffff);
+
+    /* resolve the jumps, the unconditional one after the peers goes to drop */
+    for (unsigned short pc = 0; pc < b.len; ++pc) {
+        if (b.insns[pc].code == (BPF_JMP | BPF_JA)) {
+            b.insns[pc].k = (uint32_t)(drop - pc - 1);
+        }
+        else if (BPF_CLASS(b.insns[pc].code) == BPF_JMP) {
+            b.insns[pc].jt = resolve(b.jt[pc], pc, accept, drop, peers_ok);
+            b.insns[pc].jf = resolve(b.jf[pc], pc, accept, drop, peers_ok);
+        }
+    }
+
+    struct sock_fprog prog = { .len = b.len, .filter = b.insns };
+
+    return setsockopt(socket->fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+}
+
+/* read the frames of the receive ring, a call never goes past the end of a block */
+static int recv_ring(struct scnp_socket* socket, struct scnp_frame* frames, unsigned int vlen, int flags)
+{
+    /* the frames of the previous call are no longer used */
+    if (socket->rx_release) {
+        ATOMIC_STORE(&RX_BLOCK(socket, socket->rx_block)->hdr.bh1.block_status, TP_STATUS_KERNEL);
+        socket->rx_block = (socket->rx_block + 1) % RING_BLOCK_NR;
+        socket->rx_release = false;
+    }
+
+    /* wait for a block filled by the kernel */
+    while (socket->rx_left == 0) {
+        struct tpacket_block_desc * block = RX_BLOCK(socket, socket->rx_block);
+
+        if (ATOMIC_LOAD(&block->hdr.bh1.block_status) & TP_STATUS_USER) {
+            socket->rx_left = block->hdr.bh1.num_pkts;
+            socket->rx_frame = (uint8_t*)block + block->hdr.bh1.offset_to_first_pkt;
+            if (socket->rx_left == 0) socket->rx_release = true;
+            break;
+        }
+
+        if (flags & MSG_DONTWAIT) {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        struct pollfd pfd = { .fd = socket->fd, .events = POLLIN | POLLERR, .revents = 0 };
+        ATOMIC_FETCH_ADD(&socket->rx_calls, 1);
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR) return -1;
+    }
+
+    unsigned int n = 0;
+    while (n < vlen && socket->rx_left > 0) {
+        struct tpacket3_hdr * hdr = (struct tpacket3_hdr *) socket->rx_frame;
+        uint8_t * eth = socket->rx_frame + hdr->tp_mac;
+
+        if (hdr->tp_snaplen >= ETHER_HEADER_LEN) {
+            frames[n].buf = eth + ETHER_HEADER_LEN;
+            frames[n].len = hdr->tp_snaplen - ETHER_HEADER_LEN;
+            memcpy(frames[n].addr, eth + ETHER_ADDR_LEN, ETHER_ADDR_LEN);
+            ++n;
+        }
+
+        socket->rx_frame += hdr->tp_next_offset;
+        if (--socket->rx_left == 0) socket->rx_release = true;
+    }
+
+    /* the block contained no usable frame, read the next one */
+    if (n == 0) return recv_ring(socket, frames, vlen, flags);
+
+    return (int)n;
+}
+
+/* receive datagrams and give the handles of their sources */
+static int recv_udp(struct scnp_socket* socket, struct scnp_frame* frames, unsigned int vlen, int flags)
+{
+    struct mmsghdr          msgs[SCNP_SOCKET_BATCH];
+    struct iovec            iovecs[SCNP_SOCKET_BATCH];
+    struct sockaddr_storage addrs[SCNP_SOCKET_BATCH];
+    unsigned int            n = 0;
+
+    if (vlen > SCNP_SOCKET_BATCH) vlen = SCNP_SOCKET_BATCH;
+
+    /* read again while every datagram is dropped */
+    while (n == 0) {
+        memset(msgs, 0, vlen * sizeof(struct mmsghdr));
+
+        for (unsigned int i = 0; i < vlen; ++i) {
+            iovecs[i].iov_base = frames[i].buf;
+            iovecs[i].iov_len = frames[i].len;
+
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        ATOMIC_FETCH_ADD(&socket->rx_calls, 1);
+        int ret = recvmmsg(socket->fd, msgs, vlen, flags | MSG_WAITFORONE, NULL);
+        if (ret == -1) return -1;
+
+        int64_t now = udp_clock();
+
+        pthread_mutex_lock(&socket->peers_mutex);
+        for (int i = 0; i < ret; ++i) {
+            struct sockaddr_in6 src;
+            if (udp_map((struct sockaddr*) &addrs[i], msgs[i].msg_hdr.msg_namelen, &src)) continue;
+
+            /* an unknown source becomes a peer unless the filter names the accepted ones */
+            int64_t index = udp_find(socket, &src);
+            if (!udp_accepted(socket, index)) continue;
+            if (index == -1 && (index = udp_append(socket, &src, false, now)) == -1) continue;
+            socket->peer_seen[index] = now;
+
+            /* the accepted frames are moved first, the buffers are swapped to stay distinct */
+            uint8_t * buf = frames[n].buf;
+            frames[n].buf = frames[i].buf;
+            frames[i].buf = buf;
+            frames[n].len = msgs[i].msg_len;
+            udp_handle(index, frames[n].addr);
+            ++n;
+        }
+        pthread_mutex_unlock(&socket->peers_mutex);
+    }
+
+    return (int)n;
+}
+
+int scnp_socket_recvmmsg(struct scnp_socket* socket, struct scnp_frame* frames, unsigned int vlen, int flags)
+{
+    if (socket->mode == SCNP_SOCKET_RING) return recv_ring(socket, frames, vlen, flags);
+    if (socket->mode == SCNP_SOCKET_UDP) return recv_udp(socket, frames, vlen, flags);
+
+    struct mmsghdr     msgs[SCNP_SOCKET_BATCH];
+    struct iovec       iovecs[SCNP_SOCKET_BATCH];
+    struct sockaddr_ll addrs[SCNP_SOCKET_BATCH];
+
+    if (vlen > SCNP_SOCKET_BATCH) vlen = SCNP_SOCKET_BATCH;
+
+    memset(msgs, 0, vlen * sizeof(struct mmsghdr));
+
+    for (unsigned int i = 0; i < vlen; ++i) {
+        iovecs[i].iov_base = frames[i].buf;
+        iovecs[i].iov_len = frames[i].len;
+
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* block for the first frame only */
+    ATOMIC_FETCH_ADD(&socket->rx_calls, 1);
+    int ret = recvmmsg(socket->fd, msgs, vlen, flags | MSG_WAITFORONE, NULL);
+    if (ret == -1) return -1;
+
+    for (int i = 0; i < ret; ++i) {
+        frames[i].len = msgs[i].msg_len;
+        memcpy(frames[i].addr, addrs[i].sll_addr, ETHER_ADDR_LEN);
+    }
+
+    return ret;
+}
+
+/* write the frames in the transmit ring then ask the kernel to send them */
+static int send_ring(struct scnp_socket* socket, const struct scnp_frame* frames, unsigned int vlen, int flags)
+{
+    const uint16_t ethtype = htons(ETH_P_SCNP);
+    unsigned int   queued = 0;
+    int            err = EAGAIN;
+
+    while (queued < vlen) {
+        struct tpacket3_hdr * hdr = TX_FRAME(socket, socket->tx_frame);
+        const struct scnp_frame* f = &frames[queued];
+
+        /* a frame rejected by the kernel can be reused */
+        if (ATOMIC_LOAD(&hdr->tp_status) == TP_STATUS_WRONG_FORMAT) hdr->tp_status = TP_STATUS_AVAILABLE;
+        /* the ring is full */
+        if (ATOMIC_LOAD(&hdr->tp_status) != TP_STATUS_AVAILABLE) break;
+        /* the frame is dropped if it does not fit */
+        if (f->len > RING_FRAME_SIZE - TPACKET_ALIGN(sizeof(struct tpacket3_hdr)) - ETHER_HEADER_LEN) {
+            err = EMSGSIZE;
+            break;
+        }
+
+        uint8_t * data = TX_DATA(hdr);
+        memcpy(data, f->addr, ETHER_ADDR_LEN);
+        memcpy(data + ETHER_ADDR_LEN, socket->src_addr, ETHER_ADDR_LEN);
+        memcpy(data + 2 * ETHER_ADDR_LEN, &ethtype, sizeof(ethtype));
+        memcpy(data + ETHER_HEADER_LEN, f->buf, f->len);
+        hdr->tp_len = (uint32_t)(ETHER_HEADER_LEN + f->len);
+        hdr->tp_next_offset = 0;
+        ATOMIC_STORE(&hdr->tp_status, TP_STATUS_SEND_REQUEST);
+
+        socket->tx_frame = (socket->tx_frame + 1) % RING_FRAME_NR;
+        ++queued;
+    }
+
+    /* the ring is full, the caller keeps the frames for a later call */
+    if (queued == 0) {
+        errno = err;
+        return -1;
+    }
+
+    /* a blocking send returns once every frame of the ring is sent, the frames queued
+       are sent by the next call if it fails */
+    ATOMIC_FETCH_ADD(&socket->tx_calls, 1);
+    send(socket->fd, NULL, 0, flags);
+
+    return (int)queued;
+}
+
+/* send the datagrams written, return the first frame not completely sent or -1 */
+static int flush_udp(struct scnp_socket* socket, struct mmsghdr* msgs, const unsigned int* owners, unsigned int n, int flags)
+{
+    unsigned int sent = 0;
+
+    while (sent < n) {
+        ATOMIC_FETCH_ADD(&socket->tx_calls, 1);
+        int ret = sendmmsg(socket->fd, msgs + sent, n - sent, flags);
+        if (ret == -1 && errno == EINTR) continue;
+
+        /* a datagram refused for its peer (unreachable, filtered...) does not keep
+           the others, in particular the copies of a broadcast, from being sent */
+        if (ret == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS
+            && !scnp_socket_send_failed(errno)) {
+            ATOMIC_FETCH_ADD(&socket->tx_errors, 1);
+            ++sent;
+            continue;
+        }
+        if (ret <= 0) return (int)owners[sent];
+
+        sent += (unsigned int)ret;
+    }
+
+    return -1;
+}
+
+/* send a datagram per frame, or per peer for the broadcast address */
+static int send_udp(struct scnp_socket* socket, const struct scnp_frame* frames, unsigned int vlen, int flags)
+{
+    static const uint8_t    broadcast[ETHER_ADDR_LEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    struct mmsghdr          msgs[SCNP_SOCKET_BATCH];
+    struct iovec            iovecs[SCNP_SOCKET_BATCH];
+    struct sockaddr_storage addrs[SCNP_SOCKET_BATCH];
+    unsigned int            owners[SCNP_SOCKET_BATCH];
+    unsigned int            n = 0;
+    int64_t                 npeers = ATOMIC_LOAD(&socket->npeers);
+
+    for (unsigned int f = 0; f < vlen; ++f) {
+        /* a frame for an unknown handle is lost, as on a network */
+        int64_t first = udp_index(socket, frames[f].addr);
+        int64_t last = (first == -1) ? -1 : first + 1;
+        if (memcmp(frames[f].addr, broadcast, ETHER_ADDR_LEN) == 0) {
+            first = 0;
+            last = npeers;
+        }
+
+        for (int64_t p = first; p < last; ++p) {
+            if (n == SCNP_SOCKET_BATCH) {
+                int unsent = flush_udp(socket, msgs, owners, n, flags);
+                if (unsent != -1) return (unsent > 0) ? unsent : -1;
+                n = 0;
+            }
+
+            memset(&msgs[n], 0, sizeof(struct mmsghdr));
+            iovecs[n].iov_base = frames[f].buf;
+            iovecs[n].iov_len = frames[f].len;
+
+            /* a place given to another source is written under the mutex */
+            pthread_mutex_lock(&socket->peers_mutex);
+            msgs[n].msg_hdr.msg_name = &addrs[n];
+            msgs[n].msg_hdr.msg_namelen = udp_unmap(socket, &socket->peers[p], &addrs[n]);
+            pthread_mutex_unlock(&socket->peers_mutex);
+            msgs[n].msg_hdr.msg_iov = &iovecs[n];
+            msgs[n].msg_hdr.msg_iovlen = 1;
+            owners[n] = f;
+            ++n;
+        }
+    }
+
+    if (n > 0) {
+        int unsent = flush_udp(socket, msgs, owners, n, flags);
+        if (unsent != -1) return (unsent > 0) ? unsent : -1;
+    }
+
+    return (int)vlen;
+}
+
+int scnp_socket_sendmmsg(struct scnp_socket* socket, const struct scnp_frame* frames, unsigned int vlen, int flags)
+{
+    if (socket->mode == SCNP_SOCKET_RING) return send_ring(socket, frames, vlen, flags);
+    if (socket->mode == SCNP_SOCKET_UDP) return send_udp(socket, frames, vlen, flags);
+
+    struct mmsghdr     msgs[SCNP_SOCKET_BATCH];
+    struct iovec       iovecs[SCNP_SOCKET_BATCH];
+    struct sockaddr_ll addrs[SCNP_SOCKET_BATCH];
+    unsigned int       sent = 0;
+
+    while (sent < vlen) {
+        unsigned int n = vlen - sent;
+        if (n > SCNP_SOCKET_BATCH) n = SCNP_SOCKET_BATCH;
+
+        memset(msgs, 0, n * sizeof(struct mmsghdr));
+        memset(addrs, 0, n * sizeof(struct sockaddr_ll));
+
+        for (unsigned int i = 0; i < n; ++i) {
+            const struct scnp_frame* f = &frames[sent + i];
+
+            addrs[i].sll_family = AF_PACKET;
+            addrs[i].sll_protocol = htons(ETH_P_SCNP);
+            addrs[i].sll_ifindex = socket->if_index;
+            addrs[i].sll_halen = ETHER_ADDR_LEN;
+            memcpy(addrs[i].sll_addr, f->addr, ETHER_ADDR_LEN);
+
+            iovecs[i].iov_base = f->buf;
+            iovecs[i].iov_len = f->len;
+
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        ATOMIC_FETCH_ADD(&socket->tx_calls, 1);
+        int ret = sendmmsg(socket->fd, msgs, n, flags);
+        if (ret <= 0) return (sent > 0) ? (int)sent : -1;
+
+        sent += (unsigned int)ret;
+    }
+
+    return (int)sent;
+}
+
+bool scnp_socket_send_failed(int err)
+{
+    return err == EBADF || err == ENOTSOCK || err == ENODEV || err == ENXIO;
+}
@@ -1,3 +1,7 @@
+#ifdef __gnu_linux__
+#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
@@ -5,53 +9,246 @@
 
 #ifdef __gnu_linux__
 
-#include <values.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #else
 
+#include <windows.h>
+
 #define EXFULL ENOSPC
 
 #endif
 
+#include "atomic.h"
 #include "queue.h"
 
 
 struct scnp_queue * init_queue(void)
 {
+  return init_queue_capacity(QUEUE_CAPACITY);
+}
+
+struct scnp_queue * init_queue_capacity(size_t capacity)
+{
+  if (capacity == 0 || capacity > QUEUE_MAX_CAPACITY) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  /* the positions are masked, the capacity is rounded up to a power of two, with a single
+     element the next push would see it free before it is pulled */
+  int64_t size = 2;
+  while (size < (int64_t) capacity) size <<= 1;
+
   struct scnp_queue * q = malloc(sizeof(struct scnp_queue));
+  if (q == NULL) return NULL;
 
-  if (q != NULL) {
-    /* initialize queue fields */
-    pthread_mutex_init(&q->__mutex, NULL);
-    sem_init(&q->__sem, 0, 0);
-    q->head = NULL;
-    q->tail = NULL;
+  q->elts = malloc((size_t) size * sizeof(queue_elt));
+  if (q->elts == NULL) {
+    free(q);
+    return NULL;
   }
 
+#ifdef __gnu_linux__
+  q->__efd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE);
+  q->__room_efd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE);
+  if (q->__efd == -1 || q->__room_efd == -1) {
+    if (q->__efd != -1) close(q->__efd);
+    if (q->__room_efd != -1) close(q->__room_efd);
+    free(q->elts);
+    free(q);
+    return NULL;
+  }
+#else
+  sem_init(&q->__sem, 0, 0);
+  sem_init(&q->__room_sem, 0, 0);
+#endif
+
+  /* initialize queue fields */
+  q->capacity = size;
+  q->mask = size - 1;
+  for (int64_t i = 0; i < q->capacity; ++i) {
+    q->elts[i].sequence = i;
+  }
+  q->enqueue_pos = 0;
+  q->dequeue_pos = 0;
+  q->sleepers = 0;
+  q->waiters = 0;
+
   return q;
 }
 
 void free_queue(struct scnp_queue * queue)
 {
   if (queue != NULL) {
-    pthread_mutex_lock(&queue->__mutex);
-    /* remove and free elements in the queue */
-    queue_elt * e = queue->head;
-    while (e != NULL) {
-      queue_elt * x = e;
-      e = e->next;
-      free(x->packet);
-      free(x);
-    }
-
-    pthread_mutex_unlock(&queue->__mutex);
     /* destroy and free the queue */
-    pthread_mutex_destroy(&queue->__mutex);
+#ifdef __gnu_linux__
+    close(queue->__efd);
+    close(queue->__room_efd);
+#else
     sem_destroy(&queue->__sem);
+    sem_destroy(&queue->__room_sem);
+#endif
+    free(queue->elts);
     free(queue);
   }
 }
 
+long long int queue_clock(void)
+{
+#ifdef __gnu_linux__
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+#else
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  return (counter.QuadPart / frequency.QuadPart) * 1000000000LL +
+         (counter.QuadPart % frequency.QuadPart) * 1000000000LL / frequency.QuadPart;
+#endif
+}
+
+/* wake up to count threads sleeping in pull(), if any */
+static void wake(struct scnp_queue * queue, int64_t count)
+{
+  /* the elements must be visible before sleepers is read */
+  ATOMIC_FENCE();
+  int64_t sleepers = ATOMIC_LOAD(&queue->sleepers);
+  if (sleepers > 0) {
+    if (count > sleepers) count = sleepers;
+#ifdef __gnu_linux__
+    uint64_t tokens = (uint64_t) count;
+    if (write(queue->__efd, &tokens, sizeof(tokens)) == -1) errno = 0;
+#else
+    while (count-- > 0) sem_post(&queue->__sem);
+#endif
+  }
+}
+
+/* wake up a thread sleeping in push_wait(), if any */
+static void wake_room(struct scnp_queue * queue)
+{
+  /* the free element must be visible before waiters is read */
+  ATOMIC_FENCE();
+  if (ATOMIC_LOAD(&queue->waiters) > 0) {
+#ifdef __gnu_linux__
+    uint64_t token = 1;
+    if (write(queue->__room_efd, &token, sizeof(token)) == -1) errno = 0;
+#else
+    sem_post(&queue->__room_sem);
+#endif
+  }
+}
+
+#ifdef __gnu_linux__
+
+/* wait for one of the descriptors until the deadline of queue_clock(), -1 to wait without timeout */
+static int wait_fds(struct pollfd * pfds, nfds_t count, long long int deadline)
+{
+  struct timespec timeout, * ptimeout = NULL;
+  if (deadline >= 0) {
+    long long int remaining = deadline - queue_clock();
+    if (remaining < 0) remaining = 0;
+    timeout.tv_sec = remaining / 1000000000;
+    timeout.tv_nsec = remaining % 1000000000;
+    ptimeout = &timeout;
+  }
+
+  int ret = ppoll(pfds, count, ptimeout, NULL);
+  if (ret == -1) return (errno == EINTR) ? 0 : -1;
+  if (ret == 0) {
+    errno = ETIMEDOUT;
+    return -1;
+  }
+  return ret;
+}
+
+/* take the token given by wake() or wake_room() */
+static int take_token(int efd)
+{
+  uint64_t token;
+  if (read(efd, &token, sizeof(token)) == -1 && errno != EAGAIN) return -1;
+  return 0;
+}
+
+#endif
+
+/*
+ * sleep until wake(), or wake_room() if room is true, is called or the deadline of queue_clock()
+ * is reached, -1 to sleep without timeout
+ */
+static int sleep_on(struct scnp_queue * queue, bool room, long long int deadline)
+{
+#ifdef __gnu_linux__
+  int efd = room ? queue->__room_efd : queue->__efd;
+  struct pollfd pfd = { .fd = efd, .events = POLLIN, .revents = 0 };
+
+  int ret = wait_fds(&pfd, 1, deadline);
+  if (ret <= 0) return ret;
+
+  return take_token(efd);
+#else
+  sem_t * sem = room ? &queue->__room_sem : &queue->__sem;
+  if (deadline < 0) return sem_wait(sem);
+
+  /* the semaphore takes a time of the real time clock, computed at each call */
+  long long int remaining = deadline - queue_clock();
+  if (remaining < 0) remaining = 0;
+
+  struct timespec timeout;
+  timespec_get(&timeout, TIME_UTC);
+  long long int nsec = timeout.tv_nsec + remaining % 1000000000;
+  timeout.tv_sec += (time_t) (remaining / 1000000000 + nsec / 1000000000);
+  timeout.tv_nsec = (long) (nsec % 1000000000);
+
+  return sem_timedwait(sem, &timeout);
+#endif
+}
+
+/* check without blocking that the first element can be pulled */
+static bool is_ready(struct scnp_queue * queue)
+{
+  int64_t pos = ATOMIC_LOAD(&queue->dequeue_pos);
+  return ATOMIC_LOAD(&queue->elts[pos & queue->mask].sequence) == pos + 1;
+}
+
+/* remove the first element without blocking, returns false if queue is empty */
+static bool try_pull(struct scnp_queue * queue, struct scnp_packet * packet, uint8_t * addr)
+{
+  queue_elt * e;
+  int64_t pos = ATOMIC_LOAD(&queue->dequeue_pos);
+
+  for (;;) {
+    e = &queue->elts[pos & queue->mask];
+    int64_t diff = ATOMIC_LOAD(&e->sequence) - (pos + 1);
+
+    if (diff == 0) {
+      /* the element is ready, try to reserve it */
+      if (ATOMIC_CAS(&queue->dequeue_pos, &pos, pos + 1)) break;
+    }
+    else if (diff < 0) {
+      /* the element has not been pushed yet */
+      return false;
+    }
+    else {
+      /* another consumer took the element */
+      pos = ATOMIC_LOAD(&queue->dequeue_pos);
+    }
+  }
+
+  /* copy data of the element and release it for the next round */
+  memcpy(packet, &e->packet, sizeof(struct scnp_packet));
+  memcpy(addr, e->addr, ETHER_ADDR_LEN);
+  ATOMIC_STORE(&e->sequence, pos + queue->capacity);
+
+  wake_room(queue);
+
+  return true;
+}
+
 int push(struct scnp_queue * queue, const struct scnp_packet * packet, const uint8_t * addr)
 {
   if (queue == NULL) {
@@ -59,37 +256,114 @@ int push(struct scnp_queue * queue, const struct scnp_packet * packet, const uin
     return -1;
   }
 
-  /* verify the size of the queue */
-  int sval;
-  sem_getvalue(&queue->__sem, &sval);
-  if (sval >= SEM_VALUE_MAX) {
-    errno = EXFULL;
-    return -1;
-  }
+  queue_elt * e;
+  int64_t pos = ATOMIC_LOAD(&queue->enqueue_pos);
 
-  queue_elt * e = malloc(sizeof(queue_elt));
-  if (e == NULL) return -1;
+  for (;;) {
+    e = &queue->elts[pos & queue->mask];
+    int64_t diff = ATOMIC_LOAD(&e->sequence) - pos;
+
+    if (diff == 0) {
+      /* the element is free, try to reserve it */
+      if (ATOMIC_CAS(&queue->enqueue_pos, &pos, pos + 1)) break;
+    }
+    else if (diff < 0) {
+      /* the element of the previous round has not been pulled yet */
+      errno = EXFULL;
+      return -1;
+    }
+    else {
+      /* another producer took the element */
+      pos = ATOMIC_LOAD(&queue->enqueue_pos);
+    }
+  }
 
-  /* initialize a new element fields */
-  e->packet = malloc(sizeof(struct scnp_packet));
-  if (e->packet == NULL) return -1;
-  memcpy(e->packet, packet, sizeof(struct scnp_packet));
+  /* fill the element and publish it */
+  memcpy(&e->packet, packet, sizeof(struct scnp_packet));
   memcpy(e->addr, addr, ETHER_ADDR_LEN);
-  e->next = NULL;
+  ATOMIC_STORE(&e->sequence, pos + 1);
 
-  pthread_mutex_lock(&queue->__mutex);
+  wake(queue, 1);
 
-  /* insert the new element */
-  e->prev = queue->tail;
-  if (queue->tail != NULL) queue->tail->next = e;
-  else queue->head = e;
-  queue->tail = e;
+  return 0;
+}
 
-  sem_post(&queue->__sem);
+int push_wait(struct scnp_queue * queue, const struct scnp_packet * packet, const uint8_t * addr, long long int tout_nsec)
+{
+  if (push(queue, packet, addr) == 0) return 0;
+  if (errno != EXFULL || tout_nsec == 0) return -1;
 
-  pthread_mutex_unlock(&queue->__mutex);
+  long long int deadline = (tout_nsec < 0) ? -1 : queue_clock() + tout_nsec;
 
-  return 0;
+  for (;;) {
+    /* register as waiter then try again so that no pull is missed */
+    ATOMIC_FETCH_ADD(&queue->waiters, 1);
+    ATOMIC_FENCE();
+    int ret = push(queue, packet, addr);
+    int err = errno;
+
+    if (ret == 0 || err != EXFULL || (deadline >= 0 && queue_clock() >= deadline)) {
+      ATOMIC_FETCH_ADD(&queue->waiters, -1);
+      errno = err;
+      return ret;
+    }
+
+    ret = sleep_on(queue, true, deadline);
+    err = errno;
+    ATOMIC_FETCH_ADD(&queue->waiters, -1);
+
+    if (ret && err != ETIMEDOUT) {
+      errno = err;
+      return -1;
+    }
+  }
+}
+
+int push_batch(struct scnp_queue * queue, const struct scnp_packet * packets, const uint8_t (* addrs)[ETHER_ADDR_LEN], size_t count)
+{
+  if (queue == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (count == 0) return 0;
+
+  int64_t n;
+  int64_t pos = ATOMIC_LOAD(&queue->enqueue_pos);
+
+  for (;;) {
+    /* count the free elements following the position */
+    int64_t diff = 0;
+    for (n = 0; n < (int64_t) count && n < queue->capacity; ++n) {
+      diff = ATOMIC_LOAD(&queue->elts[(pos + n) & queue->mask].sequence) - (pos + n);
+      if (diff != 0) break;
+    }
+
+    if (n > 0) {
+      /* reserve every free element at once */
+      if (ATOMIC_CAS(&queue->enqueue_pos, &pos, pos + n)) break;
+    }
+    else if (diff < 0) {
+      /* the element of the previous round has not been pulled yet */
+      errno = EXFULL;
+      return -1;
+    }
+    else {
+      /* another producer took the element */
+      pos = ATOMIC_LOAD(&queue->enqueue_pos);
+    }
+  }
+
+  /* fill and publish the elements */
+  for (int64_t i = 0; i < n; ++i) {
+    queue_elt * e = &queue->elts[(pos + i) & queue->mask];
+    memcpy(&e->packet, &packets[i], sizeof(struct scnp_packet));
+    memcpy(e->addr, addrs[i], ETHER_ADDR_LEN);
+    ATOMIC_STORE(&e->sequence, pos + i + 1);
+  }
+
+  wake(queue, n);
+
+  return (int) n;
 }
 
 int pull(struct scnp_queue * queue, struct scnp_packet * packet, uint8_t * addr, long long int tout_nsec)
@@ -99,37 +373,153 @@ int pull(struct scnp_queue * queue, struct scnp_packet * packet, uint8_t * addr,
     return -1;
   }
 
-  /* verify the size of the queue */
-  if (tout_nsec < 0) {
-    if (sem_wait(&queue->__sem)) return -1;
+  if (try_pull(queue, packet, addr)) return 0;
+  if (tout_nsec == 0) {
+    errno = ETIMEDOUT;
+    return -1;
+  }
+
+  long long int deadline = (tout_nsec < 0) ? -1 : queue_clock() + tout_nsec;
+
+  for (;;) {
+    /* register as sleeper then check again so that no push is missed */
+    ATOMIC_FETCH_ADD(&queue->sleepers, 1);
+    ATOMIC_FENCE();
+    if (try_pull(queue, packet, addr)) {
+      ATOMIC_FETCH_ADD(&queue->sleepers, -1);
+      return 0;
+    }
+
+    if (deadline >= 0 && queue_clock() >= deadline) {
+      ATOMIC_FETCH_ADD(&queue->sleepers, -1);
+      errno = ETIMEDOUT;
+      return -1;
+    }
+
+    int ret = sleep_on(queue, false, deadline);
+    int err = errno;
+    ATOMIC_FETCH_ADD(&queue->sleepers, -1);
+
+    if (ret) {
+      /* a push may have happened right before the timeout */
+      if (try_pull(queue, packet, addr)) return 0;
+      errno = err;
+      return -1;
+    }
+    if (try_pull(queue, packet, addr)) return 0;
   }
-  else {
-    struct timespec timeout;
-    timeout.tv_sec = time(NULL) + tout_nsec / 1000000000;
-    timeout.tv_nsec = tout_nsec % 1000000000;
-    if (sem_timedwait(&queue->__sem, &timeout)) return -1;
+}
+
+/* index of the first queue with an element ready, -1 if there is none */
+static int ready_index(struct scnp_queue * const * queues, size_t count)
+{
+  for (size_t i = 0; i < count; ++i) {
+    if (is_ready(queues[i])) return (int) i;
   }
+  return -1;
+}
 
-  pthread_mutex_lock(&queue->__mutex);
+int queue_wait(struct scnp_queue * const * queues, size_t count, int cancel_fd, long long int tout_nsec)
+{
+  if (queues == NULL || count == 0 || count > QUEUE_WAIT_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (queues[i] == NULL) {
+      errno = EINVAL;
+      return -1;
+    }
+  }
 
-  /* copy data of the first element */
-  memcpy(packet, queue->head->packet, sizeof(struct scnp_packet));
-  memcpy(addr, queue->head->addr, ETHER_ADDR_LEN);
+#ifndef __gnu_linux__
+  /* a semaphore cannot be waited for with a file descriptor */
+  if (cancel_fd != -1) {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+#endif
 
-  /* remove the first element */
-  free(queue->head->packet);
-  if (queue->head == queue->tail) {
-    free(queue->head);
-    queue->head = NULL;
-    queue->tail = NULL;
+  int index = ready_index(queues, count);
+  if (index != -1) return index;
+  if (tout_nsec == 0) {
+    errno = ETIMEDOUT;
+    return -1;
   }
-  else {
-    queue->head = queue->head->next;
-    free(queue->head->prev);
-    queue->head->prev = NULL;
+
+  long long int deadline = (tout_nsec < 0) ? -1 : queue_clock() + tout_nsec;
+
+  for (;;) {
+    /* register as sleeper of every queue then check again so that no push is missed */
+    for (size_t i = 0; i < count; ++i) ATOMIC_FETCH_ADD(&queues[i]->sleepers, 1);
+    ATOMIC_FENCE();
+    index = ready_index(queues, count);
+
+    int ret = 0, err = 0;
+    bool cancelled = false;
+    if (index == -1 && deadline >= 0 && queue_clock() >= deadline) {
+      ret = -1;
+      err = ETIMEDOUT;
+    }
+    else if (index == -1) {
+#ifdef __gnu_linux__
+      struct pollfd pfds[QUEUE_WAIT_MAX + 1];
+      nfds_t nfds = 0;
+      for (size_t i = 0; i < count; ++i) {
+        pfds[nfds].fd = queues[i]->__efd;
+        pfds[nfds].events = POLLIN;
+        pfds[nfds++].revents = 0;
+      }
+      if (cancel_fd != -1) {
+        pfds[nfds].fd = cancel_fd;
+        pfds[nfds].events = POLLIN;
+        pfds[nfds++].revents = 0;
+      }
+
+      ret = wait_fds(pfds, nfds, deadline);
+      err = errno;
+      for (size_t i = 0; ret > 0 && i < count; ++i) {
+        if (pfds[i].revents & POLLIN) take_token(queues[i]->__efd);
+      }
+      /* the cancellation descriptor is left readable for the other waiters */
+      cancelled = ret > 0 && cancel_fd != -1 && (pfds[count].revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL));
+#else
+      /* a semaphore cannot be waited for with other ones, the others are checked after a slice */
+      long long int until = deadline;
+      if (count > 1) {
+        long long int slice = queue_clock() + QUEUE_WAIT_SLICE_NS;
+        if (until < 0 || slice < until) until = slice;
+      }
+      ret = sleep_on(queues[0], false, until);
+      err = errno;
+      if (ret < 0 && err == ETIMEDOUT && until != deadline) ret = 0;
+#endif
+    }
+
+    for (size_t i = 0; i < count; ++i) ATOMIC_FETCH_ADD(&queues[i]->sleepers, -1);
+
+    if (index != -1) return index;
+    if (cancelled) {
+      errno = ECANCELED;
+      return -1;
+    }
+
+    /* a push may have happened right before the timeout */
+    index = ready_index(queues, count);
+    if (index != -1) return index;
+    if (ret < 0) {
+      errno = err;
+      return -1;
+    }
   }
+}
 
-  pthread_mutex_unlock(&queue->__mutex);
+size_t queue_size(struct scnp_queue * queue)
+{
+  if (queue == NULL) return 0;
 
-  return 0;
+  int64_t size = ATOMIC_LOAD(&queue->enqueue_pos) - ATOMIC_LOAD(&queue->dequeue_pos);
+  if (size < 0) return 0;
+  if (size > queue->capacity) return (size_t) queue->capacity;
+  return (size_t) size;
 }
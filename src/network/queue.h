@@ -5,10 +5,10 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 #ifdef __gnu_linux__
 #include <net/ethernet.h>
-#include <pthread.h>
-#include <semaphore.h>
 #else
 #define ETHER_ADDR_LEN 6
 #include <pthread.h>
@@ -18,6 +18,21 @@ extern "C" {
 #include "scnp.h"
 
 
+/* Default number of elements a struct scnp_queue can store. Must be a power of two. */
+#define QUEUE_CAPACITY 1024
+
+/* Maximum number of elements given to init_queue_capacity() */
+#define QUEUE_MAX_CAPACITY (1 << 20)
+
+/* Size of a cache line, used to keep producer and consumer positions apart */
+#define QUEUE_CACHE_LINE 64
+
+/* Maximum number of queues given to queue_wait() */
+#define QUEUE_WAIT_MAX 8
+
+/* Interval at which queue_wait() checks the queues it cannot sleep on (Windows) */
+#define QUEUE_WAIT_SLICE_NS 1000000
+
 /**
  * @struct queue_elt
  * @brief Element of an struct scnp_queue.
@@ -25,38 +40,59 @@ extern "C" {
  * Structure used to store a SCNP packet and an ethernet address (source or
  * destination) in a queue.
  *
+ * @var sequence Position of the queue this element is ready for. It is used to
+ * know if the element is free to be pushed or ready to be pulled.
  * @var packet A SCNP packet that needs to be stored in a queue.
  * @var addr An address associated with the SCNP packet in the structure.
- * @var prev Pointer to the previous element in the queue.
- * @var next Pointer to the next element in the queue.
  */
 
 typedef struct queued_packet
 {
-  struct scnp_packet *packet;
+  int64_t sequence;
+  struct scnp_packet packet;
   uint8_t addr[ETHER_ADDR_LEN];
-  struct queued_packet *prev;
-  struct queued_packet *next;
 } queue_elt;
 
 /**
  * @struct struct scnp_queue
  * @brief Queue structure that stores queue_elt.
  *
- * Structure of queue used to store SCNP packet and an ethernet address.
+ * Fixed-capacity lock-free ring used to store SCNP packets and ethernet
+ * addresses. Any number of threads may push and pull at the same time.
+ * The positions of producers and consumers are kept on separate cache lines.
+ * A thread blocked in pull() sleeps on an eventfd (a semaphore on Windows)
+ * which is only signaled when at least one thread is sleeping. A thread
+ * blocked in push_wait() sleeps on another one, signaled when an element is
+ * pulled.
  *
- * @var head Pointer to the first element in the queue. It is the element that
- * is going to be pulled.
- * @var tail Pointer to the last element in the queue. It is the last element
- * that has been pushed.
+ * @var capacity Number of elements the queue can store.
+ * @var mask Mask applied to a position to get the index of an element.
+ * @var elts Ring of elements.
+ * @var enqueue_pos Position of the next element to push.
+ * @var dequeue_pos Position of the next element to pull.
+ * @var sleepers Number of threads sleeping in pull() or queue_wait().
+ * @var waiters Number of threads sleeping in push_wait().
  */
 
 struct scnp_queue
 {
-  pthread_mutex_t __mutex;
+  int64_t capacity;
+  int64_t mask;
+  queue_elt * elts;
+  char __pad0[QUEUE_CACHE_LINE];
+  int64_t enqueue_pos;
+  char __pad1[QUEUE_CACHE_LINE - sizeof(int64_t)];
+  int64_t dequeue_pos;
+  char __pad2[QUEUE_CACHE_LINE - sizeof(int64_t)];
+  int64_t sleepers;
+  int64_t waiters;
+#ifdef __gnu_linux__
+  int __efd;
+  int __room_efd;
+#else
   sem_t __sem;
-  queue_elt *head;
-  queue_elt *tail;
+  sem_t __room_sem;
+#endif
 };
 
 /**
@@ -64,7 +100,7 @@ struct scnp_queue
  * @brief Constructor of struct scnp_queue.
  *
  * Function that allocate memory for a pointer to a struct scnp_queue
- * and initialize its fields.
+ * and initialize its fields. The queue can store QUEUE_CAPACITY elements.
  *
  * @return On success returns an initialized pointer to a struct scnp_queue.
  * On error, returns NULL and errno is set appropriately
@@ -74,6 +110,22 @@ struct scnp_queue
 
 struct scnp_queue *init_queue(void);
 
+/**
+ * @fn struct scnp_queue * init_queue_capacity(size_t capacity)
+ * @brief Constructor of struct scnp_queue with a given capacity.
+ *
+ * Same as init_queue(), the queue can store at least capacity elements.
+ * The capacity is rounded up to the next power of two, at least 2.
+ *
+ * @return On success returns an initialized pointer to a struct scnp_queue.
+ * On error, returns NULL and errno is set appropriately
+ * @section Errors
+ * EINVAL capacity is 0 or above QUEUE_MAX_CAPACITY.
+ * ENOMEM Out of memory.
+ */
+
+struct scnp_queue *init_queue_capacity(size_t capacity);
+
 /**
  * @fn int free_queue(struct scnp_queue * queue)
  * @brief Destructor of struct scnp_queue.
@@ -102,12 +154,52 @@ void free_queue(struct scnp_queue *queue);
  * On error, returns -1 and errno is set appropriately.
  * @section Errors
  * EINVAL Invalid queue pointer. Maybe the queue was not initialized or was freed.
- * ENOMEM Out of memory.
  * EXFULL The queue is full. Pull an element before push a new one.
  */
 
 int push(struct scnp_queue *queue, const struct scnp_packet *packet, const uint8_t *addr);
 
+/**
+ * @fn int push_wait(struct scnp_queue * queue, const struct scnp_packet * packet, const uint8_t * addr, long long int tout_nsec)
+ * @brief Add an element at the end of a struct scnp_queue, waiting for a
+ * free place if it is full.
+ *
+ * Same as push(), but the function blocks until an element is pulled when
+ * the queue is full, for at most tout_nsec nanoseconds. If tout_nsec is
+ * negative, it blocks until the element is added.
+ *
+ * @return On success, returns 0.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * EINVAL Invalid queue pointer. Maybe the queue was not initialized or was freed.
+ * EXFULL The queue is still full when the timeout expires.
+ */
+
+int push_wait(struct scnp_queue *queue, const struct scnp_packet *packet, const uint8_t *addr, long long int tout_nsec);
+
+/**
+ * @fn int push_batch(struct scnp_queue * queue, const struct scnp_packet * packets, const uint8_t (* addrs)[ETHER_ADDR_LEN], size_t count)
+ * @brief Add several elements at the end of a struct scnp_queue.
+ *
+ * Same as push() for count elements. The places of the elements are reserved
+ * in one operation and sleeping threads are woken up once, so the elements
+ * are published together. If the queue cannot store every element, only
+ * the first ones are added.
+ *
+ * @param queue Pointer to the struct scnp_queue where the new elements will
+ * be inserted.
+ * @param packets SCNP data of the new elements.
+ * @param addrs Ethernet addresses of the new elements.
+ * @param count Number of elements to insert.
+ * @return On success, returns the number of elements added.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * EINVAL Invalid queue pointer. Maybe the queue was not initialized or was freed.
+ * EXFULL The queue is full. Pull an element before push a new one.
+ */
+
+int push_batch(struct scnp_queue *queue, const struct scnp_packet *packets, const uint8_t (*addrs)[ETHER_ADDR_LEN], size_t count);
+
 /**
  * @fn int pull(struct scnp_queue * queue, struct scnp_packet * packet, uint8_t * addr, long long int tout_nsec);
  * @brief Remove the first element of a struct scnp_queue.
@@ -116,7 +208,9 @@ int push(struct scnp_queue *queue, const struct scnp_packet *packet, const uint8
  * copy its data into the packet and the address in parameters.
  * If the queue is empty, this function will block the execution
  * for tout_nsec nanoseconds. If tout_nsec is negative, the execution will be
- * blocked until an element is inserted.
+ * blocked until an element is inserted. The deadline is computed once on
+ * queue_clock() with a nanosecond resolution, so changes of the real time
+ * clock do not alter it.
  *
  * @param queue Pointer to the struct scnp_queue where the element will be
  * removed.
@@ -134,6 +228,56 @@ int push(struct scnp_queue *queue, const struct scnp_packet *packet, const uint8
 
 int pull(struct scnp_queue *queue, struct scnp_packet *packet, uint8_t *addr, long long int tout_nsec);
 
+/**
+ * @fn int queue_wait(struct scnp_queue * const * queues, size_t count, int cancel_fd, long long int tout_nsec)
+ * @brief Wait until one of several queues is not empty.
+ *
+ * The element is not removed, pull() must be called on the queue returned.
+ * It may fail with ETIMEDOUT if another thread pulled the element first.
+ * The waiter can also be woken up by a readable file descriptor, which is
+ * not read so that every waiter sees the cancellation.
+ * On Windows, the thread sleeps on the first queue and checks the others
+ * every QUEUE_WAIT_SLICE_NS nanoseconds.
+ *
+ * @param queues Queues to wait for.
+ * @param count Number of queues, at most QUEUE_WAIT_MAX.
+ * @param cancel_fd File descriptor that cancels the wait when it is
+ * readable, for example an eventfd. -1 for none.
+ * @param tout_nsec Number of nanoseconds to wait. If negative, the function
+ * waits until an element is pushed or the wait is cancelled.
+ * @return On success, returns the index of a queue that is not empty.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * ECANCELED cancel_fd is readable.
+ * EINVAL Invalid queue pointer or number of queues.
+ * EOPNOTSUPP A file descriptor given on Windows.
+ * ETIMEDOUT The call timed out before a new element was pushed.
+ */
+
+int queue_wait(struct scnp_queue * const * queues, size_t count, int cancel_fd, long long int tout_nsec);
+
+/**
+ * @fn size_t queue_size(struct scnp_queue * queue)
+ * @brief Number of elements in a struct scnp_queue.
+ *
+ * The value is only a snapshot when other threads are pushing or pulling.
+ *
+ * @param queue Pointer to the struct scnp_queue.
+ * @return Number of elements in the queue, 0 if queue is NULL.
+ */
+
+size_t queue_size(struct scnp_queue *queue);
+
+/**
+ * @fn long long int queue_clock(void)
+ * @brief Current time of the clock used by the queues.
+ *
+ * @return Time in nanoseconds of a monotonic clock (CLOCK_MONOTONIC, or the
+ * performance counter on Windows).
+ */
+
+long long int queue_clock(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+
+#define REPLAY_WORDS (REPLAY_WINDOW / 64)
+
+struct replay_peer
+{
+  bool used;
+  uint8_t addr[ETHER_ADDR_LEN];
+  uint32_t highest;
+  uint64_t bitmap[REPLAY_WORDS]; // bit i is set if highest - i was received
+};
+
+struct replay_table
+{
+  struct replay_peer peers[REPLAY_MAX_PEERS];
+  int next_victim;
+};
+
+/* restart the window of a source at an identifier */
+static void reset_window(struct replay_peer * peer, uint32_t id)
+{
+  peer->highest = id;
+  memset(peer->bitmap, 0, sizeof(peer->bitmap));
+  peer->bitmap[0] = 1;
+}
+
+/* move the window forward by count identifiers */
+static void slide(struct replay_peer * peer, uint32_t count)
+{
+  if (count >= REPLAY_WINDOW) {
+    memset(peer->bitmap, 0, sizeof(peer->bitmap));
+    return;
+  }
+
+  uint32_t words = count / 64, bits = count % 64;
+  for (uint32_t i = REPLAY_WORDS; i-- > 0;) {
+    uint64_t value = 0;
+    if (i >= words) {
+      value = peer->bitmap[i - words] << bits;
+      if (bits > 0 && i > words) value |= peer->bitmap[i - words - 1] >> (64 - bits);
+    }
+    peer->bitmap[i] = value;
+  }
+}
+
+static struct replay_peer * find_peer(struct replay_table * replay, const uint8_t * addr)
+{
+  for (int i = 0; i < REPLAY_MAX_PEERS; ++i) {
+    if (replay->peers[i].used && memcmp(replay->peers[i].addr, addr, ETHER_ADDR_LEN) == 0) return &replay->peers[i];
+  }
+  return NULL;
+}
+
+struct replay_table * replay_new(void)
+{
+  struct replay_table * replay = malloc(sizeof(struct replay_table));
+  if (replay != NULL) replay_init(replay);
+  return replay;
+}
+
+void replay_free(struct replay_table * replay)
+{
+  free(replay);
+}
+
+void replay_init(struct replay_table * replay)
+{
+  memset(replay, 0, sizeof(struct replay_table));
+}
+
+bool replay_check(struct replay_table * replay, const uint8_t * src_addr, uint32_t id)
+{
+  struct replay_peer * peer = find_peer(replay, src_addr);
+
+  if (peer == NULL) {
+    /* take an unused place or the oldest one */
+    peer = &replay->peers[replay->next_victim];
+    replay->next_victim = (replay->next_victim + 1) % REPLAY_MAX_PEERS;
+    peer->used = true;
+    memcpy(peer->addr, src_addr, ETHER_ADDR_LEN);
+    reset_window(peer, id);
+    return true;
+  }
+
+  /* serial number arithmetic, the identifiers wrap around */
+  int32_t diff = (int32_t) (id - peer->highest);
+  if (diff > 0) {
+    slide(peer, (uint32_t) diff);
+    peer->highest = id;
+    peer->bitmap[0] |= 1;
+    return true;
+  }
+
+  /* a sender keeps far fewer packets in flight than the window, an identifier behind it is not
+     a retransmission: the source restarted its identifiers and its window restarts with them */
+  uint32_t offset = peer->highest - id;
+  if (offset >= REPLAY_WINDOW) {
+    reset_window(peer, id);
+    return true;
+  }
+
+  uint64_t mask = (uint64_t) 1 << (offset % 64);
+  if (peer->bitmap[offset / 64] & mask) return false;
+  peer->bitmap[offset / 64] |= mask;
+
+  return true;
+}
+
+void replay_forget(struct replay_table * replay, const uint8_t * src_addr, uint32_t id)
+{
+  struct replay_peer * peer = find_peer(replay, src_addr);
+  if (peer == NULL) return;
+
+  uint32_t offset = peer->highest - id;
+  if ((int32_t) offset < 0 || offset >= REPLAY_WINDOW) return;
+
+  peer->bitmap[offset / 64] &= ~((uint64_t) 1 << (offset % 64));
+}
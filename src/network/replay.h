@@ -0,0 +1,87 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "queue.h"
+
+/* Number of sources whose identifiers are remembered at the same time */
+#define REPLAY_MAX_PEERS 16
+
+/* Number of identifiers remembered before the highest one of a source. Must be a multiple of 64. */
+#define REPLAY_WINDOW 1024
+
+/**
+ * @struct replay_table
+ * @brief Identifiers received from each source, one table per SCNP session.
+ */
+
+struct replay_table;
+
+/**
+ * @fn struct replay_table * replay_new(void)
+ * @brief Create an empty table.
+ *
+ * @return The table, NULL if out of memory.
+ */
+
+struct replay_table * replay_new(void);
+
+/**
+ * @fn void replay_free(struct replay_table * replay)
+ * @brief Free a table.
+ */
+
+void replay_free(struct replay_table * replay);
+
+/**
+ * @fn void replay_init(struct replay_table * replay)
+ * @brief Forget the identifiers received from every source.
+ */
+
+void replay_init(struct replay_table * replay);
+
+/**
+ * @fn bool replay_check(struct replay_table * replay, const uint8_t * src_addr, uint32_t id)
+ * @brief Check that a packet needing acknowledgement was not already received.
+ *
+ * The identifiers of a source are compared to the highest one received with
+ * a sliding bitmap, so that the packets reordered inside the window are
+ * accepted once. An identifier ahead of the window moves it forward, and the
+ * first identifier of an unknown source starts its window. An identifier
+ * older than the window cannot be a retransmission, the source restarted
+ * its identifiers (a new session or another peer given its address): the
+ * window restarts at it. Must only be called by the receiving thread.
+ *
+ * @param src_addr Source ethernet address of the packet.
+ * @param id Identifier of the packet.
+ * @return true if the identifier is new, false if it is a duplicate.
+ */
+
+bool replay_check(struct replay_table * replay, const uint8_t * src_addr, uint32_t id);
+
+/**
+ * @fn void replay_forget(struct replay_table * replay, const uint8_t * src_addr, uint32_t id)
+ * @brief Forget an identifier accepted by replay_check(), so that its
+ * retransmission is accepted again.
+ *
+ * Used when the packet is dropped after the check. The window is not moved
+ * back, an identifier that left it or a forgotten source is ignored. Must
+ * only be called by the receiving thread.
+ *
+ * @param src_addr Source ethernet address of the packet.
+ * @param id Identifier of the packet.
+ */
+
+void replay_forget(struct replay_table * replay, const uint8_t * src_addr, uint32_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REPLAY_H */
@@ -0,0 +1,217 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sack.h"
+
+struct sack_peer
+{
+  bool used;
+  uint8_t addr[ETHER_ADDR_LEN];
+  struct scnp_sack sack;
+  long long int deadline;
+};
+
+struct sack_table
+{
+  pthread_mutex_t mutex;
+  long long int delay;
+  struct sack_peer peers[SACK_MAX_PEERS];
+  int pending;
+};
+
+static struct sack_peer * find_peer(struct sack_table * table, const uint8_t * addr)
+{
+  for (int i = 0; i < SACK_MAX_PEERS; ++i) {
+    if (table->peers[i].used && memcmp(table->peers[i].addr, addr, ETHER_ADDR_LEN) == 0) return &table->peers[i];
+  }
+  return NULL;
+}
+
+/* remove the acknowledgement of a peer from the table */
+static void take(struct sack_table * table, struct sack_peer * peer, struct sack_pending * pending)
+{
+  memcpy(pending->addr, peer->addr, ETHER_ADDR_LEN);
+  memcpy(&pending->sack, &peer->sack, sizeof(struct scnp_sack));
+  peer->used = false;
+  --table->pending;
+}
+
+void sack_start(struct scnp_sack * sack, uint32_t id)
+{
+  sack->type = SCNP_SACK;
+  sack->id = id;
+  sack->count = 1;
+  sack->bitmap = 0;
+}
+
+bool sack_merge(struct scnp_sack * sack, uint32_t id)
+{
+  /* serial number arithmetic, the identifiers wrap around */
+  uint32_t offset = id - sack->id;
+  if (offset < sack->count) return true;
+
+  if (id == sack->id - 1 && sack->count < UINT16_MAX) {
+    sack->id = id;
+    ++sack->count;
+    return true;
+  }
+
+  offset -= sack->count;
+  if (offset >= SACK_BITMAP_BITS) return false;
+  sack->bitmap |= (uint32_t) 1 << offset;
+
+  /* the identifiers received after the range extend it */
+  while ((sack->bitmap & 1) && sack->count < UINT16_MAX) {
+    ++sack->count;
+    sack->bitmap >>= 1;
+  }
+
+  return true;
+}
+
+bool sack_covers(const struct scnp_sack * sack, uint32_t id)
+{
+  uint32_t offset = id - sack->id;
+  if (offset < sack->count) return true;
+
+  offset -= sack->count;
+  return offset < SACK_BITMAP_BITS && (sack->bitmap >> offset) & 1;
+}
+
+uint32_t sack_ids(const struct scnp_sack * sack)
+{
+  uint32_t ids = sack->count;
+  for (uint32_t bits = sack->bitmap; bits != 0; bits &= bits - 1) ++ids;
+  return ids;
+}
+
+void sack_to_packet(const struct scnp_sack * sack, struct scnp_packet * packet)
+{
+  if (sack->count == 1 && sack->bitmap == 0) {
+    struct scnp_ack * ack = (struct scnp_ack *) packet;
+    ack->type = SCNP_ACK;
+    ack->id = sack->id;
+  }
+  else {
+    memcpy(packet, sack, sizeof(struct scnp_sack));
+    packet->type = SCNP_SACK;
+  }
+}
+
+struct sack_table * sack_new(long long int delay_ns)
+{
+  struct sack_table * table = malloc(sizeof(struct sack_table));
+  if (table == NULL) return NULL;
+
+  pthread_mutex_init(&table->mutex, NULL);
+  table->delay = delay_ns;
+  sack_init(table);
+
+  return table;
+}
+
+void sack_free(struct sack_table * table)
+{
+  if (table != NULL) {
+    pthread_mutex_destroy(&table->mutex);
+    free(table);
+  }
+}
+
+void sack_init(struct sack_table * table)
+{
+  pthread_mutex_lock(&table->mutex);
+  memset(table->peers, 0, sizeof(table->peers));
+  table->pending = 0;
+  pthread_mutex_unlock(&table->mutex);
+}
+
+int sack_add(struct sack_table * table, const uint8_t * addr, uint32_t id, long long int now, struct sack_pending * flushed)
+{
+  int ret = 0;
+
+  pthread_mutex_lock(&table->mutex);
+
+  struct sack_peer * peer = find_peer(table, addr);
+  if (peer != NULL && sack_merge(&peer->sack, id)) {
+    pthread_mutex_unlock(&table->mutex);
+    return 0;
+  }
+
+  /* the acknowledgement of the peer is sent as it is, or the oldest one makes room */
+  if (peer == NULL && table->pending == SACK_MAX_PEERS) {
+    peer = &table->peers[0];
+    for (int i = 1; i < SACK_MAX_PEERS; ++i) {
+      if (table->peers[i].deadline < peer->deadline) peer = &table->peers[i];
+    }
+  }
+  if (peer != NULL) {
+    take(table, peer, flushed);
+    ret |= SACK_FLUSHED;
+  }
+  else {
+    for (int i = 0; i < SACK_MAX_PEERS && peer == NULL; ++i) {
+      if (!table->peers[i].used) peer = &table->peers[i];
+    }
+  }
+
+  if (table->pending == 0) ret |= SACK_FIRST;
+
+  peer->used = true;
+  memcpy(peer->addr, addr, ETHER_ADDR_LEN);
+  sack_start(&peer->sack, id);
+  peer->deadline = now + table->delay;
+  ++table->pending;
+
+  pthread_mutex_unlock(&table->mutex);
+
+  return ret;
+}
+
+bool sack_take(struct sack_table * table, const uint8_t * addr, struct scnp_sack * sack)
+{
+  struct sack_pending pending;
+
+  pthread_mutex_lock(&table->mutex);
+
+  struct sack_peer * peer = (table->pending > 0) ? find_peer(table, addr) : NULL;
+  if (peer != NULL) take(table, peer, &pending);
+
+  pthread_mutex_unlock(&table->mutex);
+
+  if (peer != NULL) memcpy(sack, &pending.sack, sizeof(struct scnp_sack));
+  return peer != NULL;
+}
+
+int sack_expire(struct sack_table * table, long long int now, struct sack_pending * expired, int max)
+{
+  int n = 0;
+
+  pthread_mutex_lock(&table->mutex);
+
+  for (int i = 0; table->pending > 0 && i < SACK_MAX_PEERS && n < max; ++i) {
+    struct sack_peer * peer = &table->peers[i];
+    if (peer->used && peer->deadline <= now) take(table, peer, &expired[n++]);
+  }
+
+  pthread_mutex_unlock(&table->mutex);
+
+  return n;
+}
+
+long long int sack_next_deadline(struct sack_table * table)
+{
+  long long int deadline = -1;
+
+  pthread_mutex_lock(&table->mutex);
+
+  for (int i = 0; table->pending > 0 && i < SACK_MAX_PEERS; ++i) {
+    struct sack_peer * peer = &table->peers[i];
+    if (peer->used && (deadline == -1 || peer->deadline < deadline)) deadline = peer->deadline;
+  }
+
+  pthread_mutex_unlock(&table->mutex);
+
+  return deadline;
+}
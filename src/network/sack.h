@@ -0,0 +1,161 @@
+#ifndef SACK_H
+#define SACK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "scnp.h"
+
+/* Number of peers whose acknowledgements wait at the same time */
+#define SACK_MAX_PEERS 16
+
+/* Results of sack_add() */
+#define SACK_FLUSHED 1 // an acknowledgement must be sent at once
+#define SACK_FIRST 2   // no other acknowledgement was waiting
+
+/**
+ * @struct sack_pending
+ * @brief Acknowledgement to send to a peer.
+ *
+ * @var addr Ethernet address of the peer.
+ * @var sack Identifiers acknowledged.
+ */
+
+struct sack_pending
+{
+  uint8_t addr[ETHER_ADDR_LEN];
+  struct scnp_sack sack;
+};
+
+/**
+ * @struct sack_table
+ * @brief Acknowledgements delayed to be merged, one table per SCNP session.
+ *
+ * The functions taking a table are thread-safe.
+ */
+
+struct sack_table;
+
+/**
+ * @fn void sack_start(struct scnp_sack * sack, uint32_t id)
+ * @brief Initialize a SCNP_SACK acknowledging a single identifier.
+ */
+
+void sack_start(struct scnp_sack * sack, uint32_t id);
+
+/**
+ * @fn bool sack_merge(struct scnp_sack * sack, uint32_t id)
+ * @brief Acknowledge one more identifier with a SCNP_SACK.
+ *
+ * The identifier extends the range when it follows or precedes it, or is
+ * set in the bitmap. The bits that follow the range are moved into it.
+ *
+ * @return true if the identifier is acknowledged, false if it is too far
+ * from the range.
+ */
+
+bool sack_merge(struct scnp_sack * sack, uint32_t id);
+
+/**
+ * @fn bool sack_covers(const struct scnp_sack * sack, uint32_t id)
+ * @brief Check that a SCNP_SACK acknowledges an identifier.
+ */
+
+bool sack_covers(const struct scnp_sack * sack, uint32_t id);
+
+/**
+ * @fn uint32_t sack_ids(const struct scnp_sack * sack)
+ * @brief Number of identifiers acknowledged by a SCNP_SACK.
+ */
+
+uint32_t sack_ids(const struct scnp_sack * sack);
+
+/**
+ * @fn void sack_to_packet(const struct scnp_sack * sack, struct scnp_packet * packet)
+ * @brief Smallest packet for an acknowledgement, a SCNP_ACK when a single
+ * identifier is acknowledged, the SCNP_SACK otherwise.
+ */
+
+void sack_to_packet(const struct scnp_sack * sack, struct scnp_packet * packet);
+
+/**
+ * @fn struct sack_table * sack_new(long long int delay_ns)
+ * @brief Create an empty table.
+ *
+ * @param delay_ns Time an acknowledgement waits for the next ones.
+ * @return The table, NULL if out of memory.
+ */
+
+struct sack_table * sack_new(long long int delay_ns);
+
+/**
+ * @fn void sack_free(struct sack_table * table)
+ * @brief Free a table, the waiting acknowledgements are dropped.
+ */
+
+void sack_free(struct sack_table * table);
+
+/**
+ * @fn void sack_init(struct sack_table * table)
+ * @brief Drop the waiting acknowledgements.
+ */
+
+void sack_init(struct sack_table * table);
+
+/**
+ * @fn int sack_add(struct sack_table * table, const uint8_t * addr, uint32_t id, long long int now, struct sack_pending * flushed)
+ * @brief Acknowledge an identifier received from a peer.
+ *
+ * The identifier is merged into the acknowledgement waiting for the peer.
+ * Otherwise a new one waits until now plus the delay of the table. It takes
+ * the place of the one of the peer when the identifier cannot be merged, or
+ * of the acknowledgement waiting for the longest time when every peer has
+ * one. That acknowledgement is written in flushed.
+ *
+ * @param now Current time on the queue_clock().
+ * @return SACK_FLUSHED if flushed must be sent, SACK_FIRST if the table was
+ * empty, or them both. 0 otherwise.
+ */
+
+int sack_add(struct sack_table * table, const uint8_t * addr, uint32_t id, long long int now, struct sack_pending * flushed);
+
+/**
+ * @fn bool sack_take(struct sack_table * table, const uint8_t * addr, struct scnp_sack * sack)
+ * @brief Take the acknowledgement waiting for a peer, to send it with another
+ * packet.
+ *
+ * @return true if an acknowledgement was waiting.
+ */
+
+bool sack_take(struct sack_table * table, const uint8_t * addr, struct scnp_sack * sack);
+
+/**
+ * @fn int sack_expire(struct sack_table * table, long long int now, struct sack_pending * expired, int max)
+ * @brief Take the acknowledgements whose delay has expired.
+ *
+ * @param now Current time on the queue_clock().
+ * @param expired Array receiving the acknowledgements.
+ * @param max Size of the array.
+ * @return The number of acknowledgements taken.
+ */
+
+int sack_expire(struct sack_table * table, long long int now, struct sack_pending * expired, int max);
+
+/**
+ * @fn long long int sack_next_deadline(struct sack_table * table)
+ * @brief Time at which the next waiting acknowledgement must be sent.
+ *
+ * @return Time in nanoseconds on the queue_clock(), -1 if none is waiting.
+ */
+
+long long int sack_next_deadline(struct sack_table * table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SACK_H */
@@ -5,61 +5,231 @@
 #include <errno.h>
 #include <semaphore.h>
 
+#ifdef __gnu_linux__
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+#include "atomic.h"
 #include "queue.h"
+#include "inflight.h"
+#include "replay.h"
+#include "sack.h"
 #include "interface.h"
-#include "crypto.h"
+#include "codec.h"
 #include "scnp.h"
 
-#define ID_MAX_INCR 0x100000
-#define ACK_TIMEOUT_NS 1000000000
-#define ACK_MAX_TRIES 3
 #define SESSION_TIMEOUT 1
 
+/* maximum number of packets sent by the sending thread in one system call */
+#define SEND_BATCH_MAX 32
+
+/* maximum number of frames taken by the receiving thread in one system call */
+#define RECV_BATCH_MAX 32
+
+/* maximum time a key waits for room in its lane of the sending queue, in ns */
+#define KEY_WAIT_NS 100000000LL
+
+/* delay before the frames a busy socket could not send are tried again, in ns */
+#define SEND_RETRY_NS 1000000LL
+
+/* type of the elements of the sending queue that only wake the sending thread up */
+#define WAKE_TYPE 0x00
+
+/* codes of the buttons, BTN_MISC to the last code before KEY_OK in linux/input-event-codes.h */
+#define BUTTON_FIRST 0x100
+#define BUTTON_LAST 0x15f
+
+/* frame of a packet of the batch not built yet, or not built because it cannot be encoded */
+#define NO_FRAME (SEND_BATCH_MAX * SCNP_MAX_KEY_COPIES)
+#define DROPPED_FRAME -1
+
+/*
+ * SCNP_TUNING_LOW_LATENCY: a short busy poll before sleeping, the interactive
+ * band of the queueing discipline (TC_PRIO_INTERACTIVE), room for bursts of
+ * received frames and a send buffer small enough not to queue frames.
+ */
+#define TUNING_BUSY_POLL_US 50
+#define TUNING_PRIORITY 6
+#define TUNING_RCVBUF (256 * 1024)
+#define TUNING_SNDBUF (64 * 1024)
+
 #ifdef _WIN32
 #pragma comment(lib, "Ws2_32.lib")
 #define sleep(S) Sleep(S * 1000)
 #endif
 
-/* information used by all threads */
-static struct
+#ifndef __gnu_linux__
+#define EXFULL ENOSPC
+#endif
+
+/* information used by all threads of a session */
+struct scnp_session
 {
+  unsigned int        if_index;
+  int                 socket_mode;
+  uint16_t            udp_port;
   struct scnp_socket  socket;
+  struct scnp_tuning  tuning; // options in effect on the socket
   struct scnp_queue * rqueue;
-  struct scnp_queue * aqueue;
-  struct scnp_queue * squeue;
+  struct scnp_queue * slanes[SCNP_LANES]; // sending queue, one lane per priority
   pthread_t rthread;
   bool is_rthread_running;
+  bool is_rthread_created;
   pthread_t sthread;
   bool is_sthread_running;
+  bool is_sthread_created;
+  pthread_t mthread;
   bool stop_mthread;
-} thread_info = {
+  bool direct_send;
+  int engine;
+  int64_t poll_fd;            // signaled while received packets wait, -1 until scnp_poll_fd()
+  int64_t poll_signaled;
+  pthread_mutex_t send_mutex; // held while packets are built and sent
+  int64_t queued;             // packets of the sending queue not sent yet
+  size_t  lane_capacity[SCNP_LANES];
+  size_t  recv_capacity;
+  int64_t lane_depth[SCNP_LANES];
+  int64_t lane_sent[SCNP_LANES];
+  int64_t lane_high_water[SCNP_LANES];
+  int64_t recv_high_water;
+  int64_t movements_overflowed;
+  int64_t packets_sent;
+  int64_t packets_received;
+  int64_t movements_merged;
+  int64_t packets_batched;
+  int64_t direct_sends;
+  int64_t duplicates_dropped;
+  int64_t fast_retransmits;
+  int64_t acks_sent;
+  int64_t acks_piggybacked;
+  int64_t ids_acked;
+  int64_t copies_sent;
+  int64_t recv_dropped;
+  int64_t send_errors;
+
+  /* packets waiting for an acknowledgement, identifiers already received and acknowledgements delayed */
+  struct inflight_table * inflight;
+  struct replay_table *   replay;
+  struct sack_table *     sacks;
+  long long int           ack_delay;
+  int                     key_copies; // frames each key is sent in, see struct scnp_options
+
+  /* relative movements that did not fit in their full lane, sent once the lane is emptied */
+  struct
+  {
+    pthread_mutex_t    mutex;
+    bool               pending;
+    struct scnp_packet motion;
+    uint8_t            addr[ETHER_ADDR_LEN];
+  } overflow;
+
+  /* peers whose management packets advertise MNG_COMPACT, the others get SCNP_MOV and frames of one packet */
+  struct
+  {
+    pthread_mutex_t mutex;
+    int             count;
+    int             next; // place given to the next peer once the table is full
+    uint8_t         addrs[SCNP_MAX_PEERS][ETHER_ADDR_LEN];
+  } compact;
+
+  /* packets to send in the next system call */
+  struct
+  {
+    struct scnp_packet packets[SEND_BATCH_MAX];
+    uint8_t            addrs[SEND_BATCH_MAX][ETHER_ADDR_LEN];
+    int                size;
+  } batch;
+
+  /* frames of the batch, encoded without allocation */
+  uint8_t frame_bufs[SEND_BATCH_MAX][MAX_PACKET_LENGTH];
+
+#ifdef __gnu_linux__
+  /* descriptors of the event loop, owned by open_session and close_session */
+  struct
+  {
+    int     epfd;
+    int     tfd;       // timer of the management packets and the retransmissions
+    int     sfd;       // signaled when packets are submitted
+    int64_t submitted; // true while sfd is signaled
+    int64_t stop;
+    bool    started;
+  } loop;
+#endif
+};
+
+/* session used by scnp_start and the functions without session */
+static struct scnp_session default_session = {
     .rqueue = NULL,
-    .aqueue = NULL,
-    .squeue = NULL,
+    .slanes = { NULL },
     .is_rthread_running = false,
     .is_sthread_running = false,
-    .stop_mthread = true
+    .is_rthread_created = false,
+    .is_sthread_created = false,
+    .stop_mthread = true,
+    .direct_send = false,
+    .engine = SCNP_ENGINE_THREADS,
+    .poll_fd = -1,
+    .poll_signaled = 0,
+    .send_mutex = PTHREAD_MUTEX_INITIALIZER,
+    .inflight = NULL,
+    .replay = NULL,
+    .overflow = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .pending = false
+    },
+    .compact = {
+        .mutex = PTHREAD_MUTEX_INITIALIZER,
+        .count = 0
+    },
+#ifdef __gnu_linux__
+    .loop = {
+        .epfd = -1,
+        .tfd = -1,
+        .sfd = -1,
+        .started = false
+    }
+#endif
 };
 
-uint32_t current_id; // current identifier for packet that need acknowledgement
-uint8_t cypher_key[] = {0, 0};
+/* open sessions and sources accepted by their sockets, every source is accepted if there is none */
+static struct
+{
+  pthread_mutex_t        mutex;
+  struct scnp_session *  sessions[SCNP_MAX_SESSIONS];
+  size_t                 count;
+  size_t                 npeers;
+  uint8_t                peers[SCNP_MAX_PEERS][ETHER_ADDR_LEN];
+} registry = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .count = 0,
+    .npeers = 0
+};
 
 /* parameters of the sending and receiving threads */
 typedef struct
 {
-  int if_index;
-  sem_t thread_cnt; // used to resume scnp_start after the thread is launched
+  struct scnp_session * session;
+  sem_t thread_cnt; // used to resume open_session after the thread is launched
+  int error;        // set by the event loop when it cannot be initialized
 } param_t;
 
-static int stop_and_fail(void)
+static void close_session(struct scnp_session * s);
+
+static int close_and_fail(struct scnp_session * s)
 {
-  scnp_stop();
+  close_session(s);
   return -1;
 }
 
 static void * recv_packets(void * arg);
 static void * send_packets(void * arg);
 static void * manage(void * arg);
+static int start_loop(struct scnp_session * s, param_t * param);
+static void stop_loop(struct scnp_session * s);
 
 void scnp_set_key(const char * key)
 {
@@ -67,55 +237,271 @@ void scnp_set_key(const char * key)
   else    memset(cypher_key, 0, sizeof(cypher_key));
 }
 
-int scnp_start(unsigned int if_index, const char * key)
+/* drop in the kernel the frames that recv_packets would reject, called with the registry locked */
+static int apply_filter(struct scnp_session * s)
+{
+  static const uint8_t types[] = { SCNP_KEY, SCNP_MOV, SCNP_OUT, SCNP_MOT, SCNP_MNG, SCNP_SACK, SCNP_ACK };
+  struct scnp_filter filter;
+
+  filter.ntypes = sizeof(types);
+  for (size_t i = 0; i < sizeof(types); ++i) {
+    filter.types[i] = types[i];
+    filter.lengths[i] = (types[i] == SCNP_MNG) ? MNG_BASE_LENGTH : packet_length(types[i]);
+  }
+  /* the packets of a batch are checked when it is unpacked */
+  filter.types[filter.ntypes] = SCNP_BATCH;
+  filter.lengths[filter.ntypes] = BATCH_LENGTH;
+  ++filter.ntypes;
+  /* the peers of a UDP session have handles of their own */
+  filter.npeers = (s->socket_mode == SCNP_SOCKET_UDP) ? 0 : registry.npeers;
+  memcpy(filter.peers, registry.peers, filter.npeers * ETHER_ADDR_LEN);
+
+  return scnp_socket_set_filter(&s->socket, &filter);
+}
+
+int scnp_set_peers(const uint8_t (* addrs)[ETHER_ADDR_LEN], size_t count)
+{
+  if (count > SCNP_MAX_PEERS || (count > 0 && addrs == NULL)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  int ret = 0;
+  pthread_mutex_lock(&registry.mutex);
+
+  registry.npeers = count;
+  if (count > 0) memcpy(registry.peers, addrs, count * ETHER_ADDR_LEN);
+
+  /* regenerate the filters of the running sessions */
+  for (size_t i = 0; i < registry.count; ++i) {
+    if (scnp_socket_opened(&registry.sessions[i]->socket) && apply_filter(registry.sessions[i])) ret = -1;
+  }
+
+  pthread_mutex_unlock(&registry.mutex);
+
+  return ret;
+}
+
+/* whether two sessions would receive the same frames */
+static bool same_endpoint(const struct scnp_session * a, const struct scnp_session * b)
+{
+  bool a_udp = a->socket_mode == SCNP_SOCKET_UDP;
+  bool b_udp = b->socket_mode == SCNP_SOCKET_UDP;
+
+  if (a_udp != b_udp) return false;
+  if (a_udp) return a->udp_port == b->udp_port;
+
+  return a->if_index == b->if_index;
+}
+
+/* add a session to the registry, one session per interface or UDP port */
+static int register_session(struct scnp_session * s)
+{
+  int ret = 0;
+  pthread_mutex_lock(&registry.mutex);
+
+  for (size_t i = 0; i < registry.count; ++i) {
+    if (same_endpoint(registry.sessions[i], s)) {
+      errno = EALREADY;
+      ret = -1;
+    }
+  }
+  if (ret == 0 && registry.count == SCNP_MAX_SESSIONS) {
+    errno = EXFULL;
+    ret = -1;
+  }
+  if (ret == 0) registry.sessions[registry.count++] = s;
+
+  pthread_mutex_unlock(&registry.mutex);
+  return ret;
+}
+
+/* remove a session from the registry, the key is reset once the last session is closed */
+static void unregister_session(struct scnp_session * s)
+{
+  pthread_mutex_lock(&registry.mutex);
+
+  for (size_t i = 0; i < registry.count; ++i) {
+    if (registry.sessions[i] == s) {
+      registry.sessions[i] = registry.sessions[--registry.count];
+      break;
+    }
+  }
+  if (registry.count == 0) memset(cypher_key, 0, sizeof(cypher_key));
+
+  pthread_mutex_unlock(&registry.mutex);
+}
+
+static int open_session(struct scnp_session * s, unsigned int if_index, const char * key, const struct scnp_options * options)
 {
+  /* a structure filled with zeros gives the default options */
+  struct scnp_options opt;
+  if (options != NULL) memcpy(&opt, options, sizeof(struct scnp_options));
+  else                 memset(&opt, 0, sizeof(struct scnp_options));
+
+  /* the retransmission timeout needs a floor below its ceiling */
+  long long int rto_min = (opt.rto_min_ns != 0) ? opt.rto_min_ns : RTO_MIN_NS;
+  long long int rto_max = (opt.rto_max_ns != 0) ? opt.rto_max_ns : RTO_MAX_NS;
+  if (rto_min < 0 || rto_max < 0 || rto_min > rto_max) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* a delayed acknowledgement must arrive before the retransmission */
+  if (opt.ack_delay_ns < 0 || (opt.ack_delay_ns > 0 && opt.ack_delay_ns >= rto_min)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (opt.engine != SCNP_ENGINE_THREADS && opt.engine != SCNP_ENGINE_EPOLL) {
+    errno = EINVAL;
+    return -1;
+  }
+#ifndef __gnu_linux__
+  if (opt.engine == SCNP_ENGINE_EPOLL) {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+#endif
+
+  if (opt.key_copies < 0 || opt.key_copies > SCNP_MAX_KEY_COPIES) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* the queues are created by the threads, their capacities are checked before */
+  bool capacity_valid = opt.recv_capacity <= QUEUE_MAX_CAPACITY;
+  for (int lane = 0; lane < SCNP_LANES; ++lane) {
+    if (opt.lane_capacity[lane] > QUEUE_MAX_CAPACITY) capacity_valid = false;
+  }
+  if (!capacity_valid) {
+    errno = EINVAL;
+    return -1;
+  }
+
   /* do not start if it is already started */
   if (
-      scnp_socket_opened(&thread_info.socket) ||
-      thread_info.is_rthread_running ||
-      thread_info.is_sthread_running
+      scnp_socket_opened(&s->socket) ||
+      s->is_rthread_running ||
+      s->is_sthread_running
       ) {
     errno = EALREADY;
     return -1;
   }
 
-  /* verify interface existence */
-  if (!interface_exists(if_index)) {
+  /* verify interface existence, a UDP session may listen on every interface */
+  bool any_interface = opt.socket_mode == SCNP_SOCKET_UDP && if_index == 0;
+  if (!any_interface && !interface_exists(if_index)) {
     if (errno == 0) errno = ENODEV;
     return -1;
   }
 
+  /* only one session per interface or UDP port */
+  s->if_index = if_index;
+  s->socket_mode = opt.socket_mode;
+  s->udp_port = (opt.udp_port != 0) ? opt.udp_port : SCNP_UDP_PORT;
+  s->engine = opt.engine;
+  if (register_session(s)) return -1;
+
   /* open a socket to send and receive SCNP data */
+  int opened = (opt.socket_mode == SCNP_SOCKET_UDP) ?
+    scnp_socket_open_udp(&s->socket, (int) if_index, s->udp_port) :
+    scnp_socket_open_mode(&s->socket, (int) if_index, opt.socket_mode);
 
-  if (scnp_socket_open(&thread_info.socket, if_index)) {
-      return stop_and_fail();
+  if (opened) {
+      return close_and_fail(s);
   }
 
-  /* initialize the current identifier */
-  srand((unsigned int)time(NULL));
-  current_id = rand();
+  /* drop unwanted frames before they reach the receiving thread */
+  pthread_mutex_lock(&registry.mutex);
+  int filtered = apply_filter(s);
+  pthread_mutex_unlock(&registry.mutex);
+  if (filtered) {
+      return close_and_fail(s);
+  }
+
+  /* the tuning is best effort, the options refused are seen in the ones in effect */
+  scnp_socket_tune(&s->socket, &opt.tuning, &s->tuning);
+
+  /* reset the counters */
+  ATOMIC_STORE(&s->packets_sent, 0);
+  ATOMIC_STORE(&s->packets_received, 0);
+  ATOMIC_STORE(&s->movements_merged, 0);
+  ATOMIC_STORE(&s->packets_batched, 0);
+  ATOMIC_STORE(&s->direct_sends, 0);
+  ATOMIC_STORE(&s->duplicates_dropped, 0);
+  ATOMIC_STORE(&s->acks_sent, 0);
+  ATOMIC_STORE(&s->acks_piggybacked, 0);
+  ATOMIC_STORE(&s->ids_acked, 0);
+  ATOMIC_STORE(&s->copies_sent, 0);
+  ATOMIC_STORE(&s->recv_dropped, 0);
+  ATOMIC_STORE(&s->send_errors, 0);
+  ATOMIC_STORE(&s->fast_retransmits, 0);
+  ATOMIC_STORE(&s->queued, 0);
+  for (int lane = 0; lane < SCNP_LANES; ++lane) {
+    ATOMIC_STORE(&s->lane_depth[lane], 0);
+    ATOMIC_STORE(&s->lane_sent[lane], 0);
+    ATOMIC_STORE(&s->lane_high_water[lane], 0);
+    s->lane_capacity[lane] = (opt.lane_capacity[lane] != 0) ? opt.lane_capacity[lane] : QUEUE_CAPACITY;
+  }
+  ATOMIC_STORE(&s->recv_high_water, 0);
+  ATOMIC_STORE(&s->movements_overflowed, 0);
+  s->recv_capacity = (opt.recv_capacity != 0) ? opt.recv_capacity : QUEUE_CAPACITY;
+  s->direct_send = opt.direct_send;
+  s->key_copies = (opt.key_copies > 1) ? opt.key_copies : 1;
+  s->overflow.pending = false;
+  s->compact.count = 0;
+  s->compact.next = 0;
+
+  /* initialize the identifiers and the in-flight window, the tables of a previous start are replaced */
+  /* a session restarted within the same second does not reuse the identifiers of the previous one */
+  srand((unsigned int)time(NULL) ^ (unsigned int)queue_clock());
+  inflight_free(s->inflight);
+  s->inflight = inflight_new(rto_min, rto_max);
+  if (s->replay == NULL) s->replay = replay_new();
+  sack_free(s->sacks);
+  s->sacks = sack_new(opt.ack_delay_ns);
+  s->ack_delay = opt.ack_delay_ns;
+  if (s->inflight == NULL || s->replay == NULL || s->sacks == NULL) {
+    errno = ENOMEM;
+    return close_and_fail(s);
+  }
+  replay_init(s->replay);
 
   /* initialize threads parameters */
   param_t param;
-  param.if_index = (int) if_index;
+  param.session = s;
+  param.error = 0;
   sem_init(&param.thread_cnt, 0, 0);
 
-  /* set cyphering key */
+  /* set cyphering key, shared by all sessions */
   if (key != NULL) memcpy(cypher_key, key, sizeof(cypher_key));
 
+  /* one thread runs the event loop which receives and sends */
+  if (s->engine == SCNP_ENGINE_EPOLL) {
+    if (start_loop(s, &param)) {
+      sem_destroy(&param.thread_cnt);
+      return close_and_fail(s);
+    }
+    sem_destroy(&param.thread_cnt);
+    return 0;
+  }
+
   /* create the receiving thread */
-  if (pthread_create(&thread_info.rthread, NULL, recv_packets, (void *) &param)) {
+  if (pthread_create(&s->rthread, NULL, recv_packets, (void *) &param)) {
     sem_destroy(&param.thread_cnt);
-    return stop_and_fail();
+    return close_and_fail(s);
   }
+  s->is_rthread_created = true;
   /* wait for the end of the receiving thread initialization */
   sem_wait(&param.thread_cnt);
 
   /* create the sending thread */
-  if (pthread_create(&thread_info.sthread, NULL, send_packets, (void *) &param)) {
+  if (pthread_create(&s->sthread, NULL, send_packets, (void *) &param)) {
     sem_destroy(&param.thread_cnt);
-    return stop_and_fail();
+    return close_and_fail(s);
   }
+  s->is_sthread_created = true;
   /* wait for the end of the sending thread initialization */
   sem_wait(&param.thread_cnt);
   sem_destroy(&param.thread_cnt);
@@ -123,481 +509,1381 @@ int scnp_start(unsigned int if_index, const char * key)
   return 0;
 }
 
-void scnp_stop(void)
+static void close_session(struct scnp_session * s)
 {
-  /* stop sending thread */
-  if (thread_info.is_sthread_running) {
-    pthread_cancel(thread_info.sthread);
+  if (s->engine == SCNP_ENGINE_EPOLL) {
+    stop_loop(s);
   }
-  pthread_join(thread_info.sthread, NULL);
+  else {
+    /* stop sending thread */
+    if (s->is_sthread_running) {
+      pthread_cancel(s->sthread);
+    }
+    if (s->is_sthread_created) pthread_join(s->sthread, NULL);
+    s->is_sthread_created = false;
 
-  /* stop receiving thread */
-  if (thread_info.is_rthread_running) {
-    pthread_cancel(thread_info.rthread);
+    /* stop receiving thread */
+    if (s->is_rthread_running) {
+      pthread_cancel(s->rthread);
+    }
+    if (s->is_rthread_created) pthread_join(s->rthread, NULL);
+    s->is_rthread_created = false;
   }
-  pthread_join(thread_info.rthread, NULL);
 
-  /* reset cyphering key to zero */
-  memset(cypher_key, 0, sizeof(cypher_key));
+#ifdef __gnu_linux__
+  /* close the descriptor given by scnp_poll_fd */
+  int64_t poll_fd = ATOMIC_LOAD(&s->poll_fd);
+  if (poll_fd != -1) close((int) poll_fd);
+  ATOMIC_STORE(&s->poll_fd, -1);
+  ATOMIC_STORE(&s->poll_signaled, 0);
+#endif
 
   /* close the socket */
-  if (scnp_socket_opened(&thread_info.socket)) scnp_socket_close(&thread_info.socket);
-}
-
-static int is_ack_needed(const struct scnp_packet * packet);
-static bool is_ack_correct(const struct scnp_packet * sent, const uint8_t * dest_addr, const struct scnp_packet * received, const uint8_t * src_addr);
-static uint32_t get_id_from_packet(const struct scnp_packet * packet);
-
-int scnp_send(struct scnp_packet * packet, const uint8_t * dest_addr)
-{
-  /* raise error when the sending thread is not running */
-  if (!thread_info.is_sthread_running) {
-    errno = ESRCH;
-    return -1;
-  }
+  if (scnp_socket_opened(&s->socket)) scnp_socket_close(&s->socket);
 
-  if (is_ack_needed(packet)) {
-    /* initialize acknowledgement packet and address */
-    struct scnp_packet ack;
-    ack.type = 0;
-    uint8_t ack_addr[ETHER_ADDR_LEN];
-    memset(ack_addr, 0, ETHER_ADDR_LEN);
-
-    int tries = 0;
-    do {
-      if (push(thread_info.squeue, packet, dest_addr)) return -1;
-      ++tries;
-      pull(thread_info.aqueue, &ack, ack_addr, ACK_TIMEOUT_NS);
-    } while (tries < ACK_MAX_TRIES && !is_ack_correct(packet, dest_addr, &ack, ack_addr));
-    if (!is_ack_correct(packet, dest_addr, &ack, ack_addr)) {
-      errno = ETIMEDOUT;
-      return -1;
-    }
-  }
-  else {
-    if (push(thread_info.squeue, packet, dest_addr)) return -1;
-  }
+  /* complete the packets still waiting for an acknowledgement, the delayed acknowledgements are dropped */
+  if (s->inflight != NULL) inflight_init(s->inflight);
+  if (s->sacks != NULL) sack_init(s->sacks);
 
-  return 0;
+  /* reset cyphering key to zero if no other session uses it */
+  unregister_session(s);
 }
 
-int scnp_recv(struct scnp_packet * packet, uint8_t * src_addr)
+scnp_session_t * scnp_session_open(unsigned int if_index, const char * key, const struct scnp_options * options)
 {
-  /* raise error when the receiving thread is not running */
-  if (!thread_info.is_rthread_running)  {
-    errno = ESRCH;
-    return -1;
-  }
-
-  if (pull(thread_info.rqueue, packet, src_addr, -1)) return -1;
+  struct scnp_session * s = (struct scnp_session *) calloc(1, sizeof(struct scnp_session));
+  if (s == NULL) return NULL;
+
+  s->stop_mthread = true;
+  s->poll_fd = -1;
+  pthread_mutex_init(&s->send_mutex, NULL);
+  pthread_mutex_init(&s->overflow.mutex, NULL);
+  pthread_mutex_init(&s->compact.mutex, NULL);
+#ifdef __gnu_linux__
+  s->loop.epfd = s->loop.tfd = s->loop.sfd = -1;
+#endif
 
-  if (is_ack_needed(packet)) {
-    /* initialize acknowledgement packet */
-    struct scnp_ack ack;
-    ack.type = SCNP_ACK;
-    ack.id = get_id_from_packet(packet);
-    /* send acknowledgement */
-    scnp_send((struct scnp_packet *) &ack, src_addr);
+  if (open_session(s, if_index, key, options)) {
+    int err = errno;
+    scnp_session_close(s);
+    errno = err;
+    return NULL;
   }
 
-  return 0;
+  return s;
 }
 
-static int map_type(uint8_t type)
+void scnp_session_close(scnp_session_t * s)
 {
-  if (type >= 0xfe) return type - 0xfe + 3;
-  return type - 1;
+  if (s == NULL) return;
+
+  close_session(s);
+  inflight_free(s->inflight);
+  replay_free(s->replay);
+  sack_free(s->sacks);
+  pthread_mutex_destroy(&s->send_mutex);
+  pthread_mutex_destroy(&s->overflow.mutex);
+  pthread_mutex_destroy(&s->compact.mutex);
+  free(s);
 }
 
-static int build_key_packet(struct scnp_packet * packet, const uint8_t * buf)
+int scnp_start(unsigned int if_index, const char * key)
 {
-  struct scnp_key key;
-  /* type */
-  key.type = SCNP_KEY;
-  /* id */
-  memcpy(&key.id, buf, sizeof(uint32_t));
-  key.id = ntohl(key.id);
-  /* code */
-  uint8_t payload[2];
-  memcpy(payload, buf + sizeof(uint32_t), sizeof(payload));
-  if (decrypt(payload, 2, cypher_key, 2)) return -1;
-  memcpy(&key.code, payload, sizeof(uint16_t));
-  key.code = ntohs(key.code);
-  /* pressed */
-  key.pressed = *(buf + sizeof(uint32_t) + sizeof(uint16_t)) >> 7u;
-  /* repeated */
-  key.repeated = *(buf + sizeof(uint32_t) + sizeof(uint16_t)) & (1u << 6u);
-
-  memcpy(packet, &key, sizeof(struct scnp_key));
-
-  return 0;
+  return scnp_start_opt(if_index, key, NULL);
 }
 
-static int build_mov_packet(struct scnp_packet * packet, const uint8_t * buf)
+int scnp_start_opt(unsigned int if_index, const char * key, const struct scnp_options * options)
 {
-  struct scnp_movement mov;
-  /* type */
-  mov.type = SCNP_MOV;
-  /* move_type */
-  mov.move_type = *buf >> 7u;
-  /* code */
-  memcpy(&mov.code, buf + sizeof(uint8_t), sizeof(uint16_t));
-  mov.code = ntohs(mov.code);
-  /* value */
-  memcpy(&mov.value, buf + sizeof(uint8_t) + sizeof(uint16_t), sizeof(uint32_t));
-  mov.value = ntohl(mov.value);
-
-  memcpy(packet, &mov, sizeof(struct scnp_movement));
-
-  return 0;
+  return open_session(&default_session, if_index, key, options);
 }
 
-static int build_out_packet(struct scnp_packet * packet, const uint8_t * buf)
+void scnp_stop(void)
 {
-  struct scnp_out out;
-  /* type */
-  out.type = SCNP_OUT;
-  /* id */
-  memcpy(&out.id, buf, sizeof(uint32_t));
-  out.id = ntohl(out.id);
-  /* direction */
-  out.direction = *(buf + sizeof(uint32_t)) >> 7u;
-  /* side */
-  out.side = *(buf + sizeof(uint32_t)) & (1u << 6u);
-  /* height */
-  uint16_t height;
-  memcpy(&height, buf + sizeof(uint32_t) + sizeof(uint8_t), sizeof(uint16_t));
-  out.height = (float) ntohs(height) / ((1u << 16u) - 1u);
-
-  memcpy(packet, &out, sizeof(struct scnp_out));
-
-  return 0;
+  close_session(&default_session);
 }
 
-static int build_mng_packet(struct scnp_packet * packet, const uint8_t * buf)
+static int is_ack_needed(const struct scnp_packet * packet);
+static uint32_t get_id_from_packet(const struct scnp_packet * packet);
+static int enqueue(struct scnp_session * s, const struct scnp_packet * packet, const uint8_t * addr);
+static int flush(struct scnp_session * s);
+static int add_delayed_acks(struct scnp_session * s, bool expire);
+static bool to_motion(const struct scnp_packet * packet, struct scnp_packet * motion);
+static bool add_motion(struct scnp_packet * motion, const struct scnp_packet * delta);
+
+static void notify_loop(struct scnp_session * s);
+static bool is_loop_thread(const struct scnp_session * s);
+static void sleep_ns(long long int ns);
+
+/* raise a high-water mark to value if it is below */
+static void raise_high_water(int64_t * mark, int64_t value)
 {
-  struct scnp_management mng;
-  /* type */
-  mng.type = SCNP_MNG;
-  /* hostname */
-  memcpy(&mng.hostname, buf, HOSTNAME_LENGTH);
-
-  memcpy(packet, &mng, sizeof(struct scnp_management));
-
-  return 0;
+  int64_t old = ATOMIC_LOAD(mark);
+  while (value > old && !ATOMIC_CAS(mark, &old, value));
 }
 
-static int build_ack_packet(struct scnp_packet * packet, const uint8_t * buf)
+/*
+ * merge a relative movement into the pending motion, returns 1 if the motion is
+ * new, 0 if the movement was added to it, -1 if it cannot be
+ */
+static int merge_overflow(struct scnp_session * s, const struct scnp_packet * packet, const uint8_t * addr)
 {
-  struct scnp_ack ack;
-  /* type */
-  ack.type = SCNP_ACK;
-  /* id */
-  memcpy(&ack.id, buf, sizeof(uint32_t));
-  ack.id = ntohl(ack.id);
-
-  memcpy(packet, &ack, sizeof(struct scnp_ack));
+  struct scnp_packet motion;
+  if (!to_motion(packet, &motion)) return -1;
+
+  int ret = 0;
+  pthread_mutex_lock(&s->overflow.mutex);
+  if (!s->overflow.pending) {
+    memcpy(&s->overflow.motion, &motion, sizeof(struct scnp_packet));
+    memcpy(s->overflow.addr, addr, ETHER_ADDR_LEN);
+    s->overflow.pending = true;
+    ret = 1;
+  }
+  else if (memcmp(s->overflow.addr, addr, ETHER_ADDR_LEN) != 0 || !add_motion(&s->overflow.motion, &motion)) {
+    ret = -1;
+  }
+  pthread_mutex_unlock(&s->overflow.mutex);
 
-  return 0;
+  if (ret >= 0) ATOMIC_FETCH_ADD(&s->movements_overflowed, 1);
+  return ret;
 }
 
-static int build_packet(struct scnp_packet * packet, const uint8_t * buf)
+/* take the pending motion, returns false if there is none */
+static bool take_overflow(struct scnp_session * s, struct scnp_packet * packet, uint8_t * addr)
 {
-  static int (*builders[])(struct scnp_packet *, const uint8_t *) = {
-      build_key_packet,
-      build_mov_packet,
-      build_out_packet,
-      build_mng_packet,
-      build_ack_packet
-  };
-
-  if (*buf == 4 || *buf == 5 || map_type(*buf) > 4 || map_type(*buf) < 0) return -1;
-  return builders[map_type(*buf)](packet, buf + 1);
+  bool pending;
+  pthread_mutex_lock(&s->overflow.mutex);
+  pending = s->overflow.pending;
+  if (pending) {
+    memcpy(packet, &s->overflow.motion, sizeof(struct scnp_packet));
+    memcpy(addr, s->overflow.addr, ETHER_ADDR_LEN);
+    s->overflow.pending = false;
+  }
+  pthread_mutex_unlock(&s->overflow.mutex);
+  return pending;
 }
 
-static uint8_t * alloc_buffer(uint8_t type, size_t * length)
+/* remember whether a peer decodes SCNP_MOT and SCNP_BATCH, as its management packet tells */
+static void set_compact(struct scnp_session * s, const uint8_t * addr, bool compact)
 {
-  uint8_t * buffer = NULL;
-  size_t packet_sizes[] = { KEY_LENGTH, MOV_LENGTH, OUT_LENGTH, MNG_LENGTH, ACK_LENGTH };
-  if (type == SCNP_KEY || type == SCNP_MOV || type == SCNP_OUT || type == SCNP_MNG || type == SCNP_ACK) {
-    *length = packet_sizes[map_type(type)];
-    buffer = (uint8_t *) malloc(*length);
-    if (buffer == NULL) return NULL;
-    memset(buffer, 0, *length);
-  } else {
-    *length = 0;
-    errno = EBADMSG;
+  pthread_mutex_lock(&s->compact.mutex);
+  int i = 0;
+  while (i < s->compact.count && memcmp(s->compact.addrs[i], addr, ETHER_ADDR_LEN) != 0) ++i;
+
+  if (compact && i == s->compact.count) {
+    /* the oldest peer falls back to the packets every version decodes */
+    if (s->compact.count < SCNP_MAX_PEERS) {
+      ++s->compact.count;
+    }
+    else {
+      i = s->compact.next;
+      s->compact.next = (s->compact.next + 1) % SCNP_MAX_PEERS;
+    }
+    memcpy(s->compact.addrs[i], addr, ETHER_ADDR_LEN);
+  }
+  else if (!compact && i < s->compact.count) {
+    --s->compact.count;
+    memcpy(s->compact.addrs[i], s->compact.addrs[s->compact.count], ETHER_ADDR_LEN);
   }
-  return buffer;
+  pthread_mutex_unlock(&s->compact.mutex);
 }
 
-static int build_key_buffer(uint8_t * buf, const struct scnp_packet * packet)
+/* whether a destination decodes SCNP_MOT and SCNP_BATCH, false until its management packet is received */
+static bool is_compact(struct scnp_session * s, const uint8_t * addr)
 {
-  // TODO condition with sizeof scnp key and scnp packet
-  struct scnp_key * p = (struct scnp_key *) packet;
-
-  /* id */
-  uint32_t id = htonl(current_id += rand() % ID_MAX_INCR);
-  memcpy(buf, &id, sizeof(uint32_t));
-  /* code */
-  uint16_t code = htons(p->code);
-  memcpy(buf + sizeof(uint32_t), &code, sizeof(uint16_t));
-  if (encrypt(buf + sizeof(uint32_t), 2, cypher_key, 2)) return -1;
-  /* flags */
-  uint8_t pressed_flag = (p->pressed) << 7u;
-  uint8_t repeated_flag = (p->repeated) << 6u;
-  *(buf + sizeof(uint32_t) + sizeof(uint16_t)) = pressed_flag + repeated_flag;
+  bool compact = false;
+  pthread_mutex_lock(&s->compact.mutex);
+  for (int i = 0; i < s->compact.count && !compact; ++i) {
+    compact = memcmp(s->compact.addrs[i], addr, ETHER_ADDR_LEN) == 0;
+  }
+  pthread_mutex_unlock(&s->compact.mutex);
+  return compact;
+}
 
-  return 0;
+/* whether a packet is a SCNP_KEY of a button, which must not overtake the movements before it */
+static bool is_button(const struct scnp_packet * packet)
+{
+  const struct scnp_key * key = (const struct scnp_key *) packet;
+  return packet->type == SCNP_KEY && key->code >= BUTTON_FIRST && key->code <= BUTTON_LAST;
 }
 
-static int build_mov_buffer(uint8_t * buf, const struct scnp_packet * packet)
+/* whether relative movements were merged into a motion not queued yet */
+static bool has_overflow(struct scnp_session * s)
 {
-  // TODO same as previous function
-  struct scnp_movement * p = (struct scnp_movement *) packet;
+  pthread_mutex_lock(&s->overflow.mutex);
+  bool pending = s->overflow.pending;
+  pthread_mutex_unlock(&s->overflow.mutex);
+  return pending;
+}
 
-  /* move_type */
-  uint8_t type_flag = (p->move_type) << 7u;
-  memcpy(buf, &type_flag, sizeof(uint8_t));
-  /* code */
-  uint16_t code = htons(p->code);
-  memcpy(buf + sizeof(uint8_t), &code, sizeof(uint16_t));
-  /* value */
-  uint32_t value = htonl(p->value);
-  memcpy(buf + sizeof(uint8_t) + sizeof(uint16_t), &value, sizeof(uint32_t));
+/*
+ * push the pending motion to the lane of the movements, retrying up to timeout_ns nanoseconds
+ * while the lane is full, returns -1 if it stays full
+ */
+static int push_overflow(struct scnp_session * s, long long int timeout_ns)
+{
+  long long int deadline = queue_clock() + timeout_ns;
+  int ret;
+
+  for (;;) {
+    ret = 0;
+    pthread_mutex_lock(&s->overflow.mutex);
+    if (s->overflow.pending) {
+      ATOMIC_FETCH_ADD(&s->queued, 1);
+      ret = push_wait(s->slanes[SCNP_LANE_MOV], &s->overflow.motion, s->overflow.addr, 0);
+      if (ret == 0) {
+        s->overflow.pending = false;
+        ATOMIC_FETCH_ADD(&s->lane_depth[SCNP_LANE_MOV], 1);
+        raise_high_water(&s->lane_high_water[SCNP_LANE_MOV], (int64_t) queue_size(s->slanes[SCNP_LANE_MOV]));
+      }
+      else {
+        ATOMIC_FETCH_ADD(&s->queued, -1);
+      }
+    }
+    pthread_mutex_unlock(&s->overflow.mutex);
 
-  return 0;
+    /* the sending thread takes the motion itself once it emptied the lane */
+    if (ret == 0 || queue_clock() >= deadline) return ret;
+    sleep_ns(SEND_RETRY_NS);
+  }
 }
 
-static int build_out_buffer(uint8_t * buf, const struct scnp_packet * packet)
+/*
+ * lane of the sending queue of a packet, the acknowledgements come first and the unknown types last.
+ * A button shares the lane of the movements to be sent in order with them.
+ */
+static int lane_of(const struct scnp_packet * packet)
 {
-  // TODO same as previous function
-  struct scnp_out * p = (struct scnp_out *) packet;
-
-  /* id */
-  uint32_t id = htonl(current_id += rand() % ID_MAX_INCR);
-  memcpy(buf, &id, sizeof(uint32_t));
-  /* flags */
-  uint8_t direction_flag = (p->direction) << 7u;
-  uint8_t side_flag = (p->side) << 6u;
-  *(buf + sizeof(uint32_t)) = direction_flag + side_flag;
-  /* height */
-  if (p->height > 1 || p->height < 0) p->height = 0.5f;
-  uint16_t height = p->height * ((1u << 16u) - 1u);
-  height = htons(height);
-  memcpy(buf + sizeof(uint32_t) + sizeof(uint8_t), &height, sizeof(uint16_t));
+  if (is_button(packet)) return SCNP_LANE_MOV;
 
-  return 0;
+  switch (packet->type) {
+    case SCNP_ACK:
+    case SCNP_SACK:
+    case WAKE_TYPE:
+      return SCNP_LANE_ACK;
+    case SCNP_OUT:
+      return SCNP_LANE_OUT;
+    case SCNP_KEY:
+      return SCNP_LANE_KEY;
+    case SCNP_MOV:
+    case SCNP_MOT:
+      return SCNP_LANE_MOV;
+    default:
+      return SCNP_LANE_MNG;
+  }
 }
 
-static int build_mng_buffer(uint8_t * buf, const struct scnp_packet * packet)
+/* push a packet to its lane of the sending queue, a key may wait for room if the caller can block */
+static int queue_packet(struct scnp_session * s, const struct scnp_packet * packet, const uint8_t * addr, bool may_wait)
 {
-  // TODO same as previous function
-  struct scnp_management * p = (struct scnp_management *) packet;
+  int lane = lane_of(packet);
 
-  /* hostname */
-  memcpy(buf, p->hostname, HOSTNAME_LENGTH);
+  /* a key is not dropped at once, the caller sleeps until the sending thread makes room */
+  bool wait = may_wait && packet->type == SCNP_KEY && s->is_sthread_running && !is_loop_thread(s);
 
-  return 0;
-}
+  /* the motion merged while the lane was full is queued before a button */
+  if (is_button(packet) && push_overflow(s, wait ? KEY_WAIT_NS : 0)) {
+    errno = EXFULL;
+    return -1;
+  }
 
-static int build_ack_buffer(uint8_t * buf, const struct scnp_packet * packet)
-{
-  // TODO same as previous function
-  struct scnp_ack * p = (struct scnp_ack *) packet;
+  ATOMIC_FETCH_ADD(&s->queued, 1);
+
+  if (push_wait(s->slanes[lane], packet, addr, wait ? KEY_WAIT_NS : 0)) {
+    int err = errno;
+    ATOMIC_FETCH_ADD(&s->queued, -1);
+
+    /* a movement is merged into the pending motion rather than rejected */
+    int merged = (err == EXFULL && lane == SCNP_LANE_MOV) ? merge_overflow(s, packet, addr) : -1;
+    if (merged == -1) {
+      errno = err;
+      return -1;
+    }
+
+    /* the sending thread may have emptied the lane before the motion was pending */
+    if (merged == 1) {
+      struct scnp_packet wake;
+      wake.type = WAKE_TYPE;
+      queue_packet(s, &wake, addr, false);
+    }
+    return 0;
+  }
 
-  /* id */
-  uint32_t id = htonl(p->id);
-  memcpy(buf, &id, sizeof(uint32_t));
+  /* counted once pushed, the sending thread may take the packet first */
+  ATOMIC_FETCH_ADD(&s->lane_depth[lane], 1);
+  /* the depth is decremented after the pull, the queue gives the exact mark */
+  raise_high_water(&s->lane_high_water[lane], (int64_t) queue_size(s->slanes[lane]));
 
+  if (s->engine == SCNP_ENGINE_EPOLL) notify_loop(s);
   return 0;
 }
 
-static int build_buffer(uint8_t * buf, const struct scnp_packet * packet)
+/* send a packet from the calling thread, returns -1 if it must go through the sending queue */
+static int send_direct(struct scnp_session * s, const struct scnp_packet * packet, const uint8_t * addr)
 {
-  static int (*buf_builders[])(uint8_t *, const struct scnp_packet *) = {
-      build_key_buffer,
-      build_mov_buffer,
-      build_out_buffer,
-      build_mng_buffer,
-      build_ack_buffer
-  };
+  if (ATOMIC_LOAD(&s->queued) > 0) return -1;
+  if (is_button(packet) && has_overflow(s)) return -1;
+  if (pthread_mutex_trylock(&s->send_mutex)) return -1;
+
+  /* a queued packet must not be overtaken, only the packets a flush could not send wait in the batch */
+  int ret = -1;
+  bool unsent = false;
+  if (ATOMIC_LOAD(&s->queued) == 0 && s->batch.size < SEND_BATCH_MAX) {
+    enqueue(s, packet, addr);
+    add_delayed_acks(s, false);
+    ret = 0;
+    if (flush(s) == 0) ATOMIC_FETCH_ADD(&s->direct_sends, 1);
+    else               unsent = true;
+  }
+
+  pthread_mutex_unlock(&s->send_mutex);
 
-  /* type */
-  *buf = packet->type;
+  /* the sending thread sends the rest of the batch, the packet must not be queued again */
+  if (unsent) {
+    struct scnp_packet wake;
+    wake.type = WAKE_TYPE;
+    queue_packet(s, &wake, addr, false);
+  }
 
-  return buf_builders[map_type(packet->type)](buf + 1, packet);
+  return ret;
 }
 
-static void rcleanup(void * garbage)
+int scnp_session_send(scnp_session_t * s, struct scnp_packet * packet, const uint8_t * dest_addr)
 {
-  /* free all allocated memory */
-  if (garbage != NULL) free(garbage);
-  free_queue(thread_info.rqueue);
-  thread_info.rqueue = NULL;
-  free_queue(thread_info.aqueue);
-  thread_info.aqueue = NULL;
-
-  thread_info.is_rthread_running = false;
+  return scnp_session_send_async(s, packet, dest_addr, NULL, NULL);
 }
 
-static void * recv_packets(void * arg)
+int scnp_session_send_async(scnp_session_t * s, struct scnp_packet * packet, const uint8_t * dest_addr, scnp_callback callback, void * data)
 {
-  thread_info.is_rthread_running = true;
-  bool stop = false;
-
-  /* initialize parameters */
-  param_t * param = (param_t *) arg;
+  /* raise error when the sending thread is not running */
+  if (!s->is_sthread_running) {
+    errno = ESRCH;
+    return -1;
+  }
 
-  /* allocate memory for the buffer */
-  size_t packetlen = sizeof(struct scnp_packet);
-  uint8_t * buf = (uint8_t *) malloc(packetlen);
-  if (buf == NULL) stop = true;
+  /* keep the packet until its acknowledgement, a key sent in several copies is only identified */
+  bool kept = is_ack_needed(packet) && !(packet->type == SCNP_KEY && s->key_copies > 1);
+  long long int next_deadline = -1;
+  if (kept) {
+    if (s->direct_send) next_deadline = inflight_next_deadline(s->inflight);
+    if (inflight_add(s->inflight, packet, dest_addr, callback, data)) return -1;
+  }
+  else if (is_ack_needed(packet) && inflight_number(s->inflight, packet, dest_addr)) {
+    return -1;
+  }
 
-  /* initialize receive and ack queue */
-  thread_info.rqueue = init_queue();
-  thread_info.aqueue = init_queue();
-  if (thread_info.rqueue == NULL || thread_info.aqueue == NULL) {
-    stop = true;
+  /* skip the sending thread when it has nothing to send */
+  if (s->direct_send && send_direct(s, packet, dest_addr) == 0) {
+    /* the sending thread sleeps until the next timer, which may be the new one */
+    if (kept && inflight_next_deadline(s->inflight) != next_deadline) {
+      struct scnp_packet wake;
+      wake.type = WAKE_TYPE;
+      queue_packet(s, &wake, dest_addr, false);
+    }
+    return 0;
   }
 
-  /* push cleanup routine */
-  pthread_cleanup_push(rcleanup, buf)
+  /* a packet needing acknowledgement whose lane stays full is sent by the retransmission timer */
+  if (queue_packet(s, packet, dest_addr, true)) {
+    if (errno != EXFULL || !is_ack_needed(packet)) return -1;
+    if (!kept && inflight_add(s->inflight, packet, dest_addr, NULL, NULL)) return -1;
+  }
 
-  /* resume scnp_start */
-  sem_post(&param->thread_cnt);
+  return 0;
+}
 
-  /* initialize the packet and the socket address */
-  struct scnp_packet packet;
-  uint8_t            addr[ETHER_ADDR_LEN];
+int scnp_send(struct scnp_packet * packet, const uint8_t * dest_addr)
+{
+  return scnp_session_send_async(&default_session, packet, dest_addr, NULL, NULL);
+}
 
+int scnp_send_async(struct scnp_packet * packet, const uint8_t * dest_addr, scnp_callback callback, void * data)
+{
+  return scnp_session_send_async(&default_session, packet, dest_addr, callback, data);
+}
 
-  while (!stop) {
-    /* reset packet and buffer */
-    memset(&packet, 0, sizeof(struct scnp_packet));
-    memset(buf, 0, MAX_PACKET_LENGTH);
-    /* receive scnp data */
-    if (scnp_socket_recvfrom(&thread_info.socket, buf, packetlen, 0, addr) == -1) {
-      stop = true;
-    }
-    /* build the packet from buffer data */
-    if (build_packet(&packet, buf) == 0) {
-      /* push the packet in the corresponding queue */
-      if (packet.type == SCNP_ACK) {
-        push(thread_info.aqueue, &packet, addr);
-      }
-      else {
-        push(thread_info.rqueue, &packet, addr);
-      }
-    }
+int scnp_session_send_status(scnp_session_t * s, const uint8_t * dest_addr, uint32_t id)
+{
+  /* nothing was sent by a session never started */
+  if (s->inflight == NULL) {
+    errno = ENOENT;
+    return -1;
   }
 
-  /* execute rcleanup */
-  pthread_cleanup_pop(1);
-
-  return NULL;
+  return inflight_status(s->inflight, dest_addr, id);
 }
 
-struct waste_t
+int scnp_send_status(const uint8_t * dest_addr, uint32_t id)
 {
-  uint8_t * buf;
-  pthread_t mthread;
-};
+  return scnp_session_send_status(&default_session, dest_addr, id);
+}
 
-static void scleanup(void * garbage)
+int scnp_session_get_rtt(scnp_session_t * s, const uint8_t * dest_addr, struct scnp_rtt * rtt)
 {
-  /* free all allocated memory */
-  struct waste_t * waste = (struct waste_t *) garbage;
-  free(waste->buf);
-  thread_info.stop_mthread = true;
-  pthread_join(waste->mthread, NULL);
-  free_queue(thread_info.squeue);
-  thread_info.squeue = NULL;
+  if (s->inflight == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
 
-  thread_info.is_sthread_running = false;
+  return inflight_rtt(s->inflight, dest_addr, rtt);
 }
 
-static void * send_packets(void * arg)
+int scnp_get_rtt(const uint8_t * dest_addr, struct scnp_rtt * rtt)
 {
-  thread_info.is_sthread_running = true;
-  bool stop = false;
+  return scnp_session_get_rtt(&default_session, dest_addr, rtt);
+}
 
-  /* initialize parameters */
-  param_t * param = (param_t *) arg;
+int scnp_session_add_peer(scnp_session_t * s, const struct sockaddr * addr, socklen_t addrlen, uint8_t * peer)
+{
+  if (addr == NULL || peer == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
 
-  /* declare buffer */
-  struct waste_t waste;
-  waste.buf = NULL;
+  if (!scnp_socket_opened(&s->socket)) {
+    errno = ESRCH;
+    return -1;
+  }
 
-  /* initialize sending queue */
-  thread_info.squeue = init_queue();
-  if (thread_info.squeue == NULL) stop = true;
+  return scnp_socket_add_peer(&s->socket, addr, addrlen, peer);
+}
 
-  /* create management thread */
-  thread_info.stop_mthread = false;
-  if (pthread_create(&waste.mthread, NULL, manage, NULL)) {
-    stop = true;
+int scnp_add_peer(const struct sockaddr * addr, socklen_t addrlen, uint8_t * peer)
+{
+  return scnp_session_add_peer(&default_session, addr, addrlen, peer);
+}
+
+int scnp_best_path(scnp_session_t * const * sessions, const uint8_t (* addrs)[ETHER_ADDR_LEN], size_t count)
+{
+  if (count == 0 || sessions == NULL || addrs == NULL) {
+    errno = EINVAL;
+    return -1;
   }
 
-  /* push cleanup routine */
-  pthread_cleanup_push(scleanup, &waste)
+  int best = -1;
+  uint64_t best_srtt = 0;
 
-  /* resume scnp_start */
-  sem_post(&param->thread_cnt);
+  for (size_t i = 0; i < count; ++i) {
+    struct scnp_rtt rtt;
 
-  /* initialize the packet and the socket address */
-  struct scnp_packet packet;
-  uint8_t            addr[ETHER_ADDR_LEN];
-  
-  /* initialize the queue timeout */
-  int64_t timeout = -1;
+    /* a path without round trip is taken first so that it gets measured */
+    if (scnp_session_get_rtt(sessions[i], addrs[i], &rtt)) return (int) i;
 
-  while(!stop) {
-    /* pull packet */
-    if (pull(thread_info.squeue, &packet, addr, timeout)) {
-      stop = true;
-    }
-    /* initialize buffer */
-    size_t buf_length;
-    waste.buf = alloc_buffer(packet.type, &buf_length);
-    if (waste.buf == NULL && errno != EBADMSG) stop = true;
-    /* build packet */
-    if (waste.buf != NULL && build_buffer(waste.buf, &packet) == 0) {
-      /* send packet */
-      if (scnp_socket_sendto(&thread_info.socket, waste.buf, buf_length, 0,addr) <= 0) {
-        stop = true;
-      }
+    if (best == -1 || rtt.srtt_ns < best_srtt) {
+      best = (int) i;
+      best_srtt = rtt.srtt_ns;
     }
-    /* reset buffer */
-    free(waste.buf);
-    waste.buf = NULL;
   }
 
-  /* execute scleanup */
-  pthread_cleanup_pop(1);
-
-  return NULL;
+  return best;
 }
 
-static void * manage(void * arg)
+void scnp_session_get_stats(scnp_session_t * s, struct scnp_stats * stats)
 {
-  arg = (void *) arg;
+  int64_t packets_sent = ATOMIC_LOAD(&s->packets_sent);
+  int64_t send_calls = ATOMIC_LOAD(&s->socket.tx_calls);
+
+  stats->packets_sent = (uint64_t) packets_sent;
+  stats->send_calls = (uint64_t) send_calls;
+  stats->send_calls_saved = (uint64_t) (packets_sent - send_calls);
+  stats->packets_received = (uint64_t) ATOMIC_LOAD(&s->packets_received);
+  stats->recv_calls = (uint64_t) ATOMIC_LOAD(&s->socket.rx_calls);
+  stats->movements_merged = (uint64_t) ATOMIC_LOAD(&s->movements_merged);
+  stats->packets_batched = (uint64_t) ATOMIC_LOAD(&s->packets_batched);
+  stats->direct_sends = (uint64_t) ATOMIC_LOAD(&s->direct_sends);
+  stats->duplicates_dropped = (uint64_t) ATOMIC_LOAD(&s->duplicates_dropped);
+  stats->fast_retransmits = (uint64_t) ATOMIC_LOAD(&s->fast_retransmits);
+  for (int lane = 0; lane < SCNP_LANES; ++lane) {
+    int64_t depth = ATOMIC_LOAD(&s->lane_depth[lane]);
+    stats->lane_depth[lane] = (depth > 0) ? (uint64_t) depth : 0;
+    stats->lane_sent[lane] = (uint64_t) ATOMIC_LOAD(&s->lane_sent[lane]);
+    stats->lane_high_water[lane] = (uint64_t) ATOMIC_LOAD(&s->lane_high_water[lane]);
+  }
+  stats->recv_high_water = (uint64_t) ATOMIC_LOAD(&s->recv_high_water);
+  stats->movements_overflowed = (uint64_t) ATOMIC_LOAD(&s->movements_overflowed);
+  stats->acks_sent = (uint64_t) ATOMIC_LOAD(&s->acks_sent);
+  stats->acks_piggybacked = (uint64_t) ATOMIC_LOAD(&s->acks_piggybacked);
+  stats->ids_acked = (uint64_t) ATOMIC_LOAD(&s->ids_acked);
+  stats->copies_sent = (uint64_t) ATOMIC_LOAD(&s->copies_sent);
+  stats->recv_dropped = (uint64_t) ATOMIC_LOAD(&s->recv_dropped);
+  stats->send_errors = (uint64_t) (ATOMIC_LOAD(&s->send_errors) + ATOMIC_LOAD(&s->socket.tx_errors));
+}
+
+void scnp_get_stats(struct scnp_stats * stats)
+{
+  scnp_session_get_stats(&default_session, stats);
+}
+
+int scnp_tuning_profile(int profile, struct scnp_tuning * tuning)
+{
+  memset(tuning, 0, sizeof(struct scnp_tuning));
+
+  switch (profile) {
+  case SCNP_TUNING_NONE:
+    return 0;
+  case SCNP_TUNING_LOW_LATENCY:
+    tuning->busy_poll_us = TUNING_BUSY_POLL_US;
+    tuning->priority = TUNING_PRIORITY;
+    tuning->rcvbuf = TUNING_RCVBUF;
+    tuning->sndbuf = TUNING_SNDBUF;
+    tuning->qdisc_bypass = true;
+    return 0;
+  default:
+    errno = EINVAL;
+    return -1;
+  }
+}
+
+int scnp_session_get_tuning(scnp_session_t * s, struct scnp_tuning * tuning)
+{
+  if (!scnp_socket_opened(&s->socket)) {
+    errno = ESRCH;
+    return -1;
+  }
+
+  memcpy(tuning, &s->tuning, sizeof(struct scnp_tuning));
+
+  return 0;
+}
+
+int scnp_get_tuning(struct scnp_tuning * tuning)
+{
+  return scnp_session_get_tuning(&default_session, tuning);
+}
+
+/* make the descriptor of scnp_poll_fd readable */
+static void signal_poll_fd(struct scnp_session * s)
+{
+#ifdef __gnu_linux__
+  int64_t fd = ATOMIC_LOAD(&s->poll_fd);
+  int64_t expected = 0;
+  if (fd != -1 && ATOMIC_CAS(&s->poll_signaled, &expected, 1)) {
+    uint64_t one = 1;
+    if (write((int) fd, &one, sizeof(one)) == -1) errno = 0;
+  }
+#else
+  s = (struct scnp_session *) s;
+#endif
+}
+
+/* clear the descriptor of scnp_poll_fd once the receiving queue is empty */
+static void clear_poll_fd(struct scnp_session * s)
+{
+#ifdef __gnu_linux__
+  int64_t fd = ATOMIC_LOAD(&s->poll_fd);
+  if (fd == -1 || queue_size(s->rqueue) > 0) return;
+
+  ATOMIC_STORE(&s->poll_signaled, 0);
+  uint64_t count;
+  if (read((int) fd, &count, sizeof(count)) == -1) errno = 0;
+
+  /* a packet may have been published before the flag was cleared */
+  if (queue_size(s->rqueue) > 0) signal_poll_fd(s);
+#else
+  s = (struct scnp_session *) s;
+#endif
+}
+
+int scnp_session_poll_fd(scnp_session_t * s)
+{
+#ifdef __gnu_linux__
+  if (!s->is_rthread_running) {
+    errno = ESRCH;
+    return -1;
+  }
+
+  int64_t fd = ATOMIC_LOAD(&s->poll_fd);
+  if (fd != -1) return (int) fd;
+
+  /* created at the first call, another thread may create it at the same time */
+  int64_t efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (efd == -1) return -1;
+  if (!ATOMIC_CAS(&s->poll_fd, &fd, efd)) {
+    close((int) efd);
+    return (int) fd;
+  }
+
+  if (queue_size(s->rqueue) > 0) signal_poll_fd(s);
+  return (int) efd;
+#else
+  s = (scnp_session_t *) s;
+  errno = EOPNOTSUPP;
+  return -1;
+#endif
+}
+
+int scnp_poll_fd(void)
+{
+  return scnp_session_poll_fd(&default_session);
+}
+
+static int recv_packet(struct scnp_session * s, struct scnp_packet * packet, uint8_t * src_addr, long long int tout_nsec)
+{
+  /* raise error when the receiving thread is not running */
+  if (!s->is_rthread_running)  {
+    errno = ESRCH;
+    return -1;
+  }
+
+  if (pull(s->rqueue, packet, src_addr, tout_nsec)) return -1;
+  clear_poll_fd(s);
+
+  return 0;
+}
+
+int scnp_session_recv(scnp_session_t * s, struct scnp_packet * packet, uint8_t * src_addr)
+{
+  return recv_packet(s, packet, src_addr, -1);
+}
+
+int scnp_recv(struct scnp_packet * packet, uint8_t * src_addr)
+{
+  return scnp_session_recv(&default_session, packet, src_addr);
+}
+
+int scnp_session_try_recv(scnp_session_t * s, struct scnp_packet * packet, uint8_t * src_addr)
+{
+  if (recv_packet(s, packet, src_addr, 0) == 0) return 0;
+  if (errno == ETIMEDOUT) errno = EAGAIN;
+  return -1;
+}
+
+int scnp_try_recv(struct scnp_packet * packet, uint8_t * src_addr)
+{
+  return scnp_session_try_recv(&default_session, packet, src_addr);
+}
+
+/* packets that can be sent inside a SCNP_BATCH frame */
+static bool is_batchable(uint8_t type)
+{
+  return type == SCNP_KEY || type == SCNP_MOV || type == SCNP_MOT || type == SCNP_ACK || type == SCNP_SACK;
+}
+
+/* resources of the receiving thread to release when it is cancelled */
+struct rwaste_t
+{
+  struct scnp_session * session;
+  uint8_t *             bufs;
+};
+
+static void rcleanup(void * garbage)
+{
+  struct rwaste_t * w = (struct rwaste_t *) garbage;
+
+  /* free all allocated memory */
+  if (w->bufs != NULL) free(w->bufs);
+  free_queue(w->session->rqueue);
+  w->session->rqueue = NULL;
+
+  w->session->is_rthread_running = false;
+}
+
+/* packets decoded by the receiving thread and not published yet, and their acknowledgements */
+struct recv_batch
+{
+  struct scnp_packet packets[RECV_BATCH_MAX];
+  uint8_t            addrs[RECV_BATCH_MAX][ETHER_ADDR_LEN];
+  bool               needs_ack[RECV_BATCH_MAX];
+  size_t             size;
+  struct sack_pending acks[RECV_BATCH_MAX];
+  size_t             nacks;
+};
+
+/* send the acknowledgements of the batch in one call, without going through the sending queue */
+static void send_acks(struct scnp_session * s, struct recv_batch * rb)
+{
+  struct scnp_frame  frames[RECV_BATCH_MAX];
+  uint8_t            bufs[RECV_BATCH_MAX][SACK_LENGTH];
+  struct scnp_packet packet;
+  int64_t            ids = 0;
+
+  if (rb->nacks == 0) return;
+
+  for (size_t i = 0; i < rb->nacks; ++i) {
+    sack_to_packet(&rb->acks[i].sack, &packet);
+    frames[i].buf = bufs[i];
+    frames[i].len = build_buffer(bufs[i], &packet);
+    memcpy(frames[i].addr, rb->acks[i].addr, ETHER_ADDR_LEN);
+    ids += sack_ids(&rb->acks[i].sack);
+  }
+
+  /* the transmit ring is shared with the sending thread, which must not be blocked by a cancellation */
+  bool ring = s->socket.mode == SCNP_SOCKET_RING;
+  int  cancel_state;
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+  if (ring) pthread_mutex_lock(&s->send_mutex);
+
+  int sent = scnp_socket_sendmmsg(&s->socket, frames, (unsigned int) rb->nacks, 0);
+
+  if (ring) pthread_mutex_unlock(&s->send_mutex);
+  pthread_setcancelstate(cancel_state, NULL);
+
+  if (sent > 0) {
+    ATOMIC_FETCH_ADD(&s->packets_sent, sent);
+    ATOMIC_FETCH_ADD(&s->acks_sent, sent);
+  }
+  if (sent == (int) rb->nacks) ATOMIC_FETCH_ADD(&s->ids_acked, ids);
+  rb->nacks = 0;
+}
+
+/*
+ * acknowledge an identifier with the next frames sent by send_acks(), merged with the other
+ * acknowledgements of the batch to the peer, or delayed in the table of the session
+ */
+static void add_ack(struct scnp_session * s, struct recv_batch * rb, uint32_t id, const uint8_t * addr)
+{
+  struct sack_pending * ack = &rb->acks[rb->nacks];
+
+  if (s->ack_delay == 0) {
+    for (size_t i = 0; i < rb->nacks; ++i) {
+      if (memcmp(rb->acks[i].addr, addr, ETHER_ADDR_LEN) == 0 && sack_merge(&rb->acks[i].sack, id)) return;
+    }
+    memcpy(ack->addr, addr, ETHER_ADDR_LEN);
+    sack_start(&ack->sack, id);
+  }
+  else {
+    int added = sack_add(s->sacks, addr, id, queue_clock(), ack);
+
+    /* the sending thread sleeps until its next timer, which may be later than the delay */
+    if ((added & SACK_FIRST) && s->engine == SCNP_ENGINE_THREADS) {
+      struct scnp_packet wake;
+      wake.type = WAKE_TYPE;
+      queue_packet(s, &wake, addr, false);
+    }
+    if (!(added & SACK_FLUSHED)) return;
+  }
+
+  if (++rb->nacks == RECV_BATCH_MAX) send_acks(s, rb);
+}
+
+/* give the batch to the application, only the packets the receiving queue takes are acknowledged */
+static void publish(struct scnp_session * s, struct recv_batch * rb)
+{
+  if (rb->size == 0) return;
+
+  int pushed = push_batch(s->rqueue, rb->packets, (const uint8_t (*)[ETHER_ADDR_LEN]) rb->addrs, rb->size);
+  size_t kept = (pushed == -1) ? 0 : (size_t) pushed;
+  raise_high_water(&s->recv_high_water, (int64_t) queue_size(s->rqueue));
+  if (kept > 0) signal_poll_fd(s);
+
+  for (size_t i = 0; i < rb->size; ++i) {
+    if (!rb->needs_ack[i]) continue;
+
+    /* a dropped packet must be accepted again when its sender retransmits it */
+    uint32_t id = get_id_from_packet(&rb->packets[i]);
+    if (i < kept) add_ack(s, rb, id, rb->addrs[i]);
+    else          replay_forget(s->replay, rb->addrs[i], id);
+  }
+  if (kept < rb->size) ATOMIC_FETCH_ADD(&s->recv_dropped, (int64_t) (rb->size - kept));
+
+  rb->size = 0;
+}
+
+static void fast_retransmit(const struct scnp_packet * packet, const uint8_t * addr, void * data)
+{
+  struct scnp_session * s = (struct scnp_session *) data;
+
+  /* the receiving thread never waits for room, the packet is left to the retransmission timer */
+  if (queue_packet(s, packet, addr, false) == 0) ATOMIC_FETCH_ADD(&s->fast_retransmits, 1);
+}
+
+/* whether a packet needing acknowledgement waits in the batch, its copy is acknowledged once it is published */
+static bool is_pending(const struct recv_batch * rb, uint32_t id, const uint8_t * addr)
+{
+  for (size_t i = 0; i < rb->size; ++i) {
+    if (rb->needs_ack[i] && get_id_from_packet(&rb->packets[i]) == id && memcmp(rb->addrs[i], addr, ETHER_ADDR_LEN) == 0) return true;
+  }
+  return false;
+}
+
+/* complete the acknowledged packet or keep the packet for the queue */
+static void receive(struct scnp_session * s, struct recv_batch * rb, const uint8_t * buf, const uint8_t * addr)
+{
+  struct scnp_packet * packet = &rb->packets[rb->size];
+  if (build_packet(packet, buf)) return;
+  ATOMIC_FETCH_ADD(&s->packets_received, 1);
+
+  if (packet->type == SCNP_ACK) {
+    inflight_ack(s->inflight, addr, get_id_from_packet(packet), fast_retransmit, s);
+    return;
+  }
+  if (packet->type == SCNP_SACK) {
+    inflight_sack(s->inflight, addr, (const struct scnp_sack *) packet, fast_retransmit, s);
+    return;
+  }
+  if (packet->type == SCNP_MNG) {
+    set_compact(s, addr, ((const struct scnp_management *) packet)->features & MNG_COMPACT);
+  }
+
+  /* a retransmission whose acknowledgement was lost is acknowledged again but not delivered */
+  bool needs_ack = is_ack_needed(packet);
+  if (needs_ack && !replay_check(s->replay, addr, get_id_from_packet(packet))) {
+    if (!is_pending(rb, get_id_from_packet(packet), addr)) add_ack(s, rb, get_id_from_packet(packet), addr);
+    ATOMIC_FETCH_ADD(&s->duplicates_dropped, 1);
+    return;
+  }
+
+  /* a new packet is acknowledged once published */
+  rb->needs_ack[rb->size] = needs_ack;
+  memcpy(rb->addrs[rb->size], addr, ETHER_ADDR_LEN);
+  if (++rb->size == RECV_BATCH_MAX) publish(s, rb);
+}
+
+/* keep the packets of a SCNP_BATCH frame, the ones following a malformed packet are ignored */
+static void unpack_batch(struct scnp_session * s, struct recv_batch * rb, const uint8_t * buf, size_t len, const uint8_t * addr)
+{
+  size_t offset = BATCH_LENGTH;
+
+  for (int i = 0; i < buf[1]; ++i) {
+    if (offset >= len || !is_batchable(buf[offset])) return;
+    size_t length = packet_length(buf[offset]);
+    if (offset + length > len) return;
+
+    receive(s, rb, buf + offset, addr);
+    offset += length;
+  }
+}
+
+/* receive a batch of frames and publish their packets, returns the number of frames or -1 */
+static int receive_frames(struct scnp_session * s, uint8_t * bufs, struct recv_batch * rb, int flags)
+{
+  struct scnp_frame frames[RECV_BATCH_MAX];
+
+  /* receive scnp data */
+  for (int i = 0; i < RECV_BATCH_MAX; ++i) {
+    frames[i].buf = bufs + i * MAX_PACKET_LENGTH;
+    frames[i].len = MAX_PACKET_LENGTH;
+  }
+  int nframes = scnp_socket_recvmmsg(&s->socket, frames, RECV_BATCH_MAX, flags);
+  if (nframes == -1) return -1;
+
+  /* build the packets from buffer data */
+  for (int i = 0; i < nframes; ++i) {
+    if (frames[i].len >= BATCH_LENGTH && frames[i].buf[0] == SCNP_BATCH) {
+      unpack_batch(s, rb, frames[i].buf, frames[i].len, frames[i].addr);
+      continue;
+    }
+    /* the management packet of a device without features ends with its hostname */
+    if (frames[i].len >= MNG_BASE_LENGTH && frames[i].len < MNG_LENGTH && frames[i].buf[0] == SCNP_MNG) {
+      uint8_t mng[MNG_LENGTH] = { 0 };
+      memcpy(mng, frames[i].buf, MNG_BASE_LENGTH);
+      receive(s, rb, mng, frames[i].addr);
+      continue;
+    }
+    /* ignore the frames too short for their type */
+    if (frames[i].len == 0 || frames[i].len < packet_length(frames[i].buf[0])) continue;
+    receive(s, rb, frames[i].buf, frames[i].addr);
+  }
+
+  /* publish the whole batch, then send the acknowledgements of the packets published */
+  publish(s, rb);
+  send_acks(s, rb);
+
+  return nframes;
+}
+
+static void * recv_packets(void * arg)
+{
+  /* initialize parameters */
+  param_t * param = (param_t *) arg;
+  struct scnp_session * s = param->session;
+
+  s->is_rthread_running = true;
+  bool stop = false;
+
+  /* allocate memory for the buffers of a batch */
+  struct rwaste_t rwaste;
+  rwaste.session = s;
+  rwaste.bufs = (uint8_t *) malloc(RECV_BATCH_MAX * MAX_PACKET_LENGTH);
+  if (rwaste.bufs == NULL) stop = true;
+
+  /* initialize receive queue */
+  s->rqueue = init_queue_capacity(s->recv_capacity);
+  if (s->rqueue == NULL) stop = true;
+
+  /* push cleanup routine */
+  pthread_cleanup_push(rcleanup, &rwaste)
+
+  /* resume open_session */
+  sem_post(&param->thread_cnt);
+
+  /* initialize the decoded packets */
+  struct recv_batch rb;
+  rb.size = 0;
+  rb.nacks = 0;
+
+  while (!stop) {
+    if (receive_frames(s, rwaste.bufs, &rb, 0) == -1) stop = true;
+  }
+
+  /* execute rcleanup */
+  pthread_cleanup_pop(1);
+
+  return NULL;
+}
+
+static void scleanup(void * garbage)
+{
+  struct scnp_session * s = (struct scnp_session *) garbage;
+  s->stop_mthread = true;
+  pthread_join(s->mthread, NULL);
+  for (int lane = 0; lane < SCNP_LANES; ++lane) {
+    free_queue(s->slanes[lane]);
+    s->slanes[lane] = NULL;
+  }
+
+  s->is_sthread_running = false;
+}
+
+/*
+ * build in buf the frame of the first packet not sent yet, the batchable packets
+ * that follow it to the same destination are packed with it in a SCNP_BATCH frame,
+ * returns the length of the frame or 0 if it cannot be built
+ */
+static size_t build_frame(struct scnp_session * s, uint8_t * buf, int first, int frame, int * owners, int * count, bool * keyed)
+{
+  int    indexes[BATCH_MAX_PACKETS];
+  int    n = 0;
+  size_t batch_length = BATCH_LENGTH;
+
+  indexes[n++] = first;
+  owners[first] = frame;
+  batch_length += packet_length(s->batch.packets[first].type);
+
+  /* the order of the packets to a destination is kept, a destination without SCNP_BATCH gets them one by one */
+  bool batched = is_batchable(s->batch.packets[first].type) && is_compact(s, s->batch.addrs[first]);
+  for (int i = first + 1; batched && i < s->batch.size && n < BATCH_MAX_PACKETS; ++i) {
+    if (owners[i] != NO_FRAME || memcmp(s->batch.addrs[i], s->batch.addrs[first], ETHER_ADDR_LEN) != 0) continue;
+    if (!is_batchable(s->batch.packets[i].type)) break;
+    if (batch_length + packet_length(s->batch.packets[i].type) > MAX_PACKET_LENGTH) break;
+
+    indexes[n++] = i;
+    owners[i] = frame;
+    batch_length += packet_length(s->batch.packets[i].type);
+  }
+  *count = n;
+  *keyed = false;
+  for (int i = 0; i < n; ++i) {
+    if (s->batch.packets[indexes[i]].type == SCNP_KEY) *keyed = true;
+  }
+
+  /* a packet alone is sent as it is */
+  if (n == 1) return build_buffer(buf, &s->batch.packets[first]);
+
+  buf[0] = SCNP_BATCH;
+  buf[1] = (uint8_t) n;
+
+  size_t offset = BATCH_LENGTH;
+  for (int i = 0; i < n; ++i) {
+    size_t length = build_buffer(buf + offset, &s->batch.packets[indexes[i]]);
+    if (length == 0) return 0;
+    offset += length;
+  }
+
+  return offset;
+}
+
+/*
+ * build and send the packets of the batch, returns 0 if every frame was sent or refused, 1 if
+ * the socket is busy and -1 if it failed, the packets of the frames not sent are then kept in
+ * the batch. A refused frame is dropped, its keys are retransmitted by the timer.
+ */
+static int flush(struct scnp_session * s)
+{
+  struct scnp_frame frames[SEND_BATCH_MAX * SCNP_MAX_KEY_COPIES];
+  int               counts[SEND_BATCH_MAX * SCNP_MAX_KEY_COPIES];
+  bool              keyed[SEND_BATCH_MAX];
+  int               owners[SEND_BATCH_MAX]; // frame of each packet of the batch
+  unsigned int      nframes = 0, ncopies = 0;
+  int               ret = 0;
+
+  for (int i = 0; i < s->batch.size; ++i) owners[i] = NO_FRAME;
+
+  for (int i = 0; i < s->batch.size; ++i) {
+    if (owners[i] != NO_FRAME) continue;
+
+    /* build the frame, the packets that cannot be encoded are dropped */
+    size_t length = build_frame(s, s->frame_bufs[nframes], i, (int) nframes, owners, &counts[nframes], &keyed[nframes]);
+    if (length == 0) {
+      for (int j = i; j < s->batch.size; ++j) {
+        if (owners[j] == (int) nframes) owners[j] = DROPPED_FRAME;
+      }
+      continue;
+    }
+
+    frames[nframes].buf = s->frame_bufs[nframes];
+    frames[nframes].len = length;
+    memcpy(frames[nframes].addr, s->batch.addrs[i], ETHER_ADDR_LEN);
+    ++nframes;
+  }
+
+  /* the frames carrying keys are sent again after the others, so that a burst of losses spares a copy */
+  for (int copy = 1; copy < s->key_copies; ++copy) {
+    for (unsigned int i = 0; i < nframes; ++i) {
+      if (!keyed[i]) continue;
+      memcpy(&frames[nframes + ncopies], &frames[i], sizeof(struct scnp_frame));
+      counts[nframes + ncopies] = counts[i];
+      ++ncopies;
+    }
+  }
+
+  /* send the frames in as few calls as possible, a call may send only the first ones */
+  int sent = 0;
+  bool refused[SEND_BATCH_MAX * SCNP_MAX_KEY_COPIES] = { false };
+  while (sent < (int) (nframes + ncopies)) {
+    int n = scnp_socket_sendmmsg(&s->socket, frames + sent, nframes + ncopies - (unsigned int) sent, 0);
+    if (n == -1 && errno == EINTR) continue;
+    if (n == 0 || (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS))) {
+      ret = 1;
+      break;
+    }
+    if (n == -1 && scnp_socket_send_failed(errno)) {
+      ret = -1;
+      break;
+    }
+    if (n == -1) {
+      ATOMIC_FETCH_ADD(&s->send_errors, 1);
+      refused[sent] = true;
+      n = 1;
+    }
+    sent += n;
+  }
+
+  for (int i = 0; i < sent; ++i) {
+    if (refused[i]) continue;
+    ATOMIC_FETCH_ADD(&s->packets_sent, counts[i]);
+    if (counts[i] > 1) ATOMIC_FETCH_ADD(&s->packets_batched, counts[i]);
+  }
+  for (int i = (int) nframes; i < sent; ++i) {
+    if (!refused[i]) ATOMIC_FETCH_ADD(&s->copies_sent, 1);
+  }
+
+  /* the packets sent are removed, the copies of the keys are not sent again */
+  int kept = 0;
+  for (int i = 0; i < s->batch.size; ++i) {
+    if (owners[i] < sent) continue;
+    if (kept != i) {
+      memcpy(&s->batch.packets[kept], &s->batch.packets[i], sizeof(struct scnp_packet));
+      memcpy(s->batch.addrs[kept], s->batch.addrs[i], ETHER_ADDR_LEN);
+    }
+    ++kept;
+  }
+  s->batch.size = kept;
+
+  return ret;
+}
+
+/* convert a relative movement of an axis into a motion, returns false if it cannot be */
+static bool to_motion(const struct scnp_packet * packet, struct scnp_packet * motion)
+{
+  struct scnp_motion * mot = (struct scnp_motion *) motion;
+
+  if (packet->type == SCNP_MOT) {
+    memcpy(motion, packet, sizeof(struct scnp_motion));
+    return true;
+  }
+
+  const struct scnp_movement * mov = (const struct scnp_movement *) packet;
+  if (packet->type != SCNP_MOV || mov->move_type != MOV_REL) return false;
+
+  mot->type = SCNP_MOT;
+  mot->dx = 0;
+  mot->dy = 0;
+  mot->wheel = 0;
+
+  switch (mov->code) {
+    case MOV_CODE_X:
+      if (mov->value < INT16_MIN || mov->value > INT16_MAX) return false;
+      mot->dx = (int16_t) mov->value;
+      return true;
+    case MOV_CODE_Y:
+      if (mov->value < INT16_MIN || mov->value > INT16_MAX) return false;
+      mot->dy = (int16_t) mov->value;
+      return true;
+    case MOV_CODE_WHEEL:
+      if (mov->value < INT8_MIN || mov->value > INT8_MAX) return false;
+      mot->wheel = (int8_t) mov->value;
+      return true;
+    default:
+      return false;
+  }
+}
+
+/* add a motion to another one, returns false if the sums do not fit in the fields */
+static bool add_motion(struct scnp_packet * motion, const struct scnp_packet * delta)
+{
+  struct scnp_motion * mot = (struct scnp_motion *) motion;
+  const struct scnp_motion * d = (const struct scnp_motion *) delta;
+
+  int dx = mot->dx + d->dx, dy = mot->dy + d->dy, wheel = mot->wheel + d->wheel;
+  if (dx < INT16_MIN || dx > INT16_MAX || dy < INT16_MIN || dy > INT16_MAX || wheel < INT8_MIN || wheel > INT8_MAX) {
+    return false;
+  }
+
+  mot->dx = (int16_t) dx;
+  mot->dy = (int16_t) dy;
+  mot->wheel = (int8_t) wheel;
+
+  return true;
+}
+
+/* add a motion to the last packet of the batch if it is a motion to the same destination */
+static bool merge_motion(struct scnp_session * s, const struct scnp_packet * motion, const uint8_t * addr)
+{
+  if (s->batch.size == 0) return false;
+
+  struct scnp_packet * last = &s->batch.packets[s->batch.size - 1];
+  if (last->type != SCNP_MOT || memcmp(s->batch.addrs[s->batch.size - 1], addr, ETHER_ADDR_LEN) != 0) return false;
+
+  if (!add_motion(last, motion)) return false;
+  ATOMIC_FETCH_ADD(&s->movements_merged, 1);
+
+  return true;
+}
+
+/* add to the batch the relative movement of each axis of a motion, returns as enqueue() */
+static int enqueue_movements(struct scnp_session * s, const struct scnp_packet * motion, const uint8_t * addr)
+{
+  const struct scnp_motion * mot = (const struct scnp_motion *) motion;
+  const uint16_t codes[] = { MOV_CODE_X, MOV_CODE_Y, MOV_CODE_WHEEL };
+  const int32_t values[] = { mot->dx, mot->dy, mot->wheel };
+  struct scnp_movement mov;
+  int ret = 0;
+
+  for (int i = 0; i < 3 && ret != -1; ++i) {
+    if (values[i] == 0) continue;
+    mov.type = SCNP_MOV;
+    mov.move_type = MOV_REL;
+    mov.code = codes[i];
+    mov.value = values[i];
+    ret = enqueue(s, (const struct scnp_packet *) &mov, addr);
+  }
+
+  return ret;
+}
+
+/*
+ * add a packet to the batch, the batch is sent when it is full, returns the result of this
+ * flush, or 1 if the packet was not added because the batch is still full
+ */
+static int enqueue(struct scnp_session * s, const struct scnp_packet * packet, const uint8_t * addr)
+{
+  struct scnp_packet motion;
+
+  if (packet->type == WAKE_TYPE) return 0;
+
+  /* the batch may still be full of the packets a busy socket could not send */
+  if (s->batch.size == SEND_BATCH_MAX) {
+    int ret = flush(s);
+    if (s->batch.size == SEND_BATCH_MAX) return (ret == -1) ? -1 : 1;
+  }
+
+  /* the movements of the axes are sent together, a destination without SCNP_MOT gets one per axis */
+  if (!is_compact(s, addr)) {
+    if (packet->type == SCNP_MOT) return enqueue_movements(s, packet, addr);
+  }
+  else if (to_motion(packet, &motion)) {
+    if (merge_motion(s, &motion, addr)) return 0;
+    packet = &motion;
+  }
+
+  memcpy(&s->batch.packets[s->batch.size], packet, sizeof(struct scnp_packet));
+  memcpy(s->batch.addrs[s->batch.size], addr, ETHER_ADDR_LEN);
+  ++s->batch.size;
+
+  return (s->batch.size == SEND_BATCH_MAX) ? flush(s) : 0;
+}
+
+static void retransmit(const struct scnp_packet * packet, const uint8_t * addr, void * data)
+{
+  enqueue((struct scnp_session *) data, packet, addr);
+}
+
+/*
+ * add to the batch the delayed acknowledgements to the peers it already sends to, so that
+ * they share their frames, and the ones whose delay expired if expire is true
+ */
+static int add_delayed_acks(struct scnp_session * s, bool expire)
+{
+  struct sack_pending acks[SEND_BATCH_MAX];
+  struct scnp_packet  packet;
+  int                 n = 0, ret = 0;
+
+  if (s->ack_delay == 0) return 0;
+
+  for (int i = 0; i < s->batch.size && n < SEND_BATCH_MAX; ++i) {
+    if (sack_take(s->sacks, s->batch.addrs[i], &acks[n].sack)) memcpy(acks[n++].addr, s->batch.addrs[i], ETHER_ADDR_LEN);
+  }
+  ATOMIC_FETCH_ADD(&s->acks_piggybacked, n);
+  if (expire) n += sack_expire(s->sacks, queue_clock(), acks + n, SEND_BATCH_MAX - n);
+
+  for (int i = 0; i < n && ret != -1; ++i) {
+    sack_to_packet(&acks[i].sack, &packet);
+    ret = enqueue(s, &packet, acks[i].addr);
+    ATOMIC_FETCH_ADD(&s->acks_sent, 1);
+    ATOMIC_FETCH_ADD(&s->ids_acked, sack_ids(&acks[i].sack));
+  }
+
+  return ret;
+}
+
+/* time of the next retransmission, delayed acknowledgement or new try of the batch, -1 if there is none */
+static long long int next_deadline(struct scnp_session * s)
+{
+  long long int deadline = inflight_next_deadline(s->inflight);
+  long long int ack_deadline = sack_next_deadline(s->sacks);
+  if (deadline == -1 || (ack_deadline != -1 && ack_deadline < deadline)) deadline = ack_deadline;
+
+  /* the frames a busy socket could not send are tried again soon */
+  if (s->batch.size > 0) {
+    long long int retry = queue_clock() + SEND_RETRY_NS;
+    if (deadline == -1 || retry < deadline) deadline = retry;
+  }
+
+  return deadline;
+}
+
+/*
+ * send the queued packets and the retransmissions, returns -1 if the socket failed. The frames
+ * a busy socket could not send stay in the batch and the packets after them in their lanes.
+ */
+static int send_queued(struct scnp_session * s)
+{
+  struct scnp_packet packet;
+  uint8_t            addr[ETHER_ADDR_LEN];
+  int                ret = 0;
+
+  /* the calling threads cannot send while the batch is built and sent */
+  pthread_mutex_lock(&s->send_mutex);
+
+  /* add the queued packets by strict priority, a lane is emptied before the next one */
+  int64_t count = 0;
+  int lane = 0;
+  while (ret != -1 && lane < SCNP_LANES && s->batch.size < SEND_BATCH_MAX) {
+    if (pull(s->slanes[lane], &packet, addr, 0)) {
+      /* the movements merged while the lane was full are sent after it */
+      if (lane == SCNP_LANE_MOV && take_overflow(s, &packet, addr)) {
+        ret = enqueue(s, &packet, addr);
+        continue;
+      }
+      ++lane;
+      continue;
+    }
+    ++count;
+    ATOMIC_FETCH_ADD(&s->lane_depth[lane], -1);
+    ATOMIC_FETCH_ADD(&s->lane_sent[lane], 1);
+    ret = enqueue(s, &packet, addr);
+
+    /* the batch was sent, the lanes before may have been filled meanwhile */
+    if (s->batch.size == 0) lane = 0;
+  }
+
+  /* retransmit the packets without acknowledgement */
+  inflight_expire(s->inflight, queue_clock(), retransmit, s);
+
+  /* send the batch with the delayed acknowledgements */
+  if (add_delayed_acks(s, true) == -1) ret = -1;
+  if (flush(s) == -1) ret = -1;
+  ATOMIC_FETCH_ADD(&s->queued, -count);
+
+  pthread_mutex_unlock(&s->send_mutex);
+
+  return (ret == -1) ? -1 : 0;
+}
+
+/* suspend the calling thread for a number of nanoseconds */
+static void sleep_ns(long long int ns)
+{
+#ifdef __gnu_linux__
+  struct timespec ts = { (time_t) (ns / 1000000000LL), (long) (ns % 1000000000LL) };
+  nanosleep(&ts, NULL);
+#else
+  Sleep((DWORD) (ns / 1000000));
+#endif
+}
+
+static void * send_packets(void * arg)
+{
+  /* initialize parameters */
+  param_t * param = (param_t *) arg;
+  struct scnp_session * s = param->session;
+
+  s->is_sthread_running = true;
+  bool stop = false;
+
+  /* reset the batch */
+  s->batch.size = 0;
+
+  /* initialize the lanes of the sending queue */
+  for (int lane = 0; lane < SCNP_LANES; ++lane) {
+    s->slanes[lane] = init_queue_capacity(s->lane_capacity[lane]);
+    if (s->slanes[lane] == NULL) stop = true;
+  }
+
+  /* create management thread */
+  s->stop_mthread = false;
+  if (pthread_create(&s->mthread, NULL, manage, (void *) s)) {
+    stop = true;
+  }
+
+  /* push cleanup routine */
+  pthread_cleanup_push(scleanup, s)
+
+  /* resume open_session */
+  sem_post(&param->thread_cnt);
+
+  while(!stop) {
+    /* wait for a packet until the next retransmission or delayed acknowledgement */
+    long long int timeout = -1;
+    long long int deadline = next_deadline(s);
+    if (deadline != -1) {
+      timeout = deadline - queue_clock();
+      if (timeout < 0) timeout = 0;
+    }
+
+    /* wait for a packet in any lane, or for the socket while the batch it could not send is full */
+    if (s->batch.size == SEND_BATCH_MAX) sleep_ns(SEND_RETRY_NS);
+    else if (queue_wait(s->slanes, SCNP_LANES, -1, timeout) == -1 && errno != ETIMEDOUT) stop = true;
+
+    /* the thread is not cancelled while the batch is built and sent */
+    int cancel_state;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+    /* a frame refused or a busy socket does not stop the thread, only a socket that failed */
+    if (send_queued(s)) stop = true;
+    pthread_setcancelstate(cancel_state, NULL);
+  }
+
+  /* execute scleanup */
+  pthread_cleanup_pop(1);
+
+  return NULL;
+}
+
+/* initialize the management packet sent periodically */
+static void init_management(struct scnp_management * mng)
+{
+  mng->type = SCNP_MNG;
+  mng->features = MNG_COMPACT;
+  memset(mng->hostname, 0, HOSTNAME_LENGTH);
+  if (gethostname(mng->hostname, HOSTNAME_LENGTH)) {
+    mng->hostname[HOSTNAME_LENGTH - 1] = 0;
+    errno = 0;
+  }
+}
+
+static void * manage(void * arg)
+{
+  struct scnp_session * s = (struct scnp_session *) arg;
 
   /* initialize ethernet broadcast address */
   uint8_t broadcast[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 
   /* initialize management packet */
   struct scnp_management mng;
-  mng.type = SCNP_MNG;
-  memset(mng.hostname, 0, HOSTNAME_LENGTH);
-  if (gethostname(mng.hostname, HOSTNAME_LENGTH)) {
-    mng.hostname[HOSTNAME_LENGTH - 1] = 0;
-    errno = 0;
-  }
+  init_management(&mng);
 
-  while (!thread_info.stop_mthread) {
+  while (!s->stop_mthread) {
     /* send management packet */
-    if (scnp_send((struct scnp_packet *) &mng, broadcast) && (errno == ENOMEM || errno == ESRCH)) {
+    if (scnp_session_send(s, (struct scnp_packet *) &mng, broadcast) && (errno == ENOMEM || errno == ESRCH)) {
       return NULL;
     }
     /* wait */
@@ -607,6 +1893,217 @@ static void * manage(void * arg)
   return NULL;
 }
 
+#ifdef __gnu_linux__
+
+static void notify_loop(struct scnp_session * s)
+{
+  int64_t expected = 0;
+  if (ATOMIC_CAS(&s->loop.submitted, &expected, 1)) {
+    uint64_t one = 1;
+    if (write(s->loop.sfd, &one, sizeof(one)) == -1) errno = 0;
+  }
+}
+
+static bool is_loop_thread(const struct scnp_session * s)
+{
+  return s->engine == SCNP_ENGINE_EPOLL && pthread_equal(pthread_self(), s->rthread);
+}
+
+static void close_loop(struct scnp_session * s)
+{
+  if (s->loop.epfd != -1) close(s->loop.epfd);
+  if (s->loop.tfd != -1) close(s->loop.tfd);
+  if (s->loop.sfd != -1) close(s->loop.sfd);
+  s->loop.epfd = s->loop.tfd = s->loop.sfd = -1;
+}
+
+/* create the descriptors of the loop, returns -1 on error */
+static int open_loop(struct scnp_session * s)
+{
+  ATOMIC_STORE(&s->loop.submitted, 0);
+  ATOMIC_STORE(&s->loop.stop, 0);
+
+  s->loop.epfd = epoll_create1(EPOLL_CLOEXEC);
+  s->loop.tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  s->loop.sfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (s->loop.epfd == -1 || s->loop.tfd == -1 || s->loop.sfd == -1) return -1;
+
+  int fds[] = { s->socket.fd, s->loop.tfd, s->loop.sfd };
+  for (size_t i = 0; i < sizeof(fds) / sizeof(int); ++i) {
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = fds[i];
+    if (epoll_ctl(s->loop.epfd, EPOLL_CTL_ADD, fds[i], &event)) return -1;
+  }
+
+  return 0;
+}
+
+/* arm the timer at a time of queue_clock(), which is the monotonic clock */
+static void arm_timer(struct scnp_session * s, long long int deadline)
+{
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = deadline / 1000000000;
+  spec.it_value.tv_nsec = deadline % 1000000000;
+  /* a time of zero disarms the timer */
+  if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) spec.it_value.tv_nsec = 1;
+  timerfd_settime(s->loop.tfd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+static void stop_loop(struct scnp_session * s)
+{
+  if (s->loop.started) {
+    ATOMIC_STORE(&s->loop.stop, 1);
+    uint64_t one = 1;
+    if (s->loop.sfd != -1 && write(s->loop.sfd, &one, sizeof(one)) == -1) errno = 0;
+    pthread_join(s->rthread, NULL);
+    s->loop.started = false;
+  }
+  close_loop(s);
+}
+
+static void * run_loop(void * arg)
+{
+  bool stop = false;
+
+  /* initialize parameters */
+  param_t * param = (param_t *) arg;
+  struct scnp_session * s = param->session;
+
+  /* allocate the buffers, the queues and the descriptors */
+  uint8_t * bufs = (uint8_t *) malloc(RECV_BATCH_MAX * MAX_PACKET_LENGTH);
+  if (bufs == NULL) stop = true;
+  s->rqueue = init_queue_capacity(s->recv_capacity);
+  if (s->rqueue == NULL) stop = true;
+  for (int lane = 0; lane < SCNP_LANES; ++lane) {
+    s->slanes[lane] = init_queue_capacity(s->lane_capacity[lane]);
+    if (s->slanes[lane] == NULL) stop = true;
+  }
+  if (open_loop(s)) stop = true;
+
+  /* reset the batches */
+  s->batch.size = 0;
+  struct recv_batch rb;
+  rb.size = 0;
+  rb.nacks = 0;
+
+  /* initialize management packet and its broadcast address */
+  struct scnp_management mng;
+  init_management(&mng);
+  uint8_t broadcast[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  long long int next_management = queue_clock();
+  long long int armed = -1;
+
+  /* resume open_session, which fails if the loop could not be initialized */
+  int err = errno;
+  s->is_rthread_running = !stop;
+  s->is_sthread_running = !stop;
+  param->error = stop ? err : 0;
+  sem_post(&param->thread_cnt);
+
+  while (!stop && !ATOMIC_LOAD(&s->loop.stop)) {
+    /* queue the management packet when it is due */
+    long long int now = queue_clock();
+    if (now >= next_management) {
+      queue_packet(s, (struct scnp_packet *) &mng, broadcast, false);
+      next_management = now + SESSION_TIMEOUT * 1000000000LL;
+    }
+
+    /* wake up at the next management packet, retransmission or delayed acknowledgement */
+    long long int deadline = next_deadline(s);
+    if (deadline == -1 || deadline > next_management) deadline = next_management;
+    if (deadline != armed) {
+      arm_timer(s, deadline);
+      armed = deadline;
+    }
+
+    struct epoll_event events[3];
+    int nevents = epoll_wait(s->loop.epfd, events, 3, -1);
+    if (nevents == -1) {
+      if (errno != EINTR) stop = true;
+      continue;
+    }
+
+    for (int i = 0; i < nevents; ++i) {
+      uint64_t count;
+      if (events[i].data.fd == s->socket.fd) {
+        /* the loop is level-triggered, the frames left are taken at the next turn */
+        if (receive_frames(s, bufs, &rb, MSG_DONTWAIT) == -1 && errno != EAGAIN && errno != EWOULDBLOCK) stop = true;
+      }
+      else if (events[i].data.fd == s->loop.tfd) {
+        /* the timer is disarmed once it has expired */
+        if (read(s->loop.tfd, &count, sizeof(count)) == -1) errno = 0;
+        armed = -1;
+      }
+      else {
+        /* the flag is cleared before the queues are read so that no submission is missed */
+        if (read(s->loop.sfd, &count, sizeof(count)) == -1) errno = 0;
+        ATOMIC_STORE(&s->loop.submitted, 0);
+      }
+    }
+
+    /* send the submitted packets and the retransmissions that are due, until the socket fails */
+    if (send_queued(s)) stop = true;
+  }
+
+  /* release everything but the descriptors, closed by stop_loop */
+  s->is_rthread_running = false;
+  s->is_sthread_running = false;
+  free(bufs);
+  free_queue(s->rqueue);
+  s->rqueue = NULL;
+  for (int lane = 0; lane < SCNP_LANES; ++lane) {
+    free_queue(s->slanes[lane]);
+    s->slanes[lane] = NULL;
+  }
+
+  return NULL;
+}
+
+static int start_loop(struct scnp_session * s, param_t * param)
+{
+  if (pthread_create(&s->rthread, NULL, run_loop, (void *) param)) return -1;
+  s->loop.started = true;
+
+  /* wait for the end of the loop initialization */
+  sem_wait(&param->thread_cnt);
+  if (param->error) {
+    errno = param->error;
+    return -1;
+  }
+
+  return 0;
+}
+
+#else
+
+static void notify_loop(struct scnp_session * s)
+{
+  s = (struct scnp_session *) s;
+}
+
+static bool is_loop_thread(const struct scnp_session * s)
+{
+  s = (const struct scnp_session *) s;
+  return false;
+}
+
+static void stop_loop(struct scnp_session * s)
+{
+  s = (struct scnp_session *) s;
+}
+
+static int start_loop(struct scnp_session * s, param_t * param)
+{
+  s = (struct scnp_session *) s;
+  param = (param_t *) param;
+  errno = EOPNOTSUPP;
+  return -1;
+}
+
+#endif
+
 static int is_ack_needed(const struct scnp_packet * packet)
 {
   return packet->type == SCNP_KEY  || packet->type == SCNP_OUT;
@@ -625,14 +2122,14 @@ static uint32_t get_id_from_packet(const struct scnp_packet * packet)
       struct scnp_out * out = (struct scnp_out *) packet;
       return out->id;
     }
+    case SCNP_ACK:
+    {
+      struct scnp_ack * ack = (struct scnp_ack *) packet;
+      return ack->id;
+    }
     default:
       errno = EBADMSG;
   }
 
   return 0;
 }
-
-static bool is_ack_correct(const struct scnp_packet * sent, const uint8_t * dest_addr, const struct scnp_packet * received, const uint8_t * src_addr)
-{
-  return (received->type == SCNP_ACK && get_id_from_packet(sent) == get_id_from_packet(received) && memcmp(src_addr, dest_addr, ETHER_ADDR_LEN) == 0);
-}
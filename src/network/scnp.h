@@ -13,6 +13,9 @@ extern "C" {
 #define SCNP_KEY 0x01
 #define SCNP_MOV 0x02
 #define SCNP_OUT 0x03
+#define SCNP_MOT 0x04
+#define SCNP_BATCH 0x05
+#define SCNP_SACK 0xfd
 #define SCNP_MNG 0xfe
 #define SCNP_ACK 0xff
 
@@ -20,25 +23,81 @@ extern "C" {
 #define KEY_LENGTH 8
 #define MOV_LENGTH 8
 #define OUT_LENGTH 8
-#define MNG_LENGTH 65
+#define MOT_LENGTH 6
+#define MNG_LENGTH 66
 #define ACK_LENGTH 5
+#define SACK_LENGTH 11
+#define BATCH_LENGTH 2
 
 /* Maximum length of SCNP packet */
 #define MAX_PACKET_LENGTH 127
 
+/*
+ * Maximum number of packets in a SCNP_BATCH frame. The frame starts with its
+ * type and the number of packets, followed by the packets as they are sent
+ * alone (type and fields). Only SCNP_KEY, SCNP_MOV, SCNP_MOT and the
+ * acknowledgements are batched, each SCNP_KEY keeps its own identifier, and
+ * only to the destinations whose SCNP_MNG advertises MNG_COMPACT.
+ */
+#define BATCH_MAX_PACKETS 15
+
+/* Number of identifiers following the range of a SCNP_SACK that it can acknowledge */
+#define SACK_BITMAP_BITS 32
+
 /* Hostname length in SCNP management */
 #define HOSTNAME_LENGTH 64
 
+/* Length of the SCNP_MNG of the devices without features, which have none of them */
+#define MNG_BASE_LENGTH 65
+
+/* Features of a device, see struct scnp_management */
+#define MNG_COMPACT 0x01
+
 /* SCNP movement flag */
 #define MOV_REL true
 #define MOV_ABS false
 
+/* SCNP movement codes merged into SCNP motions, same as evdev REL_X, REL_Y and REL_WHEEL */
+#define MOV_CODE_X 0x00
+#define MOV_CODE_Y 0x01
+#define MOV_CODE_WHEEL 0x08
+
 /* SCNP out flags */
 #define OUT_EGRESS true
 #define OUT_INGRESS false
 #define OUT_RIGHT true
 #define OUT_LEFT false
 
+/* Maximum number of peers given to scnp_set_peers() */
+#define SCNP_MAX_PEERS SCNP_FILTER_MAX_PEERS
+
+/* Maximum number of SCNP sessions open at the same time */
+#define SCNP_MAX_SESSIONS 8
+
+/* Lanes of the sending queue, a lane is only sent when the lanes before it are empty */
+#define SCNP_LANE_ACK 0
+#define SCNP_LANE_OUT 1
+#define SCNP_LANE_KEY 2
+#define SCNP_LANE_MOV 3
+#define SCNP_LANE_MNG 4
+#define SCNP_LANES 5
+
+/* Engines of a SCNP session, see struct scnp_options */
+#define SCNP_ENGINE_THREADS 0
+#define SCNP_ENGINE_EPOLL 1
+
+/* Maximum number of frames a SCNP_KEY is sent in, see struct scnp_options */
+#define SCNP_MAX_KEY_COPIES 4
+
+/* Socket tuning profiles, see scnp_tuning_profile() */
+#define SCNP_TUNING_NONE 0
+#define SCNP_TUNING_LOW_LATENCY 1
+
+/* Delivery status of a SCNP packet that needs an acknowledgement */
+#define SCNP_PENDING 0
+#define SCNP_ACKED 1
+#define SCNP_TIMEDOUT 2
+
 
 /**
  * @struct struct scnp_packet
@@ -99,6 +158,32 @@ struct scnp_movement
   int32_t value;
 };
 
+/**
+ * @struct struct scnp_motion
+ * @brief SCNP motion structure.
+ *
+ * Structure of a SCNP packet used to send the relative movements of the
+ * axes of a pointing device that happened together. The sending thread
+ * converts the relative SCNP_MOV packets of MOV_CODE_X, MOV_CODE_Y and
+ * MOV_CODE_WHEEL into SCNP_MOT packets, and merges the ones that are sent
+ * to the same destination and pending at the same time. Only for the
+ * destinations whose SCNP_MNG advertises MNG_COMPACT, the others get the
+ * SCNP_MOV of each axis.
+ *
+ * @var type Type of the SCNP packet. Must be SCNP_MOT.
+ * @var dx Movement on the horizontal axis.
+ * @var dy Movement on the vertical axis.
+ * @var wheel Movement of the wheel.
+ */
+
+struct scnp_motion
+{
+  uint8_t type;
+  int16_t dx;
+  int16_t dy;
+  int8_t wheel;
+};
+
 /**
  * @struct struct scnp_out
  * @brief SCNP out structure.
@@ -138,12 +223,17 @@ struct scnp_out
  * @var type Type of the SCNP packet. Must be SCNP_MNG.
  * @var hostname Hostname of the device. Its length must not exceed
  * 63 characters. The character following the last one must be '\0'.
+ * @var features Set by the library. MNG_COMPACT if the device decodes
+ * SCNP_MOT and SCNP_BATCH, the movements and the frames sent to the other
+ * devices are not merged nor packed. 0 for the devices whose SCNP_MNG is
+ * only MNG_BASE_LENGTH long.
  */
 
 struct scnp_management
 {
   uint8_t type;
   char hostname[HOSTNAME_LENGTH];   // Hostname label of the device linked with the source interface
+  uint8_t features;
 };
 
 /**
@@ -164,13 +254,217 @@ struct scnp_ack
   uint32_t id;    //identifier
 };
 
+/**
+ * @struct scnp_sack
+ * @brief SCNP selective acknowledgement structure.
+ *
+ * Structure of a SCNP packet used to confirm the reception of several
+ * SCNP packets from the same source at once. A single identifier is
+ * acknowledged with a SCNP_ACK.
+ *
+ * @var type Type of the SCNP packet. Must be SCNP_SACK.
+ * @var id First identifier of the range of acknowledged packets.
+ * @var count Number of identifiers in the range, at least 1.
+ * @var bitmap Bit i acknowledges the identifier id + count + i, so that the
+ * packets received after a lost one are acknowledged too.
+ */
+
+struct scnp_sack
+{
+  uint8_t type;     // SCNP_SACK
+  uint32_t id;      // first identifier of the range
+  uint16_t count;   // length of the range
+  uint32_t bitmap;  // identifiers received after the range
+};
+
+/**
+ * @typedef scnp_callback
+ * @brief Completion callback of a SCNP packet that needs an acknowledgement.
+ *
+ * The callback is called by the receiving thread when the acknowledgement is
+ * received, or by the sending thread when every retransmission timed out.
+ * It must not block.
+ *
+ * @param packet SCNP packet that was sent, with its identifier set.
+ * @param dest_addr Destination ethernet address of the packet.
+ * @param status SCNP_ACKED or SCNP_TIMEDOUT.
+ * @param data Pointer given to scnp_send_async().
+ */
+
+typedef void (*scnp_callback)(const struct scnp_packet * packet, const uint8_t * dest_addr, int status, void * data);
+
+/**
+ * @struct scnp_stats
+ * @brief Counters of the current SCNP session.
+ *
+ * The counters are reset by scnp_start().
+ *
+ * @var packets_sent Number of SCNP packets sent, retransmissions included.
+ * @var send_calls Number of system calls made to send these packets.
+ * @var send_calls_saved Number of calls avoided by sending several packets
+ * in one call.
+ * @var packets_received Number of SCNP packets received, the ones of the
+ * SCNP_BATCH frames included.
+ * @var recv_calls Number of system calls made to receive these packets.
+ * @var movements_merged Number of movements merged into a pending SCNP_MOT.
+ * @var packets_batched Number of packets sent inside SCNP_BATCH frames.
+ * @var direct_sends Number of packets sent by the thread that called
+ * scnp_send_async(), see struct scnp_options.
+ * @var duplicates_dropped Number of SCNP_KEY and SCNP_OUT packets received
+ * again. They are acknowledged but not given to scnp_recv().
+ * @var fast_retransmits Number of packets retransmitted before their
+ * timeout because a packet sent after them was acknowledged.
+ * @var lane_depth Number of packets waiting in each lane of the sending
+ * queue, indexed by SCNP_LANE_ACK to SCNP_LANE_MNG.
+ * @var lane_sent Number of packets taken from each lane by the sending
+ * thread.
+ * @var lane_high_water Highest number of packets that waited in each lane.
+ * @var recv_high_water Highest number of packets that waited in the
+ * receiving queue.
+ * @var movements_overflowed Number of movements merged into a pending
+ * motion because their lane was full.
+ * @var acks_sent Number of SCNP_ACK and SCNP_SACK sent, see ack_delay_ns
+ * in struct scnp_options.
+ * @var acks_piggybacked Number of these acknowledgements sent with other
+ * packets to the peer before their delay expired.
+ * @var ids_acked Number of identifiers acknowledged by them.
+ * @var copies_sent Number of frames sent again because they carry keys,
+ * see key_copies in struct scnp_options.
+ * @var recv_dropped Number of packets received while the receiving queue
+ * was full. The SCNP_KEY and SCNP_OUT ones are not acknowledged, their
+ * sender retransmits them.
+ * @var send_errors Number of frames, or datagrams of a peer in UDP mode,
+ * refused by the system and dropped. The session keeps sending, the keys
+ * they carried are retransmitted.
+ */
+
+struct scnp_stats
+{
+  uint64_t packets_sent;
+  uint64_t send_calls;
+  uint64_t send_calls_saved;
+  uint64_t packets_received;
+  uint64_t recv_calls;
+  uint64_t movements_merged;
+  uint64_t packets_batched;
+  uint64_t direct_sends;
+  uint64_t duplicates_dropped;
+  uint64_t fast_retransmits;
+  uint64_t lane_depth[SCNP_LANES];
+  uint64_t lane_sent[SCNP_LANES];
+  uint64_t lane_high_water[SCNP_LANES];
+  uint64_t recv_high_water;
+  uint64_t movements_overflowed;
+  uint64_t acks_sent;
+  uint64_t acks_piggybacked;
+  uint64_t ids_acked;
+  uint64_t copies_sent;
+  uint64_t recv_dropped;
+  uint64_t send_errors;
+};
+
+/**
+ * @struct scnp_rtt
+ * @brief Round trip estimation of a destination, see scnp_get_rtt().
+ *
+ * @var srtt_ns Smoothed round trip time, in nanoseconds.
+ * @var rttvar_ns Variation of the round trip time, in nanoseconds.
+ * @var rto_ns Current retransmission timeout, in nanoseconds.
+ * @var samples Number of round trips measured.
+ */
+
+struct scnp_rtt
+{
+  uint64_t srtt_ns;
+  uint64_t rttvar_ns;
+  uint64_t rto_ns;
+  uint64_t samples;
+};
+
+/**
+ * @struct scnp_options
+ * @brief Options of a SCNP session, see scnp_start_opt().
+ *
+ * A structure filled with zeros gives the behaviour of scnp_start().
+ *
+ * @var socket_mode SCNP_SOCKET_PLAIN to receive and send frames with system
+ * calls, SCNP_SOCKET_RING to exchange them through memory-mapped rings
+ * (Linux only). In ring mode, a received frame may wait up to a millisecond
+ * for its block of the ring to be given by the kernel. SCNP_SOCKET_UDP to
+ * exchange the packets in UDP datagrams over IPv4 and IPv6, which needs no
+ * privilege and works on the loopback (Linux only). The peers of a UDP
+ * session are designated by the handles given by scnp_session_add_peer()
+ * or scnp_recv(), the interface index may be 0 to use every interface and
+ * the peers set by scnp_set_peers() do not apply.
+ * @var direct_send If true, scnp_send_async() builds and sends the packet
+ * from the calling thread when the sending thread has no packet waiting,
+ * which saves the wake up of the sending thread. The packets go through the
+ * sending queue when the sending thread is busy, so their order is kept.
+ * @var rto_min_ns Floor of the retransmission timeout, in nanoseconds.
+ * 0 for the default (5 ms).
+ * @var rto_max_ns Ceiling of the retransmission timeout, in nanoseconds.
+ * 0 for the default (1 s). It is also the timeout used before the first
+ * round trip to a destination is measured, if it is below one second.
+ * @var lane_capacity Number of packets each lane of the sending queue can
+ * store, indexed by SCNP_LANE_ACK to SCNP_LANE_MNG. 0 for the default
+ * (1024). It is rounded up to a power of two, at least 2. When the lane of
+ * the movements is full, the relative movements are merged into a pending
+ * motion sent after the lane. The keys of the buttons (BTN_MISC to
+ * BTN_GEAR_UP) share the lane of the movements, so that they are sent
+ * after the movements before them. When the lane of a key is full,
+ * scnp_send_async() waits up to 100 ms for the sending thread to make
+ * room, then leaves the key to the retransmission timer.
+ * @var recv_capacity Number of packets the receiving queue can store. 0 for
+ * the default (1024). The packets received when it is full are
+ * dropped, the ones needing an acknowledgement are retransmitted by their
+ * sender.
+ * @var engine SCNP_ENGINE_THREADS to receive, send and send the management
+ * packets with three threads. SCNP_ENGINE_EPOLL to do all of it in one
+ * thread running an epoll loop over the socket, a timerfd for the
+ * management packets and the retransmissions, and an eventfd signaled by
+ * scnp_send_async() (Linux only).
+ * @var udp_port Port of a session in SCNP_SOCKET_UDP mode. 0 for the
+ * default (SCNP_UDP_PORT).
+ * @var tuning Options set on the socket when the session starts, see
+ * scnp_tuning_profile(). A session still starts if some of them are
+ * refused, scnp_get_tuning() gives the ones in effect.
+ * @var ack_delay_ns Time the acknowledgements to a peer wait, in
+ * nanoseconds, so that the next ones are merged into a SCNP_SACK or carried
+ * by a packet sent to the peer meanwhile. 0 for the default, the
+ * acknowledgements are sent by the receiving thread once the frames received
+ * together are decoded, merged per peer. Must be below rto_min_ns of the
+ * peers, or their packets are retransmitted before being acknowledged.
+ * @var key_copies Number of frames each SCNP_KEY is sent in, up to
+ * SCNP_MAX_KEY_COPIES. 0 or 1 for the default, the keys are kept until
+ * their acknowledgement and retransmitted. Above 1, the frames carrying keys
+ * are sent again after the other frames of the same system call and the
+ * keys are neither kept nor retransmitted. The peer gives a key once and
+ * drops its copies, a key is lost only if every copy is.
+ */
+
+struct scnp_options
+{
+  int socket_mode;
+  bool direct_send;
+  long long int rto_min_ns;
+  long long int rto_max_ns;
+  size_t lane_capacity[SCNP_LANES];
+  size_t recv_capacity;
+  int engine;
+  uint16_t udp_port;
+  struct scnp_tuning tuning;
+  long long int ack_delay_ns;
+  int key_copies;
+};
+
 /**
  * @fn int scnp_start(int if_index)
  * @brief Start a SCNP session.
  *
  * Function that creates and runs threads required to send and receive
  * SCNP packets. Also it begins to send periodic management packets.
- * You cannot start multiple SCNP session in a same process.
+ * This is the default session, used by the functions that do not take a
+ * session. Other sessions are opened with scnp_session_open().
  *
  * @param if_index Index of the network interface used to send
  * and receive SCNP packets.
@@ -181,8 +475,8 @@ struct scnp_ack
  * @section Errors
  * EACCES Permission denied. User must be root.
  * EAGAIN Insufficient resources to create threads.
- * EALREADY SCNP session already started. Stop the older one before with
- * scnp_stop() or create a new process.
+ * EALREADY SCNP session already started, or a session is open on this
+ * interface. Stop the older one before with scnp_stop().
  * EMFILE The per-process limit on the number of open file descriptors has
  * been reached.
  * ENETDOWN Interface is not up.
@@ -192,10 +486,29 @@ struct scnp_ack
  * ENODEV Unknown interface index.
  * ENXIO Invalid interface index.
  * EPERM Permission denied, user is not the superuser.
+ * EXFULL SCNP_MAX_SESSIONS sessions are already open.
  */
 
 int scnp_start(unsigned int if_index, const char * key);
 
+/**
+ * @fn int scnp_start_opt(unsigned int if_index, const char * key, const struct scnp_options * options)
+ * @brief Start a SCNP session with options.
+ *
+ * Same as scnp_start() with the options of the session. If options is NULL,
+ * the default options are used.
+ *
+ * @section Errors
+ * Same as scnp_start(), and:
+ * EINVAL Unknown socket mode or engine, negative timeout, floor of the
+ * retransmission timeout above its ceiling, acknowledgement delay not below
+ * that floor, capacity of a queue above 2^20 packets or number of copies of
+ * the keys out of range.
+ * EOPNOTSUPP Socket mode or engine not available on this system.
+ */
+
+int scnp_start_opt(unsigned int if_index, const char * key, const struct scnp_options * options);
+
 /**
  * @fn int scnp_stop(void)
  * @brief Stop a SCNP session.
@@ -212,25 +525,122 @@ void scnp_stop(void);
  * @fn int scnp_send(struct scnp_packet * packet, const uint8_t * dest_addr)
  * @brief Send a SCNP packet.
  *
+ * Same as scnp_send_async() without completion callback. This function does
+ * not wait for the acknowledgement of the packet.
+ *
  * @param packet SCNP packet to be sent.
  * @param dest_addr Destination ethernet address.
  * @return On success, returns 0.
  * On error, returns -1 and errno is set appropriately.
  * @section Errors
- * ENOMEM Out of memory.
  * ESRCH No SCNP session running.
- * ETIMEDOUT Packet sent and an acknowledgement was required but none was
- * received.
- * EXFULL Packet queue is full.
+ * EXFULL Packet queue or in-flight window of the destination is full.
  */
 
 int scnp_send(struct scnp_packet * packet, const uint8_t * dest_addr);
 
+/**
+ * @fn int scnp_send_async(struct scnp_packet * packet, const uint8_t * dest_addr, scnp_callback callback, void * data)
+ * @brief Send a SCNP packet without waiting for its acknowledgement.
+ *
+ * The packet is queued and the function returns immediately. If the packet
+ * needs an acknowledgement (SCNP_KEY and SCNP_OUT), the library sets its
+ * identifier and keeps it in the in-flight window of the destination until
+ * the acknowledgement is received. It is retransmitted by the sending thread
+ * when no acknowledgement is received in time. The result can be obtained
+ * with the callback or with scnp_send_status(). When the session sends the
+ * keys in several copies, see struct scnp_options, a SCNP_KEY only gets its
+ * identifier: the callback is not called and its status is unknown. A
+ * packet needing an acknowledgement whose lane of the queue stays full is
+ * kept in the in-flight window and sent by the retransmission timer. On
+ * error, the packet is not kept and is never retransmitted.
+ *
+ * @param packet SCNP packet to be sent. Its identifier is set by this function.
+ * @param dest_addr Destination ethernet address.
+ * @param callback Function called when the packet is acknowledged or timed
+ * out. May be NULL. Never called for packets without acknowledgement.
+ * @param data Pointer given to the callback.
+ * @return On success, returns 0.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * ESRCH No SCNP session running.
+ * EXFULL Packet queue or in-flight window of the destination is full. A
+ * relative movement is only rejected if it cannot be merged into the
+ * pending motion, and a key or a SCNP_OUT only if the in-flight window is
+ * full too, a key after waiting 100 ms for room in the queue.
+ */
+
+int scnp_send_async(struct scnp_packet * packet, const uint8_t * dest_addr, scnp_callback callback, void * data);
+
+/**
+ * @fn int scnp_send_status(const uint8_t * dest_addr, uint32_t id)
+ * @brief Get the delivery status of a SCNP packet sent with acknowledgement.
+ *
+ * @param dest_addr Destination ethernet address of the packet.
+ * @param id Identifier of the packet, set by scnp_send_async().
+ * @return SCNP_PENDING, SCNP_ACKED or SCNP_TIMEDOUT.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * ENOENT Unknown packet. The window may have reused its place.
+ */
+
+int scnp_send_status(const uint8_t * dest_addr, uint32_t id);
+
+/**
+ * @fn int scnp_get_rtt(const uint8_t * dest_addr, struct scnp_rtt * rtt)
+ * @brief Get the round trip estimation of a destination.
+ *
+ * The round trips are measured with the acknowledgements of the packets
+ * sent once, and give the quality of the link to the destination.
+ *
+ * @param dest_addr Ethernet address of the destination.
+ * @param rtt Structure filled with the estimation.
+ * @return On success, returns 0.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * ENOENT No round trip measured to this destination.
+ */
+
+int scnp_get_rtt(const uint8_t * dest_addr, struct scnp_rtt * rtt);
+
+/**
+ * @fn int scnp_add_peer(const struct sockaddr * addr, socklen_t addrlen, uint8_t * peer)
+ * @brief Give the address used to reach a socket address through a session
+ * in SCNP_SOCKET_UDP mode.
+ *
+ * The address is a handle of 6 bytes used in place of an ethernet address
+ * by the other functions. It stays valid until the session is stopped. The
+ * sources of the datagrams received are given handles the same way, so a
+ * peer that sends first does not need to be added, but when the table of
+ * the peers is full, the handle of such a source quiet for
+ * SCNP_SOCKET_PEER_IDLE_MS may be given to a new one. The broadcast address
+ * reaches every peer of the session.
+ *
+ * @param addr IPv4 or IPv6 socket address of the peer.
+ * @param addrlen Length of addr.
+ * @param peer Filled with the handle of the peer.
+ * @return On success, returns 0.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * ESRCH The session is not running.
+ * EOPNOTSUPP The session is not in SCNP_SOCKET_UDP mode.
+ * EAFNOSUPPORT The address is neither IPv4 nor IPv6.
+ * EINVAL A parameter is NULL or addrlen is too short.
+ * EXFULL SCNP_SOCKET_MAX_PEERS peers were added by this function.
+ */
+
+int scnp_add_peer(const struct sockaddr * addr, socklen_t addrlen, uint8_t * peer);
+
 /**
  * @fn int scnp_recv(struct scnp_packet * packet, uint8_t * src_addr)
  * @brief Receive a SCNP packet and provide the source address of
  * the message.
  *
+ * The packets of a SCNP_BATCH frame are received one by one, a SCNP_BATCH
+ * packet is never returned. SCNP_KEY and SCNP_OUT packets are acknowledged
+ * by the receiving thread before they are queued, whether or not they are
+ * received with this function.
+ *
  * @param packet SCNP packet that will be fill with received SCNP data.
  * @param src_addr Source address of the received SCNP packet.
  * @return On success, returns 0.
@@ -241,8 +651,239 @@ int scnp_send(struct scnp_packet * packet, const uint8_t * dest_addr);
 
 int scnp_recv(struct scnp_packet * packet, uint8_t * src_addr);
 
+/**
+ * @fn int scnp_try_recv(struct scnp_packet * packet, uint8_t * src_addr)
+ * @brief Receive a SCNP packet without blocking, see scnp_recv().
+ *
+ * Lets the caller take every packet already received before acting on them.
+ *
+ * @return On success, returns 0.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * EAGAIN No packet is waiting.
+ * ESRCH No SCNP session is running.
+ */
+
+int scnp_try_recv(struct scnp_packet * packet, uint8_t * src_addr);
+
+/**
+ * @fn int scnp_poll_fd(void)
+ * @brief Get a file descriptor readable while received packets wait.
+ *
+ * The descriptor can be added to the poll, select or epoll loop of the
+ * caller, scnp_recv() does not block when it is readable. It is cleared by
+ * scnp_recv() once every received packet is taken, and must not be read or
+ * closed by the caller. It is closed by scnp_stop(). Works with every
+ * engine (Linux only).
+ *
+ * @return On success, returns the file descriptor.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * EMFILE, ENFILE, ENOMEM The descriptor cannot be created.
+ * EOPNOTSUPP Not available on this system.
+ * ESRCH No SCNP session is running.
+ */
+
+int scnp_poll_fd(void);
+
 void scnp_set_key(const char * key);
 
+/**
+ * @fn int scnp_set_peers(const uint8_t (* addrs)[ETHER_ADDR_LEN], size_t count)
+ * @brief Set the devices SCNP packets are accepted from.
+ *
+ * The frames of other sources are dropped by the kernel before they reach
+ * the library. The frames sent by this host, with an unknown type or too
+ * short for their type are always dropped. The peers are kept for the next
+ * sessions and the filter of the running session is regenerated.
+ *
+ * @param addrs Ethernet addresses of the peers.
+ * @param count Number of peers, 0 to accept SCNP packets from any device.
+ * @return On success, returns 0.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * EINVAL More than SCNP_MAX_PEERS peers.
+ */
+
+int scnp_set_peers(const uint8_t (* addrs)[ETHER_ADDR_LEN], size_t count);
+
+/**
+ * @fn void scnp_get_stats(struct scnp_stats * stats)
+ * @brief Get the counters of the current SCNP session.
+ *
+ * @param stats Structure filled with the counters.
+ */
+
+void scnp_get_stats(struct scnp_stats * stats);
+
+/**
+ * @fn int scnp_tuning_profile(int profile, struct scnp_tuning * tuning)
+ * @brief Fill the socket options of a tuning profile.
+ *
+ * SCNP_TUNING_NONE leaves every option to the system. SCNP_TUNING_LOW_LATENCY
+ * busy polls the device before sleeping, sends in the interactive band of
+ * the queueing discipline and past it when the socket allows it, and sizes
+ * the buffers for bursts of input events.
+ *
+ * @param profile SCNP_TUNING_NONE or SCNP_TUNING_LOW_LATENCY.
+ * @param tuning Structure filled with the options, given in struct
+ * scnp_options.
+ * @return On success, returns 0.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * EINVAL Unknown profile.
+ */
+
+int scnp_tuning_profile(int profile, struct scnp_tuning * tuning);
+
+/**
+ * @fn int scnp_get_tuning(struct scnp_tuning * tuning)
+ * @brief Get the socket options in effect for the current SCNP session.
+ *
+ * @param tuning Structure filled with the options.
+ * @return On success, returns 0.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * ESRCH The session is not running.
+ */
+
+int scnp_get_tuning(struct scnp_tuning * tuning);
+
+/**
+ * @typedef scnp_session_t
+ * @brief Handle of a SCNP session opened with scnp_session_open().
+ *
+ * Each session has its own socket, threads, queues, in-flight window and
+ * counters, so that several network interfaces can be used at the same
+ * time. The key set by scnp_set_key() and the peers set by
+ * scnp_set_peers() are shared by all sessions.
+ */
+
+typedef struct scnp_session scnp_session_t;
+
+/**
+ * @fn scnp_session_t * scnp_session_open(unsigned int if_index, const char * key, const struct scnp_options * options)
+ * @brief Open a SCNP session on a network interface.
+ *
+ * Same as scnp_start_opt() for a new session. Only one session can be
+ * open on an interface, including the one of scnp_start().
+ *
+ * @return On success, returns the session.
+ * On error, returns NULL and errno is set appropriately.
+ * @section Errors
+ * Same as scnp_start_opt().
+ */
+
+scnp_session_t * scnp_session_open(unsigned int if_index, const char * key, const struct scnp_options * options);
+
+/**
+ * @fn void scnp_session_close(scnp_session_t * session)
+ * @brief Stop a SCNP session and free it.
+ *
+ * Same as scnp_stop() for the session, which cannot be used anymore. The
+ * key is reset to zero when the last session is closed. Does nothing if
+ * session is NULL.
+ */
+
+void scnp_session_close(scnp_session_t * session);
+
+/**
+ * @fn int scnp_session_send(scnp_session_t * session, struct scnp_packet * packet, const uint8_t * dest_addr)
+ * @brief Send a SCNP packet through a session, see scnp_send().
+ */
+
+int scnp_session_send(scnp_session_t * session, struct scnp_packet * packet, const uint8_t * dest_addr);
+
+/**
+ * @fn int scnp_session_send_async(scnp_session_t * session, struct scnp_packet * packet, const uint8_t * dest_addr, scnp_callback callback, void * data)
+ * @brief Send a SCNP packet through a session without waiting for its
+ * acknowledgement, see scnp_send_async().
+ */
+
+int scnp_session_send_async(scnp_session_t * session, struct scnp_packet * packet, const uint8_t * dest_addr, scnp_callback callback, void * data);
+
+/**
+ * @fn int scnp_session_send_status(scnp_session_t * session, const uint8_t * dest_addr, uint32_t id)
+ * @brief Delivery status of a SCNP packet sent through a session, see
+ * scnp_send_status().
+ */
+
+int scnp_session_send_status(scnp_session_t * session, const uint8_t * dest_addr, uint32_t id);
+
+/**
+ * @fn int scnp_session_get_rtt(scnp_session_t * session, const uint8_t * dest_addr, struct scnp_rtt * rtt)
+ * @brief Round trip estimation of a destination through a session, see
+ * scnp_get_rtt().
+ */
+
+int scnp_session_get_rtt(scnp_session_t * session, const uint8_t * dest_addr, struct scnp_rtt * rtt);
+
+/**
+ * @fn int scnp_session_add_peer(scnp_session_t * session, const struct sockaddr * addr, socklen_t addrlen, uint8_t * peer)
+ * @brief Give the address of a peer of a UDP session, see scnp_add_peer().
+ */
+
+int scnp_session_add_peer(scnp_session_t * session, const struct sockaddr * addr, socklen_t addrlen, uint8_t * peer);
+
+/**
+ * @fn int scnp_session_recv(scnp_session_t * session, struct scnp_packet * packet, uint8_t * src_addr)
+ * @brief Receive a SCNP packet from a session, see scnp_recv().
+ */
+
+int scnp_session_recv(scnp_session_t * session, struct scnp_packet * packet, uint8_t * src_addr);
+
+/**
+ * @fn int scnp_session_try_recv(scnp_session_t * session, struct scnp_packet * packet, uint8_t * src_addr)
+ * @brief Receive a SCNP packet from a session without blocking, see
+ * scnp_try_recv().
+ */
+
+int scnp_session_try_recv(scnp_session_t * session, struct scnp_packet * packet, uint8_t * src_addr);
+
+/**
+ * @fn int scnp_session_poll_fd(scnp_session_t * session)
+ * @brief File descriptor readable while received packets wait in a
+ * session, see scnp_poll_fd(). It is closed by scnp_session_close().
+ */
+
+int scnp_session_poll_fd(scnp_session_t * session);
+
+/**
+ * @fn void scnp_session_get_stats(scnp_session_t * session, struct scnp_stats * stats)
+ * @brief Get the counters of a session, see scnp_get_stats().
+ */
+
+void scnp_session_get_stats(scnp_session_t * session, struct scnp_stats * stats);
+
+/**
+ * @fn int scnp_session_get_tuning(scnp_session_t * session, struct scnp_tuning * tuning)
+ * @brief Get the socket options in effect for a session, see
+ * scnp_get_tuning().
+ */
+
+int scnp_session_get_tuning(scnp_session_t * session, struct scnp_tuning * tuning);
+
+/**
+ * @fn int scnp_best_path(scnp_session_t * const * sessions, const uint8_t (* addrs)[ETHER_ADDR_LEN], size_t count)
+ * @brief Choose the path with the lowest latency to a peer.
+ *
+ * A peer with several network interfaces is reached through one session
+ * per path, at a different ethernet address on each. The path with the
+ * lowest smoothed round trip time is chosen. A path whose round trip is
+ * not measured yet is chosen first, so that every path gets measured by
+ * the packets with acknowledgement sent through it.
+ *
+ * @param sessions Session of each path.
+ * @param addrs Ethernet address of the peer on each path.
+ * @param count Number of paths.
+ * @return On success, returns the index of the chosen path.
+ * On error, returns -1 and errno is set appropriately.
+ * @section Errors
+ * EINVAL No path.
+ */
+
+int scnp_best_path(scnp_session_t * const * sessions, const uint8_t (* addrs)[ETHER_ADDR_LEN], size_t count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,22 +11,98 @@
 extern "C" {
 #endif
 
+    /* Socket modes */
+#define SCNP_SOCKET_PLAIN 0 // one copy and one system call per batch of frames
+#define SCNP_SOCKET_RING 1  // frames exchanged through rings shared with the kernel (Linux)
+#define SCNP_SOCKET_UDP 2   // datagrams over UDP, IPv4 and IPv6, without privileges (Linux)
+
+    /* Capacities of struct scnp_filter */
+#define SCNP_FILTER_MAX_TYPES 16
+#define SCNP_FILTER_MAX_PEERS 32
+
+    /* Default port of the UDP mode */
+#define SCNP_UDP_PORT 8888
+
+    /* Number of socket addresses a socket in UDP mode can reach */
+#define SCNP_SOCKET_MAX_PEERS 64
+
+    /* Time in milliseconds a source added on reception must stay quiet before its place is given */
+#define SCNP_SOCKET_PEER_IDLE_MS 1000
+
 #ifdef __gnu_linux__
 #include <net/ethernet.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <pthread.h>
 
 
+    /**
+     * @struct scnp_socket
+     * @brief AF_PACKET socket, optionally with memory-mapped rings.
+     *
+     * @var fd File descriptor of the socket.
+     * @var if_index Index of the interface the socket is bound to.
+     * @var mode SCNP_SOCKET_PLAIN or SCNP_SOCKET_RING.
+     * @var src_addr Ethernet address of the interface (ring mode).
+     * @var ring Mapped receive ring followed by the transmit ring.
+     * @var ring_size Size of the mapping.
+     * @var rx_block Index of the receive block being read.
+     * @var rx_left Number of frames left in this block.
+     * @var rx_frame Next frame to read in this block.
+     * @var rx_release True if this block must be given back to the kernel.
+     * @var tx_frame Index of the next frame of the transmit ring.
+     * @var rx_calls Number of system calls made to receive frames.
+     * @var tx_calls Number of system calls made to send frames.
+     * @var tx_errors Number of datagrams refused for their destination and
+     * skipped, the others of the call are still sent (UDP mode).
+     * @var family AF_INET6, or AF_INET if IPv6 is not available (UDP mode).
+     * @var port Local port (UDP mode).
+     * @var peers_mutex Held while a peer is added or replaced, and while its
+     * address is read to send (UDP mode).
+     * @var npeers Number of known peers, published once their address is
+     * written (UDP mode).
+     * @var peers Socket address of each peer, IPv4 ones mapped in IPv6 (UDP
+     * mode).
+     * @var peer_seen Time in nanoseconds of CLOCK_MONOTONIC each peer was
+     * added or last received from (UDP mode).
+     * @var peer_confirmed True for the peers given to scnp_socket_add_peer(),
+     * whose place is never given to another source (UDP mode).
+     * @var nfilter_peers Number of peers accepted by the filter (UDP mode).
+     * @var filter_peers Peers accepted by the filter (UDP mode).
+     */
+
     struct scnp_socket
     {
-        int fd;
-        int if_index;
+        int       fd;
+        int       if_index;
+        int       mode;
+        uint8_t   src_addr[ETHER_ADDR_LEN];
+        uint8_t * ring;
+        size_t    ring_size;
+        unsigned  rx_block;
+        unsigned  rx_left;
+        uint8_t * rx_frame;
+        bool      rx_release;
+        unsigned  tx_frame;
+        int64_t   rx_calls;
+        int64_t   tx_calls;
+        int64_t   tx_errors;
+        int                 family;
+        uint16_t            port;
+        pthread_mutex_t     peers_mutex;
+        int64_t             npeers;
+        struct sockaddr_in6 peers[SCNP_SOCKET_MAX_PEERS];
+        int64_t             peer_seen[SCNP_SOCKET_MAX_PEERS];
+        bool                peer_confirmed[SCNP_SOCKET_MAX_PEERS];
+        int64_t             nfilter_peers;
+        uint8_t             filter_peers[SCNP_FILTER_MAX_PEERS][ETHER_ADDR_LEN];
     };
 
 #else
 
 #include <pcap.h>
 #include <winsock2.h>
+#include <ws2tcpip.h>
   
 #define ETHER_ADDR_LEN 6
 
@@ -34,21 +110,218 @@ extern "C" {
     {
         pcap_t* fp;
         int     if_index;
+        int     mode;
         uint8_t src_addr[ETHER_ADDR_LEN];
+        int64_t rx_calls;
+        int64_t tx_calls;
+        int64_t tx_errors;
     };
 
     typedef long long int ssize_t;
 
 #endif
 
+    /* Maximum number of frames given to the system in one call */
+#define SCNP_SOCKET_BATCH 64
+
+    /**
+     * @struct scnp_frame
+     * @brief Payload of an ethernet frame and its peer address.
+     *
+     * @var buf Payload of the frame.
+     * @var len Length of the payload.
+     * @var addr Destination or source ethernet address.
+     */
+
+    struct scnp_frame
+    {
+        uint8_t * buf;
+        size_t    len;
+        uint8_t   addr[ETHER_ADDR_LEN];
+    };
+
+    /**
+     * @struct scnp_filter
+     * @brief Frames accepted by a socket, see scnp_socket_set_filter().
+     *
+     * @var ntypes Number of accepted types.
+     * @var types Accepted values of the first byte of the payload.
+     * @var lengths Minimum payload length of each accepted type.
+     * @var npeers Number of accepted source addresses, 0 to accept any source.
+     * @var peers Accepted source addresses.
+     */
+
+    struct scnp_filter
+    {
+        size_t  ntypes;
+        uint8_t types[SCNP_FILTER_MAX_TYPES];
+        size_t  lengths[SCNP_FILTER_MAX_TYPES];
+        size_t  npeers;
+        uint8_t peers[SCNP_FILTER_MAX_PEERS][ETHER_ADDR_LEN];
+    };
+
+    /**
+     * @struct scnp_tuning
+     * @brief Options of a socket set for latency, see scnp_socket_tune().
+     *
+     * A field equal to zero leaves the default of the system.
+     *
+     * @var busy_poll_us Time in microseconds a receive waiting for frames
+     * polls the queue of the device before sleeping (SO_BUSY_POLL), where
+     * the protocol supports it.
+     * @var priority Priority of the frames sent (SO_PRIORITY), which selects
+     * the band of the queueing discipline. Up to 6 without privileges.
+     * @var rcvbuf Size of the receive buffer in bytes (SO_RCVBUF). The
+     * system doubles it for its own bookkeeping.
+     * @var sndbuf Size of the send buffer in bytes (SO_SNDBUF), doubled as
+     * well.
+     * @var qdisc_bypass If true, the frames sent skip the queueing
+     * discipline and go to the driver at once (PACKET_QDISC_BYPASS, not in
+     * UDP mode).
+     */
+
+    struct scnp_tuning
+    {
+        int  busy_poll_us;
+        int  priority;
+        int  rcvbuf;
+        int  sndbuf;
+        bool qdisc_bypass;
+    };
+
     int scnp_socket_open(struct scnp_socket * socket, int if_index);
+
+    /**
+     * @brief Open a socket in a given mode, see scnp_socket_open().
+     *
+     * In SCNP_SOCKET_RING mode, the frames are read from a TPACKET_V3 ring
+     * and written to a transmit ring mapped in memory. A system call is only
+     * made to wait for frames when the ring is empty, and to flush the frames
+     * written in the transmit ring.
+     *
+     * @return 0 on success, -1 on error. errno is set to EOPNOTSUPP if the mode
+     * is not available on this system, EINVAL if the mode is unknown.
+     */
+
+    int scnp_socket_open_mode(struct scnp_socket * socket, int if_index, int mode);
+
+    /**
+     * @brief Open a socket in UDP mode, see scnp_socket_open().
+     *
+     * The socket receives the UDP datagrams of a port, over IPv4 and IPv6.
+     * A peer is designated by a 6-byte handle instead of an ethernet
+     * address, given by scnp_socket_add_peer() or when a datagram of an
+     * unknown source is received. A frame sent to the broadcast address is
+     * sent to every known peer.
+     *
+     * When SCNP_SOCKET_MAX_PEERS peers are known, an unknown source takes
+     * the place of the peer added on reception that has been quiet the
+     * longest, if it has been quiet for SCNP_SOCKET_PEER_IDLE_MS. Otherwise
+     * its datagrams are dropped, so a flood of sources does not replace the
+     * active peers. The handle of a replaced peer designates the new one.
+     *
+     * @param if_index Interface the socket is bound to, 0 for every
+     * interface.
+     * @param port Local port, 0 for a port chosen by the system.
+     * @return 0 on success, -1 on error. errno is set to EOPNOTSUPP if the
+     * mode is not available on this system.
+     */
+
+    int scnp_socket_open_udp(struct scnp_socket * socket, int if_index, uint16_t port);
+
+    /**
+     * @brief Give the handle of a socket address (UDP mode).
+     *
+     * The address is added to the peers of the socket if it is unknown,
+     * taking the place of the peer added on reception that has been quiet
+     * the longest if the table is full. The place of a peer given to this
+     * function is never given to another source.
+     *
+     * @param addr IPv4 or IPv6 socket address.
+     * @param peer Filled with the handle of the peer.
+     * @return 0 on success, -1 on error. errno is set to EOPNOTSUPP if the
+     * socket is not in UDP mode, EAFNOSUPPORT if the address family is
+     * unknown, EINVAL if addrlen is too short and EXFULL if
+     * SCNP_SOCKET_MAX_PEERS peers were given to this function.
+     */
+
+    int scnp_socket_add_peer(struct scnp_socket * socket, const struct sockaddr * addr, socklen_t addrlen, uint8_t * peer);
+
+    /**
+     * @brief Apply a tuning to a socket and read the options in effect.
+     *
+     * Each option is applied even if another one fails, a receive buffer
+     * above the limit of the system is forced when the process is allowed
+     * to.
+     *
+     * @param wanted Options to apply.
+     * @param effective Filled with the options in effect, may be NULL.
+     * @return 0 if every option was applied, -1 otherwise with errno set by
+     * the last option that failed. EOPNOTSUPP if the options cannot be set
+     * on this system.
+     */
+
+    int scnp_socket_tune(struct scnp_socket * socket, const struct scnp_tuning * wanted, struct scnp_tuning * effective);
+
     int scnp_socket_close(struct scnp_socket* socket);
 
     bool scnp_socket_opened(struct scnp_socket* socket);
 
+    /**
+     * @brief Drop the unwanted frames in the kernel.
+     *
+     * Attach a filter that drops the frames sent by this host, the frames
+     * of other sources than the peers of the filter, the frames with an
+     * unknown type and the frames shorter than the length of their type.
+     * A new call replaces the previous filter. In UDP mode, the sources
+     * are checked when the datagrams are received, before they are added
+     * to the peers.
+     *
+     * @return 0 on success, -1 on error. errno is set to EINVAL if the filter
+     * exceeds its capacities.
+     */
+
+    int scnp_socket_set_filter(struct scnp_socket* socket, const struct scnp_filter * filter);
+
     ssize_t scnp_socket_recvfrom(struct scnp_socket* socket, void * buf, size_t len, int flags, uint8_t * src_addr);
     ssize_t scnp_socket_sendto(struct scnp_socket* socket,const void * buf, size_t len, int flags, const uint8_t * dest_addr);
 
+    /**
+     * @brief Receive several frames with as few system calls as possible.
+     *
+     * Blocks until at least one frame is received, then takes the frames
+     * already available without blocking. The buffers of the frames must be
+     * allocated by the caller, their len is the size of the buffer and is
+     * replaced by the length of the received payload. In ring mode, buf is
+     * replaced by a pointer in the ring which stays valid until the next call.
+     *
+     * @return The number of frames received, -1 on error.
+     */
+
+    int scnp_socket_recvmmsg(struct scnp_socket* socket, struct scnp_frame * frames, unsigned int vlen, int flags);
+
+    /**
+     * @brief Send several frames with as few system calls as possible.
+     *
+     * In ring mode, the frames written to the transmit ring count as sent.
+     * In UDP mode, a datagram refused for its destination is counted in
+     * tx_errors and skipped.
+     *
+     * @return The number of frames sent, -1 if none could be sent. errno is
+     * set to EAGAIN if the transmit ring is full.
+     */
+
+    int scnp_socket_sendmmsg(struct scnp_socket* socket, const struct scnp_frame * frames, unsigned int vlen, int flags);
+
+    /**
+     * @brief Whether an error of scnp_socket_sendmmsg() means the socket
+     * cannot send anymore, rather than a frame or a destination being refused.
+     *
+     * @return true if the socket is dead.
+     */
+
+    bool scnp_socket_send_failed(int err);
+
 #ifdef __cplusplus
 }
 #endif
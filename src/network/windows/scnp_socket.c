@@ -1,12 +1,33 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #include <interface.h>
 #include <scnp_socket.h>
 
 int scnp_socket_open(struct scnp_socket* socket, int if_index)
 {
+    return scnp_socket_open_mode(socket, if_index, SCNP_SOCKET_PLAIN);
+}
+
+int scnp_socket_open_mode(struct scnp_socket* socket, int if_index, int mode)
+{
+    /* pcap does not give access to the rings of the driver, UDP is not implemented */
+    if (mode == SCNP_SOCKET_RING || mode == SCNP_SOCKET_UDP) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    if (mode != SCNP_SOCKET_PLAIN) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    socket->mode = mode;
+    socket->rx_calls = 0;
+    socket->tx_calls = 0;
+    socket->tx_errors = 0;
+
 	char pcap_if_prefix[100] = "rpcap://\\Device\\NPF_";
     char errbuf[PCAP_ERRBUF_SIZE];
 
@@ -37,6 +58,43 @@ int scnp_socket_open(struct scnp_socket* socket, int if_index)
     return 0;
 }
 
+int scnp_socket_open_udp(struct scnp_socket* socket, int if_index, uint16_t port)
+{
+    (void)socket;
+    (void)if_index;
+    (void)port;
+
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+int scnp_socket_add_peer(struct scnp_socket* socket, const struct sockaddr* addr, socklen_t addrlen, uint8_t* peer)
+{
+    (void)socket;
+    (void)addr;
+    (void)addrlen;
+    (void)peer;
+
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+int scnp_socket_tune(struct scnp_socket* socket, const struct scnp_tuning* wanted, struct scnp_tuning* effective)
+{
+    (void)socket;
+
+    /* pcap gives no access to the options of its socket */
+    if (effective != NULL) memset(effective, 0, sizeof(struct scnp_tuning));
+
+    if (wanted->busy_poll_us != 0 || wanted->priority != 0 || wanted->rcvbuf != 0 ||
+        wanted->sndbuf != 0 || wanted->qdisc_bypass) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+
+    return 0;
+}
+
 int scnp_socket_close(struct scnp_socket* socket)
 {
     pcap_close(socket->fp);
@@ -51,6 +109,47 @@ bool scnp_socket_opened(struct scnp_socket* socket)
 	return socket->fp != NULL;
 }
 
+int scnp_socket_set_filter(struct scnp_socket* socket, const struct scnp_filter* filter)
+{
+    /* every condition takes less than 64 characters */
+    char               expr[64 * (4 + SCNP_FILTER_MAX_PEERS + SCNP_FILTER_MAX_TYPES)];
+    struct bpf_program prog;
+    size_t             n;
+
+    if (filter->ntypes > SCNP_FILTER_MAX_TYPES || filter->npeers > SCNP_FILTER_MAX_PEERS) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* frames of this host, the payload follows the ethernet header */
+    n = sprintf(expr, "ether proto 0x%04x and not ether src %02x:%02x:%02x:%02x:%02x:%02x", ETH_P_SCNP,
+                socket->src_addr[0], socket->src_addr[1], socket->src_addr[2],
+                socket->src_addr[3], socket->src_addr[4], socket->src_addr[5]);
+
+    /* frames of unknown sources */
+    for (size_t i = 0; i < filter->npeers; ++i) {
+        const uint8_t* p = filter->peers[i];
+        n += sprintf(expr + n, "%s ether src %02x:%02x:%02x:%02x:%02x:%02x", (i == 0) ? " and (" : " or",
+                     p[0], p[1], p[2], p[3], p[4], p[5]);
+    }
+    if (filter->npeers > 0) n += sprintf(expr + n, ")");
+
+    /* frames of unknown type or too short for their type */
+    n += sprintf(expr + n, " and (");
+    for (size_t i = 0; i < filter->ntypes; ++i) {
+        n += sprintf(expr + n, "%s(ether[14] = %u and len >= %u)", (i == 0) ? "" : " or ",
+                     filter->types[i], (unsigned int)(14 + filter->lengths[i]));
+    }
+    if (filter->ntypes == 0) n += sprintf(expr + n, "0 = 1");
+    sprintf(expr + n, ")");
+
+    if (pcap_compile(socket->fp, &prog, expr, 1, PCAP_NETMASK_UNKNOWN) == -1) return -1;
+    int ret = pcap_setfilter(socket->fp, &prog);
+    pcap_freecode(&prog);
+
+    return ret;
+}
+
 ssize_t scnp_socket_recvfrom(struct scnp_socket* socket, void* buf, size_t len, int flags, uint8_t* src_addr)
 {
     const size_t len_header = 2 * ETHER_ADDR_LEN + 2; // dest and src addr + ether type
@@ -59,6 +158,7 @@ ssize_t scnp_socket_recvfrom(struct scnp_socket* socket, void* buf, size_t len,
     uint16_t ethtype = 0;
 
     while (ethtype != ETH_P_SCNP) {
+        ++socket->rx_calls;
         int res = pcap_next_ex(socket->fp, &header, &pkt_data);
 
         if (res == 0 || !memcmp(socket->src_addr, pkt_data + ETHER_ADDR_LEN, ETHER_ADDR_LEN)) {
@@ -102,10 +202,43 @@ ssize_t scnp_socket_sendto(struct scnp_socket* socket, const void* buf, size_t l
 
     /* Send the packet */
 
+    ++socket->tx_calls;
     int ret = pcap_sendpacket(socket->fp, packet, (int)(len_header + len));
     free(packet);
 
     if (ret == 0) ret = (int)len; // The number of bytes sent
 
     return ret;
-}
\ No newline at end of file
+}
+
+int scnp_socket_recvmmsg(struct scnp_socket* socket, struct scnp_frame* frames, unsigned int vlen, int flags)
+{
+    if (vlen == 0) return 0;
+
+    /* pcap delivers one frame per call */
+    ssize_t ret = scnp_socket_recvfrom(socket, frames[0].buf, frames[0].len, flags, frames[0].addr);
+    if (ret < 0) return -1;
+
+    frames[0].len = (size_t)ret;
+
+    return 1;
+}
+
+int scnp_socket_sendmmsg(struct scnp_socket* socket, const struct scnp_frame* frames, unsigned int vlen, int flags)
+{
+    unsigned int sent = 0;
+
+    /* pcap has no vectored send for single packets */
+    while (sent < vlen) {
+        if (scnp_socket_sendto(socket, frames[sent].buf, frames[sent].len, flags, frames[sent].addr) < 0) break;
+        ++sent;
+    }
+
+    return (sent > 0) ? (int)sent : -1;
+}
+
+bool scnp_socket_send_failed(int err)
+{
+    /* pcap only fails to send when the adapter is gone */
+    return err == EBADF || err == ENODEV || err == ENXIO;
+}
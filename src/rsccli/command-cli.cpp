@@ -285,12 +285,13 @@ std::map<char,
   { char{SET}, [] (IfCommand * cmd, ctrl_op_t& ops) -> int { return cmd->set(ops); } },
   { char{LIST}, [] (IfCommand *, ctrl_op_t& ops) -> int { return ops.listif(); } },
   { char{GET}, [] (IfCommand *, ctrl_op_t& ops) -> int { return ops.getif(); } },
+  { char{TUNING}, [] (IfCommand *, ctrl_op_t& ops) -> int { return ops.gettuning(); } },
 };
 
 void IfCommand::print_usage() const
 {
   std::cout << "Usage : " << RSCCLI_NAME << " " << _NAME
-	    << " {-" << SET << " id | -" << LIST << " | -" << GET << " }\n";
+	    << " {-" << SET << " id | -" << LIST << " | -" << GET << " | -" << TUNING << " }\n";
 }
 
 void IfCommand::add_arg(const std::string& arg)
@@ -330,6 +331,7 @@ void IfCommand::print_help()
   std::cout << "\t\t" << "-" << SET << " id" << "\tSet the current network interface." << "\n";
   std::cout << "\t\t" << "-" << GET << "\tGet the current network interface." << "\n";
   std::cout << "\t\t" << "-" << LIST << "\tList all the available network interface." << "\n";
+  std::cout << "\t\t" << "-" << TUNING << "\tShow the socket options in effect on the network interfaces." << "\n";
   std::cout << "\n";
 }
 
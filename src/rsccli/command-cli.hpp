@@ -218,6 +218,7 @@ namespace rscui {
     static constexpr char SET = 's';
     static constexpr char LIST = 'l';
     static constexpr char GET = 'g';
+    static constexpr char TUNING = 't';
   
   public:
     IfCommand()
@@ -62,6 +62,22 @@ void RSCCli::display_if(const IF * interface)
   std::cout << "\n";
 }
 
+void RSCCli::display_tuning(const std::string& profile,
+			    const std::vector<std::pair<int, struct scnp_tuning>>& sockets)
+{
+  std::cout << "Socket tuning profile : " << profile << "\n\n";
+  std::cout << "\tif\tbusy poll (us)\tpriority\trcvbuf\tsndbuf\tqdisc bypass\n";
+
+  for(const auto& s : sockets) {
+    const struct scnp_tuning& t = s.second;
+
+    std::cout << "\t" << s.first << "\t" << t.busy_poll_us << "\t\t" << t.priority << "\t\t"
+	      << t.rcvbuf << "\t" << t.sndbuf << "\t" << (t.qdisc_bypass ? "yes" : "no") << "\n";
+  }
+
+  std::cout << "\n";
+}
+
 void RSCCli::display_error(const std::string& error)
 {
   std::cerr << "[ERROR] " << error << "\n";
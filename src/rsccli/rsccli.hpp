@@ -28,6 +28,8 @@ namespace rscui {
     void display_all_pc(rscutil::PCList& list, bool all) override;
     void display_if(const IF * interface) override;
     void display_if(int if_index, const std::string& if_name) override;
+    void display_tuning(const std::string& profile,
+			const std::vector<std::pair<int, struct scnp_tuning>>& sockets) override;
     void display_error(const std::string& error) override;
     void display_version(const std::string& version) override;
     void display_help() override;
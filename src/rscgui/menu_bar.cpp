@@ -50,6 +50,12 @@ void IfCheckbox::on_check()
 IfMenu::IfMenu(ControllerOperation& ops, QWidget * parent) :
   QMenu("&Interface", parent), _ops(ops)
 {
+  auto * tuning = new QAction("&Tuning", this);
+
+  addAction(tuning);
+  addSeparator();
+
+  connect(tuning, &QAction::triggered, this, &IfMenu::show_tuning);
   connect(this, &QMenu::aboutToShow, this, &IfMenu::refresh_interface);
 }
 
@@ -84,6 +90,11 @@ void IfMenu::setif(int index)
   _ops.setif(std::to_string(index));
 }
 
+void IfMenu::show_tuning()
+{
+  _ops.gettuning();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                ShortcutMenu                               //
 ///////////////////////////////////////////////////////////////////////////////
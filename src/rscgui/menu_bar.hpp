@@ -86,6 +86,13 @@ namespace rscui {
      */
     
     void setif(int id);
+
+    /**
+     *\brief Called when the item tuning is clicked
+     *\brief Show the socket tuning in effect
+     */
+    
+    void show_tuning();
   };
 
   class ShortcutMenu : public QMenu
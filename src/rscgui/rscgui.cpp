@@ -156,6 +156,25 @@ void RSCGui::display_if(int index, const std::string&)
   static_cast<IfMenu*>(_if_menu)->set_interface(index);
 }
 
+void RSCGui::display_tuning(const std::string& profile,
+			    const std::vector<std::pair<int, struct scnp_tuning>>& sockets)
+{
+  QString text = tr("Profile : ") + QString::fromStdString(profile);
+
+  for(const auto& s : sockets) {
+    const struct scnp_tuning& t = s.second;
+
+    text += "\n" + tr("Interface ") + QString::number(s.first) + " : "
+      + tr("busy poll ") + QString::number(t.busy_poll_us) + " us, "
+      + tr("priority ") + QString::number(t.priority) + ", "
+      + tr("rcvbuf ") + QString::number(t.rcvbuf) + ", "
+      + tr("sndbuf ") + QString::number(t.sndbuf) + ", "
+      + tr("qdisc bypass ") + (t.qdisc_bypass ? tr("yes") : tr("no"));
+  }
+
+  QMessageBox::information(this, tr("Socket tuning"), text);
+}
+
 void RSCGui::display_error(const std::string& err)
 {
   QMessageBox::critical(this, tr("Error"), tr(err.c_str()));
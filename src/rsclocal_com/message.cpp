@@ -18,6 +18,7 @@ std::vector<std::tuple<std::string,size_t>> Message::_commands =
     std::make_tuple("SAVE_SHORTCUT",0),
     std::make_tuple("CIRCULAR",1),
     std::make_tuple("PASSWD",1),
+    std::make_tuple("TUNING",0),
   };
 
 Message::Message(Command c): _cmd(c)
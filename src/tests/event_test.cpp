@@ -6,6 +6,8 @@
 
 #include <controller.h>
 #include <cursor.h>
+#include <scnp.h>
+#include <convkey.hpp>
 
 TEST_CASE("init/exit") {
   REQUIRE_FALSE(init_controller());
@@ -127,6 +129,129 @@ TEST_CASE("Mouse")
 
 #endif
 
+TEST_CASE("convkey")
+{
+  /* the conversions are evaluated at compile time */
+  constexpr ControllerEvent key{0, KEY, EV_KEY, KEY_REPEATED, KEY_A};
+  constexpr struct scnp_key key_pkt = ConvKey<KEY>::to_packet(key);
+
+  static_assert(key_pkt.type == SCNP_KEY && key_pkt.code == KEY_A, "");
+  static_assert(key_pkt.pressed && key_pkt.repeated, "");
+  static_assert(ConvKey<KEY>::to_event(key_pkt).value == KEY_REPEATED, "");
+
+  constexpr ControllerEvent mov{0, MOUSE, EV_ABS, -12, ABS_X};
+  constexpr struct scnp_movement mov_pkt = ConvKey<MOUSE>::to_packet(mov);
+
+  static_assert(mov_pkt.type == SCNP_MOV && mov_pkt.move_type == MOV_ABS, "");
+  static_assert(ConvKey<MOUSE>::to_event(mov_pkt).value == -12, "");
+
+  SECTION("key") {
+    for(int value : {KEY_RELEASED, KEY_PRESSED, KEY_REPEATED}) {
+      ControllerEvent    ev{0, KEY, EV_KEY, value, KEY_SPACE};
+      struct scnp_packet packet;
+
+      ConvKey<KEY>::to_packet(ev, packet);
+      REQUIRE(packet.type == SCNP_KEY);
+
+      ControllerEvent back = ConvKey<KEY>::to_event(packet);
+      REQUIRE(back.controller_type == KEY);
+      REQUIRE(back.ev_type == EV_KEY);
+      REQUIRE(back.code == KEY_SPACE);
+      REQUIRE(back.value == value);
+    }
+  }
+
+  SECTION("movement") {
+    for(uint8_t type : {EV_REL, EV_ABS}) {
+      ControllerEvent    ev{0, MOUSE, type, 42, REL_Y};
+      struct scnp_packet packet;
+
+      ConvKey<MOUSE>::to_packet(ev, packet);
+      REQUIRE(packet.type == SCNP_MOV);
+
+      ControllerEvent back = ConvKey<MOUSE>::to_event(packet);
+      REQUIRE(back.controller_type == MOUSE);
+      REQUIRE(back.ev_type == type);
+      REQUIRE(back.code == REL_Y);
+      REQUIRE(back.value == 42);
+    }
+  }
+
+  SECTION("threads") {
+    /* the sending and the receiving threads convert at the same time */
+    auto convert = [](unsigned short code, bool& same) {
+      for(int i = 0; i < 100000 && same; i++) {
+	ControllerEvent    ev{0, KEY, EV_KEY, i % 3, code};
+	struct scnp_packet packet;
+
+	ConvKey<KEY>::to_packet(ev, packet);
+	ControllerEvent back = ConvKey<KEY>::to_event(packet);
+	same = back.code == code && back.value == ev.value;
+      }
+    };
+
+    bool same_a = true, same_b = true;
+    std::thread a(convert, KEY_A, std::ref(same_a));
+    std::thread b(convert, KEY_B, std::ref(same_b));
+    a.join();
+    b.join();
+
+    REQUIRE(same_a);
+    REQUIRE(same_b);
+  }
+}
+
+TEST_CASE("convkey_benchmark", "[.][benchmark]")
+{
+  /* the conversion must cost no more than copying the packet */
+  const int          n = 1000000;
+  volatile int32_t   value = 1;
+  struct scnp_packet packet{};
+  ControllerEvent    ev{};
+  int64_t            sum = 0;
+
+  ConvKey<MOUSE>::to_packet({0, MOUSE, EV_REL, value, REL_X}, packet);
+
+  BENCHMARK("1M copies of a packet") {
+    for(int i = 0; i < n; i++) {
+      struct scnp_movement pkt;
+      memcpy(&pkt, &packet, sizeof(pkt));
+      pkt.value += value;
+      sum += pkt.value;
+    }
+  }
+
+  BENCHMARK("1M conversions of a packet") {
+    for(int i = 0; i < n; i++) {
+      ev = ConvKey<MOUSE>::to_event(packet);
+      ev.value += value;
+      sum += ev.value;
+    }
+  }
+
+  BENCHMARK("1M packets written by hand") {
+    for(int i = 0; i < n; i++) {
+      struct scnp_movement pkt;
+      pkt.type = SCNP_MOV;
+      pkt.move_type = MOV_REL;
+      pkt.code = REL_X;
+      pkt.value = value;
+      memcpy(&packet, &pkt, sizeof(pkt));
+      sum += packet.type;
+    }
+  }
+
+  BENCHMARK("1M conversions of an event") {
+    for(int i = 0; i < n; i++) {
+      ControllerEvent mov{0, MOUSE, EV_REL, value, REL_X};
+      ConvKey<MOUSE>::to_packet(mov, packet);
+      sum += packet.type;
+    }
+  }
+
+  REQUIRE(sum > 0);
+}
+
 #ifdef CONTROLLER_EVENT_TEST
 
 TEST_CASE("controllerevent")
@@ -0,0 +1,137 @@
+#include "catch/catch.hpp"
+#include <vector>
+
+#include <controller.h>
+#include <event_frame.hpp>
+
+/* events written by the stub below, followed by the EV_SYN the controller adds to each write */
+static std::vector<ControllerEvent> written;
+static int writes = 0;
+
+void write_controller_events(const ControllerEvent * ces, size_t count)
+{
+  written.insert(written.end(), ces, ces + count);
+  written.push_back({ 0, 0, EV_SYN, 0, SYN_REPORT });
+  ++writes;
+}
+
+/* same as RSC::add_event() */
+static void add(EventFrame& frame, const ControllerEvent& ev)
+{
+  if(!frame.fits(ev)) frame.flush();
+  frame.push(ev);
+}
+
+static void reset_stub()
+{
+  written.clear();
+  writes = 0;
+}
+
+static bool is_syn(const ControllerEvent& ev)
+{
+  return ev.ev_type == EV_SYN;
+}
+
+TEST_CASE("frame") {
+  EventFrame frame;
+
+  SECTION("empty") {
+    reset_stub();
+    REQUIRE_FALSE(frame.flush());
+    REQUIRE(writes == 0);
+  }
+
+  SECTION("one frame") {
+    reset_stub();
+    add(frame, { 0, MOUSE, EV_REL, 3, REL_X });
+    add(frame, { 0, MOUSE, EV_REL, 4, REL_Y });
+    add(frame, { 0, KEY, EV_KEY, KEY_PRESSED, KEY_A });
+    REQUIRE(writes == 0);
+    REQUIRE(frame.size() == 3);
+
+    REQUIRE(frame.flush());
+    REQUIRE(frame.size() == 0);
+    REQUIRE(writes == 1);
+    REQUIRE(written.size() == 4);
+    REQUIRE(written[0].code == REL_X);
+    REQUIRE(written[2].code == KEY_A);
+    REQUIRE(is_syn(written[3]));
+
+    add(frame, { 0, KEY, EV_KEY, KEY_RELEASED, KEY_A });
+    REQUIRE_FALSE(frame.flush());
+  }
+
+  SECTION("repeated code") {
+    reset_stub();
+
+    /* a key pressed then released is written in two frames */
+    add(frame, { 0, KEY, EV_KEY, KEY_PRESSED, KEY_A });
+    add(frame, { 0, KEY, EV_KEY, KEY_PRESSED, KEY_B });
+    add(frame, { 0, KEY, EV_KEY, KEY_RELEASED, KEY_A });
+    REQUIRE(writes == 1);
+    REQUIRE(written.size() == 3);
+    REQUIRE(is_syn(written[2]));
+    REQUIRE(frame.size() == 1);
+
+    /* the same for an axis, another axis or type joins the frame */
+    add(frame, { 0, MOUSE, EV_REL, 1, REL_X });
+    add(frame, { 0, MOUSE, EV_ABS, 1, ABS_X });
+    REQUIRE(writes == 1);
+    add(frame, { 0, MOUSE, EV_REL, 2, REL_X });
+    REQUIRE(writes == 2);
+    REQUIRE(written.size() == 7);
+    REQUIRE(written[3].value == KEY_RELEASED);
+    REQUIRE(written[4].code == REL_X);
+    REQUIRE(written[5].ev_type == EV_ABS);
+    REQUIRE(is_syn(written[6]));
+
+    frame.flush();
+    REQUIRE(writes == 3);
+    REQUIRE(written[7].value == 2);
+  }
+
+  SECTION("full frame") {
+    reset_stub();
+
+    for(int i = 0; i < CONTROLLER_FRAME_MAX; i++) {
+      add(frame, { 0, KEY, EV_KEY, KEY_PRESSED, (unsigned short)(KEY_ESC + i) });
+    }
+    REQUIRE(writes == 0);
+    REQUIRE(frame.size() == CONTROLLER_FRAME_MAX);
+    REQUIRE_FALSE(frame.fits({ 0, KEY, EV_KEY, KEY_PRESSED, KEY_MAX }));
+
+    /* the next event starts a new frame */
+    add(frame, { 0, KEY, EV_KEY, KEY_PRESSED, KEY_MAX });
+    REQUIRE(writes == 1);
+    REQUIRE(written.size() == CONTROLLER_FRAME_MAX + 1);
+    REQUIRE(frame.size() == 1);
+    frame.flush();
+    REQUIRE(writes == 2);
+  }
+
+  SECTION("one syn per frame") {
+    reset_stub();
+
+    /* the same key and axis in 3 frames */
+    for(int i = 0; i < 3; i++) {
+      add(frame, { 0, KEY, EV_KEY, KEY_PRESSED, KEY_A });
+      add(frame, { 0, MOUSE, EV_REL, i, REL_X });
+    }
+    frame.flush();
+
+    REQUIRE(writes == 3);
+    REQUIRE(written.size() == 9);
+    size_t events = 0;
+    for(const auto& ev : written) {
+      if(is_syn(ev)) {
+        REQUIRE(events == 2);
+        events = 0;
+      }
+      else {
+        events++;
+      }
+    }
+    REQUIRE(events == 0);
+  }
+}
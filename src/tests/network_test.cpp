@@ -7,18 +7,62 @@
 #include <unistd.h>
 #include <thread>
 #include <netinet/in.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <atomic>
+#include <cerrno>
+#include <algorithm>
+#include <vector>
+#include <random>
+#include <string>
+
+#include <cstdlib>
+#include <net/if.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 
 #include "queue.h"
+#include "codec.h"
+#include "replay.h"
+#include "inflight.h"
+#include "sack.h"
 #include "scnp.h"
+#include "scnp_socket.h"
 
 #define LOOP_INDEX 1
 
 TEST_CASE("queue") {
   struct scnp_queue * q = init_queue();
   REQUIRE(q != NULL);
-  REQUIRE(q->head == NULL);
-  REQUIRE(q->tail == NULL);
+  REQUIRE(q->capacity == QUEUE_CAPACITY);
+  REQUIRE(queue_size(q) == 0);
+  struct scnp_packet p{};
+  uint8_t a[6];
+  REQUIRE(pull(q, &p, a, 0) == -1);
+  REQUIRE(errno == ETIMEDOUT);
+  free_queue(q);
+
+  /* the capacity is rounded up to a power of two */
+  q = init_queue_capacity(100);
+  REQUIRE(q != NULL);
+  REQUIRE(q->capacity == 128);
+  for (int i = 0; i < 128; ++i) {
+    REQUIRE(push(q, &p, a) == 0);
+  }
+  REQUIRE(push(q, &p, a) == -1);
+  REQUIRE(errno == EXFULL);
+  free_queue(q);
+
+  /* a single element would be overwritten before it is pulled */
+  q = init_queue_capacity(1);
+  REQUIRE(q != NULL);
+  REQUIRE(q->capacity == 2);
   free_queue(q);
+
+  REQUIRE(init_queue_capacity(0) == NULL);
+  REQUIRE(errno == EINVAL);
+  REQUIRE(init_queue_capacity(QUEUE_MAX_CAPACITY + 1) == NULL);
+  REQUIRE(errno == EINVAL);
 }
 
 TEST_CASE("push") {
@@ -28,13 +72,9 @@ TEST_CASE("push") {
   memset(&p, 0, sizeof(struct scnp_packet));
   uint8_t a[6] = {0, 1, 2, 3, 4, 5};
   REQUIRE(push(q, &p, a) == 0);
-  REQUIRE(q->head != NULL);
-  REQUIRE(q->tail != NULL);
-  REQUIRE(q->head == q->tail);
-  REQUIRE(memcmp(q->tail->packet, &p, sizeof(struct scnp_packet)) == 0);
-  REQUIRE(memcmp(q->tail->addr, a, 6) == 0);
-  REQUIRE(q->tail->prev == NULL);
-  REQUIRE(q->tail->next == NULL);
+  REQUIRE(queue_size(q) == 1);
+  REQUIRE(memcmp(&q->elts[0].packet, &p, sizeof(struct scnp_packet)) == 0);
+  REQUIRE(memcmp(q->elts[0].addr, a, 6) == 0);
   free_queue(q);
 
   q = init_queue();
@@ -44,47 +84,21 @@ TEST_CASE("push") {
   uint8_t b[6] = {9, 8, 7, 6, 5, 4};
   REQUIRE(push(q, &p2, b) == 0);
   REQUIRE(push(q, &p, a) == 0);
-  REQUIRE(q->head != NULL);
-  REQUIRE(q->tail != NULL);
-  REQUIRE(q->head != q->tail);
-  REQUIRE(memcmp(q->tail->packet, &p, sizeof(struct scnp_packet)) == 0);
-  REQUIRE(memcmp(q->tail->addr, a, 6) == 0);
-  REQUIRE(q->tail->prev != NULL);
-  REQUIRE(q->tail->prev == q->head);
-  REQUIRE(q->tail->next == NULL);
-  REQUIRE(memcmp(q->head->packet, &p2, sizeof(struct scnp_packet)) == 0);
-  REQUIRE(memcmp(q->head->addr, b, 6) == 0);
-  REQUIRE(q->head->next != NULL);
-  REQUIRE(q->head->next == q->tail);
-  REQUIRE(q->head->prev == NULL);
+  REQUIRE(queue_size(q) == 2);
+  REQUIRE(memcmp(&q->elts[0].packet, &p2, sizeof(struct scnp_packet)) == 0);
+  REQUIRE(memcmp(q->elts[0].addr, b, 6) == 0);
+  REQUIRE(memcmp(&q->elts[1].packet, &p, sizeof(struct scnp_packet)) == 0);
+  REQUIRE(memcmp(q->elts[1].addr, a, 6) == 0);
   free_queue(q);
 
   q = init_queue();
   REQUIRE(q != NULL);
-  struct scnp_packet p3{};
-  memset(&p3, 2, sizeof(struct scnp_packet));
-  uint8_t c[6] = {0, 0, 0, 0, 0, 0};
-  REQUIRE(push(q, &p2, b) == 0);
-  REQUIRE(push(q, &p3, c) == 0);
-  REQUIRE(push(q, &p, a) == 0);
-  REQUIRE(q->head != NULL);
-  REQUIRE(q->tail != NULL);
-  REQUIRE(q->head != q->tail);
-  REQUIRE(memcmp(q->tail->packet, &p, sizeof(struct scnp_packet)) == 0);
-  REQUIRE(memcmp(q->tail->addr, a, 6) == 0);
-  REQUIRE(q->tail->prev != NULL);
-  REQUIRE(q->tail->next == NULL);
-  REQUIRE(memcmp(q->tail->prev->packet, &p3, sizeof(struct scnp_packet)) == 0);
-  REQUIRE(memcmp(q->tail->prev->addr, c, 6) == 0);
-  REQUIRE(q->tail->prev->prev != NULL);
-  REQUIRE(q->tail->prev->prev == q->head);
-  REQUIRE(q->tail->prev->next != NULL);
-  REQUIRE(q->tail->prev->next == q->tail);
-  REQUIRE(memcmp(q->head->packet, &p2, sizeof(struct scnp_packet)) == 0);
-  REQUIRE(memcmp(q->head->addr, b, 6) == 0);
-  REQUIRE(q->head->next != NULL);
-  REQUIRE(q->head->next == q->tail->prev);
-  REQUIRE(q->head->prev == NULL);
+  for (int i = 0; i < QUEUE_CAPACITY; ++i) {
+    REQUIRE(push(q, &p, a) == 0);
+  }
+  REQUIRE(queue_size(q) == QUEUE_CAPACITY);
+  REQUIRE(push(q, &p2, b) == -1);
+  REQUIRE(errno == EXFULL);
   free_queue(q);
 }
 
@@ -107,8 +121,7 @@ TEST_CASE("pull") {
   REQUIRE(pull(q, &pulled, z, -1) == 0);
   REQUIRE(memcmp(&pulled, &p, sizeof(struct scnp_packet)) == 0);
   REQUIRE(memcmp(z, a, 6) == 0);
-  REQUIRE(q->head == NULL);
-  REQUIRE(q->tail == NULL);
+  REQUIRE(queue_size(q) == 0);
   free_queue(q);
 
   q = init_queue();
@@ -118,13 +131,10 @@ TEST_CASE("pull") {
   REQUIRE(pull(q, &pulled, z, -1) == 0);
   REQUIRE(memcmp(&pulled, &p2, sizeof(struct scnp_packet)) == 0);
   REQUIRE(memcmp(z, b, 6) == 0);
-  REQUIRE(q->head != NULL);
-  REQUIRE(q->tail != NULL);
-  REQUIRE(q->head == q->tail);
-  REQUIRE(memcmp(q->head->packet, &p, sizeof(struct scnp_packet)) == 0);
-  REQUIRE(memcmp(q->head->addr, a, 6) == 0);
-  REQUIRE(q->head->prev == NULL);
-  REQUIRE(q->head->next == NULL);
+  REQUIRE(queue_size(q) == 1);
+  REQUIRE(pull(q, &pulled, z, -1) == 0);
+  REQUIRE(memcmp(&pulled, &p, sizeof(struct scnp_packet)) == 0);
+  REQUIRE(memcmp(z, a, 6) == 0);
   free_queue(q);
 
   q = init_queue();
@@ -135,19 +145,568 @@ TEST_CASE("pull") {
   REQUIRE(pull(q, &pulled, z, -1) == 0);
   REQUIRE(memcmp(&pulled, &p3, sizeof(struct scnp_packet)) == 0);
   REQUIRE(memcmp(z, c, 6) == 0);
-  REQUIRE(q->head != NULL);
-  REQUIRE(q->tail != NULL);
-  REQUIRE(memcmp(q->head->packet, &p, sizeof(struct scnp_packet)) == 0);
-  REQUIRE(memcmp(q->head->addr, a, 6) == 0);
-  REQUIRE(memcmp(q->tail->packet, &p2, sizeof(struct scnp_packet)) == 0);
-  REQUIRE(memcmp(q->tail->addr, b, 6) == 0);
-  REQUIRE(q->head->next == q->tail);
-  REQUIRE(q->head->prev == NULL);
-  REQUIRE(q->tail->next == NULL);
-  REQUIRE(q->tail->prev == q->head);
+  REQUIRE(queue_size(q) == 2);
+  REQUIRE(pull(q, &pulled, z, 0) == 0);
+  REQUIRE(memcmp(&pulled, &p, sizeof(struct scnp_packet)) == 0);
+  REQUIRE(memcmp(z, a, 6) == 0);
+  REQUIRE(pull(q, &pulled, z, 0) == 0);
+  REQUIRE(memcmp(&pulled, &p2, sizeof(struct scnp_packet)) == 0);
+  REQUIRE(memcmp(z, b, 6) == 0);
+  REQUIRE(pull(q, &pulled, z, 1000000) == -1);
+  REQUIRE(errno == ETIMEDOUT);
+  free_queue(q);
+
+  /* wrap around the ring several times */
+  q = init_queue();
+  REQUIRE(q != NULL);
+  for (int i = 0; i < 3 * QUEUE_CAPACITY; ++i) {
+    p.type = (uint8_t) i;
+    REQUIRE(push(q, &p, a) == 0);
+    REQUIRE(pull(q, &pulled, z, 0) == 0);
+    REQUIRE(pulled.type == (uint8_t) i);
+  }
+  free_queue(q);
+}
+
+TEST_CASE("push_batch") {
+  struct scnp_queue * q = init_queue();
+  REQUIRE(q != NULL);
+  struct scnp_packet packets[8]{};
+  uint8_t addrs[8][6];
+  for (int i = 0; i < 8; ++i) {
+    packets[i].type = (uint8_t) i;
+    memset(addrs[i], i, 6);
+  }
+  REQUIRE(push_batch(q, packets, addrs, 0) == 0);
+  REQUIRE(push_batch(q, packets, addrs, 8) == 8);
+  REQUIRE(queue_size(q) == 8);
+  struct scnp_packet pulled{};
+  uint8_t z[6];
+  for (int i = 0; i < 8; ++i) {
+    REQUIRE(pull(q, &pulled, z, 0) == 0);
+    REQUIRE(pulled.type == (uint8_t) i);
+    REQUIRE(z[0] == (uint8_t) i);
+  }
+  free_queue(q);
+
+  /* only the elements that fit are added */
+  q = init_queue();
+  REQUIRE(q != NULL);
+  for (int i = 0; i < QUEUE_CAPACITY - 3; ++i) {
+    REQUIRE(push(q, &pulled, z) == 0);
+  }
+  REQUIRE(push_batch(q, packets, addrs, 8) == 3);
+  REQUIRE(queue_size(q) == QUEUE_CAPACITY);
+  REQUIRE(push_batch(q, packets, addrs, 8) == -1);
+  REQUIRE(errno == EXFULL);
+  free_queue(q);
+}
+
+TEST_CASE("push_wait") {
+  struct scnp_queue * q = init_queue_capacity(2);
+  REQUIRE(q != NULL);
+  struct scnp_packet p{};
+  uint8_t a[6] = {0, 1, 2, 3, 4, 5};
+  REQUIRE(push_wait(q, &p, a, 0) == 0);
+  REQUIRE(push_wait(q, &p, a, -1) == 0);
+
+  /* the queue stays full until the timeout */
+  long long int start = queue_clock();
+  REQUIRE(push_wait(q, &p, a, 20000000) == -1);
+  REQUIRE(errno == EXFULL);
+  REQUIRE(queue_clock() - start >= 20000000);
+  REQUIRE(push_wait(q, &p, a, 0) == -1);
+  REQUIRE(errno == EXFULL);
+
+  /* a pull wakes the producer up before the timeout */
+  std::thread consumer([q]() {
+    struct scnp_packet pulled{};
+    uint8_t z[6];
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    pull(q, &pulled, z, 0);
+  });
+  start = queue_clock();
+  REQUIRE(push_wait(q, &p, a, 5000000000LL) == 0);
+  REQUIRE(queue_clock() - start < 1000000000LL);
+  consumer.join();
+  REQUIRE(queue_size(q) == 2);
+  free_queue(q);
+}
+
+TEST_CASE("pull_blocking") {
+  struct scnp_queue * q = init_queue();
+  REQUIRE(q != NULL);
+  const int count = 10000;
+  uint8_t a[6] = {0, 1, 2, 3, 4, 5};
+
+  std::thread producer([q, &a]() {
+    struct scnp_packet p{};
+    for (int i = 0; i < count; ++i) {
+      memcpy(p.data, &i, sizeof(i));
+      while (push(q, &p, a)) std::this_thread::yield();
+    }
+  });
+
+  struct scnp_packet pulled{};
+  uint8_t z[6];
+  for (int i = 0; i < count; ++i) {
+    REQUIRE(pull(q, &pulled, z, -1) == 0);
+    int value;
+    memcpy(&value, pulled.data, sizeof(value));
+    REQUIRE(value == i);
+  }
+
+  producer.join();
+  free_queue(q);
+}
+
+TEST_CASE("pull_timeout") {
+  struct scnp_queue * q = init_queue();
+  REQUIRE(q != NULL);
+  struct scnp_packet pulled{};
+  uint8_t z[6];
+
+  /* timeouts below one millisecond are kept, the upper bound leaves room for a loaded machine */
+  auto start = std::chrono::steady_clock::now();
+  REQUIRE(pull(q, &pulled, z, 200000) == -1);
+  REQUIRE(errno == ETIMEDOUT);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  CHECK(elapsed >= std::chrono::microseconds(200));
+  CHECK(elapsed < std::chrono::milliseconds(100));
+
+  free_queue(q);
+}
+
+TEST_CASE("queue_wait") {
+  struct scnp_queue * queues[] = { init_queue(), init_queue() };
+  REQUIRE(queues[0] != NULL);
+  REQUIRE(queues[1] != NULL);
+  int cancel_fd = eventfd(0, EFD_NONBLOCK);
+  REQUIRE(cancel_fd != -1);
+  struct scnp_packet p{};
+  uint8_t a[6] = {0, 1, 2, 3, 4, 5};
+
+  REQUIRE(queue_wait(queues, 2, cancel_fd, 100000) == -1);
+  REQUIRE(errno == ETIMEDOUT);
+  REQUIRE(queue_wait(queues, QUEUE_WAIT_MAX + 1, -1, 0) == -1);
+  REQUIRE(errno == EINVAL);
+
+  /* a push to any queue wakes the waiter up */
+  std::thread producer([&queues, &p, &a]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    push(queues[1], &p, a);
+  });
+  REQUIRE(queue_wait(queues, 2, cancel_fd, -1) == 1);
+  producer.join();
+  REQUIRE(pull(queues[1], &p, a, 0) == 0);
+
+  /* the descriptor cancels every wait */
+  std::thread canceller([cancel_fd]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    uint64_t one = 1;
+    ssize_t written = write(cancel_fd, &one, sizeof(one));
+    (void) written;
+  });
+  REQUIRE(queue_wait(queues, 2, cancel_fd, -1) == -1);
+  REQUIRE(errno == ECANCELED);
+  canceller.join();
+  REQUIRE(queue_wait(queues, 1, cancel_fd, -1) == -1);
+  REQUIRE(errno == ECANCELED);
+
+  close(cancel_fd);
+  free_queue(queues[0]);
+  free_queue(queues[1]);
+}
+
+TEST_CASE("replay") {
+  uint8_t a[ETHER_ADDR_LEN] = { 0, 1, 2, 3, 4, 5 };
+  uint8_t b[ETHER_ADDR_LEN] = { 5, 4, 3, 2, 1, 0 };
+  struct replay_table * replay = replay_new();
+  REQUIRE(replay != nullptr);
+
+  /* every identifier is accepted once */
+  REQUIRE(replay_check(replay, a, 100));
+  REQUIRE_FALSE(replay_check(replay, a, 100));
+  REQUIRE(replay_check(replay, b, 100));
+  REQUIRE(replay_check(replay, a, 102));
+  REQUIRE(replay_check(replay, a, 101));
+  REQUIRE_FALSE(replay_check(replay, a, 101));
+  REQUIRE_FALSE(replay_check(replay, a, 102));
+
+  /* the window slides with the highest identifier and wraps around */
+  REQUIRE(replay_check(replay, a, 100 + 70));
+  REQUIRE_FALSE(replay_check(replay, a, 101));
+  REQUIRE(replay_check(replay, a, 103));
+  REQUIRE(replay_check(replay, a, UINT32_MAX));
+  REQUIRE(replay_check(replay, a, 0));
+  REQUIRE_FALSE(replay_check(replay, a, UINT32_MAX));
+
+  /* an identifier older than the window restarts it, the source restarted its identifiers */
+  REQUIRE(replay_check(replay, a, (uint32_t) -REPLAY_WINDOW - 1));
+  REQUIRE_FALSE(replay_check(replay, a, (uint32_t) -REPLAY_WINDOW - 1));
+  REQUIRE(replay_check(replay, a, (uint32_t) -REPLAY_WINDOW));
+  REQUIRE(replay_check(replay, a, 0));
+  REQUIRE(replay_check(replay, a, 1));
+
+  /* a jump forward moves the window past the identifiers received */
+  REQUIRE(replay_check(replay, a, 1 + 3 * REPLAY_WINDOW));
+  REQUIRE(replay_check(replay, a, 2 + 2 * REPLAY_WINDOW));
+  REQUIRE(replay_check(replay, a, 3 * REPLAY_WINDOW));
+  REQUIRE_FALSE(replay_check(replay, a, 3 * REPLAY_WINDOW));
+
+  replay_init(replay);
+  REQUIRE(replay_check(replay, a, 100));
+
+  /* a forgotten identifier is accepted again, without moving the window back */
+  REQUIRE(replay_check(replay, a, 101));
+  replay_forget(replay, a, 100);
+  replay_forget(replay, a, 101);
+  REQUIRE(replay_check(replay, a, 100));
+  REQUIRE(replay_check(replay, a, 101));
+  REQUIRE_FALSE(replay_check(replay, a, 100));
+  replay_forget(replay, a, 102);
+  replay_forget(replay, a, 101 - REPLAY_WINDOW);
+  REQUIRE_FALSE(replay_check(replay, a, 100));
+  replay_forget(replay, b, 101);
+  REQUIRE_FALSE(replay_check(replay, a, 101));
+
+  /* each session has its own table */
+  struct replay_table * other = replay_new();
+  REQUIRE(replay_check(other, a, 100));
+  replay_free(other);
+  replay_free(replay);
+}
+
+static std::vector<scnp_packet> resent_packets;
+
+static void record_resent(const struct scnp_packet * packet, const uint8_t *, void *)
+{
+  resent_packets.push_back(*packet);
+}
+
+TEST_CASE("inflight_rtt") {
+  uint8_t a[ETHER_ADDR_LEN] = { 0, 1, 2, 3, 4, 5 };
+  struct scnp_key first = { SCNP_KEY, 0, 1, true, false };
+  struct scnp_key second = { SCNP_KEY, 0, 2, true, false };
+  struct scnp_rtt rtt{};
+  struct inflight_table * inflight = inflight_new(RTO_MIN_NS, RTO_MAX_NS);
+  REQUIRE(inflight != nullptr);
+
+  /* the round trips are measured with the acknowledgements */
+  REQUIRE(inflight_rtt(inflight, a, &rtt) == -1);
+  REQUIRE(errno == ENOENT);
+  REQUIRE(inflight_add(inflight, (struct scnp_packet *) &first, a, nullptr, nullptr) == 0);
+  REQUIRE(inflight_ack(inflight, a, first.id, record_resent, nullptr) == 0);
+  REQUIRE(inflight_rtt(inflight, a, &rtt) == 0);
+  CHECK(rtt.samples == 1);
+  CHECK(rtt.srtt_ns < RTO_MIN_NS);
+  CHECK(rtt.rto_ns == RTO_MIN_NS);
+
+  /* a packet sent before an acknowledged one is retransmitted at once */
+  resent_packets.clear();
+  REQUIRE(inflight_add(inflight, (struct scnp_packet *) &first, a, nullptr, nullptr) == 0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  REQUIRE(inflight_add(inflight, (struct scnp_packet *) &second, a, nullptr, nullptr) == 0);
+  REQUIRE(inflight_ack(inflight, a, second.id, record_resent, nullptr) == 1);
+  REQUIRE(resent_packets.size() == 1);
+  CHECK(reinterpret_cast<scnp_key *>(&resent_packets[0])->id == first.id);
+  REQUIRE(inflight_status(inflight, a, first.id) == SCNP_PENDING);
+
+  /* the timeout follows the round trip, the retransmission is not measured */
+  resent_packets.clear();
+  std::this_thread::sleep_for(std::chrono::milliseconds(RTO_MIN_NS / 1000000 + 2));
+  inflight_expire(inflight, queue_clock(), record_resent, nullptr);
+  REQUIRE(resent_packets.size() == 1);
+  REQUIRE(inflight_ack(inflight, a, first.id, record_resent, nullptr) == 0);
+  REQUIRE(inflight_rtt(inflight, a, &rtt) == 0);
+  CHECK(rtt.samples == 2);
+
+  inflight_free(inflight);
+}
+
+TEST_CASE("inflight_cancel") {
+  uint8_t a[ETHER_ADDR_LEN] = { 0, 1, 2, 3, 4, 5 };
+  struct scnp_key key = { SCNP_KEY, 0, 1, true, false };
+  struct inflight_table * inflight = inflight_new(RTO_MIN_NS, RTO_MAX_NS);
+  REQUIRE(inflight != nullptr);
+
+  /* a packet that could not be sent is forgotten and never retransmitted */
+  REQUIRE(inflight_add(inflight, (struct scnp_packet *) &key, a, nullptr, nullptr) == 0);
+  REQUIRE(inflight_cancel(inflight, a, key.id) == 0);
+  REQUIRE(inflight_status(inflight, a, key.id) == -1);
+  REQUIRE(inflight_cancel(inflight, a, key.id) == -1);
+  REQUIRE(errno == ENOENT);
+
+  resent_packets.clear();
+  inflight_expire(inflight, queue_clock() + 2 * RTO_INITIAL_NS, record_resent, nullptr);
+  CHECK(resent_packets.empty());
+  CHECK(inflight_next_deadline(inflight) == -1);
+
+  inflight_free(inflight);
+}
+
+TEST_CASE("inflight_window") {
+  uint8_t a[ETHER_ADDR_LEN] = { 0, 1, 2, 3, 4, 5 };
+  struct scnp_key key = { SCNP_KEY, 0, 1, true, false };
+  struct inflight_table * inflight = inflight_new(RTO_MIN_NS, RTO_MAX_NS);
+  REQUIRE(inflight != nullptr);
+
+  /* the place of an acknowledged or cancelled packet is free before its timer expires */
+  for (int round = 0; round < 3; ++round) {
+    uint32_t ids[INFLIGHT_WINDOW];
+    for (int i = 0; i < INFLIGHT_WINDOW; ++i) {
+      REQUIRE(inflight_add(inflight, (struct scnp_packet *) &key, a, nullptr, nullptr) == 0);
+      ids[i] = key.id;
+    }
+    REQUIRE(inflight_add(inflight, (struct scnp_packet *) &key, a, nullptr, nullptr) == -1);
+    REQUIRE(errno == EXFULL);
+
+    for (int i = 0; i < INFLIGHT_WINDOW - 1; ++i) inflight_ack(inflight, a, ids[i], nullptr, nullptr);
+    REQUIRE(inflight_cancel(inflight, a, ids[INFLIGHT_WINDOW - 1]) == 0);
+    CHECK(inflight_next_deadline(inflight) == -1);
+  }
+
+  /* the timers left are still expired */
+  REQUIRE(inflight_add(inflight, (struct scnp_packet *) &key, a, nullptr, nullptr) == 0);
+  resent_packets.clear();
+  inflight_expire(inflight, queue_clock() + 2 * RTO_INITIAL_NS, record_resent, nullptr);
+  CHECK(resent_packets.size() == 1);
+
+  inflight_free(inflight);
+}
+
+TEST_CASE("sack") {
+  struct scnp_sack sack;
+  struct scnp_packet packet{};
+
+  /* a single identifier is sent as a SCNP_ACK */
+  sack_start(&sack, UINT32_MAX);
+  sack_to_packet(&sack, &packet);
+  REQUIRE(packet.type == SCNP_ACK);
+  REQUIRE(reinterpret_cast<scnp_ack *>(&packet)->id == UINT32_MAX);
+
+  /* the range grows on both sides and wraps around */
+  REQUIRE(sack_merge(&sack, 0));
+  REQUIRE(sack_merge(&sack, UINT32_MAX - 1));
+  REQUIRE(sack_merge(&sack, 0));
+  CHECK(sack.id == UINT32_MAX - 1);
+  CHECK(sack.count == 3);
+  CHECK(sack.bitmap == 0);
+
+  /* the identifiers after a gap are in the bitmap until the gap is filled */
+  REQUIRE(sack_merge(&sack, 2));
+  REQUIRE(sack_merge(&sack, 3));
+  CHECK(sack.count == 3);
+  CHECK(sack.bitmap == 0x6);
+  CHECK(sack_covers(&sack, 3));
+  CHECK_FALSE(sack_covers(&sack, 1));
+  CHECK(sack_ids(&sack) == 5);
+  REQUIRE(sack_merge(&sack, 1));
+  CHECK(sack.count == 6);
+  CHECK(sack.bitmap == 0);
+  REQUIRE_FALSE(sack_merge(&sack, 4 + SACK_BITMAP_BITS));
+  REQUIRE(sack_merge(&sack, 3 + SACK_BITMAP_BITS));
+  CHECK(sack_covers(&sack, 3 + SACK_BITMAP_BITS));
+  CHECK_FALSE(sack_covers(&sack, UINT32_MAX - 2));
+  sack_to_packet(&sack, &packet);
+  REQUIRE(packet.type == SCNP_SACK);
+
+  /* the acknowledgements wait for their delay or for a packet to the peer */
+  uint8_t a[ETHER_ADDR_LEN] = { 0, 1, 2, 3, 4, 5 };
+  uint8_t b[ETHER_ADDR_LEN] = { 5, 4, 3, 2, 1, 0 };
+  struct sack_pending pending[SACK_MAX_PEERS];
+  struct sack_table * table = sack_new(1000);
+  REQUIRE(table != nullptr);
+  REQUIRE(sack_next_deadline(table) == -1);
+  REQUIRE(sack_add(table, a, 10, 0, pending) == SACK_FIRST);
+  REQUIRE(sack_add(table, a, 11, 500, pending) == 0);
+  REQUIRE(sack_add(table, b, 10, 500, pending) == 0);
+  REQUIRE(sack_next_deadline(table) == 1000);
+  REQUIRE(sack_expire(table, 999, pending, SACK_MAX_PEERS) == 0);
+  REQUIRE(sack_expire(table, 1000, pending, SACK_MAX_PEERS) == 1);
+  CHECK(memcmp(pending[0].addr, a, ETHER_ADDR_LEN) == 0);
+  CHECK(pending[0].sack.id == 10);
+  CHECK(pending[0].sack.count == 2);
+  REQUIRE(sack_take(table, b, &sack));
+  CHECK(sack.id == 10);
+  REQUIRE_FALSE(sack_take(table, b, &sack));
+
+  /* an identifier that cannot be merged sends the acknowledgement at once */
+  REQUIRE(sack_add(table, a, 10, 0, pending) == SACK_FIRST);
+  REQUIRE(sack_add(table, a, 10 + 1 + SACK_BITMAP_BITS, 0, pending) == (SACK_FLUSHED | SACK_FIRST));
+  CHECK(pending[0].sack.id == 10);
+  REQUIRE(sack_take(table, a, &sack));
+  CHECK(sack.id == 10 + 1 + SACK_BITMAP_BITS);
+
+  /* the oldest acknowledgement makes room for a new peer */
+  for (int i = 0; i < SACK_MAX_PEERS; ++i) {
+    uint8_t addr[ETHER_ADDR_LEN] = { 2, 0, 0, 0, 0, (uint8_t) i };
+    REQUIRE((sack_add(table, addr, 1, 100 - i, pending) & SACK_FLUSHED) == 0);
+  }
+  REQUIRE(sack_add(table, a, 1, 200, pending) == SACK_FLUSHED);
+  CHECK(pending[0].addr[5] == SACK_MAX_PEERS - 1);
+
+  sack_init(table);
+  REQUIRE(sack_next_deadline(table) == -1);
+  sack_free(table);
+}
+
+TEST_CASE("inflight_sack") {
+  uint8_t a[ETHER_ADDR_LEN] = { 0, 1, 2, 3, 4, 5 };
+  struct scnp_key keys[4];
+  struct scnp_sack sack;
+  struct inflight_table * inflight = inflight_new(RTO_MIN_NS, RTO_MAX_NS);
+  REQUIRE(inflight != nullptr);
+
+  for (auto & key : keys) {
+    key = { SCNP_KEY, 0, 1, true, false };
+    REQUIRE(inflight_add(inflight, (struct scnp_packet *) &key, a, nullptr, nullptr) == 0);
+  }
+
+  /* the range and the bitmap complete their packets, the others stay pending */
+  sack_start(&sack, keys[0].id);
+  REQUIRE(sack_merge(&sack, keys[2].id));
+  REQUIRE(inflight_sack(inflight, a, &sack, record_resent, nullptr) >= 0);
+  CHECK(inflight_status(inflight, a, keys[0].id) == SCNP_ACKED);
+  CHECK(inflight_status(inflight, a, keys[1].id) == SCNP_PENDING);
+  CHECK(inflight_status(inflight, a, keys[2].id) == SCNP_ACKED);
+  CHECK(inflight_status(inflight, a, keys[3].id) == SCNP_PENDING);
+
+  struct scnp_rtt rtt{};
+  REQUIRE(inflight_rtt(inflight, a, &rtt) == 0);
+  CHECK(rtt.samples == 1);
+
+  /* an acknowledgement without pending packet is ignored */
+  REQUIRE(inflight_sack(inflight, a, &sack, record_resent, nullptr) == -1);
+
+  inflight_free(inflight);
+}
+
+TEST_CASE("queue_benchmark", "[.][benchmark]") {
+  /* a 1000 Hz mouse produces one REL_X and one REL_Y event every millisecond */
+  struct scnp_queue * q = init_queue();
+  REQUIRE(q != NULL);
+  struct scnp_packet mov{};
+  mov.type = SCNP_MOV;
+  uint8_t a[6] = {0, 1, 2, 3, 4, 5};
+  struct scnp_packet pulled{};
+  uint8_t z[6];
+
+  BENCHMARK("push/pull of one mouse report") {
+    push(q, &mov, a);
+    push(q, &mov, a);
+    pull(q, &pulled, z, -1);
+    pull(q, &pulled, z, -1);
+  }
+
+  /* one second of reports handed to a sleeping consumer thread */
+  const int reports = 1000;
+  std::chrono::nanoseconds total{0};
+  std::thread consumer([q, &total]() {
+    struct scnp_packet p{};
+    uint8_t addr[6];
+    for (int i = 0; i < 2 * reports; ++i) {
+      pull(q, &p, addr, -1);
+      std::chrono::steady_clock::time_point sent;
+      memcpy(&sent, p.data, sizeof(sent));
+      total += std::chrono::steady_clock::now() - sent;
+    }
+  });
+
+  for (int i = 0; i < reports; ++i) {
+    auto now = std::chrono::steady_clock::now();
+    memcpy(mov.data, &now, sizeof(now));
+    push(q, &mov, a);
+    push(q, &mov, a);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  consumer.join();
+
+  auto mean = total.count() / (2 * reports);
+  std::cout << "1000 Hz mouse, mean push to pull latency: " << mean << " ns" << std::endl;
+  CHECK(mean < 1000000);
   free_queue(q);
 }
 
+/* one packet of every type, as given to scnp_send() */
+static std::vector<scnp_packet> codec_packets()
+{
+  std::vector<scnp_packet> packets(7);
+  struct scnp_key key = { SCNP_KEY, 0x01020304, 0xabcd, true, false };
+  struct scnp_movement mov = { SCNP_MOV, MOV_REL, MOV_CODE_Y, -42 };
+  struct scnp_motion mot = { SCNP_MOT, -300, 300, -1 };
+  struct scnp_out out = { SCNP_OUT, 0x0a0b0c0d, OUT_EGRESS, OUT_LEFT, 0.0f };
+  struct scnp_management mng = { SCNP_MNG, "host" };
+  struct scnp_ack ack = { SCNP_ACK, 0x01020304 };
+  struct scnp_sack sack = { SCNP_SACK, 0xfffffffe, 300, 0x80000005 };
+  memcpy(&packets[0], &key, sizeof(key));
+  memcpy(&packets[1], &mov, sizeof(mov));
+  memcpy(&packets[2], &mot, sizeof(mot));
+  memcpy(&packets[3], &out, sizeof(out));
+  memcpy(&packets[4], &mng, sizeof(mng));
+  memcpy(&packets[5], &ack, sizeof(ack));
+  memcpy(&packets[6], &sack, sizeof(sack));
+  return packets;
+}
+
+TEST_CASE("codec") {
+  uint8_t buf[MAX_PACKET_LENGTH];
+  struct scnp_packet decoded{};
+
+  for (auto & packet : codec_packets()) {
+    size_t length = build_buffer(buf, &packet);
+    REQUIRE(length == packet_length(packet.type));
+    REQUIRE(buf[0] == packet.type);
+    REQUIRE(build_packet(&decoded, buf) == 0);
+    REQUIRE(decoded.type == packet.type);
+  }
+  auto * mng = reinterpret_cast<scnp_management *>(&decoded);
+  struct scnp_management features = { SCNP_MNG, "host", MNG_COMPACT };
+  build_buffer(buf, reinterpret_cast<scnp_packet *>(&features));
+  build_packet(&decoded, buf);
+  CHECK(std::string(mng->hostname) == "host");
+  CHECK(mng->features == MNG_COMPACT);
+  auto * mot = reinterpret_cast<scnp_motion *>(&decoded);
+  build_buffer(buf, &codec_packets()[2]);
+  build_packet(&decoded, buf);
+  CHECK(mot->dx == -300);
+  CHECK(mot->dy == 300);
+  CHECK(mot->wheel == -1);
+  auto * sack = reinterpret_cast<scnp_sack *>(&decoded);
+  build_buffer(buf, &codec_packets()[6]);
+  build_packet(&decoded, buf);
+  CHECK(sack->id == 0xfffffffe);
+  CHECK(sack->count == 300);
+  CHECK(sack->bitmap == 0x80000005);
+
+  /* unknown types are rejected */
+  struct scnp_packet unknown{};
+  unknown.type = SCNP_BATCH;
+  REQUIRE(packet_length(SCNP_BATCH) == 0);
+  REQUIRE(build_buffer(buf, &unknown) == 0);
+  REQUIRE(errno == EBADMSG);
+  buf[0] = 0;
+  REQUIRE(build_packet(&decoded, buf) == -1);
+  REQUIRE(errno == EBADMSG);
+}
+
+TEST_CASE("codec_benchmark", "[.][benchmark]") {
+  const char * names[] = { "key", "movement", "motion", "out", "management", "ack" };
+  std::vector<scnp_packet> packets = codec_packets();
+  uint8_t buf[MAX_PACKET_LENGTH];
+  struct scnp_packet decoded{};
+
+  for (size_t i = 0; i < packets.size(); ++i) {
+    BENCHMARK(std::string("build_buffer ") + names[i]) {
+      build_buffer(buf, &packets[i]);
+    }
+    build_buffer(buf, &packets[i]);
+    BENCHMARK(std::string("build_packet ") + names[i]) {
+      build_packet(&decoded, buf);
+    }
+  }
+}
+
 TEST_CASE("scnp_session") {
   REQUIRE(scnp_start(42, nullptr) == -1);
   REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
@@ -158,6 +717,40 @@ TEST_CASE("scnp_session") {
   scnp_stop();
 }
 
+TEST_CASE("scnp_try_recv") {
+  struct scnp_packet packet{};
+  uint8_t addr_r[ETHER_ADDR_LEN];
+
+  REQUIRE(scnp_try_recv(&packet, addr_r) == -1);
+  REQUIRE(errno == ESRCH);
+
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+  int fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_SCNP));
+  REQUIRE(fd > 0);
+  struct sockaddr_ll addr{};
+  addr.sll_family = AF_PACKET;
+  addr.sll_protocol = htons(ETH_P_SCNP);
+  addr.sll_ifindex = LOOP_INDEX;
+  addr.sll_halen = ETHER_ADDR_LEN;
+
+  /* the packets already received are taken without blocking */
+  uint8_t mov_buf[] = { SCNP_MOV, MOV_REL << 7u, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01 };
+  for (int i = 0; i < 3; ++i) {
+    REQUIRE(sendto(fd, mov_buf, MOV_LENGTH, 0, (struct sockaddr *) &addr, sizeof(addr)) == MOV_LENGTH);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  int movements = 0;
+  while (scnp_try_recv(&packet, addr_r) == 0) {
+    if (packet.type == SCNP_MOV) ++movements;
+  }
+  REQUIRE(errno == EAGAIN);
+  REQUIRE(movements == 3);
+
+  close(fd);
+  scnp_stop();
+}
+
 TEST_CASE("scnp_packets") {
   REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
   int fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_SCNP));
@@ -228,8 +821,24 @@ TEST_CASE("scnp_packets") {
   REQUIRE(mov->code == 0x1234);
   REQUIRE(mov->value == 0x56789012);
 
-  /* scnp_key */
-  uint8_t key_buf[] = { SCNP_KEY, 0x12, 0x34, 0x56, 0x78, 0x90, 0x12, 0xc0 };
+  /* scnp_motion */
+  uint8_t mot_buf[] = { SCNP_MOT, 0xff, 0xfe, 0x01, 0x02, 0xfd };
+
+  b = sendto(fd, mot_buf, MOT_LENGTH, 0, (struct sockaddr *) &addr, addrlen);
+  REQUIRE(b == MOT_LENGTH);
+
+  memset(packet, 0, sizeof(struct scnp_packet));
+  while (packet->type != SCNP_MOT) {
+    REQUIRE(scnp_recv(packet, addr_r) == 0);
+  }
+
+  auto * mot = reinterpret_cast<scnp_motion *>(packet);
+  REQUIRE(mot->dx == -2);
+  REQUIRE(mot->dy == 0x0102);
+  REQUIRE(mot->wheel == -3);
+
+  /* scnp_key, the identifiers of a source are unique */
+  uint8_t key_buf[] = { SCNP_KEY, 0x12, 0x34, 0x56, 0x79, 0x90, 0x12, 0xc0 };
 
   b = sendto(fd, key_buf, KEY_LENGTH, 0, (struct sockaddr *) &addr, addrlen);
   REQUIRE(b == KEY_LENGTH);
@@ -243,7 +852,7 @@ TEST_CASE("scnp_packets") {
   REQUIRE(memcmp(addr_r, loopaddr, ETHER_ADDR_LEN) == 0);
   auto * key = reinterpret_cast<scnp_key *>(packet);
   REQUIRE(key->type == SCNP_KEY);
-  REQUIRE(key->id == 0x12345678);
+  REQUIRE(key->id == 0x12345679);
   REQUIRE(key->code == 0x9012);
   REQUIRE(key->pressed);
   REQUIRE(key->repeated);
@@ -263,6 +872,20 @@ void recv_and_ack()
   }
 }
 
+void wait_status(const uint8_t * addr, uint32_t id, int status, int tout_msec)
+{
+  for (int i = 0; i < tout_msec && scnp_send_status(addr, id) != status; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void on_completion(const struct scnp_packet * packet, const uint8_t *, int status, void * data)
+{
+  auto * key = reinterpret_cast<const scnp_key *>(packet);
+  auto * result = static_cast<std::atomic_int *>(data);
+  if (key->type == SCNP_KEY && key->code == 0xabcd) *result = status;
+}
+
 TEST_CASE("scnp_ack") {
   REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
   std::thread t(recv_and_ack);
@@ -270,8 +893,62 @@ TEST_CASE("scnp_ack") {
   uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
   REQUIRE(scnp_send((struct scnp_packet *) &key, loopaddr) == 0);
   t.join();
-  REQUIRE(scnp_send((struct scnp_packet *) &key, loopaddr) == -1);
+  wait_status(loopaddr, key.id, SCNP_ACKED, 1000);
+  REQUIRE(scnp_send_status(loopaddr, key.id) == SCNP_ACKED);
+
+  /* the retransmission of a received packet is acknowledged again */
+  REQUIRE(scnp_send((struct scnp_packet *) &key, loopaddr) == 0);
+  wait_status(loopaddr, key.id, SCNP_ACKED, 2000);
+  REQUIRE(scnp_send_status(loopaddr, key.id) == SCNP_ACKED);
+
+  /* nobody acknowledges the packet, the call must not block */
+  uint8_t nobody[] = { 2, 0, 0, 0, 0, 1 };
+  auto start = std::chrono::steady_clock::now();
+  REQUIRE(scnp_send((struct scnp_packet *) &key, nobody) == 0);
+  REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100));
+  REQUIRE(scnp_send_status(nobody, key.id) == SCNP_PENDING);
+  wait_status(nobody, key.id, SCNP_TIMEDOUT, 5000);
+  REQUIRE(scnp_send_status(nobody, key.id) == SCNP_TIMEDOUT);
+  REQUIRE(scnp_send_status(nobody, key.id + 1) == -1);
+  scnp_stop();
+}
+
+TEST_CASE("scnp_ack_immediate") {
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+
+  /* the key is acknowledged while it waits in the receiving queue */
+  struct scnp_key key = { SCNP_KEY, 0, 0xabcd, true, true };
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+  REQUIRE(scnp_send((struct scnp_packet *) &key, loopaddr) == 0);
+  wait_status(loopaddr, key.id, SCNP_ACKED, 1000);
+  REQUIRE(scnp_send_status(loopaddr, key.id) == SCNP_ACKED);
+
+  struct scnp_stats stats{};
+  scnp_get_stats(&stats);
+  CHECK(stats.acks_sent >= 1);
+  CHECK(stats.packets_sent >= stats.acks_sent + 1);
+  scnp_stop();
+}
+
+TEST_CASE("scnp_ack_callback") {
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+  std::atomic_int status{-1};
+  std::thread t(recv_and_ack);
+  struct scnp_key key = { SCNP_KEY, 0, 0xabcd, true, true };
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+  REQUIRE(scnp_send_async((struct scnp_packet *) &key, loopaddr, on_completion, &status) == 0);
+  t.join();
+  for (int i = 0; i < 1000 && status == -1; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  REQUIRE(status == SCNP_ACKED);
+
+  /* pending packets are completed when the session stops */
+  status = -1;
+  uint8_t nobody[] = { 2, 0, 0, 0, 0, 1 };
+  REQUIRE(scnp_send_async((struct scnp_packet *) &key, nobody, on_completion, &status) == 0);
   scnp_stop();
+  REQUIRE(status == SCNP_TIMEDOUT);
 }
 
 void send_encrypted()
@@ -281,6 +958,1541 @@ void send_encrypted()
   scnp_send(reinterpret_cast<scnp_packet *>(&key), loopaddr);
 }
 
+TEST_CASE("scnp_duplicate") {
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+  struct scnp_socket sock{};
+  REQUIRE(scnp_socket_open(&sock, LOOP_INDEX) == 0);
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+  struct scnp_packet packet{};
+  uint8_t src[ETHER_ADDR_LEN];
+
+  /* a key retransmitted by a peer is delivered once */
+  uint8_t key[KEY_LENGTH] = { SCNP_KEY, 0x12, 0x34, 0x56, 0x78, 0x00, 0x1e, 0x80 };
+  REQUIRE(scnp_socket_sendto(&sock, key, sizeof(key), 0, loopaddr) == (ssize_t) sizeof(key));
+  do {
+    REQUIRE(scnp_recv(&packet, src) == 0);
+  } while (packet.type != SCNP_KEY);
+  REQUIRE(reinterpret_cast<scnp_key *>(&packet)->id == 0x12345678);
+
+  /* it is acknowledged again */
+  uint8_t buf[MAX_PACKET_LENGTH];
+  while (scnp_socket_recvfrom(&sock, buf, sizeof(buf), MSG_DONTWAIT, src) > 0);
+  REQUIRE(scnp_socket_sendto(&sock, key, sizeof(key), 0, loopaddr) == (ssize_t) sizeof(key));
+  bool acked = false;
+  while (!acked) {
+    ssize_t len = scnp_socket_recvfrom(&sock, buf, sizeof(buf), 0, src);
+    acked = len >= ACK_LENGTH && buf[0] == SCNP_ACK && memcmp(buf + 1, key + 1, 4) == 0;
+  }
+  struct scnp_stats stats{};
+  scnp_get_stats(&stats);
+  CHECK(stats.duplicates_dropped == 1);
+
+  /* the next key is the next packet given */
+  key[4] = 0x79;
+  REQUIRE(scnp_socket_sendto(&sock, key, sizeof(key), 0, loopaddr) == (ssize_t) sizeof(key));
+  do {
+    REQUIRE(scnp_recv(&packet, src) == 0);
+  } while (packet.type != SCNP_KEY);
+  REQUIRE(reinterpret_cast<scnp_key *>(&packet)->id == 0x12345679);
+
+  scnp_socket_close(&sock);
+  scnp_stop();
+}
+
+/* whether an acknowledgement of a key arrives on a socket before the timeout */
+static bool wait_ack(struct scnp_socket * sock, const uint8_t * key, int timeout_ms)
+{
+  uint8_t buf[MAX_PACKET_LENGTH];
+  uint8_t src[ETHER_ADDR_LEN];
+  auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+  while (std::chrono::steady_clock::now() < end) {
+    ssize_t len = scnp_socket_recvfrom(sock, buf, sizeof(buf), MSG_DONTWAIT, src);
+    if (len == -1) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    if (len >= ACK_LENGTH && buf[0] == SCNP_ACK && memcmp(buf + 1, key + 1, 4) == 0) return true;
+  }
+  return false;
+}
+
+TEST_CASE("scnp_recv_full") {
+  struct scnp_options options{};
+  options.recv_capacity = 2;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == 0);
+  struct scnp_socket sock{};
+  REQUIRE(scnp_socket_open(&sock, LOOP_INDEX) == 0);
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+  struct scnp_packet packet{};
+  uint8_t src[ETHER_ADDR_LEN];
+
+  /* fill the receiving queue */
+  uint8_t mov[MOV_LENGTH] = { SCNP_MOV, MOV_REL, MOV_CODE_X, 1 };
+  struct scnp_stats stats{};
+  for (int i = 0; i < 4; ++i) {
+    REQUIRE(scnp_socket_sendto(&sock, mov, sizeof(mov), 0, loopaddr) == (ssize_t) sizeof(mov));
+  }
+  for (int i = 0; i < 100 && stats.recv_dropped == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    scnp_get_stats(&stats);
+  }
+  REQUIRE(stats.recv_dropped > 0);
+
+  /* a key dropped by the full queue is not acknowledged */
+  uint8_t key[KEY_LENGTH] = { SCNP_KEY, 0x12, 0x34, 0x56, 0x78, 0x00, 0x1e, 0x80 };
+  uint64_t dropped = stats.recv_dropped;
+  REQUIRE(scnp_socket_sendto(&sock, key, sizeof(key), 0, loopaddr) == (ssize_t) sizeof(key));
+  CHECK_FALSE(wait_ack(&sock, key, 50));
+  scnp_get_stats(&stats);
+  CHECK(stats.recv_dropped > dropped);
+
+  /* its retransmission is delivered and acknowledged once there is room */
+  while (scnp_try_recv(&packet, src) == 0);
+  REQUIRE(scnp_socket_sendto(&sock, key, sizeof(key), 0, loopaddr) == (ssize_t) sizeof(key));
+  CHECK(wait_ack(&sock, key, 1000));
+  do {
+    REQUIRE(scnp_recv(&packet, src) == 0);
+  } while (packet.type != SCNP_KEY);
+  CHECK(reinterpret_cast<scnp_key *>(&packet)->id == 0x12345678);
+  scnp_get_stats(&stats);
+  CHECK(stats.duplicates_dropped == 0);
+
+  scnp_socket_close(&sock);
+  scnp_stop();
+}
+
+TEST_CASE("scnp_sack") {
+  struct scnp_options options{};
+  options.ack_delay_ns = RTO_MIN_NS;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == -1);
+  REQUIRE(errno == EINVAL);
+  options.ack_delay_ns = 2000000;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == 0);
+  struct scnp_socket sock{};
+  REQUIRE(scnp_socket_open(&sock, LOOP_INDEX) == 0);
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+  uint8_t src[ETHER_ADDR_LEN];
+
+  /* the keys received during the delay are acknowledged together, the lost one is not */
+  uint8_t key[KEY_LENGTH] = { SCNP_KEY, 0x00, 0x00, 0x01, 0x00, 0x00, 0x1e, 0x80 };
+  for (uint8_t id : { 0x00, 0x01, 0x03 }) {
+    key[4] = id;
+    REQUIRE(scnp_socket_sendto(&sock, key, sizeof(key), 0, loopaddr) == (ssize_t) sizeof(key));
+  }
+  uint8_t buf[MAX_PACKET_LENGTH];
+  struct scnp_packet packet{};
+  auto start = std::chrono::steady_clock::now();
+  while (packet.type != SCNP_SACK && std::chrono::steady_clock::now() - start < std::chrono::seconds(3)) {
+    ssize_t len = scnp_socket_recvfrom(&sock, buf, sizeof(buf), 0, src);
+    if (len >= SACK_LENGTH && buf[0] == SCNP_SACK) REQUIRE(build_packet(&packet, buf) == 0);
+  }
+  REQUIRE(packet.type == SCNP_SACK);
+  auto * sack = reinterpret_cast<scnp_sack *>(&packet);
+  CHECK(sack->id == 0x100);
+  CHECK(sack->count == 2);
+  CHECK(sack->bitmap == 0x2);
+  scnp_socket_close(&sock);
+
+  /* the sender completes every packet of a SCNP_SACK */
+  struct scnp_stats before{}, after{};
+  scnp_get_stats(&before);
+  const int count = 8;
+  uint32_t ids[count];
+  for (int i = 0; i < count; ++i) {
+    struct scnp_key k = { SCNP_KEY, 0, (uint16_t) i, true, false };
+    REQUIRE(scnp_send((struct scnp_packet *) &k, loopaddr) == 0);
+    ids[i] = k.id;
+  }
+  for (uint32_t id : ids) {
+    wait_status(loopaddr, id, SCNP_ACKED, 1000);
+    REQUIRE(scnp_send_status(loopaddr, id) == SCNP_ACKED);
+  }
+  scnp_get_stats(&after);
+  CHECK(after.ids_acked - before.ids_acked >= (uint64_t) count);
+  CHECK(after.acks_sent - before.acks_sent < (uint64_t) count);
+  CHECK(after.fast_retransmits == 0);
+  scnp_stop();
+}
+
+TEST_CASE("scnp_rtt") {
+  struct scnp_options options{};
+  options.rto_min_ns = 2000000;
+  options.rto_max_ns = 1000000;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == -1);
+  REQUIRE(errno == EINVAL);
+  options.rto_max_ns = 500000000;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == 0);
+
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+  struct scnp_rtt rtt{};
+  REQUIRE(scnp_get_rtt(loopaddr, &rtt) == -1);
+  REQUIRE(errno == ENOENT);
+
+  std::thread t(recv_and_ack);
+  struct scnp_key key = { SCNP_KEY, 0, 0xabcd, true, true };
+  REQUIRE(scnp_send((struct scnp_packet *) &key, loopaddr) == 0);
+  t.join();
+  wait_status(loopaddr, key.id, SCNP_ACKED, 1000);
+  REQUIRE(scnp_get_rtt(loopaddr, &rtt) == 0);
+  CHECK(rtt.samples == 1);
+  CHECK(rtt.rto_ns >= 2000000);
+  CHECK(rtt.rto_ns <= 500000000);
+
+  /* the unacknowledged packet is retransmitted after a few milliseconds and acknowledged as a duplicate */
+  auto start = std::chrono::steady_clock::now();
+  REQUIRE(scnp_send((struct scnp_packet *) &key, loopaddr) == 0);
+  wait_status(loopaddr, key.id, SCNP_ACKED, 1000);
+  REQUIRE(scnp_send_status(loopaddr, key.id) == SCNP_ACKED);
+  CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+  scnp_stop();
+}
+
+TEST_CASE("scnp_batch_send") {
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+  struct scnp_packet mov{};
+  mov.type = SCNP_MOV;
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+
+  /* a burst of packets is sent with less system calls than packets */
+  for (int i = 0; i < 256; ++i) {
+    REQUIRE(scnp_send(&mov, loopaddr) == 0);
+  }
+  struct scnp_stats stats{};
+  for (int i = 0; i < 1000 && stats.packets_sent < 256; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    scnp_get_stats(&stats);
+  }
+  REQUIRE(stats.packets_sent >= 256);
+  CHECK(stats.send_calls < stats.packets_sent);
+  CHECK(stats.send_calls_saved == stats.packets_sent - stats.send_calls);
+
+  /* the looped back frames are received in batches too */
+  for (int i = 0; i < 1000 && stats.packets_received < 256; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    scnp_get_stats(&stats);
+  }
+  REQUIRE(stats.packets_received >= 256);
+  CHECK(stats.recv_calls < stats.packets_received);
+  scnp_stop();
+
+  /* counters are reset by a new session */
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+  scnp_get_stats(&stats);
+  CHECK(stats.packets_sent <= 1);
+  scnp_stop();
+}
+
+/* number of frames received by the session after a frame is sent by another socket */
+static uint64_t received_after(struct scnp_socket * sock, const uint8_t * buf, size_t len)
+{
+  struct scnp_stats before{}, after{};
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+  scnp_get_stats(&before);
+  REQUIRE(scnp_socket_sendto(sock, buf, len, 0, loopaddr) == (ssize_t) len);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  scnp_get_stats(&after);
+  return after.packets_received - before.packets_received;
+}
+
+/* wait for the management packet of the session, which then sends SCNP_MOT and SCNP_BATCH on the loopback */
+static void wait_management()
+{
+  struct scnp_packet packet{};
+  uint8_t src[ETHER_ADDR_LEN];
+  do {
+    REQUIRE(scnp_recv(&packet, src) == 0);
+  } while (packet.type != SCNP_MNG);
+}
+
+TEST_CASE("scnp_motion") {
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+  wait_management();
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+  struct scnp_packet packet{};
+  auto * mov = reinterpret_cast<scnp_movement *>(&packet);
+  mov->type = SCNP_MOV;
+  mov->move_type = MOV_REL;
+
+  /* the relative movements queued together are merged */
+  const int count = 300;
+  for (int i = 0; i < count; ++i) {
+    mov->code = MOV_CODE_X;
+    mov->value = 1;
+    REQUIRE(scnp_send(&packet, loopaddr) == 0);
+    mov->code = MOV_CODE_Y;
+    mov->value = -2;
+    REQUIRE(scnp_send(&packet, loopaddr) == 0);
+  }
+  mov->code = MOV_CODE_WHEEL;
+  mov->value = 1;
+  REQUIRE(scnp_send(&packet, loopaddr) == 0);
+
+  int dx = 0, dy = 0, wheel = 0, received = 0;
+  uint8_t src[ETHER_ADDR_LEN];
+  while (dx != count || dy != -2 * count || wheel != 1) {
+    REQUIRE(scnp_recv(&packet, src) == 0);
+    REQUIRE(packet.type != SCNP_MOV);
+    if (packet.type != SCNP_MOT) continue;
+    auto * mot = reinterpret_cast<scnp_motion *>(&packet);
+    dx += mot->dx;
+    dy += mot->dy;
+    wheel += mot->wheel;
+    ++received;
+  }
+  CHECK(received < 2 * count + 1);
+
+  struct scnp_stats stats{};
+  scnp_get_stats(&stats);
+  CHECK(stats.movements_merged == (uint64_t) (2 * count + 1 - received));
+
+  /* absolute movements and other codes are sent as they are */
+  mov->type = SCNP_MOV;
+  mov->code = MOV_CODE_X;
+  mov->move_type = MOV_ABS;
+  REQUIRE(scnp_send(&packet, loopaddr) == 0);
+  do {
+    REQUIRE(scnp_recv(&packet, src) == 0);
+  } while (packet.type == SCNP_MNG);
+  REQUIRE(packet.type == SCNP_MOV);
+  scnp_stop();
+}
+
+TEST_CASE("scnp_batch_frame") {
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+  wait_management();
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+  struct scnp_movement mov = { SCNP_MOV, MOV_ABS, MOV_CODE_X, 0 };
+  struct scnp_key key = { SCNP_KEY, 0, 0, true, false };
+  struct scnp_out out = { SCNP_OUT, 0, OUT_EGRESS, OUT_RIGHT, 0.5f };
+
+  /* the events queued together are packed in SCNP_BATCH frames */
+  const int count = 40;
+  for (int i = 0; i < count; ++i) {
+    mov.value = i;
+    key.code = (uint16_t) i;
+    REQUIRE(scnp_send((struct scnp_packet *) &mov, loopaddr) == 0);
+    REQUIRE(scnp_send((struct scnp_packet *) &key, loopaddr) == 0);
+    if (i == count / 2) REQUIRE(scnp_send((struct scnp_packet *) &out, loopaddr) == 0);
+  }
+
+  /* they are received one by one and in order within their lane */
+  struct scnp_packet packet{};
+  uint8_t src[ETHER_ADDR_LEN];
+  int movements = 0, keys = 0;
+  bool out_received = false;
+  while (movements < count || keys < count || !out_received) {
+    REQUIRE(scnp_recv(&packet, src) == 0);
+    REQUIRE(packet.type != SCNP_BATCH);
+    if (packet.type == SCNP_MOV) {
+      REQUIRE(reinterpret_cast<scnp_movement *>(&packet)->value == movements++);
+    }
+    else if (packet.type == SCNP_KEY) {
+      REQUIRE(reinterpret_cast<scnp_key *>(&packet)->code == keys++);
+    }
+    else if (packet.type == SCNP_OUT) {
+      out_received = true;
+    }
+  }
+
+  struct scnp_stats stats{};
+  scnp_get_stats(&stats);
+  CHECK(stats.packets_batched > 0);
+  CHECK(stats.packets_received >= (uint64_t) (2 * count + 1));
+
+  /* the packets following a packet that cannot be batched are ignored */
+  struct scnp_socket sock{};
+  REQUIRE(scnp_socket_open(&sock, LOOP_INDEX) == 0);
+  uint8_t frame[BATCH_LENGTH + MOT_LENGTH + ACK_LENGTH + MOT_LENGTH] = { SCNP_BATCH, 3, SCNP_MOT, 0, 7 };
+  frame[BATCH_LENGTH + MOT_LENGTH] = SCNP_ACK;
+  frame[BATCH_LENGTH + MOT_LENGTH + ACK_LENGTH] = SCNP_MOT;
+  REQUIRE(scnp_socket_sendto(&sock, frame, sizeof(frame), 0, loopaddr) == (ssize_t) sizeof(frame));
+  do {
+    REQUIRE(scnp_recv(&packet, src) == 0);
+  } while (packet.type != SCNP_MOT);
+  CHECK(reinterpret_cast<scnp_motion *>(&packet)->dx == 7);
+  scnp_get_stats(&stats);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  struct scnp_stats after{};
+  scnp_get_stats(&after);
+  CHECK(after.packets_received == stats.packets_received);
+
+  scnp_socket_close(&sock);
+  scnp_stop();
+}
+
+TEST_CASE("scnp_lanes") {
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+  struct scnp_movement mov = { SCNP_MOV, MOV_ABS, MOV_CODE_X, 0 };
+
+  /* a key queued behind a flood of movements overtakes them */
+  const int count = 1000;
+  for (int i = 0; i < count; ++i) {
+    mov.value = i;
+    REQUIRE(scnp_send((struct scnp_packet *) &mov, loopaddr) == 0);
+  }
+  struct scnp_key key = { SCNP_KEY, 0, 0x1234, true, false };
+  REQUIRE(scnp_send((struct scnp_packet *) &key, loopaddr) == 0);
+
+  struct scnp_packet packet{};
+  uint8_t src[ETHER_ADDR_LEN];
+  int movements = 0;
+  do {
+    REQUIRE(scnp_recv(&packet, src) == 0);
+    if (packet.type == SCNP_MOV) {
+      /* the movements stay in order in their lane */
+      REQUIRE(reinterpret_cast<scnp_movement *>(&packet)->value == movements);
+      ++movements;
+    }
+  } while (packet.type != SCNP_KEY);
+  CHECK(movements < count);
+
+  /* every lane is emptied */
+  struct scnp_stats stats{};
+  for (int i = 0; i < 1000 && stats.lane_sent[SCNP_LANE_MOV] < (uint64_t) count; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    scnp_get_stats(&stats);
+  }
+  CHECK(stats.lane_sent[SCNP_LANE_MOV] == (uint64_t) count);
+  CHECK(stats.lane_sent[SCNP_LANE_KEY] >= 1);
+  /* acknowledgements do not go through the sending queue */
+  CHECK(stats.lane_sent[SCNP_LANE_ACK] == 0);
+  CHECK(stats.acks_sent >= 1);
+  CHECK(stats.lane_depth[SCNP_LANE_MOV] == 0);
+  CHECK(stats.lane_depth[SCNP_LANE_KEY] == 0);
+  scnp_stop();
+}
+
+TEST_CASE("scnp_queue_overflow") {
+  struct scnp_options options{};
+  options.lane_capacity[SCNP_LANE_MOV] = QUEUE_MAX_CAPACITY + 1;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == -1);
+  REQUIRE(errno == EINVAL);
+
+  options.lane_capacity[SCNP_LANE_MOV] = 4;
+  options.lane_capacity[SCNP_LANE_KEY] = 2;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == 0);
+  wait_management();
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+
+  /* the movements that do not fit are merged and the keys wait for room */
+  const int count = 2000, nkeys = 20;
+  struct scnp_movement mov = { SCNP_MOV, MOV_REL, MOV_CODE_X, 1 };
+  struct scnp_key key = { SCNP_KEY, 0, 0, true, false };
+  for (int i = 0; i < count; ++i) {
+    REQUIRE(scnp_send((struct scnp_packet *) &mov, loopaddr) == 0);
+    if (i % (count / nkeys) == 0) {
+      REQUIRE(scnp_send((struct scnp_packet *) &key, loopaddr) == 0);
+      ++key.code;
+    }
+  }
+
+  /* no movement is lost */
+  struct scnp_packet packet{};
+  uint8_t src[ETHER_ADDR_LEN];
+  int dx = 0, keys = 0;
+  while (dx < count || keys < nkeys) {
+    REQUIRE(scnp_recv(&packet, src) == 0);
+    if (packet.type == SCNP_MOT) dx += reinterpret_cast<scnp_motion *>(&packet)->dx;
+    else if (packet.type == SCNP_KEY) REQUIRE(reinterpret_cast<scnp_key *>(&packet)->code == keys++);
+  }
+  CHECK(dx == count);
+
+  struct scnp_stats stats{};
+  scnp_get_stats(&stats);
+  CHECK(stats.movements_overflowed > 0);
+  CHECK(stats.lane_high_water[SCNP_LANE_MOV] > 0);
+  CHECK(stats.lane_high_water[SCNP_LANE_MOV] <= 4);
+  CHECK(stats.lane_high_water[SCNP_LANE_KEY] <= 2);
+  CHECK(stats.recv_high_water > 0);
+  scnp_stop();
+}
+
+TEST_CASE("scnp_button_order") {
+  struct scnp_options options{};
+  options.lane_capacity[SCNP_LANE_MOV] = 4;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == 0);
+  wait_management();
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+
+  /* a button is sent after the movements before it, even the ones merged while their lane was full */
+  const int count = 2000, step = 100;
+  struct scnp_movement mov = { SCNP_MOV, MOV_REL, MOV_CODE_X, 1 };
+  struct scnp_key button = { SCNP_KEY, 0, 0x110, true, false };
+  for (int i = 1; i <= count; ++i) {
+    REQUIRE(scnp_send((struct scnp_packet *) &mov, loopaddr) == 0);
+    if (i % step == 0) {
+      REQUIRE(scnp_send((struct scnp_packet *) &button, loopaddr) == 0);
+      button.pressed = !button.pressed;
+    }
+  }
+
+  struct scnp_packet packet{};
+  uint8_t src[ETHER_ADDR_LEN];
+  int dx = 0, buttons = 0;
+  while (buttons < count / step) {
+    REQUIRE(scnp_recv(&packet, src) == 0);
+    if (packet.type == SCNP_MOT) dx += reinterpret_cast<scnp_motion *>(&packet)->dx;
+    else if (packet.type == SCNP_KEY) REQUIRE(dx == ++buttons * step);
+  }
+
+  struct scnp_stats stats{};
+  scnp_get_stats(&stats);
+  CHECK(stats.movements_overflowed > 0);
+  CHECK(stats.lane_sent[SCNP_LANE_KEY] == 0);
+  scnp_stop();
+}
+
+/* keys sent by the event loop, which cannot wait for room in their lane */
+static std::vector<int> full_lane_results;
+
+static void send_keys(const struct scnp_packet *, const uint8_t * dest_addr, int, void *)
+{
+  for (uint16_t code = 1; code <= 4; ++code) {
+    struct scnp_key key = { SCNP_KEY, 0, code, true, false };
+    full_lane_results.push_back(scnp_send((struct scnp_packet *) &key, dest_addr));
+  }
+}
+
+TEST_CASE("scnp_full_key_lane") {
+  for (int copies : { 1, 2 }) {
+    struct scnp_options options{};
+    options.engine = SCNP_ENGINE_EPOLL;
+    options.lane_capacity[SCNP_LANE_KEY] = 1;
+    options.key_copies = copies;
+    REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == 0);
+    uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+
+    /* the keys that do not fit in the lane are kept in flight and sent by the timer */
+    full_lane_results.clear();
+    struct scnp_out out = { SCNP_OUT, 0, OUT_EGRESS, OUT_LEFT, 0.5f };
+    REQUIRE(scnp_send_async((struct scnp_packet *) &out, loopaddr, send_keys, nullptr) == 0);
+
+    struct scnp_packet packet{};
+    uint8_t src[ETHER_ADDR_LEN];
+    std::vector<uint16_t> codes;
+    while (codes.size() < 4) {
+      REQUIRE(scnp_recv(&packet, src) == 0);
+      if (packet.type == SCNP_KEY) codes.push_back(reinterpret_cast<scnp_key *>(&packet)->code);
+    }
+    REQUIRE(full_lane_results == std::vector<int>({ 0, 0, 0, 0 }));
+    std::sort(codes.begin(), codes.end());
+    CHECK(codes == std::vector<uint16_t>({ 1, 2, 3, 4 }));
+    scnp_stop();
+  }
+}
+
+TEST_CASE("scnp_direct_send") {
+  struct scnp_options options{};
+  options.direct_send = true;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == 0);
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+  struct scnp_movement mov = { SCNP_MOV, MOV_ABS, MOV_CODE_X, 0 };
+
+  /* the packets sent one at a time skip the sending thread */
+  for (int i = 0; i < 10; ++i) {
+    mov.value = i;
+    REQUIRE(scnp_send((struct scnp_packet *) &mov, loopaddr) == 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  struct scnp_stats stats{};
+  scnp_get_stats(&stats);
+  CHECK(stats.direct_sends > 0);
+
+  /* a burst is shared with the sending thread and stays in order */
+  const int count = 100;
+  for (int i = 10; i < count; ++i) {
+    mov.value = i;
+    REQUIRE(scnp_send((struct scnp_packet *) &mov, loopaddr) == 0);
+  }
+  struct scnp_packet packet{};
+  uint8_t src[ETHER_ADDR_LEN];
+  for (int i = 0; i < count; ++i) {
+    do {
+      REQUIRE(scnp_recv(&packet, src) == 0);
+    } while (packet.type != SCNP_MOV);
+    REQUIRE(reinterpret_cast<scnp_movement *>(&packet)->value == i);
+  }
+
+  /* the sending thread retransmits the packets sent directly */
+  struct scnp_key key = { SCNP_KEY, 0, 0xabcd, true, false };
+  uint8_t nobody[] = { 2, 0, 0, 0, 0, 1 };
+  REQUIRE(scnp_send((struct scnp_packet *) &key, nobody) == 0);
+  wait_status(nobody, key.id, SCNP_TIMEDOUT, 5000);
+  REQUIRE(scnp_send_status(nobody, key.id) == SCNP_TIMEDOUT);
+  scnp_stop();
+}
+
+/* mean time between scnp_send() and the reception of the frame by another socket */
+static long long send_latency(bool direct_send, int engine = SCNP_ENGINE_THREADS, int socket_mode = SCNP_SOCKET_PLAIN)
+{
+  struct scnp_options options{};
+  options.direct_send = direct_send;
+  options.engine = engine;
+  options.socket_mode = socket_mode;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == 0);
+  struct scnp_socket sock{};
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+
+  /* in UDP mode, the frames are sent to the port of the socket */
+  if (socket_mode == SCNP_SOCKET_UDP) {
+    REQUIRE(scnp_socket_open_udp(&sock, 0, 0) == 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(sock.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(scnp_add_peer((struct sockaddr *) &addr, sizeof(addr), loopaddr) == 0);
+  }
+  else REQUIRE(scnp_socket_open(&sock, LOOP_INDEX) == 0);
+
+  const int count = 1000;
+  std::vector<std::chrono::steady_clock::time_point> sent(count);
+  std::vector<bool> received(count, false);
+  std::chrono::nanoseconds total{0};
+
+  /* the frames of the loopback are received twice, the first one is kept */
+  std::thread receiver([&]() {
+    uint8_t buf[MAX_PACKET_LENGTH];
+    uint8_t addr[ETHER_ADDR_LEN];
+    for (int n = 0; n < count;) {
+      ssize_t len = scnp_socket_recvfrom(&sock, buf, sizeof(buf), 0, addr);
+      if (len < MOV_LENGTH || buf[0] != SCNP_MOV) continue;
+      uint32_t i;
+      memcpy(&i, buf + 4, sizeof(i));
+      i = ntohl(i);
+      if (i >= (uint32_t) count || received[i]) continue;
+      total += std::chrono::steady_clock::now() - sent[i];
+      received[i] = true;
+      ++n;
+    }
+  });
+
+  /* a 1000 Hz mouse */
+  struct scnp_movement mov = { SCNP_MOV, MOV_ABS, MOV_CODE_X, 0 };
+  for (int i = 0; i < count; ++i) {
+    mov.value = i;
+    sent[i] = std::chrono::steady_clock::now();
+    scnp_send((struct scnp_packet *) &mov, loopaddr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  receiver.join();
+
+  scnp_socket_close(&sock);
+  scnp_stop();
+
+  return total.count() / count;
+}
+
+TEST_CASE("scnp_epoll") {
+  struct scnp_options options{};
+  options.engine = SCNP_ENGINE_EPOLL + 1;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == -1);
+  REQUIRE(errno == EINVAL);
+  REQUIRE(scnp_poll_fd() == -1);
+  REQUIRE(errno == ESRCH);
+
+  options.engine = SCNP_ENGINE_EPOLL;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == 0);
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+  int fd = scnp_poll_fd();
+  REQUIRE(fd >= 0);
+  REQUIRE(scnp_poll_fd() == fd);
+
+  /* the loop sends the management packets */
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  REQUIRE(poll(&pfd, 1, 2000) == 1);
+  struct scnp_packet packet{};
+  uint8_t src[ETHER_ADDR_LEN];
+  do {
+    REQUIRE(scnp_recv(&packet, src) == 0);
+  } while (packet.type != SCNP_MNG);
+
+  /* the submitted packets are sent in order and the keys are acknowledged */
+  const int count = 100;
+  struct scnp_movement mov = { SCNP_MOV, MOV_ABS, MOV_CODE_X, 0 };
+  for (int i = 0; i < count; ++i) {
+    mov.value = i;
+    REQUIRE(scnp_send((struct scnp_packet *) &mov, loopaddr) == 0);
+  }
+  struct scnp_key key = { SCNP_KEY, 0, 0x42, true, false };
+  REQUIRE(scnp_send((struct scnp_packet *) &key, loopaddr) == 0);
+  for (int i = 0; i < count; ++i) {
+    do {
+      REQUIRE(scnp_recv(&packet, src) == 0);
+    } while (packet.type != SCNP_MOV);
+    REQUIRE(reinterpret_cast<scnp_movement *>(&packet)->value == i);
+  }
+  wait_status(loopaddr, key.id, SCNP_ACKED, 1000);
+  REQUIRE(scnp_send_status(loopaddr, key.id) == SCNP_ACKED);
+
+  /* the descriptor is cleared once every packet is taken */
+  while (poll(&pfd, 1, 100) == 1) {
+    REQUIRE(scnp_recv(&packet, src) == 0);
+  }
+  CHECK(poll(&pfd, 1, 0) == 0);
+
+  /* the timer of the loop retransmits the packets */
+  uint8_t nobody[] = { 2, 0, 0, 0, 0, 1 };
+  REQUIRE(scnp_send((struct scnp_packet *) &key, nobody) == 0);
+  wait_status(nobody, key.id, SCNP_TIMEDOUT, 5000);
+  REQUIRE(scnp_send_status(nobody, key.id) == SCNP_TIMEDOUT);
+  scnp_stop();
+
+  /* the descriptor is available with the threads too */
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+  fd = scnp_poll_fd();
+  REQUIRE(fd >= 0);
+  pfd.fd = fd;
+  REQUIRE(poll(&pfd, 1, 2000) == 1);
+  REQUIRE(scnp_recv(&packet, src) == 0);
+  scnp_stop();
+}
+
+TEST_CASE("send_latency_benchmark", "[.][benchmark]") {
+  long long queued = send_latency(false);
+  long long direct = send_latency(true);
+  long long epoll = send_latency(false, SCNP_ENGINE_EPOLL);
+  long long udp = send_latency(false, SCNP_ENGINE_THREADS, SCNP_SOCKET_UDP);
+  std::cout << "mean scnp_send to wire latency, queued: " << queued << " ns, direct: " << direct
+            << " ns, epoll: " << epoll << " ns, udp: " << udp << " ns" << std::endl;
+  CHECK(direct < 1000000);
+  CHECK(queued < 1000000);
+  CHECK(epoll < 1000000);
+  CHECK(udp < 1000000);
+}
+
+TEST_CASE("scnp_filter") {
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+  struct scnp_socket sock{};
+  REQUIRE(scnp_socket_open(&sock, LOOP_INDEX) == 0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  /* invalid types and short frames are dropped by the kernel */
+  uint8_t mov[MOV_LENGTH] = { SCNP_MOV };
+  uint8_t unknown[MOV_LENGTH] = { 6 };
+  uint8_t key[3] = { SCNP_KEY };
+  CHECK(received_after(&sock, mov, sizeof(mov)) == 1);
+  CHECK(received_after(&sock, unknown, sizeof(unknown)) == 0);
+  CHECK(received_after(&sock, key, sizeof(key)) == 0);
+
+  /* only the frames of the peers are accepted */
+  uint8_t peer[][ETHER_ADDR_LEN] = { { 1, 2, 3, 4, 5, 6 } };
+  REQUIRE(scnp_set_peers(peer, 1) == 0);
+  CHECK(received_after(&sock, mov, sizeof(mov)) == 0);
+  REQUIRE(scnp_set_peers(nullptr, 0) == 0);
+  CHECK(received_after(&sock, mov, sizeof(mov)) == 1);
+  REQUIRE(scnp_set_peers(peer, SCNP_MAX_PEERS + 1) == -1);
+  REQUIRE(errno == EINVAL);
+
+  scnp_socket_close(&sock);
+  scnp_stop();
+}
+
+/* send count MOV frames from the peer of a veth pair, returns the number of
+ * system calls made by the session to receive them */
+static uint64_t recv_from_veth(const struct scnp_options * options, int count)
+{
+  unsigned int if_index = if_nametoindex("scnpveth0");
+  REQUIRE(scnp_start_opt(if_index, nullptr, options) == 0);
+
+  struct scnp_socket peer{};
+  REQUIRE(scnp_socket_open(&peer, (int) if_nametoindex("scnpveth1")) == 0);
+  uint8_t buf[MOV_LENGTH] = { SCNP_MOV };
+  std::vector<struct scnp_frame> frames(count);
+  for (auto & f : frames) {
+    f.buf = buf;
+    f.len = sizeof(buf);
+    memset(f.addr, 0xff, ETHER_ADDR_LEN);
+  }
+  /* bursts of frames small enough for the socket buffer */
+  struct scnp_packet packet{};
+  uint8_t src[ETHER_ADDR_LEN];
+  for (int sent = 0; sent < count; sent += 32) {
+    REQUIRE(scnp_socket_sendmmsg(&peer, frames.data() + sent, 32, 0) == 32);
+    for (int i = 0; i < 32; ++i) {
+      REQUIRE(scnp_recv(&packet, src) == 0);
+      REQUIRE(packet.type == SCNP_MOV);
+    }
+  }
+
+  struct scnp_stats stats{};
+  scnp_get_stats(&stats);
+  scnp_socket_close(&peer);
+  scnp_stop();
+
+  return stats.recv_calls;
+}
+
+/* deletes the veth pair of a test when it ends, even on a failed assertion */
+struct VethGuard
+{
+  ~VethGuard()
+  {
+    int ret = system("ip link del scnpveth0 2> /dev/null");
+    (void) ret;
+  }
+};
+
+TEST_CASE("scnp_ring") {
+  /* a pair left by an interrupted run is replaced */
+  VethGuard veth;
+  int ret = system("ip link del scnpveth0 2> /dev/null");
+  (void) ret;
+  if (system("ip link add scnpveth0 type veth peer name scnpveth1 2> /dev/null") != 0 ||
+      system("ip link set scnpveth0 up && ip link set scnpveth1 up") != 0) {
+    WARN("cannot create a veth pair, test skipped");
+    return;
+  }
+
+  const int count = 512;
+  struct scnp_options plain{};
+  struct scnp_options ring{};
+  ring.socket_mode = SCNP_SOCKET_RING;
+
+  uint64_t plain_calls = recv_from_veth(&plain, count);
+  uint64_t ring_calls = recv_from_veth(&ring, count);
+  CHECK(ring_calls < plain_calls);
+
+  /* frames sent through the transmit ring are received by the peer */
+  REQUIRE(scnp_start_opt(if_nametoindex("scnpveth0"), nullptr, &ring) == 0);
+  struct scnp_socket peer{};
+  REQUIRE(scnp_socket_open(&peer, (int) if_nametoindex("scnpveth1")) == 0);
+  struct scnp_packet mov{};
+  mov.type = SCNP_MOV;
+  uint8_t broadcast[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+  REQUIRE(scnp_send(&mov, broadcast) == 0);
+  uint8_t buf[MAX_PACKET_LENGTH];
+  uint8_t src[ETHER_ADDR_LEN];
+  do {
+    REQUIRE(scnp_socket_recvfrom(&peer, buf, sizeof(buf), 0, src) > 0);
+  } while (buf[0] != SCNP_MOV);
+  scnp_socket_close(&peer);
+  scnp_stop();
+
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &ring) == 0);
+  scnp_stop();
+  struct scnp_options bad{};
+  bad.socket_mode = -1;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &bad) == -1);
+  REQUIRE(errno == EINVAL);
+}
+
+/* ethernet address of an interface, read from sysfs */
+static bool read_address(const char * name, uint8_t * addr)
+{
+  std::string path = std::string("/sys/class/net/") + name + "/address";
+  FILE * f = fopen(path.c_str(), "r");
+  if (f == nullptr) return false;
+  int n = fscanf(f, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &addr[0], &addr[1], &addr[2], &addr[3], &addr[4], &addr[5]);
+  fclose(f);
+  return n == ETHER_ADDR_LEN;
+}
+
+/* send a key through a session and wait for its acknowledgement from the receiving session */
+static void exchange_key(scnp_session_t * from, scnp_session_t * to, const uint8_t * dest_addr)
+{
+  struct scnp_key key = { SCNP_KEY, 0, 0xabcd, true, false };
+  REQUIRE(scnp_session_send(from, (struct scnp_packet *) &key, dest_addr) == 0);
+
+  struct scnp_packet packet{};
+  uint8_t src[ETHER_ADDR_LEN];
+  do {
+    REQUIRE(scnp_session_recv(to, &packet, src) == 0);
+  } while (packet.type != SCNP_KEY);
+
+  for (int i = 0; i < 1000 && scnp_session_send_status(from, dest_addr, key.id) != SCNP_ACKED; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  REQUIRE(scnp_session_send_status(from, dest_addr, key.id) == SCNP_ACKED);
+}
+
+TEST_CASE("scnp_multi_session") {
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+
+  /* one session per interface, the default session included */
+  scnp_session_t * loop = scnp_session_open(LOOP_INDEX, nullptr, nullptr);
+  REQUIRE(loop != nullptr);
+  REQUIRE(scnp_session_open(LOOP_INDEX, nullptr, nullptr) == nullptr);
+  REQUIRE(errno == EALREADY);
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == -1);
+  REQUIRE(errno == EALREADY);
+  REQUIRE(scnp_session_open(42, nullptr, nullptr) == nullptr);
+
+  /* the paths are compared by their round trips, an unmeasured one first */
+  scnp_session_t * paths[] = { loop, loop };
+  uint8_t addrs[][ETHER_ADDR_LEN] = { { 0, 0, 0, 0, 0, 0 }, { 1, 2, 3, 4, 5, 6 } };
+  REQUIRE(scnp_best_path(paths, addrs, 0) == -1);
+  REQUIRE(errno == EINVAL);
+  REQUIRE(scnp_best_path(paths, addrs, 2) == 0);
+  exchange_key(loop, loop, loopaddr);
+  REQUIRE(scnp_best_path(paths, addrs, 2) == 1);
+  REQUIRE(scnp_best_path(paths, addrs, 1) == 0);
+
+  VethGuard veth;
+  int ret = system("ip link del scnpveth0 2> /dev/null");
+  (void) ret;
+  if (system("ip link add scnpveth0 type veth peer name scnpveth1 2> /dev/null") != 0 ||
+      system("ip link set scnpveth0 up && ip link set scnpveth1 up") != 0) {
+    WARN("cannot create a veth pair, test skipped");
+    scnp_session_close(loop);
+    return;
+  }
+  uint8_t addr0[ETHER_ADDR_LEN], addr1[ETHER_ADDR_LEN];
+  REQUIRE(read_address("scnpveth0", addr0));
+  REQUIRE(read_address("scnpveth1", addr1));
+
+  /* a session on each end of the pair, running with the loopback one */
+  struct scnp_options epoll{};
+  epoll.engine = SCNP_ENGINE_EPOLL;
+  scnp_session_t * end0 = scnp_session_open(if_nametoindex("scnpveth0"), nullptr, nullptr);
+  scnp_session_t * end1 = scnp_session_open(if_nametoindex("scnpveth1"), nullptr, &epoll);
+  REQUIRE(end0 != nullptr);
+  REQUIRE(end1 != nullptr);
+
+  std::thread t([loop, &loopaddr]() { exchange_key(loop, loop, loopaddr); });
+  exchange_key(end0, end1, addr1);
+  exchange_key(end1, end0, addr0);
+  t.join();
+
+  /* the windows and the counters are kept per session */
+  struct scnp_rtt rtt{};
+  REQUIRE(scnp_session_get_rtt(end0, addr1, &rtt) == 0);
+  REQUIRE(scnp_session_get_rtt(loop, addr1, &rtt) == -1);
+  struct scnp_stats stats0{}, stats1{};
+  scnp_session_get_stats(end0, &stats0);
+  scnp_session_get_stats(end1, &stats1);
+  CHECK(stats0.lane_sent[SCNP_LANE_KEY] == 1);
+  CHECK(stats1.lane_sent[SCNP_LANE_KEY] == 1);
+
+  /* the path through the pair is chosen once both are measured */
+  scnp_session_t * both[] = { loop, end0 };
+  uint8_t dests[][ETHER_ADDR_LEN] = { { 0, 0, 0, 0, 0, 0 }, { 0 } };
+  memcpy(dests[1], addr1, ETHER_ADDR_LEN);
+  struct scnp_rtt rtt_loop{}, rtt_pair{};
+  REQUIRE(scnp_session_get_rtt(loop, loopaddr, &rtt_loop) == 0);
+  REQUIRE(scnp_session_get_rtt(end0, addr1, &rtt_pair) == 0);
+  CHECK(scnp_best_path(both, dests, 2) == ((rtt_pair.srtt_ns < rtt_loop.srtt_ns) ? 1 : 0));
+
+  scnp_session_close(end1);
+  scnp_session_close(end0);
+  scnp_session_close(loop);
+
+  /* the default session can be started again */
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+  scnp_stop();
+}
+
+static struct sockaddr_in loopback4(uint16_t port)
+{
+  struct sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  return addr;
+}
+
+static struct sockaddr_in6 loopback6(uint16_t port)
+{
+  struct sockaddr_in6 addr{};
+  addr.sin6_family = AF_INET6;
+  addr.sin6_port = htons(port);
+  addr.sin6_addr = in6addr_loopback;
+  return addr;
+}
+
+TEST_CASE("scnp_socket_udp") {
+  struct scnp_socket a{}, b{};
+  REQUIRE(scnp_socket_open_udp(&a, 0, 0) == 0);
+  REQUIRE(scnp_socket_open_udp(&b, LOOP_INDEX, 0) == 0);
+  REQUIRE(a.port != 0);
+
+  /* the peers are designated by handles */
+  struct sockaddr_in to_b = loopback4(b.port);
+  uint8_t handle_b[ETHER_ADDR_LEN], again[ETHER_ADDR_LEN];
+  REQUIRE(scnp_socket_add_peer(&a, (struct sockaddr *) &to_b, sizeof(to_b), handle_b) == 0);
+  REQUIRE(scnp_socket_add_peer(&a, (struct sockaddr *) &to_b, sizeof(to_b), again) == 0);
+  CHECK(memcmp(handle_b, again, ETHER_ADDR_LEN) == 0);
+
+  uint8_t bufs[3][MAX_PACKET_LENGTH] = { { SCNP_MOV, 1 }, { SCNP_MOV, 2 }, { SCNP_MOV, 3 } };
+  struct scnp_frame frames[3];
+  for (int i = 0; i < 3; ++i) {
+    frames[i].buf = bufs[i];
+    frames[i].len = MOV_LENGTH;
+    memcpy(frames[i].addr, handle_b, ETHER_ADDR_LEN);
+  }
+  REQUIRE(scnp_socket_sendmmsg(&a, frames, 3, 0) == 3);
+
+  /* the source of the datagrams becomes a peer of b */
+  uint8_t rbufs[3][MAX_PACKET_LENGTH];
+  struct scnp_frame rframes[3];
+  for (int received = 0; received < 3;) {
+    for (int i = 0; i < 3; ++i) {
+      rframes[i].buf = rbufs[i];
+      rframes[i].len = MAX_PACKET_LENGTH;
+    }
+    int n = scnp_socket_recvmmsg(&b, rframes, 3 - received, 0);
+    REQUIRE(n > 0);
+    for (int i = 0; i < n; ++i, ++received) {
+      CHECK(rframes[i].len == MOV_LENGTH);
+      CHECK(rframes[i].buf[1] == received + 1);
+    }
+  }
+  uint8_t handle_a[ETHER_ADDR_LEN];
+  memcpy(handle_a, rframes[0].addr, ETHER_ADDR_LEN);
+
+  /* the reply reaches a from the handle it gave to b */
+  uint8_t buf[MAX_PACKET_LENGTH] = { SCNP_MOV };
+  uint8_t src[ETHER_ADDR_LEN];
+  REQUIRE(scnp_socket_sendto(&b, buf, MOV_LENGTH, 0, handle_a) == MOV_LENGTH);
+  REQUIRE(scnp_socket_recvfrom(&a, buf, sizeof(buf), 0, src) == MOV_LENGTH);
+  CHECK(memcmp(src, handle_b, ETHER_ADDR_LEN) == 0);
+
+  /* IPv6, a new source for a */
+  struct sockaddr_in6 to_a6 = loopback6(a.port);
+  uint8_t handle_a6[ETHER_ADDR_LEN];
+  REQUIRE(scnp_socket_add_peer(&b, (struct sockaddr *) &to_a6, sizeof(to_a6), handle_a6) == 0);
+  CHECK(memcmp(handle_a6, handle_a, ETHER_ADDR_LEN) != 0);
+  REQUIRE(scnp_socket_sendto(&b, buf, MOV_LENGTH, 0, handle_a6) == MOV_LENGTH);
+  REQUIRE(scnp_socket_recvfrom(&a, buf, sizeof(buf), 0, src) == MOV_LENGTH);
+  CHECK(memcmp(src, handle_b, ETHER_ADDR_LEN) != 0);
+
+  /* the broadcast address reaches both addresses of a */
+  uint8_t broadcast[] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+  REQUIRE(scnp_socket_sendto(&b, buf, MOV_LENGTH, 0, broadcast) == MOV_LENGTH);
+  REQUIRE(scnp_socket_recvfrom(&a, buf, sizeof(buf), 0, src) == MOV_LENGTH);
+  REQUIRE(scnp_socket_recvfrom(&a, buf, sizeof(buf), 0, src) == MOV_LENGTH);
+
+  /* the filter checks the types in the kernel and the peers on reception */
+  struct scnp_filter filter{};
+  filter.ntypes = 1;
+  filter.types[0] = SCNP_MOV;
+  filter.lengths[0] = MOV_LENGTH;
+  REQUIRE(scnp_socket_set_filter(&a, &filter) == 0);
+  uint8_t unknown[MOV_LENGTH] = { 6 };
+  uint8_t shorter[3] = { SCNP_MOV };
+  REQUIRE(scnp_socket_sendto(&b, unknown, sizeof(unknown), 0, handle_a) == sizeof(unknown));
+  REQUIRE(scnp_socket_sendto(&b, shorter, sizeof(shorter), 0, handle_a) == sizeof(shorter));
+  buf[1] = 42;
+  REQUIRE(scnp_socket_sendto(&b, buf, MOV_LENGTH, 0, handle_a) == MOV_LENGTH);
+  REQUIRE(scnp_socket_recvfrom(&a, buf, sizeof(buf), 0, src) == MOV_LENGTH);
+  CHECK(buf[1] == 42);
+
+  uint8_t other[ETHER_ADDR_LEN] = { 0x02, 0, 0, 0, 0, 9 };
+  filter.npeers = 1;
+  memcpy(filter.peers[0], other, ETHER_ADDR_LEN);
+  REQUIRE(scnp_socket_set_filter(&a, &filter) == 0);
+  REQUIRE(scnp_socket_sendto(&b, buf, MOV_LENGTH, 0, handle_a) == MOV_LENGTH);
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  CHECK(scnp_socket_recvfrom(&a, buf, sizeof(buf), MSG_DONTWAIT, src) == -1);
+  CHECK(errno == EAGAIN);
+  memcpy(filter.peers[0], handle_b, ETHER_ADDR_LEN);
+  REQUIRE(scnp_socket_set_filter(&a, &filter) == 0);
+  REQUIRE(scnp_socket_sendto(&b, buf, MOV_LENGTH, 0, handle_a) == MOV_LENGTH);
+  REQUIRE(scnp_socket_recvfrom(&a, buf, sizeof(buf), 0, src) == MOV_LENGTH);
+
+  struct sockaddr unknown_family{};
+  unknown_family.sa_family = AF_UNIX;
+  REQUIRE(scnp_socket_add_peer(&a, &unknown_family, sizeof(unknown_family), again) == -1);
+  CHECK(errno == EAFNOSUPPORT);
+  struct scnp_socket plain{};
+  REQUIRE(scnp_socket_open(&plain, LOOP_INDEX) == 0);
+  REQUIRE(scnp_socket_add_peer(&plain, (struct sockaddr *) &to_b, sizeof(to_b), again) == -1);
+  CHECK(errno == EOPNOTSUPP);
+
+  scnp_socket_close(&plain);
+  scnp_socket_close(&b);
+  scnp_socket_close(&a);
+}
+
+/*
+ * send a datagram to a port of the loopback from a new socket, on a port chosen by the system,
+ * the socket is kept open so that its port is not given to the next one
+ */
+static void send_from_new_port(std::vector<int>& fds, uint16_t port, uint8_t value)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  REQUIRE(fd != -1);
+  fds.push_back(fd);
+  struct sockaddr_in to = loopback4(port);
+  uint8_t buf[MOV_LENGTH] = { SCNP_MOV, value };
+  REQUIRE(sendto(fd, buf, sizeof(buf), 0, (struct sockaddr *) &to, sizeof(to)) == sizeof(buf));
+}
+
+/* number of datagrams received by a socket until none is waiting */
+static int drain_udp(struct scnp_socket * socket)
+{
+  uint8_t buf[MAX_PACKET_LENGTH];
+  uint8_t src[ETHER_ADDR_LEN];
+  int count = 0;
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  while (scnp_socket_recvfrom(socket, buf, sizeof(buf), MSG_DONTWAIT, src) > 0) ++count;
+  return count;
+}
+
+TEST_CASE("scnp_socket_udp_flood") {
+  struct scnp_socket a{}, b{}, c{};
+  REQUIRE(scnp_socket_open_udp(&a, LOOP_INDEX, 0) == 0);
+  REQUIRE(scnp_socket_open_udp(&b, LOOP_INDEX, 0) == 0);
+  REQUIRE(scnp_socket_open_udp(&c, LOOP_INDEX, 0) == 0);
+
+  /* b is given to a, c becomes a peer when a receives from it */
+  struct sockaddr_in to_a = loopback4(a.port), to_b = loopback4(b.port);
+  uint8_t handle_b[ETHER_ADDR_LEN], handle_a[ETHER_ADDR_LEN], handle_c[ETHER_ADDR_LEN];
+  uint8_t buf[MAX_PACKET_LENGTH] = { SCNP_MOV };
+  uint8_t src[ETHER_ADDR_LEN];
+  REQUIRE(scnp_socket_add_peer(&a, (struct sockaddr *) &to_b, sizeof(to_b), handle_b) == 0);
+  REQUIRE(scnp_socket_add_peer(&c, (struct sockaddr *) &to_a, sizeof(to_a), handle_a) == 0);
+  REQUIRE(scnp_socket_sendto(&c, buf, MOV_LENGTH, 0, handle_a) == MOV_LENGTH);
+  REQUIRE(scnp_socket_recvfrom(&a, buf, sizeof(buf), 0, handle_c) == MOV_LENGTH);
+
+  /* the sources of a flood only take the free places */
+  std::vector<int> fds;
+  for (int i = 0; i < 2 * SCNP_SOCKET_MAX_PEERS; ++i) send_from_new_port(fds, a.port, (uint8_t) i);
+  CHECK(drain_udp(&a) == SCNP_SOCKET_MAX_PEERS - 2);
+  CHECK(a.npeers == SCNP_SOCKET_MAX_PEERS);
+
+  /* the known peers still get through */
+  REQUIRE(scnp_socket_add_peer(&b, (struct sockaddr *) &to_a, sizeof(to_a), handle_a) == 0);
+  buf[1] = 42;
+  REQUIRE(scnp_socket_sendto(&b, buf, MOV_LENGTH, 0, handle_a) == MOV_LENGTH);
+  REQUIRE(scnp_socket_recvfrom(&a, buf, sizeof(buf), 0, src) == MOV_LENGTH);
+  CHECK(buf[1] == 42);
+  CHECK(memcmp(src, handle_b, ETHER_ADDR_LEN) == 0);
+  REQUIRE(scnp_socket_sendto(&c, buf, MOV_LENGTH, 0, handle_a) == MOV_LENGTH);
+  REQUIRE(scnp_socket_recvfrom(&a, buf, sizeof(buf), 0, src) == MOV_LENGTH);
+  CHECK(memcmp(src, handle_c, ETHER_ADDR_LEN) == 0);
+
+  /* a new source waits for a place to be quiet */
+  send_from_new_port(fds, a.port, 0);
+  CHECK(drain_udp(&a) == 0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(SCNP_SOCKET_PEER_IDLE_MS + 50));
+  REQUIRE(scnp_socket_sendto(&c, buf, MOV_LENGTH, 0, handle_a) == MOV_LENGTH);
+  REQUIRE(scnp_socket_recvfrom(&a, buf, sizeof(buf), 0, src) == MOV_LENGTH);
+  send_from_new_port(fds, a.port, 0);
+  CHECK(drain_udp(&a) == 1);
+
+  /* the active and the given peers keep their places */
+  REQUIRE(scnp_socket_sendto(&b, buf, MOV_LENGTH, 0, handle_a) == MOV_LENGTH);
+  REQUIRE(scnp_socket_recvfrom(&a, buf, sizeof(buf), 0, src) == MOV_LENGTH);
+  CHECK(memcmp(src, handle_b, ETHER_ADDR_LEN) == 0);
+  REQUIRE(scnp_socket_sendto(&c, buf, MOV_LENGTH, 0, handle_a) == MOV_LENGTH);
+  REQUIRE(scnp_socket_recvfrom(&a, buf, sizeof(buf), 0, src) == MOV_LENGTH);
+  CHECK(memcmp(src, handle_c, ETHER_ADDR_LEN) == 0);
+
+  /* a given peer takes a place at once */
+  struct sockaddr_in other = loopback4(1);
+  uint8_t handle_other[ETHER_ADDR_LEN];
+  CHECK(scnp_socket_add_peer(&a, (struct sockaddr *) &other, sizeof(other), handle_other) == 0);
+
+  for (int fd : fds) close(fd);
+  scnp_socket_close(&c);
+  scnp_socket_close(&b);
+  scnp_socket_close(&a);
+}
+
+TEST_CASE("scnp_udp_session") {
+  struct scnp_options udp0{}, udp1{};
+  udp0.socket_mode = SCNP_SOCKET_UDP;
+  udp0.udp_port = 48888;
+  udp1.socket_mode = SCNP_SOCKET_UDP;
+  udp1.udp_port = 48889;
+  udp1.engine = SCNP_ENGINE_EPOLL;
+
+  /* one session per port, beside the ethernet session of the interface */
+  scnp_session_t * end0 = scnp_session_open(0, nullptr, &udp0);
+  REQUIRE(end0 != nullptr);
+  scnp_session_t * end1 = scnp_session_open(LOOP_INDEX, nullptr, &udp1);
+  REQUIRE(end1 != nullptr);
+  REQUIRE(scnp_session_open(LOOP_INDEX, nullptr, &udp0) == nullptr);
+  REQUIRE(errno == EALREADY);
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+  uint8_t handle[ETHER_ADDR_LEN];
+  struct sockaddr_in to1 = loopback4(48889);
+  REQUIRE(scnp_add_peer((struct sockaddr *) &to1, sizeof(to1), handle) == -1);
+  REQUIRE(errno == EOPNOTSUPP);
+  scnp_stop();
+
+  /* the keys are acknowledged over IPv4 and IPv6 */
+  uint8_t handle1[ETHER_ADDR_LEN], handle0[ETHER_ADDR_LEN];
+  struct sockaddr_in6 to0 = loopback6(48888);
+  REQUIRE(scnp_session_add_peer(end0, (struct sockaddr *) &to1, sizeof(to1), handle1) == 0);
+  REQUIRE(scnp_session_add_peer(end1, (struct sockaddr *) &to0, sizeof(to0), handle0) == 0);
+  exchange_key(end0, end1, handle1);
+  exchange_key(end1, end0, handle0);
+
+  struct scnp_rtt rtt{};
+  REQUIRE(scnp_session_get_rtt(end0, handle1, &rtt) == 0);
+  REQUIRE(scnp_session_get_rtt(end1, handle0, &rtt) == 0);
+
+  scnp_session_close(end1);
+  scnp_session_close(end0);
+}
+
+/* types of the next frames a UDP socket receives, the management packets excepted */
+static std::vector<uint8_t> frame_types(int fd, size_t count)
+{
+  std::vector<uint8_t> types;
+  uint8_t buf[MAX_PACKET_LENGTH];
+  while (types.size() < count) {
+    ssize_t len = recv(fd, buf, sizeof(buf), 0);
+    REQUIRE(len > 0);
+    if (buf[0] == SCNP_MNG) CHECK(buf[MNG_LENGTH - 1] == MNG_COMPACT);
+    else                    types.push_back(buf[0]);
+  }
+  return types;
+}
+
+TEST_CASE("scnp_legacy_peer") {
+  struct scnp_options udp{};
+  udp.socket_mode = SCNP_SOCKET_UDP;
+  udp.udp_port = 48889;
+  scnp_session_t * end = scnp_session_open(0, nullptr, &udp);
+  REQUIRE(end != nullptr);
+
+  /* a UDP socket plays the peer */
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  REQUIRE(fd != -1);
+  struct sockaddr_in peer = loopback4(48890), to = loopback4(48889);
+  REQUIRE(bind(fd, (struct sockaddr *) &peer, sizeof(peer)) == 0);
+  struct timeval timeout = { 2, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  uint8_t handle[ETHER_ADDR_LEN];
+  REQUIRE(scnp_session_add_peer(end, (struct sockaddr *) &peer, sizeof(peer), handle) == 0);
+
+  /* the management packet of the peer tells whether it decodes SCNP_MOT and SCNP_BATCH */
+  auto advertise = [&](size_t len, uint8_t features) {
+    uint8_t mng[MNG_LENGTH] = { SCNP_MNG, 'o', 'l', 'd' };
+    mng[MNG_LENGTH - 1] = features;
+    REQUIRE(sendto(fd, mng, len, 0, (struct sockaddr *) &to, sizeof(to)) == (ssize_t) len);
+    struct scnp_packet packet{};
+    uint8_t src[ETHER_ADDR_LEN];
+    do {
+      REQUIRE(scnp_session_recv(end, &packet, src) == 0);
+    } while (packet.type != SCNP_MNG);
+  };
+  auto move = [&]() {
+    struct scnp_movement x = { SCNP_MOV, MOV_REL, MOV_CODE_X, 3 }, y = { SCNP_MOV, MOV_REL, MOV_CODE_Y, 4 };
+    struct scnp_movement abs = { SCNP_MOV, MOV_ABS, MOV_CODE_X, 5 };
+    REQUIRE(scnp_session_send(end, (struct scnp_packet *) &x, handle) == 0);
+    REQUIRE(scnp_session_send(end, (struct scnp_packet *) &y, handle) == 0);
+    REQUIRE(scnp_session_send(end, (struct scnp_packet *) &abs, handle) == 0);
+  };
+  const std::vector<uint8_t> legacy = { SCNP_MOV, SCNP_MOV, SCNP_MOV };
+
+  /* a peer never heard of, or without features, gets a packet per frame and per axis */
+  move();
+  CHECK(frame_types(fd, 3) == legacy);
+  advertise(MNG_LENGTH, MNG_COMPACT);
+  move();
+  std::vector<uint8_t> compact = frame_types(fd, 1);
+  CHECK((compact[0] == SCNP_MOT || compact[0] == SCNP_BATCH));
+  if (compact[0] == SCNP_MOT) frame_types(fd, 1);
+  advertise(MNG_BASE_LENGTH, 0);
+  move();
+  CHECK(frame_types(fd, 3) == legacy);
+
+  close(fd);
+  scnp_session_close(end);
+}
+
+TEST_CASE("scnp_restart_sender") {
+  struct scnp_options udp0{}, udp1{};
+  udp0.socket_mode = SCNP_SOCKET_UDP;
+  udp0.udp_port = 48888;
+  udp1.socket_mode = SCNP_SOCKET_UDP;
+  udp1.udp_port = 48889;
+
+  scnp_session_t * end1 = scnp_session_open(LOOP_INDEX, nullptr, &udp1);
+  REQUIRE(end1 != nullptr);
+  struct sockaddr_in to1 = loopback4(48889);
+
+  /* the identifiers of each new session start anywhere, behind the previous ones about half the time */
+  for (int restart = 0; restart < 8; ++restart) {
+    scnp_session_t * end0 = scnp_session_open(0, nullptr, &udp0);
+    REQUIRE(end0 != nullptr);
+    uint8_t handle1[ETHER_ADDR_LEN];
+    REQUIRE(scnp_session_add_peer(end0, (struct sockaddr *) &to1, sizeof(to1), handle1) == 0);
+
+    for (int i = 0; i < 3; ++i) {
+      struct scnp_key key = { SCNP_KEY, 0, (uint16_t) (restart * 3 + i), true, false };
+      REQUIRE(scnp_session_send(end0, (struct scnp_packet *) &key, handle1) == 0);
+
+      /* every key of the new session is given, not dropped as a replay of the previous one */
+      struct scnp_packet packet{};
+      uint8_t src[ETHER_ADDR_LEN];
+      bool received = false;
+      for (int ms = 0; ms < 1000 && !received; ++ms) {
+        if (scnp_session_try_recv(end1, &packet, src) == 0) {
+          received = packet.type == SCNP_KEY && reinterpret_cast<scnp_key *>(&packet)->code == key.code;
+        }
+        else {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+      }
+      REQUIRE(received);
+    }
+
+    scnp_session_close(end0);
+  }
+
+  scnp_session_close(end1);
+}
+
+TEST_CASE("scnp_udp_refused_peer") {
+  for (int engine : { SCNP_ENGINE_THREADS, SCNP_ENGINE_EPOLL }) {
+    struct scnp_options udp0{}, udp1{};
+    udp0.socket_mode = SCNP_SOCKET_UDP;
+    udp0.udp_port = 48888;
+    udp0.engine = engine;
+    udp1.socket_mode = SCNP_SOCKET_UDP;
+    udp1.udp_port = 48889;
+
+    scnp_session_t * end0 = scnp_session_open(0, nullptr, &udp0);
+    REQUIRE(end0 != nullptr);
+    scnp_session_t * end1 = scnp_session_open(LOOP_INDEX, nullptr, &udp1);
+    REQUIRE(end1 != nullptr);
+
+    /* the system refuses the datagrams to the broadcast address, the socket cannot broadcast */
+    struct sockaddr_in refused = loopback4(48890);
+    refused.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+    struct sockaddr_in to1 = loopback4(48889);
+    uint8_t bad[ETHER_ADDR_LEN], handle1[ETHER_ADDR_LEN];
+    REQUIRE(scnp_session_add_peer(end0, (struct sockaddr *) &refused, sizeof(refused), bad) == 0);
+    REQUIRE(scnp_session_add_peer(end0, (struct sockaddr *) &to1, sizeof(to1), handle1) == 0);
+
+    /* the session keeps sending to the other peer */
+    struct scnp_key key = { SCNP_KEY, 0, 0x1234, true, false };
+    REQUIRE(scnp_session_send(end0, (struct scnp_packet *) &key, bad) == 0);
+    exchange_key(end0, end1, handle1);
+
+    struct scnp_stats stats{};
+    scnp_session_get_stats(end0, &stats);
+    CHECK(stats.send_errors > 0);
+    exchange_key(end0, end1, handle1);
+
+    scnp_session_close(end1);
+    scnp_session_close(end0);
+  }
+}
+
+TEST_CASE("scnp_key_copies") {
+  struct scnp_options options{};
+  options.key_copies = SCNP_MAX_KEY_COPIES + 1;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == -1);
+  REQUIRE(errno == EINVAL);
+  options.key_copies = 3;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == 0);
+
+  /* the sent keys are counted once, when they are received */
+  struct scnp_socket sock{};
+  REQUIRE(scnp_socket_open(&sock, LOOP_INDEX) == 0);
+  struct scnp_filter filter{};
+  filter.ntypes = 1;
+  filter.types[0] = SCNP_KEY;
+  filter.lengths[0] = KEY_LENGTH;
+  REQUIRE(scnp_socket_set_filter(&sock, &filter) == 0);
+
+  /* each key is sent in three frames and given once */
+  uint8_t loopaddr[] = { 0, 0, 0, 0, 0, 0 };
+  struct scnp_key first = { SCNP_KEY, 0, 0x1234, true, false };
+  struct scnp_key second = { SCNP_KEY, 0, 0x5678, true, false };
+  struct scnp_packet packet{};
+  uint8_t src[ETHER_ADDR_LEN];
+  std::vector<uint16_t> codes;
+  for (auto * key : { &first, &second }) {
+    REQUIRE(scnp_send((struct scnp_packet *) key, loopaddr) == 0);
+    do {
+      REQUIRE(scnp_recv(&packet, src) == 0);
+    } while (packet.type != SCNP_KEY);
+    codes.push_back(reinterpret_cast<scnp_key *>(&packet)->code);
+  }
+  REQUIRE(second.id == first.id + 1);
+  CHECK(codes[0] == 0x1234);
+  CHECK(codes[1] == 0x5678);
+
+  /* the keys are not kept until their acknowledgement */
+  REQUIRE(scnp_send_status(loopaddr, first.id) == -1);
+  REQUIRE(errno == ENOENT);
+  struct scnp_stats stats{};
+  for (int i = 0; i < 1000 && stats.duplicates_dropped < 4; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    scnp_get_stats(&stats);
+  }
+  CHECK(stats.copies_sent == 4);
+  CHECK(stats.duplicates_dropped == 4);
+
+  uint8_t buf[MAX_PACKET_LENGTH];
+  int frames = 0;
+  while (scnp_socket_recvfrom(&sock, buf, sizeof(buf), MSG_DONTWAIT, src) > 0) ++frames;
+  CHECK(frames == 6);
+
+  scnp_socket_close(&sock);
+  scnp_stop();
+}
+
+/* forward the datagrams between two UDP ports, each one is dropped with a probability */
+static void lossy_relay(int fd, uint16_t port_a, uint16_t port_b, double loss, const std::atomic_bool * stop)
+{
+  std::mt19937 random(42);
+  std::bernoulli_distribution drop(loss);
+  uint8_t buf[MAX_PACKET_LENGTH];
+
+  while (!*stop) {
+    struct sockaddr_in from{};
+    socklen_t fromlen = sizeof(from);
+    ssize_t len = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *) &from, &fromlen);
+    if (len <= 0 || drop(random)) continue;
+
+    struct sockaddr_in to = loopback4(ntohs(from.sin_port) == port_a ? port_b : port_a);
+    sendto(fd, buf, (size_t) len, 0, (struct sockaddr *) &to, sizeof(to));
+  }
+}
+
+struct delivery
+{
+  int    delivered;
+  int    duplicates;
+  double mean_ms;
+  double max_ms;
+  uint64_t frames;
+};
+
+/* send count keys through a lossy relay and measure when they are received */
+static delivery lossy_delivery(int key_copies, double loss, int count)
+{
+  const uint16_t port_from = 48890, port_to = 48891, port_relay = 48892;
+  using clock = std::chrono::steady_clock;
+  std::vector<clock::time_point> sent(count), received(count);
+  std::vector<int> receptions(count, 0);
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  REQUIRE(fd != -1);
+  struct sockaddr_in relay_addr = loopback4(port_relay);
+  REQUIRE(bind(fd, (struct sockaddr *) &relay_addr, sizeof(relay_addr)) == 0);
+  struct timeval timeout = { 0, 10000 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  struct scnp_options from_opt{}, to_opt{};
+  from_opt.socket_mode = to_opt.socket_mode = SCNP_SOCKET_UDP;
+  from_opt.udp_port = port_from;
+  to_opt.udp_port = port_to;
+  from_opt.key_copies = key_copies;
+  scnp_session_t * from = scnp_session_open(0, nullptr, &from_opt);
+  scnp_session_t * to = scnp_session_open(0, nullptr, &to_opt);
+  REQUIRE(from != nullptr);
+  REQUIRE(to != nullptr);
+  uint8_t handle[ETHER_ADDR_LEN];
+  REQUIRE(scnp_session_add_peer(from, (struct sockaddr *) &relay_addr, sizeof(relay_addr), handle) == 0);
+
+  std::atomic_bool stop{false};
+  std::thread relay(lossy_relay, fd, port_from, port_to, loss, &stop);
+  std::thread receiver([&]() {
+    struct pollfd pfd = { scnp_session_poll_fd(to), POLLIN, 0 };
+    struct scnp_packet packet{};
+    uint8_t src[ETHER_ADDR_LEN];
+    while (!stop) {
+      if (poll(&pfd, 1, 10) <= 0) continue;
+      if (scnp_session_recv(to, &packet, src) || packet.type != SCNP_KEY) continue;
+      uint16_t code = reinterpret_cast<scnp_key *>(&packet)->code;
+      if (code < count && receptions[code]++ == 0) received[code] = clock::now();
+    }
+  });
+
+  for (int i = 0; i < count; ++i) {
+    struct scnp_key key = { SCNP_KEY, 0, (uint16_t) i, true, false };
+    sent[i] = clock::now();
+    REQUIRE(scnp_session_send(from, (struct scnp_packet *) &key, handle) == 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  stop = true;
+  receiver.join();
+  relay.join();
+
+  delivery result{};
+  for (int i = 0; i < count; ++i) {
+    if (receptions[i] == 0) continue;
+    double ms = std::chrono::duration<double, std::milli>(received[i] - sent[i]).count();
+    ++result.delivered;
+    result.duplicates += receptions[i] - 1;
+    result.mean_ms += ms;
+    if (ms > result.max_ms) result.max_ms = ms;
+  }
+  if (result.delivered > 0) result.mean_ms /= result.delivered;
+  struct scnp_stats stats{};
+  scnp_session_get_stats(from, &stats);
+  result.frames = stats.packets_sent;
+
+  scnp_session_close(to);
+  scnp_session_close(from);
+  close(fd);
+  return result;
+}
+
+TEST_CASE("scnp_key_copies_loss", "[.][benchmark]") {
+  const int count = 200;
+  const double loss = 0.2;
+  delivery ack = lossy_delivery(0, loss, count);
+  delivery copies = lossy_delivery(3, loss, count);
+
+  std::cout << "keys delivered with " << loss * 100 << "% of datagrams lost each way:" << std::endl;
+  for (auto & d : { std::make_pair("acknowledged", ack), std::make_pair("3 copies", copies) }) {
+    std::cout << "  " << d.first << " " << d.second.delivered << "/" << count
+              << ", mean " << d.second.mean_ms << " ms, max " << d.second.max_ms
+              << " ms, " << d.second.frames << " packets sent" << std::endl;
+  }
+
+  /* a key is given once, and the copies save the retransmission timeouts */
+  CHECK(ack.duplicates == 0);
+  CHECK(copies.duplicates == 0);
+  CHECK(ack.delivered >= count * 9 / 10);
+  CHECK(copies.delivered >= count * 9 / 10);
+  CHECK(copies.mean_ms < ack.mean_ms);
+}
+
+TEST_CASE("scnp_tuning") {
+  struct scnp_tuning tuning{}, effective{};
+  REQUIRE(scnp_tuning_profile(42, &tuning) == -1);
+  REQUIRE(errno == EINVAL);
+  REQUIRE(scnp_tuning_profile(SCNP_TUNING_LOW_LATENCY, &tuning) == 0);
+
+  /* the buffers are doubled by the system */
+  struct scnp_socket sock{};
+  REQUIRE(scnp_socket_open(&sock, LOOP_INDEX) == 0);
+  REQUIRE(scnp_socket_tune(&sock, &tuning, &effective) == 0);
+  CHECK(effective.busy_poll_us == tuning.busy_poll_us);
+  CHECK(effective.priority == tuning.priority);
+  CHECK(effective.rcvbuf >= tuning.rcvbuf);
+  CHECK(effective.sndbuf >= tuning.sndbuf);
+  CHECK(effective.qdisc_bypass);
+  scnp_socket_close(&sock);
+
+  /* the queueing discipline cannot be skipped by a UDP socket */
+  REQUIRE(scnp_socket_open_udp(&sock, 0, 0) == 0);
+  REQUIRE(scnp_socket_tune(&sock, &tuning, &effective) == -1);
+  CHECK(errno == EOPNOTSUPP);
+  CHECK(effective.priority == tuning.priority);
+  CHECK_FALSE(effective.qdisc_bypass);
+  scnp_socket_close(&sock);
+
+  /* a session reports the options in effect */
+  REQUIRE(scnp_get_tuning(&effective) == -1);
+  REQUIRE(errno == ESRCH);
+  struct scnp_options options{};
+  options.tuning = tuning;
+  REQUIRE(scnp_start_opt(LOOP_INDEX, nullptr, &options) == 0);
+  REQUIRE(scnp_get_tuning(&effective) == 0);
+  CHECK(effective.priority == tuning.priority);
+  CHECK(effective.qdisc_bypass);
+  scnp_stop();
+
+  REQUIRE(scnp_start(LOOP_INDEX, nullptr) == 0);
+  REQUIRE(scnp_get_tuning(&effective) == 0);
+  CHECK_FALSE(effective.qdisc_bypass);
+  scnp_stop();
+}
+
 TEST_CASE("crypto") {
   REQUIRE(scnp_start(LOOP_INDEX, "test") == 0);
 
@@ -10,7 +10,7 @@
 
 enum { LISTALL, LISTCURRENT, LISTREFRESH, ADD, ADD2, REMOVE, SETIF, LISTIF, VERSION, HELP,
        START, STOP, PAUSE, GETIF, SET_SHORTCUT, LISTALL_SHORTCUT, LIST_SHORTCUT, RESET_SHORTCUT,
-       SWAP, OPTION, KEY};
+       SWAP, OPTION, KEY, TUNING};
 
 using namespace rscui;
 
@@ -57,6 +57,11 @@ int ControllerOperation::getif()
   return GETIF;
 }
 
+int ControllerOperation::gettuning()
+{
+  return TUNING;
+}
+
 int ControllerOperation::listif()
 {
   return LISTIF;
@@ -331,6 +336,8 @@ TEST_CASE("parser") {
      std::make_tuple("if -l", 0, LISTIF),
      std::make_tuple("if -s 1", 0, SETIF),
      std::make_tuple("if -g", 0, GETIF),
+     std::make_tuple("if -t", 0, TUNING),
+     std::make_tuple("if -t 1", 1, 0),
      std::make_tuple("if -l 1", 1, 0),
      std::make_tuple("if -g 1", 1, 0),
      std::make_tuple("if", 0, 1),